@@ -41,6 +41,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/rendezvous_mgr.h"
 #include "tensorflow/core/common_runtime/scoped_allocator_mgr.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
+#include "tensorflow/core/common_runtime/work_stealing_thread_pool.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/graph.pb.h"
 #include "tensorflow/core/framework/graph_def_util.h"
@@ -302,6 +303,18 @@ static RunHandlerPool* GetOrCreateRunHandlerPool(
   return pool;
 }
 
+static thread::ThreadPool* GetOrCreateWorkStealingThreadPool(
+    const SessionOptions& options) {
+  static thread::ThreadPool* pool = [&]() {
+    const int32_t num_threads = NumInterOpThreadsFromSessionOptions(options);
+    LOG(INFO) << "Creating work-stealing inter-op pool with " << num_threads
+              << " threads";
+    return new thread::ThreadPool(new WorkStealingThreadPool(
+        options.env, ThreadOptions(), "work_stealing_inter_op", num_threads));
+  }();
+  return pool;
+}
+
 bool DirectSession::ShouldUseRunHandlerPool(
     const RunOptions& run_options) const {
   if (options_.config.use_per_session_threads()) return false;
@@ -359,11 +372,16 @@ DirectSession::DirectSession(const SessionOptions& options,
   }
   // The default value of sync_on_finish will be flipped soon and this
   // environment variable will be removed as well.
-  const Status status =
+  Status status =
       ReadBoolFromEnvVar("TF_SYNC_ON_FINISH", true, &sync_on_finish_);
   if (!status.ok()) {
     LOG(ERROR) << status.message();
   }
+  status = ReadBoolFromEnvVar("TF_EXECUTOR_USE_STATIC_ARENA_PLAN", false,
+                              &use_static_arena_plan_);
+  if (!status.ok()) {
+    LOG(ERROR) << status.message();
+  }
   session_handle_ =
       strings::StrCat("direct", strings::FpToString(random::New64()));
   if (options.config.log_device_placement()) {
@@ -609,17 +627,40 @@ Status DirectSession::RunInternal(
     pool = thread_pools_[run_options.inter_op_thread_pool()].first;
   }
 
-  const int64_t call_timeout = run_options.timeout_in_ms() > 0
-                                   ? run_options.timeout_in_ms()
-                                   : operation_timeout_in_ms_;
+  const bool use_work_stealing =
+      options_.config.experimental().use_work_stealing_inter_op_scheduler() ||
+      run_options.experimental().use_work_stealing_inter_op_scheduler();
+  // Like the RunHandlerPool, the work-stealing pool is shared across
+  // sessions, so it does not replace thread pools chosen by the caller.
+  if (use_work_stealing && !inline_execution_requested &&
+      threadpool_options.inter_op_threadpool == nullptr &&
+      !options_.config.use_per_session_threads() &&
+      options_.config.session_inter_op_thread_pool_size() == 0) {
+    VLOG(1) << "Using work stealing to schedule inter-op closures.";
+    pool = GetOrCreateWorkStealingThreadPool(options_);
+  }
+
+  const bool use_run_handler_pool =
+      ShouldUseRunHandlerPool(run_options) &&
+      run_options.experimental().use_run_handler_pool();
+  int64_t call_timeout = run_options.timeout_in_ms() > 0
+                             ? run_options.timeout_in_ms()
+                             : operation_timeout_in_ms_;
+  const int64_t latency_budget_ms =
+      run_options.experimental().run_handler_pool_options().latency_budget_ms();
+  if (use_run_handler_pool && latency_budget_ms > 0 &&
+      (call_timeout <= 0 || latency_budget_ms < call_timeout)) {
+    // A request that missed its deadline is cancelled rather than competing
+    // with the requests that can still meet theirs.
+    call_timeout = latency_budget_ms;
+  }
   absl::optional<absl::Time> deadline;
   if (call_timeout > 0) {
     deadline = absl::Now() + absl::Milliseconds(call_timeout);
   }
 
   std::unique_ptr<RunHandler> handler;
-  if (ShouldUseRunHandlerPool(run_options) &&
-      run_options.experimental().use_run_handler_pool()) {
+  if (use_run_handler_pool) {
     VLOG(1) << "Using RunHandler to scheduler inter-op closures.";
     handler = GetOrCreateRunHandlerPool(options_)->Get(
         step_id, call_timeout,
@@ -636,6 +677,10 @@ Status DirectSession::RunInternal(
 
   if (pool == nullptr) {
     default_runner = [](const Executor::Args::Closure& c) { c(); };
+  } else if (handler_ptr != nullptr && use_work_stealing) {
+    default_runner = [handler_ptr](Executor::Args::Closure c) {
+      handler_ptr->ScheduleLocalInterOpClosure(std::move(c));
+    };
   } else if (handler_ptr != nullptr) {
     default_runner = [handler_ptr](Executor::Args::Closure c) {
       handler_ptr->ScheduleInterOpClosure(std::move(c));
@@ -1398,6 +1443,7 @@ Status DirectSession::CreateExecutors(
     params.device = device;
     params.session_metadata = session_metadata;
     params.function_library = lib;
+    params.use_static_arena_plan = use_static_arena_plan_;
     auto opseg = device->op_segment();
     params.create_kernel =
         [this, lib, opseg](const std::shared_ptr<const NodeProperties>& props,
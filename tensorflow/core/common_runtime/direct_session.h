@@ -353,6 +353,10 @@ class DirectSession : public Session {
   // If true, blocks until device has finished all queued operations in a step.
   bool sync_on_finish_ = true;
 
+  // If true, the executors serve the allocations of a step from an arena
+  // laid out by a static plan, recorded after a warm-up step.
+  bool use_static_arena_plan_ = false;
+
   std::vector<std::unique_ptr<FunctionInfo>> functions_
       TF_GUARDED_BY(executor_lock_);
 
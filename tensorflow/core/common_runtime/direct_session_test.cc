@@ -18,6 +18,7 @@ limitations under the License.
 #include <map>
 #include <memory>
 #include <random>
+#include <set>
 #include <string>
 #include <thread>  // NOLINT
 #include <unordered_map>
@@ -47,6 +48,7 @@ limitations under the License.
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/strings/str_util.h"
+#include "tensorflow/core/platform/blocking_counter.h"
 #include "tensorflow/core/platform/protobuf.h"
 #include "tensorflow/core/platform/stacktrace.h"
 #include "tensorflow/core/platform/test.h"
@@ -799,6 +801,42 @@ TEST_F(DirectSessionMinusAXTest, UseRunHandlerPool) {
   EXPECT_FLOAT_EQ(5.0, mat(0, 0));
 }
 
+TEST_F(DirectSessionMinusAXTest, UseWorkStealingScheduler) {
+  Initialize({3, 2, -1, 0});
+  auto session = CreateSession();
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def_));
+
+  RunOptions run_options;
+  run_options.mutable_experimental()->set_use_work_stealing_inter_op_scheduler(
+      true);
+  // Also covers the local queues of the RunHandler threads.
+  for (bool use_run_handler_pool : {false, true}) {
+    run_options.mutable_experimental()->set_use_run_handler_pool(
+        use_run_handler_pool);
+    std::vector<Tensor> outputs;
+    TF_ASSERT_OK(session->Run(run_options, {}, {y_ + ":0"}, {y_neg_},
+                              &outputs, nullptr));
+    ASSERT_EQ(1, outputs.size());
+    EXPECT_FLOAT_EQ(5.0, outputs[0].matrix<float>()(0, 0));
+  }
+}
+
+TEST_F(DirectSessionMinusAXTest, UseWorkStealingSchedulerForSession) {
+  Initialize({3, 2, -1, 0});
+  SessionOptions options = DefaultSessionOptions();
+  options.config.mutable_experimental()
+      ->set_use_work_stealing_inter_op_scheduler(true);
+  std::unique_ptr<Session> session(NewSession(options));
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def_));
+
+  std::vector<Tensor> outputs;
+  TF_ASSERT_OK(session->Run({}, {y_ + ":0"}, {y_neg_}, &outputs));
+  ASSERT_EQ(1, outputs.size());
+  EXPECT_FLOAT_EQ(5.0, outputs[0].matrix<float>()(0, 0));
+}
+
 TEST(DirectSessionTest, KeepsStateAcrossRunsOfSession) {
   GraphDef def;
   Graph g(OpRegistry::Global());
@@ -838,6 +876,54 @@ TEST(DirectSessionTest, KeepsStateAcrossRunsOfSession) {
   EXPECT_EQ(20.0, outputs[0].flat<float>()(0));
 }
 
+TEST(DirectSessionTest, NumaAffinityPlacesEachGraphOnOneDevice) {
+  Graph g(OpRegistry::Global());
+  Node* x;
+  TF_ASSERT_OK(NodeBuilder("x", "Placeholder")
+                   .Attr("shape", TensorShape({2}))
+                   .Attr("dtype", DT_FLOAT)
+                   .Finalize(&g, &x));
+  Node* y = test::graph::Unary(&g, "Square", x);
+  Node* z = test::graph::Unary(&g, "Neg", y);
+  GraphDef def;
+  g.ToGraphDef(&def);
+
+  SessionOptions options;
+  options.config.mutable_experimental()->set_use_numa_affinity(true);
+  // The unconstrained nodes are only co-located when all devices are CPUs.
+  (*options.config.mutable_device_count())["CPU"] = 2;
+  (*options.config.mutable_device_count())["GPU"] = 0;
+  RunOptions run_options;
+  run_options.set_output_partition_graphs(true);
+  std::set<string> devices;
+  for (int i = 0; i < 2; ++i) {
+    std::unique_ptr<Session> session(NewSession(options));
+    ASSERT_TRUE(session != nullptr);
+    TF_ASSERT_OK(session->Create(def));
+    std::vector<Tensor> outputs;
+    RunMetadata run_metadata;
+    TF_ASSERT_OK(session->Run(run_options,
+                              {{x->name(), test::AsTensor<float>({1, 2})}},
+                              {z->name() + ":0"}, {}, &outputs, &run_metadata));
+    ASSERT_EQ(1, outputs.size());
+    test::ExpectTensorEqual<float>(outputs[0], test::AsTensor<float>({-1, -4}));
+
+    string y_device;
+    string z_device;
+    for (const GraphDef& partition_graph : run_metadata.partition_graphs()) {
+      for (const NodeDef& node : partition_graph.node()) {
+        if (node.name() == y->name()) y_device = node.device();
+        if (node.name() == z->name()) z_device = node.device();
+      }
+    }
+    EXPECT_FALSE(y_device.empty());
+    EXPECT_EQ(y_device, z_device);
+    devices.insert(y_device);
+  }
+  // Consecutive sessions are placed on different devices.
+  EXPECT_EQ(2, devices.size());
+}
+
 TEST(DirectSessionTest, MultipleFeedTest) {
   GraphDef def;
   Graph g(OpRegistry::Global());
@@ -2806,6 +2892,64 @@ BENCHMARK(BM_FeedFetchCallableSingleThreadExecutor)
     ->Arg(5)
     ->Arg(10);
 
+// Runs `num_sessions` sessions concurrently, each of which computes
+// elementwise ops over 64MB tensors, so that the steps are bound by memory
+// bandwidth. With NUMA affinity, each session allocates its tensors and runs
+// its kernels on the NUMA node of its CPU device.
+void BM_MemoryBandwidthBoundSessions(::testing::benchmark::State& state) {
+  const int num_sessions = state.range(0);
+  const bool use_numa_affinity = state.range(1);
+  constexpr int64_t kNumElements = 16 << 20;
+
+  Graph g(OpRegistry::Global());
+  Node* x = test::graph::RandomUniform(
+      &g, test::graph::Constant(&g, test::AsTensor<int32>({kNumElements})),
+      DT_FLOAT);
+  Node* y = test::graph::Binary(&g, "Mul", x, x);
+  Node* z = test::graph::Binary(&g, "Add", y, x);
+  Node* sum = test::graph::Reduce(&g, "Sum", z,
+                                  test::graph::Constant(&g, Tensor(0)));
+  GraphDef def;
+  g.ToGraphDef(&def);
+
+  SessionOptions opts;
+  opts.config.mutable_experimental()->set_use_numa_affinity(use_numa_affinity);
+  (*opts.config.mutable_device_count())["GPU"] = 0;
+  std::vector<std::unique_ptr<Session>> sessions;
+  for (int i = 0; i < num_sessions; ++i) {
+    sessions.emplace_back(NewSession(opts));
+    TF_CHECK_OK(sessions.back()->Create(def));
+    // Ignore the first run, which places and optimizes the graph.
+    std::vector<Tensor> outputs;
+    TF_CHECK_OK(sessions.back()->Run({}, {sum->name() + ":0"}, {}, &outputs));
+  }
+
+  thread::ThreadPool pool(Env::Default(), "sessions", num_sessions);
+  for (auto s : state) {
+    BlockingCounter counter(num_sessions);
+    for (const std::unique_ptr<Session>& session : sessions) {
+      pool.Schedule([&session, &counter, sum]() {
+        std::vector<Tensor> outputs;
+        TF_CHECK_OK(session->Run({}, {sum->name() + ":0"}, {}, &outputs));
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+  }
+  // RandomUniform writes x, Mul reads x and writes y, Add reads x and y and
+  // writes z, and Sum reads z.
+  state.SetBytesProcessed(state.iterations() * num_sessions * kNumElements *
+                          sizeof(float) * 7);
+}
+
+BENCHMARK(BM_MemoryBandwidthBoundSessions)
+    ->ArgPair(1, false)
+    ->ArgPair(1, true)
+    ->ArgPair(4, false)
+    ->ArgPair(4, true)
+    ->ArgPair(16, false)
+    ->ArgPair(16, true);
+
 }  // namespace
 
 class DirectSessionCollectiveTest : public ::testing::Test {
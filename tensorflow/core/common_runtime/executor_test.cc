@@ -30,18 +30,22 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/lower_functional_ops.h"
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
+#include "tensorflow/core/common_runtime/work_stealing_thread_pool.h"
 #include "tensorflow/core/framework/attr_value.pb.h"
 #include "tensorflow/core/framework/local_rendezvous.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/rendezvous.h"
+#include "tensorflow/core/framework/run_handler.h"
 #include "tensorflow/core/framework/step_stats.pb.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/graph/testlib.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/strcat.h"
 #include "tensorflow/core/platform/test.h"
@@ -77,10 +81,12 @@ class ExecutorTest : public ::testing::Test {
   }
 
   // Resets executor_ with a new executor based on a graph 'gdef'.
-  void Create(std::unique_ptr<const Graph> graph) {
+  void Create(std::unique_ptr<const Graph> graph,
+              bool use_static_arena_plan = false) {
     const int version = graph->versions().producer();
     LocalExecutorParams params;
     params.device = device_.get();
+    params.use_static_arena_plan = use_static_arena_plan;
     params.create_kernel =
         [this, version](const std::shared_ptr<const NodeProperties>& props,
                         OpKernel** kernel) {
@@ -265,6 +271,33 @@ TEST_F(ExecutorTest, RandomTree) {
   EXPECT_EQ(4096.0, V(out));
 }
 
+TEST_F(ExecutorTest, StaticArenaPlan) {
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  BuildTree(1024, g.get());
+  Create(std::move(g), /*use_static_arena_plan=*/true);
+  // Runs the nodes inline, so that they run in the same order in every step.
+  runner_ = [](std::function<void()> fn) { fn(); };
+  monitoring::testing::CellReader<int64_t> allocations(
+      "/tensorflow/core/static_arena_plan_allocations");
+  // The first step warms up, the second one is recorded, and the later ones
+  // allocate from the arena of the plan.
+  for (int step = 0; step < 4; ++step) {
+    Rendezvous* rendez = NewLocalRendezvous();
+    Rendezvous::Args args;
+    TF_ASSERT_OK(rendez->Send(Key(ALICE, kIncarnation, BOB, "a"), args, V(1.0),
+                              false));
+    TF_ASSERT_OK(Run(rendez));
+    Tensor out = V(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(
+        rendez->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out, &is_dead));
+    EXPECT_EQ(1024.0, V(out));
+    rendez->Unref();
+  }
+  EXPECT_GT(allocations.Delta("arena"), 0);
+  EXPECT_EQ(allocations.Delta("fallback"), 0);
+}
+
 void BuildConcurrentAddAssign(Graph* g) {
   auto one = test::graph::Constant(g, V(1.0));
   // A variable holds one float.
@@ -543,6 +576,156 @@ static void BM_FeedInputFetchOutput(::testing::benchmark::State& state) {
 }
 BENCHMARK(BM_FeedInputFetchOutput);
 
+// Returns an executor of `g` on `device` for benchmarks.
+static std::unique_ptr<Executor> NewBenchmarkExecutor(
+    Device* device, const Graph& g, bool use_static_arena_plan = false) {
+  const int version = g.versions().producer();
+  LocalExecutorParams params;
+  params.device = device;
+  params.create_kernel =
+      [device, version](const std::shared_ptr<const NodeProperties>& props,
+                        OpKernel** kernel) {
+        return CreateNonCachedKernel(device, nullptr, props, version, kernel);
+      };
+  params.delete_kernel = [](OpKernel* kernel) {
+    DeleteNonCachedKernel(kernel);
+  };
+  params.use_static_arena_plan = use_static_arena_plan;
+  Executor* exec = nullptr;
+  TF_CHECK_OK(NewLocalExecutor(params, g, &exec));
+  return std::unique_ptr<Executor>(exec);
+}
+
+// Runs `depth` levels of elementwise ops whose intermediate tensors are
+// allocated from the device allocator, or from the arena of a static plan.
+static void BM_StaticArenaPlan(::testing::benchmark::State& state) {
+  const int depth = state.range(0);
+  const bool use_static_arena_plan = state.range(1);
+
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  Tensor one(DT_FLOAT, TensorShape({1024}));
+  one.flat<float>().setConstant(1.0f);
+  Node* c = test::graph::Constant(g.get(), one);
+  Node* v = c;
+  for (int i = 0; i < depth; ++i) {
+    // `v` has two consumers, so they cannot forward its buffer.
+    Node* sum = test::graph::Binary(g.get(), "Add", v, c);
+    Node* product = test::graph::Binary(g.get(), "Mul", v, c);
+    v = test::graph::Binary(g.get(), "Sub", sum, product);
+  }
+  FixupSourceAndSinkEdges(g.get());
+
+  std::unique_ptr<Device> device(DeviceFactory::NewDevice(
+      "CPU", {}, "/job:localhost/replica:0/task:0"));
+  std::unique_ptr<Executor> executor =
+      NewBenchmarkExecutor(device.get(), *g, use_static_arena_plan);
+
+  Executor::Args args;
+  args.runner = [](std::function<void()> fn) { fn(); };
+  for (auto s : state) {
+    TF_CHECK_OK(executor->Run(args));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * depth *
+                          3);
+}
+BENCHMARK(BM_StaticArenaPlan)
+    ->ArgPair(64, false)
+    ->ArgPair(64, true)
+    ->ArgPair(1024, false)
+    ->ArgPair(1024, true);
+
+enum class InterOpScheduler {
+  kThreadPool,
+  kWorkStealing,
+  kRunHandler,
+  kRunHandlerLocalQueues,
+};
+
+// Runs `width` independent chains of elementwise ops, with the inter-op
+// closures scheduled by the scheduler given as second argument.
+static void BM_WideGraphScheduler(::testing::benchmark::State& state) {
+  const int width = state.range(0);
+  const auto scheduler = static_cast<InterOpScheduler>(state.range(1));
+  constexpr int kDepth = 8;
+
+  auto g = std::make_unique<Graph>(OpRegistry::Global());
+  Tensor x(DT_FLOAT, TensorShape({4096}));
+  x.flat<float>().setConstant(0.5f);
+  Node* c = test::graph::Constant(g.get(), x);
+  for (int i = 0; i < width; ++i) {
+    Node* v = c;
+    for (int j = 0; j < kDepth; ++j) {
+      v = test::graph::Unary(g.get(), "Tanh", v);
+    }
+  }
+  FixupSourceAndSinkEdges(g.get());
+
+  std::unique_ptr<Device> device(DeviceFactory::NewDevice(
+      "CPU", {}, "/job:localhost/replica:0/task:0"));
+  std::unique_ptr<Executor> executor = NewBenchmarkExecutor(device.get(), *g);
+
+  const int num_threads = port::MaxParallelism();
+  std::unique_ptr<WorkStealingThreadPool> work_stealing_pool;
+  std::unique_ptr<thread::ThreadPool> pool;
+  std::unique_ptr<RunHandlerPool> run_handler_pool;
+  switch (scheduler) {
+    case InterOpScheduler::kThreadPool:
+      pool = std::make_unique<thread::ThreadPool>(Env::Default(), "inter_op",
+                                                  num_threads);
+      state.SetLabel("thread pool");
+      break;
+    case InterOpScheduler::kWorkStealing:
+      work_stealing_pool = std::make_unique<WorkStealingThreadPool>(
+          Env::Default(), ThreadOptions(), "inter_op", num_threads);
+      pool = std::make_unique<thread::ThreadPool>(work_stealing_pool.get());
+      state.SetLabel("work stealing");
+      break;
+    case InterOpScheduler::kRunHandler:
+    case InterOpScheduler::kRunHandlerLocalQueues:
+      run_handler_pool = std::make_unique<RunHandlerPool>(num_threads);
+      state.SetLabel(scheduler == InterOpScheduler::kRunHandler
+                         ? "run handler"
+                         : "run handler with local queues");
+      break;
+  }
+
+  for (auto s : state) {
+    Executor::Args args;
+    std::unique_ptr<RunHandler> handler;
+    if (run_handler_pool != nullptr) {
+      handler = run_handler_pool->Get();
+      RunHandler* h = handler.get();
+      if (scheduler == InterOpScheduler::kRunHandler) {
+        args.runner = [h](std::function<void()> fn) {
+          h->ScheduleInterOpClosure(std::move(fn));
+        };
+      } else {
+        args.runner = [h](std::function<void()> fn) {
+          h->ScheduleLocalInterOpClosure(std::move(fn));
+        };
+      }
+    } else {
+      args.runner = [p = pool.get()](std::function<void()> fn) {
+        p->Schedule(std::move(fn));
+      };
+    }
+    TF_CHECK_OK(executor->Run(args));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * width *
+                          kDepth);
+}
+BENCHMARK(BM_WideGraphScheduler)
+    ->UseRealTime()
+    ->ArgPair(64, static_cast<int>(InterOpScheduler::kThreadPool))
+    ->ArgPair(64, static_cast<int>(InterOpScheduler::kWorkStealing))
+    ->ArgPair(64, static_cast<int>(InterOpScheduler::kRunHandler))
+    ->ArgPair(64, static_cast<int>(InterOpScheduler::kRunHandlerLocalQueues))
+    ->ArgPair(1024, static_cast<int>(InterOpScheduler::kThreadPool))
+    ->ArgPair(1024, static_cast<int>(InterOpScheduler::kWorkStealing))
+    ->ArgPair(1024, static_cast<int>(InterOpScheduler::kRunHandler))
+    ->ArgPair(1024,
+              static_cast<int>(InterOpScheduler::kRunHandlerLocalQueues));
+
 Status ReplaceEdgeWithSendRecv(Graph* g, const Edge* edge, const string& tensor,
                                const string& sender,
                                const uint64 sender_incarnation,
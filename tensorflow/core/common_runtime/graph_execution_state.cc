@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/core/common_runtime/graph_execution_state.h"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 #include <set>
 #include <string>
@@ -39,6 +41,7 @@ limitations under the License.
 #include "tensorflow/core/framework/node_def.pb.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
 #include "tensorflow/core/graph/collective_order.h"
@@ -69,6 +72,39 @@ bool IsCollectiveV2(const string& op) {
          op == "CollectiveBcastRecvV2" || op == "CollectiveBcastSendV2" ||
          op == "ColectiveReduceScatterV2" || op == "ColectiveAllToAllV2";
 }
+
+// With NUMA affinity, there is a CPU device per NUMA node. Returns the device
+// on which the placer puts the nodes without a requested device, so that the
+// tensors of a graph are allocated and computed on a single node. Graphs are
+// spread over the devices in a round-robin fashion.
+//
+// Returns nullptr if NUMA affinity is disabled, or if the device set has other
+// than local CPU devices, which the placer should keep preferring.
+const Device* NumaHomeDevice(const SessionOptions* session_options,
+                             const DeviceSet* device_set) {
+  if (session_options == nullptr ||
+      !session_options->config.experimental().use_numa_affinity() ||
+      device_set->client_device() == nullptr) {
+    return nullptr;
+  }
+  const DeviceNameUtils::ParsedName& client_name =
+      device_set->client_device()->parsed_name();
+  for (const Device* device : device_set->devices()) {
+    if (device->device_type() != DEVICE_CPU ||
+        !DeviceNameUtils::IsSameAddressSpace(device->parsed_name(),
+                                             client_name)) {
+      return nullptr;
+    }
+  }
+  if (device_set->devices().size() < 2) {
+    return nullptr;
+  }
+  static std::atomic<uint64_t>* next_home_device =
+      new std::atomic<uint64_t>(0);
+  const uint64_t index =
+      next_home_device->fetch_add(1, std::memory_order_relaxed);
+  return device_set->devices()[index % device_set->devices().size()];
+}
 }  // namespace
 
 GraphExecutionState::GraphExecutionState(
@@ -628,8 +664,13 @@ absl::Status GraphExecutionState::InitBaseGraph(
       OptimizationPassRegistry::PRE_PLACEMENT, optimization_options));
 
   if (run_placer_) {
+    const Device* home_device = NumaHomeDevice(session_options_, device_set_);
+    if (home_device != nullptr) {
+      VLOG(1) << "Placing the nodes of session " << session_handle_
+              << " without a requested device on " << home_device->name();
+    }
     Placer placer(new_graph.get(), "", flib_def_.get(), device_set_,
-                  /* default_local_device= */ nullptr,
+                  /* default_local_device= */ home_device,
                   session_options_ == nullptr ||
                       session_options_->config.allow_soft_placement(),
                   session_options_ != nullptr &&
@@ -50,6 +50,12 @@ struct LocalExecutorParams {
 
   // Whether control flow nodes are allowed to be executed synchronously.
   bool allow_control_flow_sync_execution = false;
+
+  // Whether the executor records the allocations of a step after a warm-up
+  // step, and serves those of later steps from a single arena laid out by a
+  // static plan (see StaticArenaPlanner). Only worth it if the graph runs with
+  // the same shapes in every step.
+  bool use_static_arena_plan = false;
 };
 
 }  // end namespace tensorflow
@@ -15,7 +15,9 @@ limitations under the License.
 
 #include "tensorflow/core/common_runtime/process_state.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <cstring>
 #include <vector>
 
@@ -28,6 +30,7 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/platform/types.h"
 #include "tensorflow/core/util/env_var.h"
 
@@ -61,6 +64,79 @@ ProcessState::MemDesc ProcessState::PtrType(const void* ptr) {
   return MemDesc();
 }
 
+Allocator* ProcessState::CreateCPUAllocator(int numa_node) {
+  // If visitors have been defined we need an Allocator built from
+  // a SubAllocator.  Prefer BFCAllocator, but fall back to PoolAllocator
+  // depending on env var setting.
+  const bool alloc_visitors_defined =
+      (!cpu_alloc_visitors_.empty() || !cpu_free_visitors_.empty());
+  bool use_bfc_allocator = false;
+  absl::Status status = ReadBoolFromEnvVar(
+      "TF_CPU_ALLOCATOR_USE_BFC", alloc_visitors_defined, &use_bfc_allocator);
+  if (!status.ok()) {
+    LOG(ERROR) << "GetCPUAllocator: " << status.message();
+  }
+  Allocator* allocator = nullptr;
+  SubAllocator* sub_allocator =
+      (numa_node != port::kNUMANoAffinity || alloc_visitors_defined ||
+       use_bfc_allocator)
+          ? new BasicCPUAllocator(numa_node, cpu_alloc_visitors_,
+                                  cpu_free_visitors_)
+          : nullptr;
+  if (use_bfc_allocator) {
+    // TODO(reedwm): evaluate whether 64GB by default is the best choice.
+    int64_t cpu_mem_limit_in_mb = -1;
+    absl::Status status = ReadInt64FromEnvVar(
+        "TF_CPU_BFC_MEM_LIMIT_IN_MB", 1LL << 16 /*64GB max by default*/,
+        &cpu_mem_limit_in_mb);
+    if (!status.ok()) {
+      LOG(ERROR) << "GetCPUAllocator: " << status.message();
+    }
+    int64_t cpu_mem_limit = cpu_mem_limit_in_mb * (1LL << 20);
+    DCHECK(sub_allocator);
+
+    // Small tensors are served from per-thread caches of freed chunks, so
+    // that inter-op threads rarely contend on the allocator lock.
+    int64_t thread_cache_bytes = 0;
+    status = ReadInt64FromEnvVar("TF_CPU_BFC_THREAD_CACHE_BYTES",
+                                 1LL << 20 /*1MB per thread by default*/,
+                                 &thread_cache_bytes);
+    if (!status.ok()) {
+      LOG(ERROR) << "GetCPUAllocator: " << status.message();
+    }
+
+    BFCAllocator::Options allocator_opts;
+    allocator_opts.allow_growth = true;
+    allocator_opts.thread_cache_bytes =
+        std::max<int64_t>(thread_cache_bytes, 0);
+    allocator = new BFCAllocator(
+        absl::WrapUnique(sub_allocator), cpu_mem_limit,
+        /*name=*/"bfc_cpu_allocator_for_gpu", allocator_opts);
+
+    VLOG(2) << "Using BFCAllocator with memory limit of "
+            << cpu_mem_limit_in_mb << " MB for ProcessState CPU allocator";
+  } else if (sub_allocator) {
+    DCHECK(sub_allocator);
+    allocator =
+        new PoolAllocator(/*pool_size_limit=*/100, /*auto_resize=*/true,
+                          sub_allocator, new NoopRounder, "cpu_pool");
+    VLOG(2) << "Using PoolAllocator for ProcessState CPU allocator "
+            << "numa_node=" << numa_node;
+  } else {
+    DCHECK(!sub_allocator);
+    allocator = cpu_allocator_base();
+  }
+  if (!sub_allocator) {
+    DCHECK(cpu_alloc_visitors_.empty() && cpu_free_visitors_.empty());
+  }
+  if (LogMemory::IsEnabled() && !allocator->TracksAllocationSizes()) {
+    // Wrap the allocator to track allocation ids for better logging
+    // at the cost of performance.
+    allocator = new TrackingAllocator(allocator, true);
+  }
+  return allocator;
+}
+
 Allocator* ProcessState::GetCPUAllocator(int numa_node) {
   if (!numa_enabled_ || numa_node == port::kNUMANoAffinity) numa_node = 0;
 
@@ -71,77 +147,34 @@ Allocator* ProcessState::GetCPUAllocator(int numa_node) {
 
   mutex_lock lock(mu_);
   while (cpu_allocators_.size() <= static_cast<size_t>(numa_node)) {
-    // If visitors have been defined we need an Allocator built from
-    // a SubAllocator.  Prefer BFCAllocator, but fall back to PoolAllocator
-    // depending on env var setting.
-    const bool alloc_visitors_defined =
-        (!cpu_alloc_visitors_.empty() || !cpu_free_visitors_.empty());
-    bool use_bfc_allocator = false;
-    absl::Status status = ReadBoolFromEnvVar(
-        "TF_CPU_ALLOCATOR_USE_BFC", alloc_visitors_defined, &use_bfc_allocator);
-    if (!status.ok()) {
-      LOG(ERROR) << "GetCPUAllocator: " << status.message();
-    }
-    Allocator* allocator = nullptr;
-    SubAllocator* sub_allocator =
-        (numa_enabled_ || alloc_visitors_defined || use_bfc_allocator)
-            ? new BasicCPUAllocator(
-                  numa_enabled_ ? numa_node : port::kNUMANoAffinity,
-                  cpu_alloc_visitors_, cpu_free_visitors_)
-            : nullptr;
-    if (use_bfc_allocator) {
-      // TODO(reedwm): evaluate whether 64GB by default is the best choice.
-      int64_t cpu_mem_limit_in_mb = -1;
-      absl::Status status = ReadInt64FromEnvVar(
-          "TF_CPU_BFC_MEM_LIMIT_IN_MB", 1LL << 16 /*64GB max by default*/,
-          &cpu_mem_limit_in_mb);
-      if (!status.ok()) {
-        LOG(ERROR) << "GetCPUAllocator: " << status.message();
-      }
-      int64_t cpu_mem_limit = cpu_mem_limit_in_mb * (1LL << 20);
-      DCHECK(sub_allocator);
-
-      BFCAllocator::Options allocator_opts;
-      allocator_opts.allow_growth = true;
-      allocator = new BFCAllocator(
-          absl::WrapUnique(sub_allocator), cpu_mem_limit,
-          /*name=*/"bfc_cpu_allocator_for_gpu", allocator_opts);
-
-      VLOG(2) << "Using BFCAllocator with memory limit of "
-              << cpu_mem_limit_in_mb << " MB for ProcessState CPU allocator";
-    } else if (sub_allocator) {
-      DCHECK(sub_allocator);
-      allocator =
-          new PoolAllocator(/*pool_size_limit=*/100, /*auto_resize=*/true,
-                            sub_allocator, new NoopRounder, "cpu_pool");
-      VLOG(2) << "Using PoolAllocator for ProcessState CPU allocator "
-              << "numa_enabled_=" << numa_enabled_
-              << " numa_node=" << numa_node;
-    } else {
-      DCHECK(!sub_allocator);
-      allocator = cpu_allocator_base();
-    }
-    if (LogMemory::IsEnabled() && !allocator->TracksAllocationSizes()) {
-      // Wrap the allocator to track allocation ids for better logging
-      // at the cost of performance.
-      allocator = new TrackingAllocator(allocator, true);
-    }
+    Allocator* allocator =
+        CreateCPUAllocator(numa_enabled_ ? numa_node : port::kNUMANoAffinity);
     cpu_allocators_.push_back(allocator);
     if (cpu_allocators_.size() < cpu_allocators_cache_.max_size()) {
       cpu_allocators_cache_[cpu_allocators_.size() - 1] = allocator;
       cpu_allocators_cached_.fetch_add(1, std::memory_order_release);
     }
-    if (!sub_allocator) {
-      DCHECK(cpu_alloc_visitors_.empty() && cpu_free_visitors_.empty());
-    }
   }
   return cpu_allocators_[numa_node];
 }
 
+Allocator* ProcessState::GetNUMACPUAllocator(int numa_node) {
+  if (numa_enabled_ || !port::NUMAEnabled() ||
+      numa_node == port::kNUMANoAffinity) {
+    return GetCPUAllocator(numa_node);
+  }
+  mutex_lock lock(mu_);
+  Allocator*& allocator = numa_cpu_allocators_[numa_node];
+  if (allocator == nullptr) {
+    allocator = CreateCPUAllocator(numa_node);
+  }
+  return allocator;
+}
+
 void ProcessState::AddCPUAllocVisitor(SubAllocator::Visitor visitor) {
   VLOG(1) << "AddCPUAllocVisitor";
   mutex_lock lock(mu_);
-  CHECK_EQ(0, cpu_allocators_.size())  // Crash OK
+  CHECK(cpu_allocators_.empty() && numa_cpu_allocators_.empty())  // Crash OK
       << "AddCPUAllocVisitor must be called prior to first call to "
          "ProcessState::GetCPUAllocator";
   cpu_alloc_visitors_.push_back(std::move(visitor));
@@ -149,7 +182,7 @@ void ProcessState::AddCPUAllocVisitor(SubAllocator::Visitor visitor) {
 
 void ProcessState::AddCPUFreeVisitor(SubAllocator::Visitor visitor) {
   mutex_lock lock(mu_);
-  CHECK_EQ(0, cpu_allocators_.size())  // Crash OK
+  CHECK(cpu_allocators_.empty() && numa_cpu_allocators_.empty())  // Crash OK
       << "AddCPUFreeVisitor must be called prior to first call to "
          "ProcessState::GetCPUAllocator";
   cpu_free_visitors_.push_back(std::move(visitor));
@@ -164,6 +197,10 @@ void ProcessState::TestOnlyReset() {
     if (a != default_cpu_allocator) delete a;
   }
   cpu_allocators_.clear();
+  for (const auto& [unused_numa_node, a] : numa_cpu_allocators_) {
+    delete a;
+  }
+  numa_cpu_allocators_.clear();
   for (Allocator* a : cpu_al_) {
     delete a;
   }
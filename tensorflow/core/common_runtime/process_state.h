@@ -66,6 +66,13 @@ class ProcessState : public ProcessStateInterface {
   // Treats numa_node == kNUMANoAffinity as numa_node == 0.
   Allocator* GetCPUAllocator(int numa_node) override;
 
+  // Returns a CPUAllocator that allocates from `numa_node`, for devices pinned
+  // to that node. Unlike `EnableNUMA`, it can be called after other allocators
+  // have been handed out, since it does not change what `GetCPUAllocator`
+  // returns. Same as `GetCPUAllocator` if NUMA is enabled or unavailable, or
+  // if numa_node == kNUMANoAffinity.
+  Allocator* GetNUMACPUAllocator(int numa_node);
+
   // Registers alloc visitor for the CPU allocator(s).
   // REQUIRES: must be called before GetCPUAllocator.
   void AddCPUAllocVisitor(SubAllocator::Visitor v);
@@ -91,6 +98,10 @@ class ProcessState : public ProcessStateInterface {
   // cleaning up everything. Never use in production.
   void TestOnlyReset();
 
+  // Creates a CPU allocator that allocates from `numa_node`, or from any node
+  // if numa_node == kNUMANoAffinity.
+  Allocator* CreateCPUAllocator(int numa_node) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
   static ProcessState* instance_;
   bool numa_enabled_;
 
@@ -99,6 +110,8 @@ class ProcessState : public ProcessStateInterface {
   // Indexed by numa_node.  If we want numa-specific allocators AND a
   // non-specific allocator, maybe should index by numa_node+1.
   std::vector<Allocator*> cpu_allocators_ TF_GUARDED_BY(mu_);
+  // Allocators returned by `GetNUMACPUAllocator`, indexed by numa_node.
+  std::map<int, Allocator*> numa_cpu_allocators_ TF_GUARDED_BY(mu_);
   std::vector<SubAllocator::Visitor> cpu_alloc_visitors_ TF_GUARDED_BY(mu_);
   std::vector<SubAllocator::Visitor> cpu_free_visitors_ TF_GUARDED_BY(mu_);
 
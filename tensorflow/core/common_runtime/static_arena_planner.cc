@@ -0,0 +1,408 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/static_arena_planner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/metrics.h"
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+namespace {
+
+// States of the buffers of a planned step.
+constexpr int kFree = 0;
+constexpr int kClaiming = 1;
+constexpr int kLive = 2;
+
+size_t RoundUp(size_t num_bytes) {
+  constexpr size_t kAlignment = Allocator::kAllocatorAlignment;
+  return (num_bytes + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+bool LifetimesOverlap(const ArenaPlan::Allocation& a,
+                      const ArenaPlan::Allocation& b) {
+  return a.first_tick <= b.last_tick && b.first_tick <= a.last_tick;
+}
+
+}  // namespace
+
+ArenaPlan::ArenaPlan(int num_nodes, std::vector<Allocation> allocations) {
+  // Numbers the buffers by node id and allocation index. Indices that were
+  // not recorded get an empty buffer, which no allocation fits in.
+  std::vector<int> num_indices(num_nodes, 0);
+  for (const Allocation& allocation : allocations) {
+    DCHECK_GE(allocation.node_id, 0);
+    DCHECK_LT(allocation.node_id, num_nodes);
+    num_indices[allocation.node_id] =
+        std::max(num_indices[allocation.node_id], allocation.index + 1);
+  }
+  node_begin_.resize(num_nodes + 1, 0);
+  for (int i = 0; i < num_nodes; ++i) {
+    node_begin_[i + 1] = node_begin_[i] + num_indices[i];
+  }
+  buffers_.resize(node_begin_[num_nodes], Buffer{0, 0, 0, 0});
+
+  // Places the allocations from the largest to the smallest. `placed` is
+  // sorted by offset.
+  std::vector<int> order(allocations.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return allocations[a].num_bytes > allocations[b].num_bytes;
+  });
+  std::vector<int> placed;
+  std::vector<int> buffer_of(allocations.size());
+  for (int i : order) {
+    const Allocation& allocation = allocations[i];
+    const size_t num_bytes = RoundUp(allocation.num_bytes);
+    size_t offset = 0;
+    for (int j : placed) {
+      if (!LifetimesOverlap(allocation, allocations[j])) continue;
+      const Buffer& other = buffers_[buffer_of[j]];
+      if (offset + num_bytes <= other.offset) break;
+      offset = std::max(offset, other.offset + other.num_bytes);
+    }
+    const int buffer = node_begin_[allocation.node_id] + allocation.index;
+    buffer_of[i] = buffer;
+    buffers_[buffer].offset = offset;
+    buffers_[buffer].num_bytes = num_bytes;
+    arena_size_ = std::max(arena_size_, offset + num_bytes);
+    auto position = std::upper_bound(
+        placed.begin(), placed.end(), offset, [&](size_t value, int j) {
+          return value < buffers_[buffer_of[j]].offset;
+        });
+    placed.insert(position, i);
+  }
+
+  // Records which buffers share memory, for checking at run time that a
+  // buffer is not claimed while another one that overlaps it is live.
+  std::vector<std::vector<int>> overlapping(buffers_.size());
+  for (size_t a = 0; a < placed.size(); ++a) {
+    const Buffer& buffer_a = buffers_[buffer_of[placed[a]]];
+    for (size_t b = a + 1; b < placed.size(); ++b) {
+      const Buffer& buffer_b = buffers_[buffer_of[placed[b]]];
+      if (buffer_b.offset >= buffer_a.offset + buffer_a.num_bytes) break;
+      overlapping[buffer_of[placed[a]]].push_back(buffer_of[placed[b]]);
+      overlapping[buffer_of[placed[b]]].push_back(buffer_of[placed[a]]);
+    }
+  }
+  for (size_t i = 0; i < buffers_.size(); ++i) {
+    buffers_[i].overlapping_begin = overlapping_.size();
+    overlapping_.insert(overlapping_.end(), overlapping[i].begin(),
+                        overlapping[i].end());
+    buffers_[i].overlapping_end = overlapping_.size();
+    if (buffers_[i].num_bytes > 0) {
+      buffers_at_offset_[buffers_[i].offset].push_back(i);
+    }
+  }
+}
+
+int ArenaPlan::BufferIndex(int node_id, int index) const {
+  if (node_id < 0 || node_id + 1 >= static_cast<int>(node_begin_.size())) {
+    return -1;
+  }
+  const int buffer = node_begin_[node_id] + index;
+  return buffer < node_begin_[node_id + 1] ? buffer : -1;
+}
+
+absl::Span<const int> ArenaPlan::Overlapping(int buffer) const {
+  const Buffer& b = buffers_[buffer];
+  return absl::MakeConstSpan(overlapping_.data() + b.overlapping_begin,
+                             b.overlapping_end - b.overlapping_begin);
+}
+
+absl::Span<const int> ArenaPlan::BuffersAt(size_t offset) const {
+  auto it = buffers_at_offset_.find(offset);
+  if (it == buffers_at_offset_.end()) return {};
+  return it->second;
+}
+
+void* StepArena::NodeAllocator::AllocateRaw(size_t alignment,
+                                            size_t num_bytes) {
+  return AllocateRaw(alignment, num_bytes, AllocationAttributes());
+}
+
+void* StepArena::NodeAllocator::AllocateRaw(
+    size_t alignment, size_t num_bytes,
+    const AllocationAttributes& allocation_attr) {
+  const int index = next_index_.fetch_add(1, std::memory_order_relaxed);
+  return step_arena_->Allocate(node_id_, index, alignment, num_bytes,
+                               allocation_attr);
+}
+
+void StepArena::NodeAllocator::DeallocateRaw(void* ptr) {
+  step_arena_->Deallocate(ptr);
+}
+
+std::string StepArena::NodeAllocator::Name() {
+  return step_arena_->base_allocator_->Name();
+}
+
+AllocatorMemoryType StepArena::NodeAllocator::GetMemoryType() const {
+  return step_arena_->base_allocator_->GetMemoryType();
+}
+
+StepArena::StepArena(StaticArenaPlanner* planner, Allocator* base_allocator,
+                     int num_nodes, std::shared_ptr<const ArenaPlan> plan,
+                     bool recording)
+    : planner_(planner),
+      base_allocator_(base_allocator),
+      node_allocators_(new NodeAllocator[num_nodes]),
+      plan_(std::move(plan)),
+      recording_(recording) {
+  for (int i = 0; i < num_nodes; ++i) {
+    node_allocators_[i].step_arena_ = this;
+    node_allocators_[i].node_id_ = i;
+  }
+  if (plan_ != nullptr && plan_->arena_size() > 0) {
+    arena_ = static_cast<char*>(base_allocator_->AllocateRaw(
+        Allocator::kAllocatorAlignment, plan_->arena_size()));
+    if (arena_ != nullptr) {
+      buffer_states_ =
+          std::make_unique<std::atomic<int>[]>(plan_->num_buffers());
+      for (int i = 0; i < plan_->num_buffers(); ++i) {
+        buffer_states_[i].store(kFree, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+StepArena::~StepArena() {
+  if (arena_ != nullptr) {
+    base_allocator_->DeallocateRaw(arena_);
+  }
+}
+
+void* StepArena::Allocate(int node_id, int index, size_t alignment,
+                          size_t num_bytes,
+                          const AllocationAttributes& allocation_attr) {
+  if (recording_) {
+    return RecordAllocation(node_id, index, alignment, num_bytes,
+                            allocation_attr);
+  }
+  if (arena_ != nullptr && num_bytes > 0 &&
+      alignment <= Allocator::kAllocatorAlignment &&
+      allocation_attr.freed_by_func == nullptr) {
+    const int buffer = plan_->BufferIndex(node_id, index);
+    if (buffer >= 0 && num_bytes <= plan_->num_bytes(buffer) &&
+        ClaimBuffer(buffer)) {
+      num_arena_allocations_.fetch_add(1, std::memory_order_relaxed);
+      Ref();
+      return arena_ + plan_->offset(buffer);
+    }
+  }
+  if (plan_ != nullptr) {
+    num_fallbacks_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void* ptr = base_allocator_->AllocateRaw(alignment, num_bytes,
+                                           allocation_attr);
+  if (ptr != nullptr) Ref();
+  return ptr;
+}
+
+bool StepArena::ClaimBuffer(int buffer) {
+  // Marks the buffer before checking the buffers that overlap it, so that of
+  // two overlapping buffers claimed concurrently, at most one succeeds.
+  int expected = kFree;
+  if (!buffer_states_[buffer].compare_exchange_strong(expected, kClaiming)) {
+    return false;
+  }
+  for (int other : plan_->Overlapping(buffer)) {
+    if (buffer_states_[other].load() != kFree) {
+      buffer_states_[buffer].store(kFree);
+      return false;
+    }
+  }
+  buffer_states_[buffer].store(kLive);
+  return true;
+}
+
+void StepArena::Deallocate(void* ptr) {
+  char* p = static_cast<char*>(ptr);
+  if (recording_) {
+    RecordDeallocation(ptr);
+  } else if (arena_ != nullptr && p >= arena_ &&
+             p < arena_ + plan_->arena_size()) {
+    // Buffers that start at the same offset overlap, so only one is live.
+    for (int buffer : plan_->BuffersAt(p - arena_)) {
+      if (buffer_states_[buffer].load() == kLive) {
+        buffer_states_[buffer].store(kFree);
+        break;
+      }
+    }
+  } else {
+    base_allocator_->DeallocateRaw(ptr);
+  }
+  Unref();
+}
+
+void* StepArena::RecordAllocation(int node_id, int index, size_t alignment,
+                                  size_t num_bytes,
+                                  const AllocationAttributes& allocation_attr) {
+  void* ptr = base_allocator_->AllocateRaw(alignment, num_bytes,
+                                           allocation_attr);
+  if (ptr == nullptr) return nullptr;
+  Ref();
+  if (num_bytes == 0 || alignment > Allocator::kAllocatorAlignment ||
+      allocation_attr.freed_by_func != nullptr) {
+    return ptr;
+  }
+  mutex_lock l(mu_);
+  if (!finished_) {
+    live_allocations_[ptr] = allocations_.size();
+    allocations_.push_back(ArenaPlan::Allocation{
+        node_id, index, num_bytes, tick_++, ArenaPlan::kLiveAtEndOfStep});
+  }
+  return ptr;
+}
+
+void StepArena::RecordDeallocation(void* ptr) {
+  {
+    mutex_lock l(mu_);
+    auto it = live_allocations_.find(ptr);
+    if (it != live_allocations_.end()) {
+      allocations_[it->second].last_tick = tick_++;
+      live_allocations_.erase(it);
+    }
+  }
+  base_allocator_->DeallocateRaw(ptr);
+}
+
+void StepArena::Finish(bool ok) {
+  if (!recording_) {
+    const int64_t num_arena_allocations =
+        num_arena_allocations_.load(std::memory_order_relaxed);
+    const int64_t num_fallbacks =
+        num_fallbacks_.load(std::memory_order_relaxed);
+    if (num_fallbacks > 0) {
+      VLOG(1) << num_fallbacks << " allocations of a planned step did not fit "
+              << "in the arena of " << base_allocator_->Name();
+    }
+    metrics::UpdateStaticArenaPlanAllocations(num_arena_allocations,
+                                              num_fallbacks);
+    planner_->FinishPlannedStep(plan_.get(), num_arena_allocations,
+                                num_fallbacks);
+    return;
+  }
+  std::vector<ArenaPlan::Allocation> allocations;
+  {
+    mutex_lock l(mu_);
+    finished_ = true;
+    allocations = std::move(allocations_);
+    live_allocations_.clear();
+  }
+  planner_->FinishRecording(std::move(allocations), ok);
+}
+
+StaticArenaPlanner::StaticArenaPlanner(Allocator* base_allocator,
+                                       int num_nodes)
+    : base_allocator_(base_allocator), num_nodes_(num_nodes) {}
+
+core::RefCountPtr<StepArena> StaticArenaPlanner::StartStep() {
+  std::shared_ptr<const ArenaPlan> plan;
+  bool recording = false;
+  {
+    mutex_lock l(mu_);
+    switch (state_) {
+      case State::kWarmUp:
+        state_ = State::kRecordNext;
+        return nullptr;
+      case State::kRecordNext:
+        state_ = State::kRecording;
+        recording = true;
+        break;
+      case State::kRecording:
+        return nullptr;
+      case State::kPlanned:
+        plan = plan_;
+        break;
+      case State::kDisabled:
+        return nullptr;
+    }
+  }
+  return core::RefCountPtr<StepArena>(new StepArena(
+      this, base_allocator_, num_nodes_, std::move(plan), recording));
+}
+
+std::shared_ptr<const ArenaPlan> StaticArenaPlanner::plan() const {
+  mutex_lock l(mu_);
+  return plan_;
+}
+
+void StaticArenaPlanner::FinishRecording(
+    std::vector<ArenaPlan::Allocation> allocations, bool ok) {
+  if (!ok) {
+    mutex_lock l(mu_);
+    state_ = State::kRecordNext;
+    return;
+  }
+  size_t total_bytes = 0;
+  for (const ArenaPlan::Allocation& allocation : allocations) {
+    total_bytes += allocation.num_bytes;
+  }
+  const int num_allocations = allocations.size();
+  auto plan = std::make_shared<const ArenaPlan>(num_nodes_,
+                                                std::move(allocations));
+  VLOG(1) << "Planned " << num_allocations << " allocations of "
+          << total_bytes << " bytes in total into an arena of "
+          << plan->arena_size() << " bytes of " << base_allocator_->Name();
+  mutex_lock l(mu_);
+  plan_ = std::move(plan);
+  state_ = State::kPlanned;
+  num_missed_steps_ = 0;
+  ++num_recordings_;
+}
+
+void StaticArenaPlanner::FinishPlannedStep(const ArenaPlan* plan,
+                                           int64_t num_arena_allocations,
+                                           int64_t num_fallbacks) {
+  mutex_lock l(mu_);
+  if (state_ != State::kPlanned || plan != plan_.get()) {
+    // The step was planned before the plan was recorded again.
+    return;
+  }
+  if (num_fallbacks <= num_arena_allocations) {
+    num_missed_steps_ = 0;
+    return;
+  }
+  if (++num_missed_steps_ < kMaxMissedSteps) {
+    return;
+  }
+  num_missed_steps_ = 0;
+  if (num_recordings_ >= kMaxRecordings) {
+    VLOG(1) << "Disabled the static arena plan of " << base_allocator_->Name()
+            << " after " << num_recordings_ << " recordings";
+    plan_.reset();
+    state_ = State::kDisabled;
+    return;
+  }
+  VLOG(1) << "Recording the static arena plan of " << base_allocator_->Name()
+          << " again";
+  state_ = State::kRecordNext;
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,236 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_ARENA_PLANNER_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_ARENA_PLANNER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/lib/core/refcount.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+
+namespace tensorflow {
+
+class StaticArenaPlanner;
+
+// A static memory plan for the allocations of a step: each allocation is
+// identified by its node and by its index among the allocations of the node,
+// and is assigned an offset in a single arena. Allocations whose lifetimes
+// overlapped when they were recorded never share memory.
+class ArenaPlan {
+ public:
+  // An allocation made during the recorded step. Lifetimes are measured in
+  // ticks of a logical clock, which advances on every allocation and
+  // deallocation. Allocations that outlive the step have a `last_tick` of
+  // `kLiveAtEndOfStep`.
+  struct Allocation {
+    int node_id;
+    int index;
+    size_t num_bytes;
+    int64_t first_tick;
+    int64_t last_tick;
+  };
+  static constexpr int64_t kLiveAtEndOfStep = INT64_MAX;
+
+  // Assigns offsets to `allocations` greedily, from the largest allocation to
+  // the smallest, at the lowest offset that does not overlap an allocation
+  // with an overlapping lifetime. `num_nodes` is the number of node ids.
+  ArenaPlan(int num_nodes, std::vector<Allocation> allocations);
+
+  // Returns the index of the planned buffer for the `index`-th allocation of
+  // node `node_id`, or -1 if there is none. Allocations that were not recorded
+  // have an empty buffer.
+  int BufferIndex(int node_id, int index) const;
+
+  size_t arena_size() const { return arena_size_; }
+  int num_buffers() const { return static_cast<int>(buffers_.size()); }
+  size_t offset(int buffer) const { return buffers_[buffer].offset; }
+  size_t num_bytes(int buffer) const { return buffers_[buffer].num_bytes; }
+
+  // Returns the buffers whose memory overlaps that of `buffer`.
+  absl::Span<const int> Overlapping(int buffer) const;
+
+  // Returns the buffers that start at `offset`.
+  absl::Span<const int> BuffersAt(size_t offset) const;
+
+ private:
+  struct Buffer {
+    size_t offset;
+    size_t num_bytes;
+    // Range of `overlapping_` with the buffers that overlap this one.
+    int overlapping_begin;
+    int overlapping_end;
+  };
+
+  // Buffers sorted by node id and allocation index.
+  std::vector<Buffer> buffers_;
+  // Indexed by node id. The buffers of node `i` are
+  // [node_begin_[i], node_begin_[i + 1]).
+  std::vector<int> node_begin_;
+  std::vector<int> overlapping_;
+  absl::flat_hash_map<size_t, std::vector<int>> buffers_at_offset_;
+  size_t arena_size_ = 0;
+};
+
+// Serves the allocations of a single step. Depending on the state of the
+// `StaticArenaPlanner` that created it, a `StepArena` either records the
+// allocations of the step, forwarding them to the base allocator, or serves
+// them from one arena laid out by an `ArenaPlan`.
+//
+// A planned allocation falls back to the base allocator if it is larger than
+// its buffer, e.g. because shapes changed, or if a buffer that shares its
+// memory is still live, e.g. because nodes ran in a different order than in
+// the recorded step. The arena is freed once the step is finished and all the
+// tensors allocated in it are deallocated, so tensors may outlive the step.
+class StepArena : public core::RefCounted {
+ public:
+  // Allocates on behalf of one node. Returned by `ForNode()` and valid as long
+  // as the `StepArena`, which each allocation keeps alive.
+  class NodeAllocator : public Allocator {
+   public:
+    void* AllocateRaw(size_t alignment, size_t num_bytes) override;
+    void* AllocateRaw(size_t alignment, size_t num_bytes,
+                      const AllocationAttributes& allocation_attr) override;
+    void DeallocateRaw(void* ptr) override;
+    std::string Name() override;
+    AllocatorMemoryType GetMemoryType() const override;
+
+   private:
+    friend class StepArena;
+
+    StepArena* step_arena_ = nullptr;
+    int node_id_ = 0;
+    std::atomic<int> next_index_{0};
+  };
+
+  ~StepArena() override;
+
+  // Returns the allocator for the node `node_id`.
+  Allocator* ForNode(int node_id) { return &node_allocators_[node_id]; }
+
+  // Marks the end of the step. If the step was recorded and `ok` is true,
+  // computes the plan of the later steps. If it was recorded and failed, the
+  // next step is recorded instead. Allocations made after this call are not
+  // recorded.
+  void Finish(bool ok);
+
+ private:
+  friend class StaticArenaPlanner;
+
+  StepArena(StaticArenaPlanner* planner, Allocator* base_allocator,
+            int num_nodes, std::shared_ptr<const ArenaPlan> plan,
+            bool recording);
+
+  void* Allocate(int node_id, int index, size_t alignment, size_t num_bytes,
+                 const AllocationAttributes& allocation_attr);
+  void Deallocate(void* ptr);
+
+  // Claims the planned buffer `buffer`, or returns false if it or a buffer
+  // overlapping it is live.
+  bool ClaimBuffer(int buffer);
+
+  void* RecordAllocation(int node_id, int index, size_t alignment,
+                         size_t num_bytes,
+                         const AllocationAttributes& allocation_attr);
+  void RecordDeallocation(void* ptr);
+
+  StaticArenaPlanner* const planner_;
+  Allocator* const base_allocator_;
+  std::unique_ptr<NodeAllocator[]> node_allocators_;
+
+  // Set in planned steps.
+  const std::shared_ptr<const ArenaPlan> plan_;
+  char* arena_ = nullptr;
+  // Indexed by buffer: kFree, kClaiming or kLive.
+  std::unique_ptr<std::atomic<int>[]> buffer_states_;
+  std::atomic<int64_t> num_arena_allocations_{0};
+  std::atomic<int64_t> num_fallbacks_{0};
+
+  // Set in the recorded step.
+  const bool recording_;
+  mutex mu_;
+  bool finished_ TF_GUARDED_BY(mu_) = false;
+  int64_t tick_ TF_GUARDED_BY(mu_) = 0;
+  std::vector<ArenaPlan::Allocation> allocations_ TF_GUARDED_BY(mu_);
+  // Maps the pointers of the live recorded allocations to their index in
+  // `allocations_`.
+  absl::flat_hash_map<void*, int> live_allocations_ TF_GUARDED_BY(mu_);
+};
+
+// Plans the memory of the steps of an executor whose graph runs with the same
+// shapes in every step, the way TFLite's `ArenaPlanner` does: after a warm-up
+// step, the sizes and lifetimes of the allocations of one step are recorded,
+// and later steps serve them from a single arena allocated up front, with
+// offsets computed once. This replaces one allocator call per tensor with one
+// per step. This class is thread-safe.
+//
+// If most allocations of `kMaxMissedSteps` consecutive planned steps fall back
+// to the base allocator, e.g. because shapes changed, the next step is recorded
+// again. After `kMaxRecordings` recordings, planning is disabled instead.
+class StaticArenaPlanner {
+ public:
+  static constexpr int kMaxMissedSteps = 3;
+  static constexpr int kMaxRecordings = 3;
+
+  // `base_allocator` must outlive the planner and all the tensors allocated
+  // by its step arenas.
+  StaticArenaPlanner(Allocator* base_allocator, int num_nodes);
+
+  // Returns the arena of a new step, or nullptr if the step should allocate
+  // from the device allocator, i.e. during warm-up, while another step is
+  // being recorded, or if planning is disabled.
+  core::RefCountPtr<StepArena> StartStep();
+
+  // Returns the current plan, or nullptr if no step has been recorded yet or
+  // planning is disabled.
+  std::shared_ptr<const ArenaPlan> plan() const;
+
+ private:
+  friend class StepArena;
+
+  // The first step initializes the kernels and their persistent state, so
+  // the second step is the first one to be recorded.
+  enum class State { kWarmUp, kRecordNext, kRecording, kPlanned, kDisabled };
+
+  // Called when the recorded step finishes.
+  void FinishRecording(std::vector<ArenaPlan::Allocation> allocations,
+                       bool ok);
+
+  // Called when a step planned with `plan` finishes.
+  void FinishPlannedStep(const ArenaPlan* plan, int64_t num_arena_allocations,
+                         int64_t num_fallbacks);
+
+  Allocator* const base_allocator_;
+  const int num_nodes_;
+
+  mutable mutex mu_;
+  State state_ TF_GUARDED_BY(mu_) = State::kWarmUp;
+  std::shared_ptr<const ArenaPlan> plan_ TF_GUARDED_BY(mu_);
+  // Number of consecutive planned steps in which most allocations fell back.
+  int num_missed_steps_ TF_GUARDED_BY(mu_) = 0;
+  int num_recordings_ TF_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_STATIC_ARENA_PLANNER_H_
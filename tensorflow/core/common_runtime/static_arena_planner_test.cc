@@ -0,0 +1,195 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/static_arena_planner.h"
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+TEST(ArenaPlanTest, SharesMemoryOfDisjointLifetimes) {
+  // Node 0 allocates a buffer that is freed before node 1 allocates; node 2
+  // allocates while node 1's buffer is live.
+  ArenaPlan plan(/*num_nodes=*/3, {{0, 0, 1024, 0, 1},
+                                   {1, 0, 512, 2, 4},
+                                   {2, 0, 256, 3, 5}});
+  ASSERT_EQ(plan.num_buffers(), 3);
+  const int b0 = plan.BufferIndex(0, 0);
+  const int b1 = plan.BufferIndex(1, 0);
+  const int b2 = plan.BufferIndex(2, 0);
+  EXPECT_EQ(plan.offset(b0), 0);
+  EXPECT_EQ(plan.offset(b1), 0);
+  EXPECT_EQ(plan.offset(b2), 512);
+  EXPECT_EQ(plan.arena_size(), 1024);
+  EXPECT_EQ(plan.BufferIndex(0, 1), -1);
+  EXPECT_EQ(plan.BufferIndex(3, 0), -1);
+}
+
+TEST(ArenaPlanTest, RoundsUpToAllocatorAlignment) {
+  ArenaPlan plan(/*num_nodes=*/1, {{0, 0, 1, 0, 2}, {0, 1, 1, 1, 3}});
+  EXPECT_EQ(plan.num_bytes(plan.BufferIndex(0, 0)),
+            Allocator::kAllocatorAlignment);
+  EXPECT_EQ(plan.offset(plan.BufferIndex(0, 1)),
+            Allocator::kAllocatorAlignment);
+  EXPECT_EQ(plan.arena_size(), 2 * Allocator::kAllocatorAlignment);
+}
+
+// Records one step in which node 0 allocates a buffer that is freed before
+// node 1 allocates one of the same size, so both share the same memory.
+core::RefCountPtr<StepArena> StartPlannedStep(StaticArenaPlanner& planner) {
+  EXPECT_EQ(planner.StartStep(), nullptr);
+  core::RefCountPtr<StepArena> recorded = planner.StartStep();
+  EXPECT_NE(recorded, nullptr);
+  // Only one step is recorded at a time.
+  EXPECT_EQ(planner.StartStep(), nullptr);
+  void* p0 = recorded->ForNode(0)->AllocateRaw(64, 1024);
+  recorded->ForNode(0)->DeallocateRaw(p0);
+  void* p1 = recorded->ForNode(1)->AllocateRaw(64, 1024);
+  recorded->ForNode(1)->DeallocateRaw(p1);
+  recorded->Finish(/*ok=*/true);
+  EXPECT_NE(planner.plan(), nullptr);
+  EXPECT_EQ(planner.plan()->arena_size(), 1024);
+  return planner.StartStep();
+}
+
+TEST(StaticArenaPlannerTest, ServesAllocationsFromArena) {
+  StaticArenaPlanner planner(cpu_allocator(), /*num_nodes=*/2);
+  core::RefCountPtr<StepArena> step = StartPlannedStep(planner);
+  ASSERT_NE(step, nullptr);
+  void* p0 = step->ForNode(0)->AllocateRaw(64, 1000);
+  step->ForNode(0)->DeallocateRaw(p0);
+  void* p1 = step->ForNode(1)->AllocateRaw(64, 1024);
+  EXPECT_EQ(p0, p1);
+  step->ForNode(1)->DeallocateRaw(p1);
+  step->Finish(/*ok=*/true);
+}
+
+TEST(StaticArenaPlannerTest, FallsBackWhenOverlappingBufferIsLive) {
+  StaticArenaPlanner planner(cpu_allocator(), /*num_nodes=*/2);
+  core::RefCountPtr<StepArena> step = StartPlannedStep(planner);
+  ASSERT_NE(step, nullptr);
+  // Unlike in the recorded step, both allocations are live at once.
+  void* p0 = step->ForNode(0)->AllocateRaw(64, 1024);
+  void* p1 = step->ForNode(1)->AllocateRaw(64, 1024);
+  EXPECT_NE(p0, p1);
+  step->ForNode(0)->DeallocateRaw(p0);
+  step->ForNode(1)->DeallocateRaw(p1);
+  step->Finish(/*ok=*/true);
+}
+
+TEST(StaticArenaPlannerTest, FallsBackWhenAllocationIsLarger) {
+  StaticArenaPlanner planner(cpu_allocator(), /*num_nodes=*/2);
+  core::RefCountPtr<StepArena> step = StartPlannedStep(planner);
+  ASSERT_NE(step, nullptr);
+  void* p0 = step->ForNode(0)->AllocateRaw(64, 4096);
+  ASSERT_NE(p0, nullptr);
+  // The arena is not in use, so node 1 still gets its planned buffer.
+  void* p1 = step->ForNode(1)->AllocateRaw(64, 1024);
+  EXPECT_NE(p0, p1);
+  step->ForNode(0)->DeallocateRaw(p0);
+  step->ForNode(1)->DeallocateRaw(p1);
+  step->Finish(/*ok=*/true);
+}
+
+TEST(StaticArenaPlannerTest, AllocationsOutliveStep) {
+  StaticArenaPlanner planner(cpu_allocator(), /*num_nodes=*/2);
+  void* p0 = nullptr;
+  Allocator* allocator = nullptr;
+  {
+    core::RefCountPtr<StepArena> step = StartPlannedStep(planner);
+    ASSERT_NE(step, nullptr);
+    allocator = step->ForNode(0);
+    p0 = allocator->AllocateRaw(64, 1024);
+    step->Finish(/*ok=*/true);
+  }
+  // The allocation keeps the arena alive.
+  static_cast<char*>(p0)[1023] = 1;
+  allocator->DeallocateRaw(p0);
+}
+
+TEST(StaticArenaPlannerTest, RecordsAgainAfterFailedStep) {
+  StaticArenaPlanner planner(cpu_allocator(), /*num_nodes=*/1);
+  EXPECT_EQ(planner.StartStep(), nullptr);
+  core::RefCountPtr<StepArena> step = planner.StartStep();
+  ASSERT_NE(step, nullptr);
+  step->Finish(/*ok=*/false);
+  EXPECT_EQ(planner.plan(), nullptr);
+  step = planner.StartStep();
+  ASSERT_NE(step, nullptr);
+  step->Finish(/*ok=*/true);
+  EXPECT_NE(planner.plan(), nullptr);
+}
+
+// Runs a planned step in which node 0 allocates more than its planned buffer,
+// so its only allocation falls back.
+void RunMissedStep(StaticArenaPlanner& planner) {
+  core::RefCountPtr<StepArena> step = planner.StartStep();
+  ASSERT_NE(step, nullptr);
+  void* p0 = step->ForNode(0)->AllocateRaw(64, 4096);
+  step->ForNode(0)->DeallocateRaw(p0);
+  step->Finish(/*ok=*/true);
+}
+
+// Records a step in which node 0 allocates more than in the first recording.
+void RecordLargerStep(StaticArenaPlanner& planner) {
+  core::RefCountPtr<StepArena> step = planner.StartStep();
+  ASSERT_NE(step, nullptr);
+  void* p0 = step->ForNode(0)->AllocateRaw(64, 4096);
+  step->ForNode(0)->DeallocateRaw(p0);
+  step->Finish(/*ok=*/true);
+}
+
+TEST(StaticArenaPlannerTest, RecordsAgainAfterMissedSteps) {
+  StaticArenaPlanner planner(cpu_allocator(), /*num_nodes=*/2);
+  core::RefCountPtr<StepArena> step = StartPlannedStep(planner);
+  ASSERT_NE(step, nullptr);
+  step->Finish(/*ok=*/true);
+  for (int i = 0; i < StaticArenaPlanner::kMaxMissedSteps; ++i) {
+    RunMissedStep(planner);
+  }
+  EXPECT_EQ(planner.plan()->arena_size(), 1024);
+  RecordLargerStep(planner);
+  EXPECT_EQ(planner.plan()->arena_size(), 4096);
+}
+
+TEST(StaticArenaPlannerTest, DisablesAfterRepeatedRecordings) {
+  StaticArenaPlanner planner(cpu_allocator(), /*num_nodes=*/2);
+  core::RefCountPtr<StepArena> step = StartPlannedStep(planner);
+  ASSERT_NE(step, nullptr);
+  step->Finish(/*ok=*/true);
+  for (int i = 1; i < StaticArenaPlanner::kMaxRecordings; ++i) {
+    for (int j = 0; j < StaticArenaPlanner::kMaxMissedSteps; ++j) {
+      RunMissedStep(planner);
+    }
+    // Records a step like the first one, so that the later steps miss again.
+    step = planner.StartStep();
+    ASSERT_NE(step, nullptr);
+    void* p0 = step->ForNode(0)->AllocateRaw(64, 1024);
+    step->ForNode(0)->DeallocateRaw(p0);
+    step->Finish(/*ok=*/true);
+  }
+  for (int j = 0; j < StaticArenaPlanner::kMaxMissedSteps; ++j) {
+    RunMissedStep(planner);
+  }
+  EXPECT_EQ(planner.plan(), nullptr);
+  EXPECT_EQ(planner.StartStep(), nullptr);
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -38,8 +38,13 @@ class ThreadPoolDeviceFactory : public DeviceFactory {
   absl::Status CreateDevices(
       const SessionOptions& options, const string& name_prefix,
       std::vector<std::unique_ptr<Device>>* devices) override {
+    const bool use_numa_affinity =
+        options.config.experimental().use_numa_affinity();
     int num_numa_nodes = port::NUMANumNodes();
-    int n = 1;
+    // With NUMA affinity, there is one CPU device per NUMA node by default.
+    // Each of them allocates from its node and runs its kernels on a thread
+    // pool pinned to its node.
+    int n = use_numa_affinity ? num_numa_nodes : 1;
     auto iter = options.config.device_count().find("CPU");
     if (iter != options.config.device_count().end()) {
       n = iter->second;
@@ -47,7 +52,7 @@ class ThreadPoolDeviceFactory : public DeviceFactory {
     for (int i = 0; i < n; i++) {
       string name = strings::StrCat(name_prefix, "/device:CPU:", i);
       std::unique_ptr<ThreadPoolDevice> tpd;
-      if (options.config.experimental().use_numa_affinity()) {
+      if (use_numa_affinity) {
         int numa_node = i % num_numa_nodes;
         if (numa_node != i) {
           LOG(INFO) << "Only " << num_numa_nodes
@@ -59,7 +64,7 @@ class ThreadPoolDeviceFactory : public DeviceFactory {
         dev_locality.set_numa_node(numa_node);
         tpd = std::make_unique<ThreadPoolDevice>(
             options, name, Bytes(256 << 20), dev_locality,
-            ProcessState::singleton()->GetCPUAllocator(numa_node));
+            ProcessState::singleton()->GetNUMACPUAllocator(numa_node));
       } else {
         tpd = std::make_unique<ThreadPoolDevice>(
             options, name, Bytes(256 << 20), DeviceLocality(),
@@ -0,0 +1,164 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/work_stealing_thread_pool.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+
+namespace tensorflow {
+namespace {
+
+struct PerThread {
+  const WorkStealingThreadPool* pool = nullptr;
+  int id = -1;
+};
+
+PerThread& GetPerThread() {
+  thread_local PerThread per_thread;
+  return per_thread;
+}
+
+}  // namespace
+
+WorkStealingThreadPool::WorkStealingThreadPool(
+    Env* env, const ThreadOptions& thread_options, const std::string& name,
+    int num_threads) {
+  CHECK_GE(num_threads, 1);
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+    // Any non-zero seed works for xorshift.
+    workers_.back()->random_state = 0x9E3779B97F4A7C15ull * (i + 1);
+  }
+  // Starts the threads once all the deques exist, since workers steal from
+  // each other.
+  for (int i = 0; i < num_threads; ++i) {
+    workers_[i]->thread.reset(
+        env->StartThread(thread_options, absl::StrCat("tf_", name, "_", i),
+                         [this, i]() { WorkerLoop(i); }));
+  }
+}
+
+WorkStealingThreadPool::~WorkStealingThreadPool() {
+  {
+    mutex_lock l(mu_);
+    cancelled_ = true;
+  }
+  work_available_.notify_all();
+  for (auto& worker : workers_) {
+    // Joins the thread, once it has run all the pending closures.
+    worker->thread.reset();
+  }
+}
+
+void WorkStealingThreadPool::Schedule(std::function<void()> fn) {
+  const PerThread& per_thread = GetPerThread();
+  const int id = per_thread.pool == this
+                     ? per_thread.id
+                     : next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                           workers_.size();
+  {
+    Worker& worker = *workers_[id];
+    mutex_lock l(worker.mu);
+    worker.closures.push_back(std::move(fn));
+  }
+  // Pairs with the check of `num_pending_` after `num_waiting_` is
+  // incremented in `WorkerLoop()`: either the worker sees the new closure, or
+  // this thread sees the waiting worker and wakes it up.
+  num_pending_.fetch_add(1);
+  if (num_waiting_.load() > 0) {
+    mutex_lock l(mu_);
+    work_available_.notify_one();
+  }
+}
+
+int WorkStealingThreadPool::NumThreads() const { return workers_.size(); }
+
+int WorkStealingThreadPool::CurrentThreadId() const {
+  const PerThread& per_thread = GetPerThread();
+  return per_thread.pool == this ? per_thread.id : -1;
+}
+
+void WorkStealingThreadPool::WorkerLoop(int id) {
+  PerThread& per_thread = GetPerThread();
+  per_thread.pool = this;
+  per_thread.id = id;
+  while (true) {
+    std::function<void()> fn = PopLocal(id);
+    if (!fn) {
+      fn = Steal(id);
+    }
+    if (fn) {
+      fn();
+      continue;
+    }
+    mutex_lock l(mu_);
+    num_waiting_.fetch_add(1);
+    while (num_pending_.load() == 0 && !cancelled_) {
+      work_available_.wait(l);
+    }
+    num_waiting_.fetch_sub(1);
+    if (cancelled_ && num_pending_.load() == 0) {
+      return;
+    }
+  }
+}
+
+std::function<void()> WorkStealingThreadPool::PopLocal(int id) {
+  Worker& worker = *workers_[id];
+  mutex_lock l(worker.mu);
+  if (worker.closures.empty()) {
+    return nullptr;
+  }
+  std::function<void()> fn = std::move(worker.closures.back());
+  worker.closures.pop_back();
+  num_pending_.fetch_sub(1, std::memory_order_relaxed);
+  return fn;
+}
+
+std::function<void()> WorkStealingThreadPool::Steal(int id) {
+  const int num_workers = workers_.size();
+  if (num_workers == 1 || num_pending_.load(std::memory_order_relaxed) == 0) {
+    return nullptr;
+  }
+  uint64_t& state = workers_[id]->random_state;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  const int start = state % num_workers;
+  for (int i = 0; i < num_workers; ++i) {
+    const int victim = (start + i) % num_workers;
+    if (victim == id) continue;
+    Worker& worker = *workers_[victim];
+    mutex_lock l(worker.mu);
+    if (!worker.closures.empty()) {
+      std::function<void()> fn = std::move(worker.closures.front());
+      worker.closures.pop_front();
+      num_pending_.fetch_sub(1, std::memory_order_relaxed);
+      return fn;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace tensorflow
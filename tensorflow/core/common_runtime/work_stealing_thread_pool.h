@@ -0,0 +1,90 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_WORK_STEALING_THREAD_POOL_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_WORK_STEALING_THREAD_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/threadpool_interface.h"
+
+namespace tensorflow {
+
+// A thread pool in which each worker thread owns a deque of closures, for
+// scheduling the inter-op closures of executors.
+//
+// Closures scheduled from a worker thread, e.g. the ready successors of the
+// node it just ran, are pushed to the back of its own deque, and the worker
+// runs its closures last-in first-out, so successors tend to run on the
+// thread, and in the cache, where their inputs were produced. Closures
+// scheduled from other threads are spread round-robin over the workers. A
+// worker whose deque is empty steals the oldest closure of the deque of
+// another worker, starting from a random one.
+//
+// The destructor waits until all scheduled closures have run. This class is
+// thread-safe.
+class WorkStealingThreadPool : public thread::ThreadPoolInterface {
+ public:
+  WorkStealingThreadPool(Env* env, const ThreadOptions& thread_options,
+                         const std::string& name, int num_threads);
+  ~WorkStealingThreadPool() override;
+
+  void Schedule(std::function<void()> fn) override;
+  int NumThreads() const override;
+  // Returns the index of the current worker thread, or -1 if the current
+  // thread does not belong to this pool.
+  int CurrentThreadId() const override;
+
+ private:
+  struct Worker {
+    mutex mu;
+    std::deque<std::function<void()>> closures TF_GUARDED_BY(mu);
+    // State of the random number generator that picks the first victim when
+    // stealing. Only accessed by the worker thread.
+    uint64_t random_state;
+    std::unique_ptr<Thread> thread;
+  };
+
+  void WorkerLoop(int id);
+
+  // Pops the most recently pushed closure of worker `id`.
+  std::function<void()> PopLocal(int id);
+
+  // Pops the oldest closure of another worker than `id`.
+  std::function<void()> Steal(int id);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<uint64_t> next_worker_{0};
+
+  // Number of closures in the deques.
+  std::atomic<int64_t> num_pending_{0};
+  // Number of workers waiting on `work_available_`.
+  std::atomic<int> num_waiting_{0};
+  mutex mu_;
+  condition_variable work_available_;
+  bool cancelled_ TF_GUARDED_BY(mu_) = false;
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_WORK_STEALING_THREAD_POOL_H_
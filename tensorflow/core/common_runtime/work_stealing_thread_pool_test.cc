@@ -0,0 +1,123 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/work_stealing_thread_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/platform/blocking_counter.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/notification.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+std::unique_ptr<WorkStealingThreadPool> CreatePool(int num_threads) {
+  return std::make_unique<WorkStealingThreadPool>(
+      Env::Default(), ThreadOptions(), "test", num_threads);
+}
+
+TEST(WorkStealingThreadPoolTest, RunsAllClosures) {
+  constexpr int kNumClosures = 10000;
+  auto pool = CreatePool(4);
+  EXPECT_EQ(pool->NumThreads(), 4);
+  EXPECT_EQ(pool->CurrentThreadId(), -1);
+  std::atomic<int> num_run{0};
+  BlockingCounter counter(kNumClosures);
+  for (int i = 0; i < kNumClosures; ++i) {
+    pool->Schedule([&]() {
+      EXPECT_GE(pool->CurrentThreadId(), 0);
+      EXPECT_LT(pool->CurrentThreadId(), 4);
+      num_run.fetch_add(1);
+      counter.DecrementCount();
+    });
+  }
+  counter.Wait();
+  EXPECT_EQ(num_run.load(), kNumClosures);
+}
+
+TEST(WorkStealingThreadPoolTest, RunsNestedClosures) {
+  // Every closure schedules two more, down to a depth of 10.
+  constexpr int kDepth = 10;
+  auto pool = CreatePool(4);
+  BlockingCounter counter((1 << (kDepth + 1)) - 1);
+  std::function<void(int)> fn = [&](int depth) {
+    if (depth < kDepth) {
+      pool->Schedule([&fn, depth]() { fn(depth + 1); });
+      pool->Schedule([&fn, depth]() { fn(depth + 1); });
+    }
+    counter.DecrementCount();
+  };
+  pool->Schedule([&fn]() { fn(0); });
+  counter.Wait();
+}
+
+TEST(WorkStealingThreadPoolTest, RunsLocalClosuresLastInFirstOut) {
+  auto pool = CreatePool(1);
+  mutex mu;
+  std::vector<int> order;
+  Notification done;
+  pool->Schedule([&]() {
+    for (int i = 0; i < 3; ++i) {
+      pool->Schedule([&, i]() {
+        mutex_lock l(mu);
+        order.push_back(i);
+        if (order.size() == 3) done.Notify();
+      });
+    }
+  });
+  done.WaitForNotification();
+  EXPECT_EQ(order, std::vector<int>({2, 1, 0}));
+}
+
+TEST(WorkStealingThreadPoolTest, IdleThreadsStealClosures) {
+  auto pool = CreatePool(2);
+  Notification stolen;
+  Notification done;
+  pool->Schedule([&]() {
+    const int owner = pool->CurrentThreadId();
+    // The closure is pushed to the deque of this thread, which is busy until
+    // another thread runs it.
+    pool->Schedule([&, owner]() {
+      EXPECT_NE(pool->CurrentThreadId(), owner);
+      stolen.Notify();
+    });
+    stolen.WaitForNotification();
+    done.Notify();
+  });
+  done.WaitForNotification();
+}
+
+TEST(WorkStealingThreadPoolTest, DestructorWaitsForClosures) {
+  constexpr int kNumClosures = 100;
+  std::atomic<int> num_run{0};
+  {
+    auto pool = CreatePool(2);
+    for (int i = 0; i < kNumClosures; ++i) {
+      pool->Schedule([&]() {
+        Env::Default()->SleepForMicroseconds(100);
+        num_run.fetch_add(1);
+      });
+    }
+  }
+  EXPECT_EQ(num_run.load(), kNumClosures);
+}
+
+}  // namespace
+}  // namespace tensorflow
@@ -0,0 +1,74 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+// Builds the record-offset indices of uncompressed TFRecord files, so that
+// `TFRecordDataset` can read them at random positions. Example:
+//
+//   build_tfrecord_index --files='/data/train-*.tfrecord' --num_threads=32
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_split.h"
+#include "tensorflow/core/data/tfrecord_index.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/init_main.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/command_line_flags.h"
+
+int main(int argc, char** argv) {
+  std::string files;
+  int num_threads = 16;
+  std::vector<tensorflow::Flag> flag_list = {
+      tensorflow::Flag("files", &files,
+                       "Comma-separated TFRecord files or glob patterns to "
+                       "index."),
+      tensorflow::Flag("num_threads", &num_threads,
+                       "Number of files to index in parallel."),
+  };
+  bool parse_result = tensorflow::Flags::Parse(&argc, argv, flag_list);
+  if (!parse_result || files.empty()) {
+    std::cerr << tensorflow::Flags::Usage(argv[0], flag_list);
+    return -1;
+  }
+  tensorflow::port::InitMain(argv[0], &argc, &argv);
+
+  tensorflow::Env* env = tensorflow::Env::Default();
+  std::vector<std::string> filenames;
+  const std::vector<std::string> patterns =
+      absl::StrSplit(files, ',', absl::SkipEmpty());
+  for (const std::string& pattern : patterns) {
+    std::vector<std::string> matches;
+    absl::Status status = env->GetMatchingPaths(pattern, &matches);
+    if (!status.ok()) {
+      LOG(ERROR) << "Failed to match " << pattern << ": " << status;
+      return 1;
+    }
+    if (matches.empty()) {
+      LOG(ERROR) << "No files match " << pattern;
+      return 1;
+    }
+    filenames.insert(filenames.end(), matches.begin(), matches.end());
+  }
+
+  absl::Status status =
+      tensorflow::data::BuildTFRecordIndices(env, filenames, num_threads);
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to index TFRecord files: " << status;
+    return 1;
+  }
+  LOG(INFO) << "Indexed " << filenames.size() << " TFRecord files.";
+  return 0;
+}
@@ -23,6 +23,7 @@ limitations under the License.
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/time/clock.h"
 #include "tensorflow/core/common_runtime/function.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
@@ -33,8 +34,10 @@ limitations under the License.
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/function_handle_cache.h"
+#include "tensorflow/core/framework/node_def_util.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/stats_aggregator.h"
+#include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/strings/strcat.h"
@@ -53,6 +56,30 @@ namespace {
 
 constexpr char kAllowSmallFunctionOptimizations[] =
     "allow_small_function_optimizations";
+constexpr char kXlaMustCompileAttr[] = "_XlaMustCompile";
+
+// Returns the type of `arg` of a function instantiated with `func_attrs`, or
+// `DT_INVALID` if it can not be resolved.
+DataType ResolveArgType(const OpDef::ArgDef& arg,
+                        const protobuf::Map<string, AttrValue>& func_attrs) {
+  if (!arg.number_attr().empty() || !arg.type_list_attr().empty()) {
+    return DT_INVALID;
+  }
+  if (arg.type() != DT_INVALID) {
+    return arg.type();
+  }
+  auto it = func_attrs.find(arg.type_attr());
+  if (it == func_attrs.end() || it->second.value_case() != AttrValue::kType) {
+    return DT_INVALID;
+  }
+  return it->second.type();
+}
+
+// Returns whether XLA can compile a function argument of type `dtype`.
+bool IsJitCompatibleType(DataType dtype) {
+  return dtype != DT_INVALID && dtype != DT_STRING && dtype != DT_VARIANT &&
+         dtype != DT_RESOURCE;
+}
 
 // Simplistic implementation of the `StepStatsCollectorInterface` that only
 // cares about collecting the CPU time needed to execute a captured function.
@@ -258,6 +285,58 @@ absl::Status LookupFunction(const FunctionLibraryDefinition& lib_def,
   return absl::OkStatus();
 }
 
+// Returns an error naming the first op reachable from `func` that has no
+// kernel on `jit_device_type`, the device XLA compiles for.
+absl::Status CheckXlaKernels(const FunctionLibraryDefinition& lib_def,
+                             const NameAttrList& func,
+                             const DeviceType& jit_device_type) {
+  const FunctionDef* fdef;
+  TF_RETURN_IF_ERROR(LookupFunction(lib_def, func.name(), &fdef));
+  InstantiationResult result;
+  TF_RETURN_IF_ERROR(InstantiateFunction(
+      *fdef, AttrSlice(&func.attr()),
+      [&lib_def](const string& op, const OpDef** sig) {
+        return lib_def.LookUpOpDef(op, sig);
+      },
+      &result));
+  for (NodeDef& node : result.nodes) {
+    if (node.op() == FunctionLibraryDefinition::kArgOp ||
+        node.op() == FunctionLibraryDefinition::kRetOp) {
+      continue;
+    }
+    // Functions passed as attributes, e.g. to control flow ops, are compiled
+    // along with the op.
+    for (const auto& attr : node.attr()) {
+      if (attr.second.has_func()) {
+        TF_RETURN_IF_ERROR(
+            CheckXlaKernels(lib_def, attr.second.func(), jit_device_type));
+      }
+      for (const NameAttrList& attr_func : attr.second.list().func()) {
+        TF_RETURN_IF_ERROR(
+            CheckXlaKernels(lib_def, attr_func, jit_device_type));
+      }
+    }
+    if (lib_def.Find(node.op()) != nullptr) {
+      NameAttrList call;
+      call.set_name(node.op());
+      *call.mutable_attr() = node.attr();
+      TF_RETURN_IF_ERROR(CheckXlaKernels(lib_def, call, jit_device_type));
+      continue;
+    }
+    const OpDef* op_def;
+    TF_RETURN_IF_ERROR(lib_def.LookUpOpDef(node.op(), &op_def));
+    AddDefaultsToNodeDef(*op_def, &node);
+    if (!FindKernelDef(jit_device_type, node, /*def=*/nullptr,
+                       /*kernel_class_name=*/nullptr)
+             .ok()) {
+      return errors::Unimplemented("op ", node.op(), " of ", func.name(),
+                                   " has no ", jit_device_type.type(),
+                                   " kernel");
+    }
+  }
+  return absl::OkStatus();
+}
+
 class CallFrameBase : public CallFrameInterface {
  public:
   explicit CallFrameBase(DataTypeSlice ret_types)
@@ -480,9 +559,78 @@ absl::Status FunctionMetadata::Create(
       return absl::OkStatus();
     }
   }
+  if (params.jit_compile) {
+    TF_RETURN_IF_ERROR((*out_metadata)->MaybeCreateJitFunction(*fdef));
+  }
   return absl::OkStatus();
 }
 
+absl::Status FunctionMetadata::MaybeCreateJitFunction(const FunctionDef& fdef) {
+  const OpDef& signature = fdef.signature();
+  if (!short_circuit_info_.indices.empty()) {
+    VLOG(1) << "Not compiling " << signature.name()
+            << " with XLA because it only forwards its arguments.";
+    return absl::OkStatus();
+  }
+  if (signature.is_stateful()) {
+    VLOG(1) << "Not compiling " << signature.name()
+            << " with XLA because it is stateful.";
+    return absl::OkStatus();
+  }
+  DataTypeVector input_types;
+  DataTypeVector output_types;
+  for (const auto& arg : signature.input_arg()) {
+    input_types.push_back(ResolveArgType(arg, func_.attr()));
+  }
+  for (const auto& arg : signature.output_arg()) {
+    output_types.push_back(ResolveArgType(arg, func_.attr()));
+  }
+  if (!absl::c_all_of(input_types, IsJitCompatibleType) ||
+      !absl::c_all_of(output_types, IsJitCompatibleType)) {
+    VLOG(1) << "Not compiling " << signature.name()
+            << " with XLA because it has arguments of types "
+            << DataTypeVectorString(input_types) << " -> "
+            << DataTypeVectorString(output_types) << ".";
+    return absl::OkStatus();
+  }
+
+  // The wrapper has the signature of the function, with the attributes of
+  // `func_` applied, and a single call node that XLA compiles.
+  FunctionDef jit_fdef;
+  OpDef* jit_signature = jit_fdef.mutable_signature();
+  jit_signature->set_name(
+      lib_def_->UniqueFunctionName(strings::StrCat(signature.name(), "_jit")));
+  NodeDef* call = jit_fdef.add_node_def();
+  call->set_name("call");
+  call->set_op("PartitionedCall");
+  for (int i = 0; i < signature.input_arg_size(); ++i) {
+    OpDef::ArgDef* arg = jit_signature->add_input_arg();
+    arg->set_name(signature.input_arg(i).name());
+    arg->set_type(input_types[i]);
+    call->add_input(arg->name());
+  }
+  for (int i = 0; i < signature.output_arg_size(); ++i) {
+    OpDef::ArgDef* arg = jit_signature->add_output_arg();
+    arg->set_name(signature.output_arg(i).name());
+    arg->set_type(output_types[i]);
+    (*jit_fdef.mutable_ret())[arg->name()] =
+        strings::StrCat(call->name(), ":output:", i);
+  }
+  *jit_fdef.mutable_arg_attr() = fdef.arg_attr();
+  AddNodeAttr("Tin", input_types, call);
+  AddNodeAttr("Tout", output_types, call);
+  AddNodeAttr("f", func_, call);
+  AddNodeAttr("config", "", call);
+  AddNodeAttr("config_proto", "", call);
+  AddNodeAttr("executor_type", "", call);
+  AddNodeAttr(kXlaMustCompileAttr, true, call);
+
+  jit_func_.set_name(jit_signature->name());
+  VLOG(1) << "Compiling " << signature.name() << " with XLA through "
+          << jit_func_.name() << ".";
+  return lib_def_->AddFunctionDef(std::move(jit_fdef));
+}
+
 /* static */
 absl::Status CapturedFunction::Create(
     OpKernelContext* ctx, std::shared_ptr<const FunctionMetadata> metadata,
@@ -665,15 +813,38 @@ absl::Status CapturedFunction::Instantiate(
 #endif  // !IS_MOBILE_PLATFORM
   }
 
+  // The XLA-compiled wrapper has the same arguments as the function, so the
+  // options computed above apply to either.
+  auto instantiate = [&](const NameAttrList& func,
+                         FunctionLibraryRuntime::Handle* f_handle) {
+    if (params.function_handle_cache) {
+      return params.function_handle_cache->Instantiate(
+          func.name(), AttrSlice(&func.attr()), inst_opts, f_handle);
+    }
+    return lib->Instantiate(func.name(), AttrSlice(&func.attr()), inst_opts,
+                            f_handle);
+  };
+  bool jit_compile = metadata_->jit_compile();
   FunctionLibraryRuntime::Handle f_handle;
-  if (params.function_handle_cache) {
-    TF_RETURN_IF_ERROR(params.function_handle_cache->Instantiate(
-        metadata_->func().name(), AttrSlice(&metadata_->func().attr()),
-        inst_opts, &f_handle));
-  } else {
-    TF_RETURN_IF_ERROR(lib->Instantiate(metadata_->func().name(),
-                                        AttrSlice(&metadata_->func().attr()),
-                                        inst_opts, &f_handle));
+  TF_RETURN_IF_ERROR(instantiate(
+      jit_compile ? metadata_->jit_func() : metadata_->func(), &f_handle));
+  if (jit_compile) {
+    // The wrapper must compile, so run the function by the executor instead
+    // if XLA has no kernel for one of its ops. Creating the kernel of the
+    // wrapper above registers the XLA kernels when XLA JIT is linked in.
+    absl::Status s = CheckXlaKernels(
+        *metadata_->lib_def(), metadata_->func(),
+        DeviceType(strings::StrCat("XLA_", lib->device()->device_type(),
+                                   "_JIT")));
+    if (!s.ok()) {
+      VLOG(1) << "Running " << metadata_->func().name()
+              << " without XLA because " << s.message() << ".";
+      if (!params.function_handle_cache) {
+        TF_RETURN_IF_ERROR(lib->ReleaseHandle(f_handle));
+      }
+      jit_compile = false;
+      TF_RETURN_IF_ERROR(instantiate(metadata_->func(), &f_handle));
+    }
   }
 
   DataTypeVector ret_types;
@@ -683,7 +854,8 @@ absl::Status CapturedFunction::Instantiate(
   TF_RETURN_IF_ERROR(IsMultiDevice(lib, &is_multi_device));
   *instantiated_captured_function = absl::WrapUnique(
       new InstantiatedCapturedFunction(lib, f_handle, std::move(ret_types),
-                                       *params.runner, this, is_multi_device));
+                                       *params.runner, this, is_multi_device,
+                                       jit_compile));
   return absl::OkStatus();
 }
 
@@ -779,13 +951,14 @@ absl::Status CapturedFunction::IsMultiDevice(FunctionLibraryRuntime* flr,
 InstantiatedCapturedFunction::InstantiatedCapturedFunction(
     FunctionLibraryRuntime* lib, FunctionLibraryRuntime::Handle f_handle,
     DataTypeVector ret_types, std::function<void(std::function<void()>)> runner,
-    CapturedFunction* captured_func, bool is_multi_device)
+    CapturedFunction* captured_func, bool is_multi_device, bool jit_compile)
     : lib_(lib),
       f_handle_(f_handle),
       ret_types_(std::move(ret_types)),
       captured_runner_(std::move(runner)),
       captured_func_(captured_func),
-      is_multi_device_(is_multi_device) {}
+      is_multi_device_(is_multi_device),
+      jit_compile_(jit_compile) {}
 
 absl::Status InstantiatedCapturedFunction::Run(
     IteratorContext* ctx, std::vector<Tensor>&& args,
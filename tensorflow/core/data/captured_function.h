@@ -71,6 +71,9 @@ class FunctionMetadata {
   struct Params {
     bool use_inter_op_parallelism = true;
     bool use_default_device = true;
+    // Whether to compile the function with XLA, if it is compatible. See
+    // `jit_compile()`.
+    bool jit_compile = false;
   };
 
   // Creates a new instance of the `FunctionMetadata` class, fetching function
@@ -108,13 +111,28 @@ class FunctionMetadata {
   // Indicates whether the function should a multi-device function backend.
   bool use_multi_device_function() const { return use_multi_device_function_; }
 
+  // Indicates whether the function may be instantiated through `jit_func()`,
+  // a wrapper that calls it with the `_XlaMustCompile` attribute. The wrapper
+  // is only used if XLA JIT is linked in and has kernels for every op of the
+  // function, in which case the call is compiled to a single executable that
+  // XLA caches per input shape.
+  bool jit_compile() const { return !jit_func_.name().empty(); }
+
+  // Returns the XLA-compiled wrapper of `func()`, if `jit_compile()`.
+  const NameAttrList& jit_func() const { return jit_func_; }
+
  private:
   FunctionMetadata(NameAttrList&& func, Params params)
       : func_(std::move(func)),
         use_default_device_(params.use_default_device),
         use_inter_op_parallelism_(params.use_inter_op_parallelism) {}
 
+  // Adds the XLA-compiled wrapper of `fdef` to `lib_def_`, unless `fdef` has
+  // arguments that XLA can not compile or nothing to compile.
+  absl::Status MaybeCreateJitFunction(const FunctionDef& fdef);
+
   NameAttrList func_;
+  NameAttrList jit_func_;
   std::unique_ptr<FunctionLibraryDefinition> lib_def_ = nullptr;
   ShortCircuitInfo short_circuit_info_;
   bool use_default_device_ = true;
@@ -207,6 +225,10 @@ class CapturedFunction {
     return metadata_->use_inter_op_parallelism();
   }
 
+  // Indicates whether the function may be compiled with XLA. See
+  // `InstantiatedCapturedFunction::jit_compile()` for whether it is.
+  bool jit_compile() const { return metadata_->jit_compile(); }
+
  private:
   CapturedFunction(std::shared_ptr<const FunctionMetadata> metadata,
                    std::vector<Tensor> captured_inputs);
@@ -304,6 +326,10 @@ class InstantiatedCapturedFunction {
 
   std::string func_name() const { return captured_func_->func().name(); }
 
+  // Indicates whether the function runs through the XLA-compiled wrapper of
+  // the captured function.
+  bool jit_compile() const { return jit_compile_; }
+
  private:
   friend class CapturedFunction;
 
@@ -311,7 +337,7 @@ class InstantiatedCapturedFunction {
       FunctionLibraryRuntime* lib, FunctionLibraryRuntime::Handle f_handle,
       DataTypeVector ret_types,
       std::function<void(std::function<void()>)> runner,
-      CapturedFunction* captured_func, bool is_multi_device);
+      CapturedFunction* captured_func, bool is_multi_device, bool jit_compile);
 
   // Determines whether a rendezvous object should be created when running the
   // instantiated function.
@@ -325,6 +351,7 @@ class InstantiatedCapturedFunction {
   std::function<void(std::function<void()>)> captured_runner_;
   CapturedFunction* const captured_func_;  // Not owned.
   const bool is_multi_device_;
+  const bool jit_compile_;
 
   InstantiatedCapturedFunction(const InstantiatedCapturedFunction&) = delete;
   void operator=(const InstantiatedCapturedFunction&) = delete;
@@ -28,6 +28,7 @@ limitations under the License.
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_join.h"
@@ -53,6 +54,7 @@ limitations under the License.
 #include "tensorflow/core/platform/regexp.h"
 #include "tensorflow/core/platform/status.h"
 #include "tensorflow/core/platform/tstring.h"
+#include "tensorflow/core/util/batch_util.h"
 #include "tensorflow/core/util/determinism.h"
 #include "tensorflow/core/util/work_sharder.h"
 
@@ -792,6 +794,118 @@ absl::Status ProcessBatch(int64_t batch_size, int64_t num_elements,
   return absl::OkStatus();
 }
 
+namespace {
+
+// Runs `copy_element_fn(i)` for every `i` in [0, num_batch_elements). The
+// copies are spread over the runner threads of `ctx` if `parallel_copy` is set
+// and the batch is at least 1MB.
+absl::Status CopyBatchElements(
+    const AnyContext& ctx, int64_t num_batch_elements, bool parallel_copy,
+    int64_t total_bytes,
+    const std::function<absl::Status(int64_t)>& copy_element_fn) {
+  if (parallel_copy && total_bytes >= (1 << 20)) {
+    absl::Status status;
+    mutex status_mu;
+    const auto num_threads = ctx.runner_threadpool_size;
+    const auto slice_size = num_batch_elements / num_threads;
+    int64_t offset = 0;
+    BlockingCounter counter(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+      int64_t length = slice_size;
+      // When the number of threads does not divide the number of elements
+      // evenly, the size of some slices is incremented to guarantee their
+      // sizes add up to the total number of elements.
+      if (i < num_batch_elements % num_threads) ++length;
+      (*ctx.runner)([offset, length, &status, &status_mu, &counter,
+                     &copy_element_fn]() {
+        absl::Status s;
+        for (size_t j = offset; j < offset + length; ++j) {
+          s.Update(copy_element_fn(j));
+        }
+        {
+          mutex_lock l(status_mu);
+          status.Update(s);
+        }
+        counter.DecrementCount();
+      });
+      offset += length;
+    }
+    counter.Wait();
+    return status;
+  }
+  for (size_t i = 0; i < num_batch_elements; ++i) {
+    TF_RETURN_IF_ERROR(copy_element_fn(i));
+  }
+  return absl::OkStatus();
+}
+
+// Batches component `component_index` of `batch_elements` into `values`, the
+// concatenation of the elements along their first dimension, and `row_splits`,
+// the offsets of the elements in `values`.
+absl::Status CopyRaggedComponent(
+    const AnyContext& ctx, std::vector<std::vector<Tensor>>& batch_elements,
+    size_t component_index, bool parallel_copy, Tensor* values,
+    Tensor* row_splits) {
+  const int64_t num_batch_elements = batch_elements.size();
+  const Tensor& first_element = batch_elements.at(0)[component_index];
+  if (first_element.dims() < 1) {
+    return errors::InvalidArgument(
+        "Cannot batch scalars as ragged tensors in component ",
+        component_index, ".");
+  }
+  TensorShape row_shape(first_element.shape());
+  row_shape.RemoveDim(0);
+  *row_splits = Tensor(ctx.allocator, DT_INT64,
+                       TensorShape({num_batch_elements + 1}));
+  if (!row_splits->IsInitialized()) {
+    return errors::ResourceExhausted(
+        "Failed to allocate memory for the row splits of component ",
+        component_index);
+  }
+  auto splits = row_splits->vec<int64_t>();
+  splits(0) = 0;
+  int64_t total_bytes = 0;
+  for (int64_t i = 0; i < num_batch_elements; ++i) {
+    const Tensor& element = batch_elements[i][component_index];
+    TensorShape element_row_shape(element.shape());
+    if (element.dims() >= 1) element_row_shape.RemoveDim(0);
+    if (element.dims() < 1 || element_row_shape != row_shape) {
+      return errors::InvalidArgument(
+          "Cannot batch tensors whose rows have different shapes in component ",
+          component_index, ". First element had shape ",
+          first_element.shape().DebugString(), " and element ", i,
+          " had shape ", element.shape().DebugString(), ".");
+    }
+    splits(i + 1) = splits(i) + element.dim_size(0);
+    total_bytes += element.AllocatedBytes();
+  }
+
+  TensorShape values_shape({splits(num_batch_elements)});
+  values_shape.AppendShape(row_shape);
+  *values = Tensor(ctx.allocator, first_element.dtype(), values_shape);
+  if (!values->IsInitialized()) {
+    return errors::ResourceExhausted(
+        "Failed to allocate memory for the values of component ",
+        component_index);
+  }
+  // Each element is copied (or, for uniquely referenced strings and variants,
+  // moved) into its rows of the preallocated `values` tensor.
+  auto copy_element_fn = [component_index, &batch_elements, &splits,
+                          values](int64_t index) {
+    Tensor& element = batch_elements.at(index)[component_index];
+    if (element.dim_size(0) == 0) {
+      return absl::OkStatus();
+    }
+    return batch_util::MaybeMoveContiguousSlices(
+        element, /*src_offset=*/0, /*dst_offset=*/splits(index),
+        /*num_slices=*/element.dim_size(0), values);
+  };
+  return CopyBatchElements(ctx, num_batch_elements, parallel_copy, total_bytes,
+                           copy_element_fn);
+}
+
+}  // namespace
+
 absl::Status CopyBatch(AnyContext ctx,
                        std::vector<std::vector<Tensor>>&& batch_elements,
                        bool parallel_copy, std::vector<Tensor>* out_tensors) {
@@ -820,7 +934,7 @@ absl::Status CopyBatch(AnyContext ctx,
     // Build the output tuple component by copying one slice from each input
     // element in the batch.
     auto copy_element_fn = [component_index, &batch_elements, &batch_component,
-                            &first_element_shape](int index) {
+                            &first_element_shape](int64_t index) {
       if (batch_elements.at(index)[component_index].shape() !=
           first_element_shape) {
         return errors::InvalidArgument(
@@ -837,43 +951,58 @@ absl::Status CopyBatch(AnyContext ctx,
     };
     const auto total_bytes =
         first_element.AllocatedBytes() * num_batch_elements;
-    // Use parallelism for creating the batch as long as the final batch is at
-    // least 1MB.
-    if (parallel_copy && total_bytes >= (1 << 20)) {
-      absl::Status status;
-      mutex status_mu;
-      const auto num_threads = ctx.runner_threadpool_size;
-      const auto slice_size = num_batch_elements / num_threads;
-      int64_t offset = 0;
-      BlockingCounter counter(num_threads);
-      for (size_t i = 0; i < num_threads; ++i) {
-        int64_t length = slice_size;
-        // When the number of threads does not divide the number of elements
-        // evenly, the size of some slices is incremented to guarantee their
-        // sizes add up to the total number of elements.
-        if (i < num_batch_elements % num_threads) ++length;
-        (*ctx.runner)([offset, length, &status, &status_mu, &counter,
-                       &copy_element_fn]() {
-          absl::Status s;
-          for (size_t j = offset; j < offset + length; ++j) {
-            s.Update(copy_element_fn(j));
-          }
-          {
-            mutex_lock l(status_mu);
-            status.Update(s);
-          }
-          counter.DecrementCount();
-        });
-        offset += length;
-      }
-      counter.Wait();
-      TF_RETURN_IF_ERROR(status);
-    } else {
-      for (size_t i = 0; i < num_batch_elements; ++i) {
-        TF_RETURN_IF_ERROR(copy_element_fn(i));
+    TF_RETURN_IF_ERROR(CopyBatchElements(ctx, num_batch_elements,
+                                         parallel_copy, total_bytes,
+                                         copy_element_fn));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status CopyRaggedBatch(AnyContext ctx,
+                             std::vector<std::vector<Tensor>>&& batch_elements,
+                             const std::vector<bool>& ragged_components,
+                             bool parallel_copy,
+                             std::vector<Tensor>* out_tensors) {
+  const size_t num_tuple_components = batch_elements.at(0).size();
+  if (ragged_components.size() != num_tuple_components) {
+    return errors::InvalidArgument(
+        "Expected ", ragged_components.size(), " components but got ",
+        num_tuple_components, ".");
+  }
+  // Batches the dense components first, as one tuple.
+  std::vector<std::vector<Tensor>> dense_elements(batch_elements.size());
+  for (size_t i = 0; i < batch_elements.size(); ++i) {
+    for (size_t component_index = 0; component_index < num_tuple_components;
+         ++component_index) {
+      if (!ragged_components[component_index]) {
+        dense_elements[i].push_back(
+            std::move(batch_elements[i][component_index]));
       }
     }
   }
+  std::vector<Tensor> dense_batch;
+  if (!dense_elements[0].empty()) {
+    TF_RETURN_IF_ERROR(CopyBatch(ctx, std::move(dense_elements),
+                                 parallel_copy, &dense_batch));
+  }
+
+  out_tensors->clear();
+  out_tensors->reserve(num_tuple_components +
+                       absl::c_count(ragged_components, true));
+  size_t dense_index = 0;
+  for (size_t component_index = 0; component_index < num_tuple_components;
+       ++component_index) {
+    if (!ragged_components[component_index]) {
+      out_tensors->push_back(std::move(dense_batch[dense_index++]));
+      continue;
+    }
+    Tensor values, row_splits;
+    TF_RETURN_IF_ERROR(CopyRaggedComponent(ctx, batch_elements,
+                                           component_index, parallel_copy,
+                                           &values, &row_splits));
+    out_tensors->push_back(std::move(values));
+    out_tensors->push_back(std::move(row_splits));
+  }
   return absl::OkStatus();
 }
 
@@ -1009,6 +1138,10 @@ REGISTER_DATASET_EXPERIMENT("min_outer_interleave_parallelism",
                             RandomJobSamplePercentage<0>, AllTasks);
 REGISTER_DATASET_EXPERIMENT("reduce_interleave_prefetch",
                             RandomJobSamplePercentage<0>, AllTasks);
+REGISTER_DATASET_EXPERIMENT("adaptive_interleave_cycle",
+                            RandomJobSamplePercentage<0>, AllTasks);
+REGISTER_DATASET_EXPERIMENT("jit_compile_map", RandomJobSamplePercentage<0>,
+                            AllTasks);
 REGISTER_DATASET_EXPERIMENT("serialize_input_cycle_length",
                             RandomJobSamplePercentage<0>, AllTasks);
 REGISTER_DATASET_EXPERIMENT("stage_based_autotune",
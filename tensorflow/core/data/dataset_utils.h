@@ -296,6 +296,20 @@ absl::Status CopyBatch(AnyContext ctx,
                        std::vector<std::vector<Tensor>>&& batch_elements,
                        bool parallel_copy, std::vector<Tensor>* out_tensors);
 
+// Copies the input elements to a batch in which the components marked in
+// `ragged_components` are batched as ragged tensors.
+//
+// A ragged component is output as two tensors: `values`, the elements
+// concatenated along their first dimension, and the int64 vector `row_splits`,
+// such that element `i` is `values[row_splits[i]:row_splits[i + 1]]`. The
+// elements of a ragged component may differ in their first dimension only. The
+// other components are batched as in `CopyBatch`.
+absl::Status CopyRaggedBatch(AnyContext ctx,
+                             std::vector<std::vector<Tensor>>&& batch_elements,
+                             const std::vector<bool>& ragged_components,
+                             bool parallel_copy,
+                             std::vector<Tensor>* out_tensors);
+
 // Computes the set of experiments to apply based on the job name, task id,
 // rollout percentage of registered experiments, and the
 // TF_DATA_EXPERIMENT_OPT_IN and TF_DATA_EXPERIMENT_OPT_OUT environment
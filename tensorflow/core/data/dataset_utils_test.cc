@@ -18,9 +18,13 @@ limitations under the License.
 #include <functional>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "xla/tsl/util/determinism_test_util.h"
 #include "tensorflow/core/data/compression_utils.h"
 #include "tensorflow/core/data/dataset_test_base.h"
@@ -31,12 +35,15 @@ limitations under the License.
 #include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/function.pb.h"
 #include "tensorflow/core/framework/node_def_builder.h"
+#include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/types.pb.h"
 #include "tensorflow/core/framework/variant.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/str_util.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/threadpool.h"
 #include "tensorflow/core/protobuf/error_codes.pb.h"
 #include "tensorflow/core/util/work_sharder.h"
 #include "tsl/platform/status_matchers.h"
@@ -748,6 +755,162 @@ TEST(DatasetUtilsTest, CountBytes) {
   EXPECT_EQ(GetTotalBytes(compressed), compressed_element.ByteSizeLong());
 }
 
+TEST(DatasetUtilsTest, CopyRaggedBatch) {
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TestContext> test_ctx,
+                          TestContext::Create());
+  std::vector<std::vector<Tensor>> batch_elements = {
+      {CreateTensor<int64_t>(TensorShape{2}, {1, 2}),
+       CreateTensor<tstring>(TensorShape{1, 2}, {"a", "b"}),
+       CreateTensor<int64_t>(TensorShape{}, {10})},
+      {CreateTensor<int64_t>(TensorShape{0}, {}),
+       CreateTensor<tstring>(TensorShape{2, 2}, {"c", "d", "e", "f"}),
+       CreateTensor<int64_t>(TensorShape{}, {20})},
+      {CreateTensor<int64_t>(TensorShape{3}, {3, 4, 5}),
+       CreateTensor<tstring>(TensorShape{0, 2}, {}),
+       CreateTensor<int64_t>(TensorShape{}, {30})}};
+  std::vector<Tensor> out_tensors;
+  TF_ASSERT_OK(CopyRaggedBatch(AnyContext(test_ctx->iter_ctx()),
+                               std::move(batch_elements),
+                               /*ragged_components=*/{true, true, false},
+                               /*parallel_copy=*/false, &out_tensors));
+  ASSERT_EQ(out_tensors.size(), 5);
+  test::ExpectEqual(out_tensors[0],
+                    CreateTensor<int64_t>(TensorShape{5}, {1, 2, 3, 4, 5}));
+  test::ExpectEqual(out_tensors[1],
+                    CreateTensor<int64_t>(TensorShape{4}, {0, 2, 2, 5}));
+  test::ExpectEqual(out_tensors[2],
+                    CreateTensor<tstring>(TensorShape{3, 2},
+                                          {"a", "b", "c", "d", "e", "f"}));
+  test::ExpectEqual(out_tensors[3],
+                    CreateTensor<int64_t>(TensorShape{4}, {0, 1, 3, 3}));
+  test::ExpectEqual(out_tensors[4],
+                    CreateTensor<int64_t>(TensorShape{3}, {10, 20, 30}));
+}
+
+TEST(DatasetUtilsTest, CopyRaggedBatchWithDifferentRowShapes) {
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TestContext> test_ctx,
+                          TestContext::Create());
+  std::vector<std::vector<Tensor>> batch_elements = {
+      {CreateTensor<int64_t>(TensorShape{1, 2}, {1, 2})},
+      {CreateTensor<int64_t>(TensorShape{1, 3}, {3, 4, 5})}};
+  std::vector<Tensor> out_tensors;
+  EXPECT_THAT(CopyRaggedBatch(AnyContext(test_ctx->iter_ctx()),
+                              std::move(batch_elements),
+                              /*ragged_components=*/{true},
+                              /*parallel_copy=*/false, &out_tensors),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       HasSubstr("rows have different shapes")));
+}
+
+TEST(DatasetUtilsTest, CopyRaggedBatchOfScalars) {
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TestContext> test_ctx,
+                          TestContext::Create());
+  std::vector<std::vector<Tensor>> batch_elements = {
+      {CreateTensor<int64_t>(TensorShape{}, {1})}};
+  std::vector<Tensor> out_tensors;
+  EXPECT_THAT(CopyRaggedBatch(AnyContext(test_ctx->iter_ctx()),
+                              std::move(batch_elements),
+                              /*ragged_components=*/{true},
+                              /*parallel_copy=*/false, &out_tensors),
+              StatusIs(absl::StatusCode::kInvalidArgument,
+                       HasSubstr("scalars")));
+}
+
+// Batches `batch_size` sequences whose lengths vary in [1, 128]. If `ragged` is
+// false, the sequences are padded to the maximum length beforehand and batched
+// densely, which is what batching ragged inputs costs without
+// ragged support (excluding the conversion to and from variants).
+template <typename T>
+void CopyRaggedBatchBenchmark(::testing::benchmark::State& state,
+                              bool ragged) {
+  const int64_t batch_size = state.range(0);
+  const bool parallel_copy = state.range(1);
+  constexpr int64_t kMaxLength = 128;
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TestContext> test_ctx,
+                          TestContext::Create());
+  thread::ThreadPool thread_pool(Env::Default(), "copy_ragged_batch",
+                                 /*num_threads=*/8);
+  std::function<void(std::function<void()>)> runner =
+      [&thread_pool](std::function<void()> fn) {
+        thread_pool.Schedule(std::move(fn));
+      };
+  AnyContext ctx(test_ctx->iter_ctx());
+  ctx.runner = &runner;
+  ctx.runner_threadpool_size = thread_pool.NumThreads();
+
+  std::vector<Tensor> sequences;
+  int64_t num_values = 0;
+  for (int64_t i = 0; i < batch_size; ++i) {
+    const int64_t length = ragged ? 1 + (i * 7919) % kMaxLength : kMaxLength;
+    Tensor sequence(DataTypeToEnum<T>::value, TensorShape({length}));
+    auto flat = sequence.flat<T>();
+    for (int64_t j = 0; j < length; ++j) {
+      if constexpr (std::is_same_v<T, tstring>) {
+        flat(j) = absl::StrCat("token_", j);
+      } else {
+        flat(j) = j;
+      }
+    }
+    num_values += length;
+    sequences.push_back(std::move(sequence));
+  }
+
+  for (auto s : state) {
+    state.PauseTiming();
+    std::vector<std::vector<Tensor>> batch_elements;
+    batch_elements.reserve(batch_size);
+    for (const Tensor& sequence : sequences) {
+      // Deep copies, so that every iteration batches uniquely referenced
+      // tensors like the ones produced by an input pipeline.
+      batch_elements.push_back({tensor::DeepCopy(sequence)});
+    }
+    std::vector<Tensor> out_tensors;
+    state.ResumeTiming();
+    if (ragged) {
+      TF_CHECK_OK(CopyRaggedBatch(ctx, std::move(batch_elements),
+                                  /*ragged_components=*/{true}, parallel_copy,
+                                  &out_tensors));
+    } else {
+      TF_CHECK_OK(CopyBatch(ctx, std::move(batch_elements), parallel_copy,
+                            &out_tensors));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * num_values);
+}
+
+void BM_CopyRaggedBatchInt64(::testing::benchmark::State& state) {
+  CopyRaggedBatchBenchmark<int64_t>(state, /*ragged=*/true);
+}
+
+void BM_CopyPaddedBatchInt64(::testing::benchmark::State& state) {
+  CopyRaggedBatchBenchmark<int64_t>(state, /*ragged=*/false);
+}
+
+void BM_CopyRaggedBatchString(::testing::benchmark::State& state) {
+  CopyRaggedBatchBenchmark<tstring>(state, /*ragged=*/true);
+}
+
+void BM_CopyPaddedBatchString(::testing::benchmark::State& state) {
+  CopyRaggedBatchBenchmark<tstring>(state, /*ragged=*/false);
+}
+
+BENCHMARK(BM_CopyRaggedBatchInt64)
+    ->ArgPair(32, 0)
+    ->ArgPair(1024, 0)
+    ->ArgPair(1024, 1);
+BENCHMARK(BM_CopyPaddedBatchInt64)
+    ->ArgPair(32, 0)
+    ->ArgPair(1024, 0)
+    ->ArgPair(1024, 1);
+BENCHMARK(BM_CopyRaggedBatchString)
+    ->ArgPair(32, 0)
+    ->ArgPair(1024, 0)
+    ->ArgPair(1024, 1);
+BENCHMARK(BM_CopyPaddedBatchString)
+    ->ArgPair(32, 0)
+    ->ArgPair(1024, 0)
+    ->ArgPair(1024, 1);
+
 TEST_F(DatasetOpsTestBase, TestVariantEqualityChecking) {
   Tensor scalar_0{DT_VARIANT, TensorShape({})};
   scalar_0.scalar<Variant>()() = TestVariant({CreateTensor<int64_t>({}, {0})});
@@ -0,0 +1,413 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/incremental_checkpoint.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/data/serialization_utils.h"
+#include "tensorflow/core/data/snapshot_utils.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/variant_tensor_data.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/threadpool.h"
+#include "tensorflow/core/platform/tstring.h"
+#include "tensorflow/core/profiler/lib/traceme.h"
+#include "tsl/platform/statusor.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+constexpr char kCheckpointPrefix[] = "checkpoint_";
+constexpr char kTempSuffix[] = ".tmp";
+constexpr int64_t kVersion = 1;
+constexpr int64_t kHeaderSize = 3;
+// The number of tensors preceding the values in a checkpoint file.
+constexpr int64_t kNumMetadataTensors = 3;
+// Tensors up to this size are compared by value to find unchanged entries.
+constexpr int64_t kMaxComparedBytes = 4 << 10;  // 4KB
+
+using Key = std::pair<std::string, std::string>;
+using State = std::map<Key, Tensor>;
+
+// Returns whether `a` and `b` are known to hold the same value.
+bool IsUnchanged(const Tensor& a, const Tensor& b) {
+  if (a.dtype() != b.dtype() || a.shape() != b.shape()) {
+    return false;
+  }
+  const absl::string_view a_data = a.tensor_data();
+  const absl::string_view b_data = b.tensor_data();
+  if (a_data.data() == b_data.data()) {
+    // The previous value is still referenced, so its buffer can not have been
+    // reused for a different one.
+    return true;
+  }
+  if (a.TotalBytes() > kMaxComparedBytes) {
+    return false;
+  }
+  if (DataTypeCanUseMemcpy(a.dtype())) {
+    return a_data == b_data;
+  }
+  if (a.dtype() == DT_STRING) {
+    const auto a_flat = a.flat<tstring>();
+    const auto b_flat = b.flat<tstring>();
+    for (int64_t i = 0; i < a_flat.size(); ++i) {
+      if (a_flat(i) != b_flat(i)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+// Returns the entries of the `VariantTensorData`s written by a
+// `VariantTensorDataWriter`.
+absl::StatusOr<State> ToState(
+    const std::vector<const VariantTensorData*>& data) {
+  State state;
+  for (const VariantTensorData* d : data) {
+    std::string metadata;
+    d->get_metadata(&metadata);
+    std::vector<std::string> keys =
+        absl::StrSplit(metadata, kVariantTensorDataKeyDelimiter,
+                       absl::SkipEmpty());
+    if (keys.empty() || keys.size() - 1 != d->tensors_size()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Invalid iterator state with metadata ", metadata, " and ",
+          d->tensors_size(), " tensors."));
+    }
+    for (size_t i = 1; i < keys.size(); ++i) {
+      state[{keys[0], keys[i]}] = d->tensors(i - 1);
+    }
+  }
+  return state;
+}
+
+absl::StatusOr<std::vector<std::unique_ptr<VariantTensorData>>> FromState(
+    const State& state) {
+  VariantTensorDataWriter writer;
+  for (const auto& [key, value] : state) {
+    TF_RETURN_IF_ERROR(writer.WriteTensor(key.first, key.second, value));
+  }
+  std::vector<std::unique_ptr<VariantTensorData>> data;
+  writer.ReleaseData(&data);
+  return data;
+}
+
+Tensor KeysTensor(const std::vector<Key>& keys) {
+  Tensor tensor(DT_STRING, TensorShape({static_cast<int64_t>(keys.size()), 2}));
+  auto matrix = tensor.matrix<tstring>();
+  for (size_t i = 0; i < keys.size(); ++i) {
+    matrix(i, 0) = keys[i].first;
+    matrix(i, 1) = keys[i].second;
+  }
+  return tensor;
+}
+
+absl::StatusOr<std::vector<Key>> KeysFromTensor(const Tensor& tensor) {
+  if (tensor.dtype() != DT_STRING || tensor.dims() != 2 ||
+      tensor.dim_size(1) != 2) {
+    return absl::DataLossError(absl::StrCat(
+        "Invalid keys in incremental checkpoint: ", tensor.DebugString()));
+  }
+  std::vector<Key> keys;
+  auto matrix = tensor.matrix<tstring>();
+  for (int64_t i = 0; i < tensor.dim_size(0); ++i) {
+    keys.emplace_back(matrix(i, 0), matrix(i, 1));
+  }
+  return keys;
+}
+
+// Parses the file name of checkpoint `index`. Returns false for other files.
+bool ParseCheckpointFilename(absl::string_view filename, int64_t* index) {
+  if (!absl::ConsumePrefix(&filename, kCheckpointPrefix)) {
+    return false;
+  }
+  return absl::SimpleAtoi(filename, index) && *index >= 0;
+}
+
+// Writes `tensors` to a new file `filename`.
+absl::Status WriteCheckpointFile(Env* env, const std::string& filename,
+                                 const std::string& compression,
+                                 const std::vector<Tensor>& tensors) {
+  snapshot_util::TFRecordWriter writer(filename, compression);
+  TF_RETURN_IF_ERROR(writer.Initialize(env));
+  TF_RETURN_IF_ERROR(writer.WriteTensors(tensors));
+  return writer.Close();
+}
+
+// Reads checkpoint `index` and applies it to `state`, after applying the
+// checkpoints it depends on.
+absl::Status ApplyCheckpoint(Env* env, absl::string_view directory,
+                             int64_t index, const std::string& compression,
+                             State& state) {
+  const std::string filename = IncrementalCheckpointFilename(directory, index);
+  snapshot_util::TFRecordReaderImpl reader(filename, compression);
+  TF_RETURN_IF_ERROR(reader.Initialize(env));
+  TF_ASSIGN_OR_RETURN(std::vector<Tensor> tensors, reader.GetTensors());
+  if (tensors.size() < kNumMetadataTensors ||
+      tensors[0].dtype() != DT_INT64 ||
+      tensors[0].NumElements() != kHeaderSize) {
+    return absl::DataLossError(
+        absl::StrCat(filename, " is not a valid incremental checkpoint."));
+  }
+  const auto header = tensors[0].flat<int64_t>();
+  if (header(0) != kVersion) {
+    return absl::UnimplementedError(
+        absl::StrCat("Unsupported version ", header(0),
+                     " of incremental checkpoint ", filename,
+                     ". Supported version: ", kVersion));
+  }
+  const int64_t base_index = header(2);
+  if (header(1) != index || base_index > index || base_index < 0) {
+    return absl::DataLossError(absl::StrCat(
+        "Incremental checkpoint ", filename, " has index ", header(1),
+        " and base index ", base_index, "; expected index ", index, "."));
+  }
+  if (base_index == index) {
+    state.clear();
+  } else {
+    TF_RETURN_IF_ERROR(
+        ApplyCheckpoint(env, directory, index - 1, compression, state));
+  }
+
+  TF_ASSIGN_OR_RETURN(std::vector<Key> changed, KeysFromTensor(tensors[1]));
+  TF_ASSIGN_OR_RETURN(std::vector<Key> deleted, KeysFromTensor(tensors[2]));
+  if (tensors.size() != kNumMetadataTensors + changed.size()) {
+    return absl::DataLossError(absl::StrCat(
+        "Incremental checkpoint ", filename, " has ", changed.size(),
+        " changed keys, but ", tensors.size() - kNumMetadataTensors,
+        " values."));
+  }
+  for (const Key& key : deleted) {
+    state.erase(key);
+  }
+  for (size_t i = 0; i < changed.size(); ++i) {
+    state[changed[i]] = std::move(tensors[kNumMetadataTensors + i]);
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+IncrementalCheckpointWriter::IncrementalCheckpointWriter(
+    Env* env, absl::string_view directory, const Options& options)
+    : env_(env),
+      directory_(directory),
+      options_(options),
+      thread_pool_(std::make_unique<thread::ThreadPool>(
+          env, "incremental_checkpoint_writer", /*num_threads=*/1)) {}
+
+IncrementalCheckpointWriter::~IncrementalCheckpointWriter() {
+  absl::Status s = Wait();
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to write incremental iterator checkpoint to "
+                 << directory_ << ": " << s;
+  }
+}
+
+absl::StatusOr<int64_t> IncrementalCheckpointWriter::Save(
+    const std::vector<const VariantTensorData*>& data) {
+  TF_ASSIGN_OR_RETURN(State state, ToState(data));
+  auto checkpoint = std::make_shared<Checkpoint>();
+  {
+    mutex_lock l(mu_);
+    while (num_pending_ >= std::max<int64_t>(options_.max_pending_checkpoints,
+                                             1)) {
+      cv_.wait(l);
+    }
+    TF_RETURN_IF_ERROR(std::exchange(status_, absl::OkStatus()));
+    if (next_index_ < 0) {
+      // Continues the numbering of the checkpoints already in the directory,
+      // so that the latest checkpoint is always the last one written.
+      absl::StatusOr<int64_t> latest =
+          LatestIncrementalCheckpoint(env_, directory_);
+      if (!latest.ok() && !absl::IsNotFound(latest.status())) {
+        return latest.status();
+      }
+      next_index_ = latest.ok() ? *latest + 1 : 0;
+    }
+    checkpoint->index = next_index_++;
+    const bool full = force_full_checkpoint_ ||
+                      checkpoint->index - base_index_ >=
+                          std::max<int64_t>(options_.full_checkpoint_period, 1);
+    force_full_checkpoint_ = false;
+    if (full) {
+      base_index_ = checkpoint->index;
+      checkpoint->changed = state;
+    } else {
+      for (const auto& [key, value] : state) {
+        auto it = last_state_.find(key);
+        if (it == last_state_.end() || !IsUnchanged(it->second, value)) {
+          checkpoint->changed.emplace(key, value);
+        }
+      }
+      for (const auto& [key, value] : last_state_) {
+        if (state.find(key) == state.end()) {
+          checkpoint->deleted.push_back(key);
+        }
+      }
+    }
+    checkpoint->base_index = base_index_;
+    last_state_ = std::move(state);
+    ++num_pending_;
+  }
+  VLOG(2) << "Saving incremental iterator checkpoint " << checkpoint->index
+          << " with " << checkpoint->changed.size() << " changed and "
+          << checkpoint->deleted.size() << " deleted entries.";
+  thread_pool_->Schedule([this, checkpoint]() {
+    bool chain_broken = false;
+    {
+      mutex_lock l(mu_);
+      chain_broken = checkpoint->base_index == failed_base_index_;
+    }
+    // A delta on top of a checkpoint that failed to be written could not be
+    // read, so it is not written either.
+    absl::Status s =
+        chain_broken
+            ? absl::AbortedError(absl::StrCat(
+                  "Incremental checkpoint ", checkpoint->index,
+                  " was not written because a checkpoint it depends on failed "
+                  "to be written."))
+            : Write(*checkpoint);
+    mutex_lock l(mu_);
+    if (!s.ok()) {
+      status_.Update(s);
+      failed_base_index_ = checkpoint->base_index;
+      force_full_checkpoint_ = true;
+    }
+    --num_pending_;
+    cv_.notify_all();
+  });
+  return checkpoint->index;
+}
+
+absl::Status IncrementalCheckpointWriter::Wait() {
+  mutex_lock l(mu_);
+  while (num_pending_ > 0) {
+    cv_.wait(l);
+  }
+  return std::exchange(status_, absl::OkStatus());
+}
+
+absl::Status IncrementalCheckpointWriter::Write(const Checkpoint& checkpoint) {
+  tsl::profiler::TraceMe activity("IncrementalCheckpointWrite",
+                                  tsl::profiler::TraceMeLevel::kInfo);
+  TF_RETURN_IF_ERROR(env_->RecursivelyCreateDir(directory_));
+  const std::string filename =
+      IncrementalCheckpointFilename(directory_, checkpoint.index);
+  const std::string tmp_filename = absl::StrCat(filename, kTempSuffix);
+
+  std::vector<Tensor> tensors;
+  tensors.reserve(kNumMetadataTensors + checkpoint.changed.size());
+  Tensor header(DT_INT64, TensorShape({kHeaderSize}));
+  header.flat<int64_t>()(0) = kVersion;
+  header.flat<int64_t>()(1) = checkpoint.index;
+  header.flat<int64_t>()(2) = checkpoint.base_index;
+  tensors.push_back(std::move(header));
+  std::vector<Key> changed;
+  changed.reserve(checkpoint.changed.size());
+  for (const auto& [key, value] : checkpoint.changed) {
+    changed.push_back(key);
+  }
+  tensors.push_back(KeysTensor(changed));
+  tensors.push_back(KeysTensor(checkpoint.deleted));
+  for (const auto& [key, value] : checkpoint.changed) {
+    tensors.push_back(value);
+  }
+
+  absl::Status s = WriteCheckpointFile(env_, tmp_filename,
+                                       options_.compression, tensors);
+  if (s.ok()) {
+    s = env_->RenameFile(tmp_filename, filename);
+  }
+  if (!s.ok()) {
+    env_->DeleteFile(tmp_filename).IgnoreError();
+    return s;
+  }
+  if (checkpoint.base_index != checkpoint.index) {
+    return absl::OkStatus();
+  }
+
+  // Deletes the checkpoints of the previous chains, which are not needed to
+  // restore this one or any later one, and the temporary files left by writes
+  // of them that were interrupted.
+  std::vector<std::string> children;
+  TF_RETURN_IF_ERROR(env_->GetChildren(directory_, &children));
+  for (const std::string& child : children) {
+    absl::string_view name = child;
+    absl::ConsumeSuffix(&name, kTempSuffix);
+    int64_t index = 0;
+    if (ParseCheckpointFilename(name, &index) && index < checkpoint.index) {
+      TF_RETURN_IF_ERROR(env_->DeleteFile(io::JoinPath(directory_, child)));
+    }
+  }
+  return absl::OkStatus();
+}
+
+std::string IncrementalCheckpointFilename(absl::string_view directory,
+                                          int64_t index) {
+  return io::JoinPath(directory, absl::StrCat(kCheckpointPrefix, index));
+}
+
+absl::StatusOr<int64_t> LatestIncrementalCheckpoint(
+    Env* env, absl::string_view directory) {
+  std::vector<std::string> children;
+  TF_RETURN_IF_ERROR(env->GetChildren(std::string(directory), &children));
+  int64_t latest = -1;
+  for (const std::string& child : children) {
+    int64_t index = 0;
+    if (ParseCheckpointFilename(child, &index)) {
+      latest = std::max(latest, index);
+    }
+  }
+  if (latest < 0) {
+    return absl::NotFoundError(
+        absl::StrCat("No incremental iterator checkpoint in ", directory));
+  }
+  return latest;
+}
+
+absl::StatusOr<std::vector<std::unique_ptr<VariantTensorData>>>
+ReadIncrementalCheckpoint(Env* env, absl::string_view directory, int64_t index,
+                          const std::string& compression) {
+  State state;
+  TF_RETURN_IF_ERROR(
+      ApplyCheckpoint(env, directory, index, compression, state));
+  return FromState(state);
+}
+
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,167 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_INCREMENTAL_CHECKPOINT_H_
+#define TENSORFLOW_CORE_DATA_INCREMENTAL_CHECKPOINT_H_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/variant_tensor_data.h"
+#include "tensorflow/core/lib/io/compression.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/threadpool.h"
+
+namespace tensorflow {
+namespace data {
+
+// Incremental iterator checkpoints store only the iterator state that changed
+// since the previous checkpoint, so that saving an iterator with a large
+// shuffle buffer does not rewrite the whole buffer every time.
+//
+// Checkpoint `i` of a directory is the file `<directory>/checkpoint_<i>`. It
+// is either a full checkpoint, or a delta on top of checkpoint `i - 1`. A
+// chain of deltas always starts with a full checkpoint. Each file is a
+// TFRecord file of tensors:
+//
+//   header: int64 [version, index, base index]
+//   changed keys: string [num_changed, 2], as (iterator name, key) pairs
+//   deleted keys: string [num_deleted, 2]
+//   values: one tensor per changed key
+//
+// The base index of a full checkpoint is its own index. A state entry is
+// considered unchanged if its tensor shares its buffer with the previously
+// saved tensor, or if it is a small tensor with the same contents. tf.data
+// iterators keep buffered elements in place between saves, so most of a
+// shuffle buffer is not rewritten.
+
+// Writes incremental checkpoints of an iterator in the background.
+//
+// Sample usage:
+//
+//   IncrementalCheckpointWriter writer(env, directory, options);
+//   ...
+//   VariantTensorDataWriter state;
+//   TF_RETURN_IF_ERROR(iterator->Save(ctx, &state));
+//   std::vector<const VariantTensorData*> data;
+//   state.GetData(&data);
+//   TF_ASSIGN_OR_RETURN(int64_t index, writer.Save(data));
+//
+// This class is thread-safe.
+class IncrementalCheckpointWriter {
+ public:
+  struct Options {
+    // Every `full_checkpoint_period`-th checkpoint stores the full state.
+    int64_t full_checkpoint_period = 10;
+    // Maximum number of checkpoints waiting to be written. `Save` blocks while
+    // this many checkpoints are pending.
+    int64_t max_pending_checkpoints = 1;
+    // Compression of the checkpoint files, as defined in
+    // tensorflow/core/lib/io/compression.h.
+    std::string compression = io::compression::kNone;
+  };
+
+  // `directory` should be used by a single writer. Checkpoint indices continue
+  // after the latest checkpoint already in `directory`, or start at 0, and the
+  // first checkpoint is a full one. Checkpoints of previous chains are deleted
+  // once a new full checkpoint is written.
+  IncrementalCheckpointWriter(Env* env, absl::string_view directory,
+                              const Options& options);
+  // Waits for the pending checkpoints to be written.
+  ~IncrementalCheckpointWriter();
+
+  // Captures the iterator state in `data`, as produced by
+  // `VariantTensorDataWriter::GetData`, and writes it in the background. The
+  // state is captured before `Save` returns, without copying tensors. Returns
+  // the index of the checkpoint, or the error of a previous write.
+  absl::StatusOr<int64_t> Save(
+      const std::vector<const VariantTensorData*>& data);
+
+  // Waits for the pending checkpoints to be written, and returns the first
+  // error since the last call to `Save` or `Wait`.
+  absl::Status Wait();
+
+ private:
+  // Iterator state, keyed by (iterator name, key).
+  using State = std::map<std::pair<std::string, std::string>, Tensor>;
+
+  // The content of one checkpoint file.
+  struct Checkpoint {
+    int64_t index = 0;
+    int64_t base_index = 0;
+    State changed;
+    std::vector<std::pair<std::string, std::string>> deleted;
+  };
+
+  // Writes `checkpoint` to its file and, for full checkpoints, deletes the
+  // checkpoints of the previous chain.
+  absl::Status Write(const Checkpoint& checkpoint);
+
+  Env* const env_;
+  const std::string directory_;
+  const Options options_;
+
+  mutex mu_;
+  condition_variable cv_;
+  // The state of the last saved checkpoint.
+  State last_state_ TF_GUARDED_BY(mu_);
+  // Set to the index after the latest checkpoint in `directory_` by the first
+  // `Save`.
+  int64_t next_index_ TF_GUARDED_BY(mu_) = -1;
+  int64_t base_index_ TF_GUARDED_BY(mu_) = 0;
+  int64_t num_pending_ TF_GUARDED_BY(mu_) = 0;
+  // Set initially and after a failed write, so that the next checkpoint starts
+  // a new chain.
+  bool force_full_checkpoint_ TF_GUARDED_BY(mu_) = true;
+  // Base index of the last chain with a checkpoint that failed to be written.
+  // The later checkpoints of that chain are not written.
+  int64_t failed_base_index_ TF_GUARDED_BY(mu_) = -1;
+  absl::Status status_ TF_GUARDED_BY(mu_);
+
+  // Single thread that writes the checkpoints in order. Declared last so that
+  // it is joined before the other members are destroyed.
+  std::unique_ptr<thread::ThreadPool> thread_pool_;
+};
+
+// Returns the name of checkpoint `index` of `directory`.
+std::string IncrementalCheckpointFilename(absl::string_view directory,
+                                          int64_t index);
+
+// Returns the index of the latest checkpoint in `directory`, or a NotFound
+// error if there is none.
+absl::StatusOr<int64_t> LatestIncrementalCheckpoint(
+    Env* env, absl::string_view directory);
+
+// Reads the iterator state of checkpoint `index` of `directory`, by applying
+// the deltas of its chain to the full checkpoint the chain starts with. The
+// result can be restored through a `VariantTensorDataReader`.
+absl::StatusOr<std::vector<std::unique_ptr<VariantTensorData>>>
+ReadIncrementalCheckpoint(Env* env, absl::string_view directory, int64_t index,
+                          const std::string& compression =
+                              io::compression::kNone);
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_INCREMENTAL_CHECKPOINT_H_
@@ -0,0 +1,358 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/incremental_checkpoint.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/data/serialization_utils.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/framework/variant_tensor_data.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/test.h"
+#include "tsl/platform/status_matchers.h"
+#include "tsl/platform/statusor.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::tsl::testing::IsOkAndHolds;
+using ::tsl::testing::StatusIs;
+
+constexpr char kIterator[] = "Iterator::Root::Shuffle";
+
+// Iterator state of a fake shuffle iterator: a position and a buffer.
+struct FakeState {
+  int64_t position = 0;
+  std::vector<Tensor> buffer;
+};
+
+std::string TestDirectory(const std::string& name) {
+  std::string directory = io::JoinPath(tsl::testing::TmpDir(), name);
+  int64_t undeleted_files, undeleted_dirs;
+  Env::Default()->DeleteRecursively(directory, &undeleted_files,
+                                    &undeleted_dirs)
+      .IgnoreError();
+  return directory;
+}
+
+Tensor Element(int64_t value, int64_t size) {
+  Tensor tensor(DT_INT64, TensorShape({size}));
+  tensor.flat<int64_t>().setConstant(value);
+  return tensor;
+}
+
+absl::StatusOr<int64_t> Save(IncrementalCheckpointWriter& writer,
+                             const FakeState& state) {
+  VariantTensorDataWriter variant_writer;
+  TF_RETURN_IF_ERROR(variant_writer.WriteScalar(
+      kIterator, "position", state.position));
+  TF_RETURN_IF_ERROR(variant_writer.WriteScalar(
+      kIterator, "buffer_size", static_cast<int64_t>(state.buffer.size())));
+  for (size_t i = 0; i < state.buffer.size(); ++i) {
+    TF_RETURN_IF_ERROR(variant_writer.WriteTensor(
+        kIterator, absl::StrCat("buffer[", i, "]"), state.buffer[i]));
+  }
+  std::vector<const VariantTensorData*> data;
+  variant_writer.GetData(&data);
+  return writer.Save(data);
+}
+
+// Reads checkpoint `index` through a `VariantTensorDataReader`, the way
+// iterators restore their state.
+absl::StatusOr<FakeState> Restore(const std::string& directory,
+                                  int64_t index) {
+  TF_ASSIGN_OR_RETURN(
+      std::vector<std::unique_ptr<VariantTensorData>> data,
+      ReadIncrementalCheckpoint(Env::Default(), directory, index));
+  std::vector<const VariantTensorData*> data_ptrs;
+  for (const auto& d : data) {
+    data_ptrs.push_back(d.get());
+  }
+  VariantTensorDataReader reader(data_ptrs);
+  FakeState state;
+  int64_t buffer_size = 0;
+  TF_RETURN_IF_ERROR(reader.ReadScalar(kIterator, "position", &state.position));
+  TF_RETURN_IF_ERROR(reader.ReadScalar(kIterator, "buffer_size", &buffer_size));
+  for (int64_t i = 0; i < buffer_size; ++i) {
+    state.buffer.emplace_back();
+    TF_RETURN_IF_ERROR(reader.ReadTensor(
+        kIterator, absl::StrCat("buffer[", i, "]"), &state.buffer.back()));
+  }
+  if (reader.Contains(kIterator, absl::StrCat("buffer[", buffer_size, "]"))) {
+    return absl::InternalError("Deleted buffer entry was restored.");
+  }
+  return state;
+}
+
+void ExpectEqual(const FakeState& actual, const FakeState& expected) {
+  EXPECT_EQ(actual.position, expected.position);
+  ASSERT_EQ(actual.buffer.size(), expected.buffer.size());
+  for (size_t i = 0; i < actual.buffer.size(); ++i) {
+    test::ExpectEqual(actual.buffer[i], expected.buffer[i]);
+  }
+}
+
+uint64_t FileSize(const std::string& directory, int64_t index) {
+  uint64_t size = 0;
+  TF_CHECK_OK(Env::Default()->GetFileSize(
+      IncrementalCheckpointFilename(directory, index), &size));
+  return size;
+}
+
+TEST(IncrementalCheckpointTest, RestoreEveryCheckpoint) {
+  const std::string directory = TestDirectory("restore_every_checkpoint");
+  IncrementalCheckpointWriter::Options options;
+  options.full_checkpoint_period = 100;
+  IncrementalCheckpointWriter writer(Env::Default(), directory, options);
+
+  FakeState state;
+  for (int64_t i = 0; i < 8; ++i) {
+    state.buffer.push_back(Element(i, /*size=*/16));
+  }
+  std::vector<FakeState> saved;
+  for (int64_t i = 0; i < 10; ++i) {
+    // Replaces one buffer element per step, and shrinks the buffer at the end
+    // of the input.
+    state.position = i;
+    state.buffer[i % state.buffer.size()] = Element(100 + i, /*size=*/16);
+    if (i >= 7) {
+      state.buffer.pop_back();
+    }
+    EXPECT_THAT(Save(writer, state), IsOkAndHolds(i));
+    saved.push_back(state);
+  }
+  TF_ASSERT_OK(writer.Wait());
+
+  EXPECT_THAT(LatestIncrementalCheckpoint(Env::Default(), directory),
+              IsOkAndHolds(9));
+  for (int64_t i = 0; i < saved.size(); ++i) {
+    TF_ASSERT_OK_AND_ASSIGN(FakeState restored, Restore(directory, i));
+    ExpectEqual(restored, saved[i]);
+  }
+}
+
+TEST(IncrementalCheckpointTest, DeltaOnlyWritesChangedEntries) {
+  const std::string directory = TestDirectory("delta_writes_changed_entries");
+  IncrementalCheckpointWriter writer(Env::Default(), directory,
+                                     IncrementalCheckpointWriter::Options());
+  constexpr int64_t kElementSize = 1 << 12;
+  FakeState state;
+  for (int64_t i = 0; i < 16; ++i) {
+    state.buffer.push_back(Element(i, kElementSize));
+  }
+  TF_ASSERT_OK(Save(writer, state).status());
+  state.position = 1;
+  state.buffer[3] = Element(100, kElementSize);
+  TF_ASSERT_OK(Save(writer, state).status());
+  TF_ASSERT_OK(writer.Wait());
+
+  const uint64_t element_bytes = kElementSize * sizeof(int64_t);
+  EXPECT_GT(FileSize(directory, 0), 16 * element_bytes);
+  EXPECT_GT(FileSize(directory, 1), element_bytes);
+  EXPECT_LT(FileSize(directory, 1), 2 * element_bytes);
+  TF_ASSERT_OK_AND_ASSIGN(FakeState restored, Restore(directory, 1));
+  ExpectEqual(restored, state);
+}
+
+TEST(IncrementalCheckpointTest, PeriodicFullCheckpoints) {
+  const std::string directory = TestDirectory("periodic_full_checkpoints");
+  IncrementalCheckpointWriter::Options options;
+  options.full_checkpoint_period = 3;
+  IncrementalCheckpointWriter writer(Env::Default(), directory, options);
+  FakeState state;
+  state.buffer.push_back(Element(0, /*size=*/4));
+  for (int64_t i = 0; i < 8; ++i) {
+    state.position = i;
+    TF_ASSERT_OK(Save(writer, state).status());
+  }
+  TF_ASSERT_OK(writer.Wait());
+
+  // Checkpoints 0, 3 and 6 are full, so the chains before 6 are deleted.
+  for (int64_t i = 0; i < 6; ++i) {
+    EXPECT_THAT(Restore(directory, i), StatusIs(absl::StatusCode::kNotFound))
+        << "Checkpoint " << i;
+  }
+  TF_ASSERT_OK_AND_ASSIGN(FakeState restored, Restore(directory, 7));
+  ExpectEqual(restored, state);
+}
+
+TEST(IncrementalCheckpointTest, NoCheckpoint) {
+  const std::string directory = TestDirectory("no_checkpoint");
+  TF_ASSERT_OK(Env::Default()->RecursivelyCreateDir(directory));
+  EXPECT_THAT(LatestIncrementalCheckpoint(Env::Default(), directory),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(IncrementalCheckpointTest, InvalidCheckpoint) {
+  const std::string directory = TestDirectory("invalid_checkpoint");
+  TF_ASSERT_OK(Env::Default()->RecursivelyCreateDir(directory));
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(),
+                                 IncrementalCheckpointFilename(directory, 0),
+                                 "not a checkpoint"));
+  EXPECT_FALSE(Restore(directory, 0).ok());
+}
+
+// Makes the write of checkpoint `index` fail, by creating a directory where its
+// temporary file should be.
+void BlockCheckpoint(const std::string& directory, int64_t index) {
+  TF_ASSERT_OK(Env::Default()->RecursivelyCreateDir(
+      absl::StrCat(IncrementalCheckpointFilename(directory, index), ".tmp")));
+}
+
+void UnblockCheckpoint(const std::string& directory, int64_t index) {
+  int64_t undeleted_files, undeleted_dirs;
+  TF_ASSERT_OK(Env::Default()->DeleteRecursively(
+      absl::StrCat(IncrementalCheckpointFilename(directory, index), ".tmp"),
+      &undeleted_files, &undeleted_dirs));
+}
+
+TEST(IncrementalCheckpointTest, WriteErrorStartsNewChain) {
+  const std::string directory = TestDirectory("write_error");
+  BlockCheckpoint(directory, 0);
+  IncrementalCheckpointWriter writer(Env::Default(), directory,
+                                     IncrementalCheckpointWriter::Options());
+  FakeState state;
+  state.buffer.push_back(Element(0, /*size=*/4));
+  TF_ASSERT_OK(Save(writer, state).status());
+  EXPECT_FALSE(writer.Wait().ok());
+
+  UnblockCheckpoint(directory, 0);
+  state.position = 1;
+  EXPECT_THAT(Save(writer, state), IsOkAndHolds(1));
+  TF_ASSERT_OK(writer.Wait());
+  TF_ASSERT_OK_AND_ASSIGN(FakeState restored, Restore(directory, 1));
+  ExpectEqual(restored, state);
+}
+
+TEST(IncrementalCheckpointTest, WriteErrorDropsPendingDeltas) {
+  const std::string directory = TestDirectory("write_error_pending");
+  IncrementalCheckpointWriter::Options options;
+  options.max_pending_checkpoints = 3;
+  IncrementalCheckpointWriter writer(Env::Default(), directory, options);
+  FakeState state;
+  state.buffer.push_back(Element(0, /*size=*/4));
+  EXPECT_THAT(Save(writer, state), IsOkAndHolds(0));
+  TF_ASSERT_OK(writer.Wait());
+
+  BlockCheckpoint(directory, 1);
+  state.position = 1;
+  EXPECT_THAT(Save(writer, state), IsOkAndHolds(1));
+  // Fails if the write of checkpoint 1 has already failed.
+  state.position = 2;
+  absl::StatusOr<int64_t> index = Save(writer, state);
+  writer.Wait().IgnoreError();
+  if (index.ok()) {
+    // The checkpoint is a delta on top of checkpoint 1, so it is not written.
+    EXPECT_THAT(Restore(directory, *index),
+                StatusIs(absl::StatusCode::kNotFound));
+  }
+
+  UnblockCheckpoint(directory, 1);
+  state.position = 3;
+  TF_ASSERT_OK_AND_ASSIGN(index, Save(writer, state));
+  TF_ASSERT_OK(writer.Wait());
+  EXPECT_THAT(LatestIncrementalCheckpoint(Env::Default(), directory),
+              IsOkAndHolds(*index));
+  TF_ASSERT_OK_AND_ASSIGN(FakeState restored, Restore(directory, *index));
+  ExpectEqual(restored, state);
+}
+
+TEST(IncrementalCheckpointTest, WriteErrorDeletesTempFile) {
+  const std::string directory = TestDirectory("write_error_temp_file");
+  // The temporary file is written, but can not be renamed over a directory
+  // that is not empty.
+  const std::string filename = IncrementalCheckpointFilename(directory, 0);
+  TF_ASSERT_OK(Env::Default()->RecursivelyCreateDir(filename));
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(),
+                                 io::JoinPath(filename, "file"), "contents"));
+  IncrementalCheckpointWriter writer(Env::Default(), directory,
+                                     IncrementalCheckpointWriter::Options());
+  FakeState state;
+  state.buffer.push_back(Element(0, /*size=*/4));
+  TF_ASSERT_OK(Save(writer, state).status());
+  EXPECT_FALSE(writer.Wait().ok());
+  EXPECT_THAT(Env::Default()->FileExists(absl::StrCat(filename, ".tmp")),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(IncrementalCheckpointTest, FullCheckpointDeletesStaleTempFiles) {
+  const std::string directory = TestDirectory("stale_temp_files");
+  IncrementalCheckpointWriter::Options options;
+  options.full_checkpoint_period = 2;
+  IncrementalCheckpointWriter writer(Env::Default(), directory, options);
+  FakeState state;
+  state.buffer.push_back(Element(0, /*size=*/4));
+  EXPECT_THAT(Save(writer, state), IsOkAndHolds(0));
+  TF_ASSERT_OK(writer.Wait());
+  // Left by an interrupted write of checkpoint 0, e.g. by a process that
+  // crashed before a new writer wrote the checkpoint again.
+  const std::string stale_filename =
+      absl::StrCat(IncrementalCheckpointFilename(directory, 0), ".tmp");
+  TF_ASSERT_OK(
+      WriteStringToFile(Env::Default(), stale_filename, "partial checkpoint"));
+
+  for (int64_t i = 1; i < 3; ++i) {
+    state.position = i;
+    EXPECT_THAT(Save(writer, state), IsOkAndHolds(i));
+  }
+  TF_ASSERT_OK(writer.Wait());
+  EXPECT_THAT(Env::Default()->FileExists(stale_filename),
+              StatusIs(absl::StatusCode::kNotFound));
+  TF_ASSERT_OK_AND_ASSIGN(FakeState restored, Restore(directory, 2));
+  ExpectEqual(restored, state);
+}
+
+TEST(IncrementalCheckpointTest, NewWriterContinuesNumbering) {
+  const std::string directory = TestDirectory("new_writer");
+  IncrementalCheckpointWriter::Options options;
+  options.full_checkpoint_period = 10;
+  FakeState state;
+  state.buffer.push_back(Element(0, /*size=*/4));
+  {
+    IncrementalCheckpointWriter writer(Env::Default(), directory, options);
+    for (int64_t i = 0; i < 3; ++i) {
+      state.position = i;
+      EXPECT_THAT(Save(writer, state), IsOkAndHolds(i));
+    }
+  }
+
+  IncrementalCheckpointWriter writer(Env::Default(), directory, options);
+  state.position = 3;
+  EXPECT_THAT(Save(writer, state), IsOkAndHolds(3));
+  TF_ASSERT_OK(writer.Wait());
+  EXPECT_THAT(LatestIncrementalCheckpoint(Env::Default(), directory),
+              IsOkAndHolds(3));
+  // The first checkpoint of the new writer is a full one, so the previous
+  // chain is deleted.
+  EXPECT_THAT(Restore(directory, 2), StatusIs(absl::StatusCode::kNotFound));
+  TF_ASSERT_OK_AND_ASSIGN(FakeState restored, Restore(directory, 3));
+  ExpectEqual(restored, state);
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -37,6 +37,7 @@ limitations under the License.
 #include "tensorflow/core/platform/refcount.h"
 #include "tensorflow/core/platform/status.h"
 #include "tensorflow/core/platform/stringprintf.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tsl/platform/host_info.h"
 
 namespace tensorflow {
@@ -46,6 +47,7 @@ namespace {
 constexpr char kDatasetType[] = "Root";
 
 constexpr char kAlgorithm[] = "algorithm";
+constexpr char kBufferedBytes[] = "buffered_megabytes";
 constexpr char kCpuBudget[] = "cpu_budget";
 constexpr char kExperiments[] = "experiments";
 constexpr char kReadRoundtripLatency[] = "read_latency_usec";
@@ -58,11 +60,30 @@ constexpr char kRamUsage[] = "ram_usage_megabytes";
 constexpr char kMaxBufferBytes[] = "max_buffered_megabytes";
 constexpr char kWarmStart[] = "warm_start";
 
+// Environment variable setting a hard limit on the number of megabytes that
+// the buffers of an iterator's pipeline may hold.
+constexpr char kIteratorMemoryLimitEnvVar[] =
+    "TF_DATA_ITERATOR_MEMORY_LIMIT_IN_MB";
+
 // If value `x` matches `y`, returns default value `z`. Otherwise, return `x`.
 inline int64_t value_or_default(int64_t x, int64_t y, int64_t z) {
   return x == y ? z : x;
 }
 
+// Returns the hard limit on the bytes buffered by a pipeline, or 0 if there is
+// none.
+int64_t GetIteratorMemoryLimit() {
+  int64_t memory_limit_mb = 0;
+  absl::Status s = ReadInt64FromEnvVar(kIteratorMemoryLimitEnvVar,
+                                       /*default_val=*/0, &memory_limit_mb);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to read " << kIteratorMemoryLimitEnvVar << ": "
+                 << s;
+    return 0;
+  }
+  return std::max<int64_t>(memory_limit_mb, 0) << 20;
+}
+
 void SetRootDatasetParams(const Options& options, RootDataset::Params* params) {
   if (ShouldConfigureMaxIntraOpParallelism(options)) {
     params->max_intra_op_parallelism =
@@ -199,7 +220,8 @@ class RootDataset::Iterator : public DatasetIterator<RootDataset> {
     // so no matter whether dataset()->params_.autotune is on or not
     // we need to pass ram_budget_manager_ to the downstream dataset operations
     ram_budget_manager_ = std::make_shared<model::RamBudgetManager>(
-        dataset()->params_.ComputeInitialAutotuneRamBudget());
+        dataset()->params_.ComputeInitialAutotuneRamBudget(),
+        GetIteratorMemoryLimit());
 
     if (dataset()->params_.autotune) {
       if (ctx->model() != nullptr) {
@@ -273,9 +295,24 @@ class RootDataset::Iterator : public DatasetIterator<RootDataset> {
     return absl::OkStatus();
   }
 
+  std::shared_ptr<model::RamBudgetManager> ram_budget_manager()
+      const override {
+    return ram_budget_manager_;
+  }
+
   TraceMeMetadata GetTraceMeMetadata() const override {
     tensorflow::data::TraceMeMetadata traceme_metadata =
         dataset()->traceme_metadata_;
+    if (ram_budget_manager_ != nullptr) {
+      traceme_metadata.push_back(std::make_pair(
+          kBufferedBytes,
+          strings::Printf(
+              "%lld (peak: %lld)",
+              static_cast<long long>(ram_budget_manager_->buffered_bytes() /
+                                     1.0e6),
+              static_cast<long long>(
+                  ram_budget_manager_->peak_buffered_bytes() / 1.0e6))));
+    }
     const int64_t mem_bw = port::GetMemoryBandwidthInfo().bw_used;
     if (mem_bw != INT64_MAX) {
       traceme_metadata.push_back(std::make_pair(
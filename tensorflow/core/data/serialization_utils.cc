@@ -15,6 +15,7 @@ limitations under the License.
 #include "tensorflow/core/data/serialization_utils.h"
 
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -39,7 +40,6 @@ namespace tensorflow {
 namespace data {
 namespace {
 
-constexpr char kDelimiter[] = "@@";
 constexpr char kComponent[] = "component";
 constexpr char kNumComponents[] = "num_components";
 constexpr char kNumElements[] = "num_elements";
@@ -99,18 +99,26 @@ absl::Status FindStatefulOps(const GraphDef& graph_def,
 absl::Status ReadElementsFromCheckpoint(
     IteratorContext* ctx, IteratorStateReader* reader, StringPiece key_prefix,
     std::vector<std::vector<Tensor>>* elements) {
+  DCHECK(elements->empty());
+  return ReadElementsFromCheckpoint(
+      ctx, reader, key_prefix, [elements](std::vector<Tensor> element) {
+        elements->push_back(std::move(element));
+        return absl::OkStatus();
+      });
+}
+
+absl::Status ReadElementsFromCheckpoint(
+    IteratorContext* ctx, IteratorStateReader* reader, StringPiece key_prefix,
+    const std::function<absl::Status(std::vector<Tensor>)>& add_element) {
   int64_t num_elements;
   TF_RETURN_IF_ERROR(
       reader->ReadScalar(key_prefix, kNumElements, &num_elements));
-  DCHECK(elements->empty());
-  elements->reserve(num_elements);
   for (int i = 0; i < num_elements; ++i) {
     std::string element_prefix = absl::StrCat(key_prefix, "::", i);
     int64_t num_components;
     TF_RETURN_IF_ERROR(
         reader->ReadScalar(element_prefix, kNumComponents, &num_components));
-    elements->emplace_back();
-    std::vector<Tensor>& element = elements->at(i);
+    std::vector<Tensor> element;
     element.reserve(num_components);
     for (int j = 0; j < num_components; ++j) {
       element.emplace_back();
@@ -118,14 +126,13 @@ absl::Status ReadElementsFromCheckpoint(
           ctx->flr(), element_prefix, absl::StrCat(kComponent, "[", j, "]"),
           &element.back()));
     }
+    TF_RETURN_IF_ERROR(add_element(std::move(element)));
   }
   return absl::OkStatus();
 }
 
 absl::Status WriteElement(IteratorStateWriter* writer, StringPiece key_prefix,
-                          const std::vector<std::vector<Tensor>>& elements,
-                          int64_t index) {
-  const std::vector<Tensor>& element = elements[index];
+                          const std::vector<Tensor>& element, int64_t index) {
   std::string element_prefix = absl::StrCat(key_prefix, "::", index);
   TF_RETURN_IF_ERROR(
       writer->WriteScalar(element_prefix, kNumComponents, element.size()));
@@ -142,7 +149,21 @@ absl::Status WriteElementsToCheckpoint(
   TF_RETURN_IF_ERROR(
       writer->WriteScalar(key_prefix, kNumElements, elements.size()));
   for (int i = 0; i < elements.size(); ++i) {
-    TF_RETURN_IF_ERROR(WriteElement(writer, key_prefix, elements, i));
+    TF_RETURN_IF_ERROR(WriteElement(writer, key_prefix, elements[i], i));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status WriteElementsToCheckpoint(
+    IteratorStateWriter* writer, StringPiece key_prefix, int64_t num_elements,
+    const std::function<absl::Status(int64_t, std::vector<Tensor>*)>&
+        get_element) {
+  TF_RETURN_IF_ERROR(
+      writer->WriteScalar(key_prefix, kNumElements, num_elements));
+  for (int64_t i = 0; i < num_elements; ++i) {
+    std::vector<Tensor> element;
+    TF_RETURN_IF_ERROR(get_element(i, &element));
+    TF_RETURN_IF_ERROR(WriteElement(writer, key_prefix, element, i));
   }
   return absl::OkStatus();
 }
@@ -154,7 +175,7 @@ absl::Status UpdateCheckpointElements(
   TF_RETURN_IF_ERROR(
       writer->WriteScalar(key_prefix, kNumElements, elements.size()));
   for (int64_t i : checkpoint_indices) {
-    TF_RETURN_IF_ERROR(WriteElement(writer, key_prefix, elements, i));
+    TF_RETURN_IF_ERROR(WriteElement(writer, key_prefix, elements[i], i));
   }
   return absl::OkStatus();
 }
@@ -164,7 +185,8 @@ VariantTensorDataReader::VariantTensorDataReader(
   for (const auto& d : data) {
     string metadata;
     d->get_metadata(&metadata);
-    auto keys = str_util::Split(metadata, kDelimiter, str_util::SkipEmpty());
+    auto keys = str_util::Split(metadata, kVariantTensorDataKeyDelimiter,
+                                str_util::SkipEmpty());
     const string name = keys[0];
     data_[name] = d;
     map_[name] = std::map<string, size_t>();
@@ -309,7 +331,7 @@ std::map<string, Tensor> VariantTensorDataReader::ReadAllTensors() {
     for (const auto& inner : entry.second) {
       string key2 = inner.first;
       size_t index = inner.second;
-      result[absl::StrCat(key1, kDelimiter, key2)] =
+      result[absl::StrCat(key1, kVariantTensorDataKeyDelimiter, key2)] =
           data_[key1]->tensors(index);
     }
   }
@@ -361,7 +383,8 @@ void VariantTensorDataWriter::MaybeFlush() {
     const string name = keys.first;
     string metadata = name;
     for (size_t i = 0; i < keys_[name].size(); ++i) {
-      strings::StrAppend(&metadata, kDelimiter, keys_[name][i]);
+      strings::StrAppend(&metadata, kVariantTensorDataKeyDelimiter,
+                         keys_[name][i]);
     }
     data_[name]->set_metadata(metadata);
   }
@@ -415,7 +438,7 @@ absl::Status VariantTensorDataWriter::WriteTensorInternal(StringPiece n,
     return errors::FailedPrecondition(
         "Cannot call WriteTensor after GetData or ReleaseData is called");
   }
-  DCHECK_EQ(key.find(kDelimiter), string::npos);
+  DCHECK_EQ(key.find(kVariantTensorDataKeyDelimiter), string::npos);
   string name(n);
   if (keys_.count(name) == 0) {
     keys_[name] = std::vector<string>();
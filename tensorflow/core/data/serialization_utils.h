@@ -17,6 +17,7 @@ limitations under the License.
 #define TENSORFLOW_CORE_DATA_SERIALIZATION_UTILS_H_
 
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -35,12 +36,22 @@ namespace tensorflow {
 namespace data {
 
 inline constexpr absl::string_view kRetvalOp = "_Retval";
+// Separates the iterator name and the keys in the metadata of the
+// `VariantTensorData`s written by `VariantTensorDataWriter`.
+inline constexpr absl::string_view kVariantTensorDataKeyDelimiter = "@@";
 
 // Reads dataset elements from the checkpoint reader using the given key prefix.
 absl::Status ReadElementsFromCheckpoint(
     IteratorContext* ctx, IteratorStateReader* reader, StringPiece key_prefix,
     std::vector<std::vector<Tensor>>* elements);
 
+// Like the overload above, but passes the elements to `add_element` one at a
+// time instead of collecting them, so that the caller can store them
+// elsewhere, e.g. on disk.
+absl::Status ReadElementsFromCheckpoint(
+    IteratorContext* ctx, IteratorStateReader* reader, StringPiece key_prefix,
+    const std::function<absl::Status(std::vector<Tensor>)>& add_element);
+
 // Writes dataset elements to the checkpoint writer using the given key prefix.
 // The elements can be read back by passing the same key prefix to
 // ReadElementsFromCheckpoint. Only one list of elements can be written under
@@ -49,6 +60,14 @@ absl::Status WriteElementsToCheckpoint(
     IteratorStateWriter* writer, StringPiece key_prefix,
     const std::vector<std::vector<Tensor>>& elements);
 
+// Like the overload above, but fetches the `num_elements` elements one at a
+// time from `get_element`, so that only one of them needs to be in memory at
+// once.
+absl::Status WriteElementsToCheckpoint(
+    IteratorStateWriter* writer, StringPiece key_prefix, int64_t num_elements,
+    const std::function<absl::Status(int64_t, std::vector<Tensor>*)>&
+        get_element);
+
 // Updates the dataset elements in the checkpoint for given `checkpoint_indices`
 // using the given key prefix, assuming that vector of elements have
 // checkpointed these before. The elements can be read back by passing the same
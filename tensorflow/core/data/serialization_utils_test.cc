@@ -82,6 +82,40 @@ TEST(SerializationUtilsTest, CheckpointElementsRoundTrip) {
   }
 }
 
+TEST(SerializationUtilsTest, CheckpointElementsOneAtATimeRoundTrip) {
+  std::vector<std::vector<Tensor>> elements;
+  elements.push_back(CreateTensors<int32>(TensorShape({3}), {{1, 2, 3}}));
+  elements.push_back(CreateTensors<int32>(TensorShape({2}), {{4, 5}}));
+  VariantTensorDataWriter writer;
+  tstring test_prefix = full_name("test_prefix");
+  TF_ASSERT_OK(WriteElementsToCheckpoint(
+      &writer, test_prefix, elements.size(),
+      [&elements](int64_t index, std::vector<Tensor>* element) {
+        *element = elements[index];
+        return absl::OkStatus();
+      }));
+  std::vector<const VariantTensorData*> data;
+  writer.GetData(&data);
+
+  VariantTensorDataReader reader(data);
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<TestContext> ctx,
+                          TestContext::Create());
+  std::vector<std::vector<Tensor>> read_elements;
+  TF_ASSERT_OK(ReadElementsFromCheckpoint(
+      ctx->iter_ctx(), &reader, test_prefix,
+      [&read_elements](std::vector<Tensor> element) {
+        read_elements.push_back(std::move(element));
+        return absl::OkStatus();
+      }));
+  ASSERT_EQ(elements.size(), read_elements.size());
+  for (int i = 0; i < elements.size(); ++i) {
+    ASSERT_EQ(elements[i].size(), read_elements[i].size());
+    for (int j = 0; j < elements[i].size(); ++j) {
+      test::ExpectEqual(elements[i][j], read_elements[i][j]);
+    }
+  }
+}
+
 TEST(SerializationUtilsTest, VariantTensorDataRoundtrip) {
   VariantTensorDataWriter writer;
   TF_ASSERT_OK(writer.WriteScalar(full_name("Int64"), 24));
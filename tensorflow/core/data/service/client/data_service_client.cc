@@ -456,6 +456,13 @@ void DataServiceClient::Heartbeat() TF_LOCKS_EXCLUDED(mu_) {
     mutex_lock l(mu_);
     double target_processing_time_nsec = ctx_->GetTargetProcessingTimeNsec();
     req.set_target_processing_time_nsec(target_processing_time_nsec);
+    if (num_transfers_since_heartbeat_ > 0) {
+      req.set_transfer_time_nsec(
+          absl::ToDoubleNanoseconds(transfer_time_since_heartbeat_) /
+          num_transfers_since_heartbeat_);
+      transfer_time_since_heartbeat_ = absl::ZeroDuration();
+      num_transfers_since_heartbeat_ = 0;
+    }
   }
   ClientHeartbeatResponse resp;
   absl::Status s = dispatcher_->ClientHeartbeat(req, resp);
@@ -774,12 +781,15 @@ absl::Status DataServiceClient::TryGetElement(const Task& task, bool allow_skip,
 
 void DataServiceClient::ProcessGetElementResponse(
     bool enqueue_result, GetElementResult& get_element_result,
-    std::shared_ptr<Result> result, Task& task) TF_LOCKS_EXCLUDED(mu_) {
+    absl::Duration transfer_time, std::shared_ptr<Result> result, Task& task)
+    TF_LOCKS_EXCLUDED(mu_) {
   mutex_lock l(mu_);
   result->ready = true;
   result->end_of_sequence = get_element_result.end_of_sequence;
   result->skip = get_element_result.skip;
   if (!get_element_result.end_of_sequence && !get_element_result.skip) {
+    transfer_time_since_heartbeat_ += transfer_time;
+    ++num_transfers_since_heartbeat_;
     task.skipped_previous_round = false;
     result->element = std::move(get_element_result.components);
     result->element_index = get_element_result.element_index;
@@ -859,7 +869,9 @@ absl::Status DataServiceClient::GetElement(Task* task, int64_t deadline_micros,
                                            std::shared_ptr<Result> result)
     TF_LOCKS_EXCLUDED(mu_) {
   GetElementResult get_element_result;
+  absl::Time start;
   while (true) {
+    start = absl::Now();
     absl::Status s = TryGetElement(*task, allow_skip, get_element_result);
     if (s.ok()) {
       task->num_retries = 0;
@@ -917,7 +929,9 @@ absl::Status DataServiceClient::GetElement(Task* task, int64_t deadline_micros,
       return absl::OkStatus();
     }
   }
-  ProcessGetElementResponse(enqueue_result, get_element_result, result, *task);
+  ProcessGetElementResponse(enqueue_result, get_element_result,
+                            /*transfer_time=*/absl::Now() - start, result,
+                            *task);
   return absl::OkStatus();
 }
 
@@ -24,6 +24,7 @@ limitations under the License.
 #include <vector>
 
 #include "absl/container/flat_hash_set.h"
+#include "absl/time/time.h"
 #include "tensorflow/core/data/service/client/common.h"
 #include "tensorflow/core/data/service/common.h"
 #include "tensorflow/core/data/service/common.pb.h"
@@ -180,6 +181,7 @@ class DataServiceClient {
                              GetElementResult& result);
   void ProcessGetElementResponse(bool enqueue_result,
                                  GetElementResult& get_element_result,
+                                 absl::Duration transfer_time,
                                  std::shared_ptr<Result> result, Task& task);
   absl::Status GetElementTraced(Task* task, int64_t deadline_micros,
                                 bool enqueue_result, bool allow_skip,
@@ -255,6 +257,11 @@ class DataServiceClient {
 
   int64_t get_next_index_ TF_GUARDED_BY(mu_) = 0;
 
+  // Total time spent getting the elements received since the last heartbeat,
+  // and their number.
+  absl::Duration transfer_time_since_heartbeat_ TF_GUARDED_BY(mu_);
+  int64_t num_transfers_since_heartbeat_ TF_GUARDED_BY(mu_) = 0;
+
   bool iteration_finished_ TF_GUARDED_BY(mu_) = false;
   bool should_finish_iteration_ TF_GUARDED_BY(mu_) = true;
 
@@ -127,16 +127,15 @@ absl::Status DataServiceDispatcherClient::GetDatasetDef(
   return absl::OkStatus();
 }
 
-absl::Status DataServiceDispatcherClient::GetSplit(int64_t iteration_id,
-                                                   int64_t repetition,
-                                                   int64_t split_provider_index,
-                                                   Tensor& split,
-                                                   bool& end_of_splits) {
+absl::Status DataServiceDispatcherClient::GetSplit(
+    int64_t iteration_id, int64_t repetition, int64_t split_provider_index,
+    const std::string& worker_address, Tensor& split, bool& end_of_splits) {
   TF_RETURN_IF_ERROR(EnsureInitialized());
   GetSplitRequest req;
   req.set_iteration_id(iteration_id);
   req.set_repetition(repetition);
   req.set_split_provider_index(split_provider_index);
+  req.set_worker_address(worker_address);
   GetSplitResponse resp;
   grpc::ClientContext client_ctx;
   grpc::Status status = stub_->GetSplit(&client_ctx, req, &resp);
@@ -378,6 +377,20 @@ absl::Status DataServiceDispatcherClient::DisableCompressionAtRuntime(
   return absl::OkStatus();
 }
 
+absl::Status DataServiceDispatcherClient::GetWorkerCountRecommendation(
+    GetWorkerCountRecommendationResponse& response) {
+  TF_RETURN_IF_ERROR(EnsureInitialized());
+  grpc::ClientContext ctx;
+  GetWorkerCountRecommendationRequest request;
+  grpc::Status s =
+      stub_->GetWorkerCountRecommendation(&ctx, request, &response);
+  if (!s.ok()) {
+    return grpc_util::WrapError("Failed to get worker count recommendation",
+                                s);
+  }
+  return absl::OkStatus();
+}
+
 absl::Status DataServiceDispatcherClient::EnsureInitialized() {
   return grpc_util::Retry([this] { return Initialize(); },
                           "Initialize dispatcher client",
@@ -63,9 +63,11 @@ class DataServiceDispatcherClient : public DataServiceClientBase {
                              DatasetDef& dataset_def);
 
   // Gets the next split for the specified iteration id, repetition, and split
-  // provider index.
+  // provider index. `worker_address` is the address of the worker that will
+  // read the split, if known.
   absl::Status GetSplit(int64_t iteration_id, int64_t repetition,
-                        int64_t split_provider_index, Tensor& split,
+                        int64_t split_provider_index,
+                        const std::string& worker_address, Tensor& split,
                         bool& end_of_splits);
 
   // Gets the next split for the specified source of a stream of the snapshot in
@@ -137,6 +139,11 @@ class DataServiceDispatcherClient : public DataServiceClientBase {
       const std::string& dataset_id, bool disable_compression_at_runtime,
       DisableCompressionAtRuntimeResponse& response);
 
+  // Returns the number of workers the dispatcher recommends for the current
+  // workload.
+  absl::Status GetWorkerCountRecommendation(
+      GetWorkerCountRecommendationResponse& response);
+
  protected:
   absl::Status EnsureInitialized() override;
 
@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <algorithm>
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <optional>
@@ -49,6 +50,7 @@ limitations under the License.
 #include "tensorflow/core/data/service/export.pb.h"
 #include "tensorflow/core/data/service/grpc_util.h"
 #include "tensorflow/core/data/service/journal.h"
+#include "tensorflow/core/data/service/locality_split_scheduler.h"
 #include "tensorflow/core/data/service/journal.pb.h"
 #include "tensorflow/core/data/service/snapshot/file_utils.h"
 #include "tensorflow/core/data/service/snapshot/path_utils.h"
@@ -100,10 +102,16 @@ constexpr char kDatasetsDir[] = "datasets";
 // between completing a stream and getting assigned a new one.
 constexpr int kDefaultWorkerMaxConcurrentSnapshots = 3;
 
+// Number of splits per dataset source for which the dispatcher remembers the
+// worker that read them last.
+constexpr size_t kSplitReadHistoryCapacity = 100000;
+
 constexpr absl::Duration kDefaultIterationGcCheckInterval = absl::Minutes(10);
 constexpr absl::Duration kDefaultIterationGcTimeout = absl::Minutes(5);
 constexpr absl::Duration kDefaultClientTimeout = absl::Minutes(5);
 constexpr absl::Duration kDefaultWorkerTimeout = absl::Minutes(10);
+constexpr absl::Duration kDefaultWorkerCountRecommenderUpdateInterval =
+    absl::Seconds(10);
 
 constexpr std::array<const char*, 8> kNodeNameSharingOps = {
     "HashTable",
@@ -117,6 +125,7 @@ constexpr std::array<const char*, 8> kNodeNameSharingOps = {
 };
 
 using DispatcherConfig = experimental::DispatcherConfig;
+using WorkerCountRecommenderConfig = experimental::WorkerCountRecommenderConfig;
 using Dataset = DispatcherState::Dataset;
 using Worker = DispatcherState::Worker;
 using Job = DispatcherState::Job;
@@ -184,8 +193,41 @@ DispatcherConfig ApplyConfigDefaults(const DispatcherConfig& config) {
     new_config.set_worker_max_concurrent_snapshots(
         kDefaultWorkerMaxConcurrentSnapshots);
   }
+  if (new_config.worker_count_recommender().update_interval_ms() == 0) {
+    new_config.mutable_worker_count_recommender()->set_update_interval_ms(
+        absl::ToInt64Milliseconds(
+            kDefaultWorkerCountRecommenderUpdateInterval));
+  }
   return new_config;
 }
+
+WorkerCountRecommender::Options ToWorkerCountRecommenderOptions(
+    const WorkerCountRecommenderConfig& config) {
+  WorkerCountRecommender::Options options;
+  if (config.sample_window_ms() > 0) {
+    options.sample_window = absl::Milliseconds(config.sample_window_ms());
+  }
+  if (config.worker_startup_time_ms() > 0) {
+    options.worker_startup_time =
+        absl::Milliseconds(config.worker_startup_time_ms());
+  }
+  if (config.max_utilization() > 0) {
+    options.max_utilization = config.max_utilization();
+  }
+  if (config.max_wait_probability() > 0) {
+    options.max_wait_probability = config.max_wait_probability();
+  }
+  if (config.scale_up_delay_ms() > 0) {
+    options.scale_up_delay = absl::Milliseconds(config.scale_up_delay_ms());
+  }
+  if (config.scale_down_delay_ms() > 0) {
+    options.scale_down_delay = absl::Milliseconds(config.scale_down_delay_ms());
+  }
+  if (config.scale_down_threshold() > 0) {
+    options.scale_down_threshold = config.scale_down_threshold();
+  }
+  return options;
+}
 }  // namespace
 
 DataServiceDispatcherImpl::DataServiceDispatcherImpl(
@@ -193,7 +235,9 @@ DataServiceDispatcherImpl::DataServiceDispatcherImpl(
     : config_(ApplyConfigDefaults(config)),
       env_(Env::Default()),
       snapshot_assignment_manager_(config_.worker_max_concurrent_snapshots()),
-      state_(config_) {
+      state_(config_),
+      worker_count_recommender_(
+          ToWorkerCountRecommenderOptions(config_.worker_count_recommender())) {
   if (config_.work_dir().empty()) {
     dataset_store_ = std::make_unique<MemoryDatasetStore>();
   } else {
@@ -209,6 +253,7 @@ DataServiceDispatcherImpl::~DataServiceDispatcherImpl() {
     maintenance_thread_cv_.notify_all();
   }
   maintenance_thread_.reset();
+  worker_count_recommender_thread_.reset();
 }
 
 absl::Status DataServiceDispatcherImpl::Start() {
@@ -217,6 +262,9 @@ absl::Status DataServiceDispatcherImpl::Start() {
     maintenance_thread_ = absl::WrapUnique(env_->StartThread(
         {}, "maintenance-thread", [&] { MaintenanceThread(); }));
   }
+  worker_count_recommender_thread_ = absl::WrapUnique(env_->StartThread(
+      {}, "worker-count-recommender-thread",
+      [&] { WorkerCountRecommenderThread(); }));
   if (config_.work_dir().empty()) {
     if (config_.fault_tolerant_mode()) {
       return errors::InvalidArgument(
@@ -421,6 +469,18 @@ void DataServiceDispatcherImpl::ReportProcessingTimesFromActiveTasks(
               << worker_address
               << " to tf.data service AutoScaler: " << auto_scaler_status;
     }
+    absl::Status recommender_status =
+        worker_count_recommender_.ReportProcessingTime(
+            task->iteration->iteration_id, worker_address,
+            absl::Nanoseconds(processing_time_nsec),
+            absl::FromUnixMicros(env_->NowMicros()));
+    if (!recommender_status.ok()) {
+      VLOG(1) << "Failed to report processing time for Iteration "
+              << task->iteration->iteration_id << " and worker address "
+              << worker_address
+              << " to tf.data service WorkerCountRecommender: "
+              << recommender_status;
+    }
   }
 }
 
@@ -541,6 +601,7 @@ absl::Status DataServiceDispatcherImpl::GetSplit(const GetSplitRequest* request,
   mutex_lock l(get_split_mu_);
   int64_t current_repetition = 0;
   SplitProvider* split_provider = nullptr;
+  LocalitySplitScheduler* split_scheduler = nullptr;
   {
     mutex_lock l(mu_);
     std::shared_ptr<const Iteration> iteration;
@@ -560,23 +621,32 @@ absl::Status DataServiceDispatcherImpl::GetSplit(const GetSplitRequest* request,
       return absl::OkStatus();
     }
     split_provider = split_providers_[iteration_id][provider_index].get();
+    split_scheduler = GetSplitScheduler(*iteration, provider_index);
   }
+  auto reset = [split_provider, split_scheduler]() {
+    return split_scheduler ? split_scheduler->Reset() : split_provider->Reset();
+  };
   if (request->repetition() > current_repetition) {
     // This could happen if an iterator is repeated before reaching end of
     // input, e.g. for the longer input to `Dataset.zip`. In this case we mark
     // the previous repetitions as completed and advance to the requested
     // repetition.
-    TF_RETURN_IF_ERROR(split_provider->Reset());
+    TF_RETURN_IF_ERROR(reset());
   }
   Tensor split;
   bool end_of_splits = false;
-  TF_RETURN_IF_ERROR(split_provider->GetNext(&split, &end_of_splits));
+  if (split_scheduler) {
+    TF_RETURN_IF_ERROR(split_scheduler->GetNext(request->worker_address(),
+                                                split, end_of_splits));
+  } else {
+    TF_RETURN_IF_ERROR(split_provider->GetNext(&split, &end_of_splits));
+  }
   TF_RETURN_IF_ERROR(RecordSplitProduced(iteration_id, repetition,
                                          provider_index, end_of_splits));
   response->set_end_of_splits(end_of_splits);
   if (end_of_splits) {
     // Reset the split provider to prepare for the next iteration.
-    TF_RETURN_IF_ERROR(split_provider->Reset());
+    TF_RETURN_IF_ERROR(reset());
   } else {
     split.AsProtoTensorContent(response->mutable_split());
   }
@@ -597,6 +667,30 @@ absl::Status DataServiceDispatcherImpl::MakeSplitProviders(
   return absl::OkStatus();
 }
 
+LocalitySplitScheduler* DataServiceDispatcherImpl::GetSplitScheduler(
+    const Iteration& iteration, int64_t provider_index)
+    TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+  // Fault tolerant mode restores split providers by replaying the number of
+  // splits produced, which requires handing them out in order.
+  if (config_.split_locality_window_size() <= 0 ||
+      config_.fault_tolerant_mode()) {
+    return nullptr;
+  }
+  std::unique_ptr<LocalitySplitScheduler>& split_scheduler =
+      split_schedulers_[{iteration.iteration_id, provider_index}];
+  if (!split_scheduler) {
+    std::shared_ptr<SplitReadHistory>& history =
+        split_read_histories_[{iteration.job->dataset_id, provider_index}];
+    if (!history) {
+      history = std::make_shared<SplitReadHistory>(kSplitReadHistoryCapacity);
+    }
+    split_scheduler = std::make_unique<LocalitySplitScheduler>(
+        split_providers_[iteration.iteration_id][provider_index].get(),
+        config_.split_locality_window_size(), history);
+  }
+  return split_scheduler.get();
+}
+
 absl::Status DataServiceDispatcherImpl::GetVersion(
     const GetVersionRequest* request, GetVersionResponse* response) {
   response->set_version(kDataServiceVersion);
@@ -793,6 +887,8 @@ absl::Status DataServiceDispatcherImpl::MaybeRemoveTask(
             << " for Iteration " << task->iteration->iteration_id
             << " from tf.data service AutoScaler: " << auto_scaler_status;
   }
+  worker_count_recommender_.RemoveWorker(task->iteration->iteration_id,
+                                         task->worker_address);
   VLOG(1) << "Task " << task->task_id << " successfully removed";
   return absl::OkStatus();
 }
@@ -813,6 +909,8 @@ absl::Status DataServiceDispatcherImpl::ReleaseIterationClient(
             << " for Iteration " << iteration->iteration_id
             << " from tf.data service AutoScaler: " << auto_scaler_status;
   }
+  worker_count_recommender_.RemoveConsumer(iteration->iteration_id,
+                                           iteration_client_id);
   Update update;
   ReleaseIterationClientUpdate* release_iteration_client =
       update.mutable_release_iteration_client();
@@ -1148,6 +1246,23 @@ absl::Status DataServiceDispatcherImpl::ClientHeartbeat(
             << request->iteration_client_id()
             << " to tf.data service AutoScaler: " << auto_scaler_status;
   }
+  const absl::Time now = absl::FromUnixMicros(env_->NowMicros());
+  absl::Status recommender_status =
+      worker_count_recommender_.ReportTargetProcessingTime(
+          iteration->iteration_id, request->iteration_client_id(),
+          absl::Nanoseconds(request->target_processing_time_nsec()), now);
+  if (recommender_status.ok() && request->transfer_time_nsec() > 0) {
+    recommender_status = worker_count_recommender_.ReportTransferTime(
+        iteration->iteration_id, request->iteration_client_id(),
+        absl::Nanoseconds(request->transfer_time_nsec()), now);
+  }
+  if (!recommender_status.ok()) {
+    VLOG(1) << "Failed to report times for Iteration "
+            << iteration->iteration_id << " and consumer ID "
+            << request->iteration_client_id()
+            << " to tf.data service WorkerCountRecommender: "
+            << recommender_status;
+  }
 
   std::vector<std::shared_ptr<const Task>> tasks;
   TF_RETURN_IF_ERROR(state_.TasksForIteration(iteration->iteration_id, tasks));
@@ -1311,6 +1426,27 @@ absl::Status DataServiceDispatcherImpl::DisableCompressionAtRuntime(
   return absl::OkStatus();
 }
 
+absl::Status DataServiceDispatcherImpl::GetWorkerCountRecommendation(
+    const GetWorkerCountRecommendationRequest* request,
+    GetWorkerCountRecommendationResponse* response) {
+  TF_RETURN_IF_ERROR(CheckStarted());
+  {
+    mutex_lock l(mu_);
+    response->set_current_num_workers(state_.GetNumberOfRegisteredWorkers());
+  }
+  std::optional<WorkerCountRecommender::Recommendation> recommendation =
+      worker_count_recommender_.GetRecommendation();
+  if (!recommendation.has_value()) {
+    return absl::OkStatus();
+  }
+  response->set_num_workers(recommendation->num_workers);
+  response->set_model_num_workers(recommendation->model_num_workers);
+  response->set_consumption_rate(recommendation->consumption_rate);
+  response->set_offered_load(recommendation->offered_load);
+  response->set_utilization(recommendation->utilization);
+  return absl::OkStatus();
+}
+
 absl::Status DataServiceDispatcherImpl::PopulateTaskDef(
     std::shared_ptr<const Task> task, TaskDef* task_def) const
     TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
@@ -1423,6 +1559,27 @@ void DataServiceDispatcherImpl::MaintenanceThread() {
   }
 }
 
+void DataServiceDispatcherImpl::WorkerCountRecommenderThread() {
+  const int64_t interval_micros =
+      config_.worker_count_recommender().update_interval_ms() * 1000;
+  int64_t next_update_micros = 0;
+  while (true) {
+    {
+      mutex_lock l(mu_);
+      while (!cancelled_ && env_->NowMicros() < next_update_micros) {
+        int64_t remaining_micros = next_update_micros - env_->NowMicros();
+        maintenance_thread_cv_.wait_for(
+            l, std::chrono::microseconds(remaining_micros));
+      }
+      if (cancelled_) {
+        return;
+      }
+    }
+    worker_count_recommender_.Update(absl::FromUnixMicros(env_->NowMicros()));
+    next_update_micros = env_->NowMicros() + interval_micros;
+  }
+}
+
 void DataServiceDispatcherImpl::RemoveClientFromAutoScaler(int64_t client_id)
     TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
   std::shared_ptr<const Iteration> iteration;
@@ -1435,6 +1592,8 @@ void DataServiceDispatcherImpl::RemoveClientFromAutoScaler(int64_t client_id)
               << " for Iteration " << iteration->iteration_id
               << " from tf.data service AutoScaler: " << auto_scaler_status;
     }
+    worker_count_recommender_.RemoveConsumer(iteration->iteration_id,
+                                             client_id);
   } else {
     VLOG(1) << "Could not find Iteration for client with id " << client_id
             << " in tf.data service dispatcher state: " << s;
@@ -1476,6 +1635,8 @@ void DataServiceDispatcherImpl::RemoveWorkerFromAutoScaler(
                 << " for Iteration " << task->iteration->iteration_id
                 << " from tf.data service AutoScaler: " << auto_scaler_status;
       }
+      worker_count_recommender_.RemoveWorker(task->iteration->iteration_id,
+                                             worker_address);
     }
   } else {
     VLOG(1) << "Could not find tasks for worker with address " << worker_address
@@ -1521,6 +1682,7 @@ absl::Status DataServiceDispatcherImpl::GcOldIterations()
       VLOG(1) << "Failed to unregister Iteration " << iteration->iteration_id
               << " with tf.data service AutoScaler: " << auto_scaler_status;
     }
+    worker_count_recommender_.UnregisterIteration(iteration->iteration_id);
     LOG(INFO) << "Garbage collected iteration " << iteration->DebugString();
   }
   return absl::OkStatus();
@@ -20,6 +20,7 @@ limitations under the License.
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
@@ -32,9 +33,11 @@ limitations under the License.
 #include "tensorflow/core/data/service/dispatcher.pb.h"
 #include "tensorflow/core/data/service/dispatcher_state.h"
 #include "tensorflow/core/data/service/export.pb.h"
+#include "tensorflow/core/data/service/locality_split_scheduler.h"
 #include "tensorflow/core/data/service/snapshot/snapshot_manager.h"
 #include "tensorflow/core/data/service/task_remover.h"
 #include "tensorflow/core/data/service/worker.grpc.pb.h"
+#include "tensorflow/core/data/service/worker_count_recommender.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/macros.h"
@@ -192,6 +195,9 @@ class DataServiceDispatcherImpl {
   absl::Status DisableCompressionAtRuntime(
       const DisableCompressionAtRuntimeRequest* request,
       DisableCompressionAtRuntimeResponse* response);
+  absl::Status GetWorkerCountRecommendation(
+      const GetWorkerCountRecommendationRequest* request,
+      GetWorkerCountRecommendationResponse* response);
 
   // Exports the dispatcher state for debugging.
   DispatcherStateExport ExportState() const;
@@ -200,6 +206,9 @@ class DataServiceDispatcherImpl {
   // A thread which periodically checks for iterations to clean up, clients to
   // release, workers to consider missing, and snapshot streams to reassign.
   void MaintenanceThread();
+  // A thread which periodically updates the recommendation of
+  // `worker_count_recommender_` from the reported times.
+  void WorkerCountRecommenderThread();
 
   // Restores split providers from the state in `iteration` and stores them in
   // `restored`.
@@ -213,6 +222,11 @@ class DataServiceDispatcherImpl {
       const std::string& dataset_id,
       std::vector<std::unique_ptr<SplitProvider>>& split_providers)
       TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Returns the locality-aware scheduler for split provider `provider_index`
+  // of `iteration`, or nullptr if splits are handed out in order.
+  LocalitySplitScheduler* GetSplitScheduler(
+      const DispatcherState::Iteration& iteration, int64_t provider_index)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
   // Registers a dataset, storing the new dataset's id in `dataset_id`.
   absl::Status RegisterDataset(const DatasetDef& dataset,
                                const DataServiceMetadata& metadata,
@@ -258,7 +272,8 @@ class DataServiceDispatcherImpl {
       const absl::flat_hash_set<int64_t>& current_tasks,
       std::vector<std::shared_ptr<const DispatcherState::Task>>& assigned_tasks,
       WorkerHeartbeatResponse* response);
-  // Reports the processing time of each active task to `auto_scaler_`.
+  // Reports the processing time of each active task to `auto_scaler_` and
+  // `worker_count_recommender_`.
   void ReportProcessingTimesFromActiveTasks(
       const std::vector<ActiveTask>& active_tasks,
       const std::string& worker_address) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
@@ -325,12 +340,14 @@ class DataServiceDispatcherImpl {
   // used when recovering state when the dispatcher starts.
   absl::Status ApplyWithoutJournaling(const Update& update)
       TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
-  // Removes the client with `client_id` from `auto_scaler_`
+  // Removes the client with `client_id` from `auto_scaler_` and
+  // `worker_count_recommender_`.
   void RemoveClientFromAutoScaler(int64_t client_id)
       TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
   // Releases iteration clients that haven't heartbeated recently.
   absl::Status ReleaseMissingClients() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
-  // Removes the worker with `worker_address` from `auto_scaler_`, which is
+  // Removes the worker with `worker_address` from `auto_scaler_` and
+  // `worker_count_recommender_`, which is
   // potentially associated with multiple iterations.
   void RemoveWorkerFromAutoScaler(const std::string& worker_address)
       TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
@@ -371,6 +388,16 @@ class DataServiceDispatcherImpl {
   // Mapping from iteration id to the split providers for the iteration.
   absl::flat_hash_map<int64_t, std::vector<std::unique_ptr<SplitProvider>>>
       split_providers_ TF_GUARDED_BY(mu_);
+  // Locality-aware schedulers wrapping `split_providers_`, keyed by iteration
+  // id and split provider index.
+  absl::flat_hash_map<std::pair<int64_t, int64_t>,
+                      std::unique_ptr<LocalitySplitScheduler>>
+      split_schedulers_ TF_GUARDED_BY(mu_);
+  // Which worker read which split, keyed by dataset id and split provider
+  // index. Shared by all iterations of a dataset.
+  absl::flat_hash_map<std::pair<std::string, int64_t>,
+                      std::shared_ptr<SplitReadHistory>>
+      split_read_histories_ TF_GUARDED_BY(mu_);
   // Mapping from round robin iteration id to the round the iteration is
   // currently on. This is based on the data provided by client heartbeats,
   // and may be stale.
@@ -397,10 +424,14 @@ class DataServiceDispatcherImpl {
   std::optional<std::unique_ptr<JournalWriter>> journal_writer_
       TF_GUARDED_BY(mu_);
   DispatcherState state_ TF_GUARDED_BY(mu_);
-  // Condition variable for waking up the gc thread.
+  // Condition variable for waking up the gc and worker count recommender
+  // threads.
   condition_variable maintenance_thread_cv_;
   std::unique_ptr<Thread> maintenance_thread_;
+  std::unique_ptr<Thread> worker_count_recommender_thread_;
   MultipleIterationsAutoScaler auto_scaler_;
+  // Fed the same times as `auto_scaler_`, plus client transfer times.
+  WorkerCountRecommender worker_count_recommender_;
 
   DataServiceDispatcherImpl(const DataServiceDispatcherImpl&) = delete;
   void operator=(const DataServiceDispatcherImpl&) = delete;
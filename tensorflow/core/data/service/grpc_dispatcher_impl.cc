@@ -69,6 +69,7 @@ HANDLER(Snapshot);
 HANDLER(GetSnapshotSplit);
 HANDLER(GetSnapshotStreams);
 HANDLER(DisableCompressionAtRuntime);
+HANDLER(GetWorkerCountRecommendation);
 #undef HANDLER
 
 }  // namespace data
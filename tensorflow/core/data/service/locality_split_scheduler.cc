@@ -0,0 +1,132 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/locality_split_scheduler.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/data/hash_utils.h"
+#include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/types.h"
+#include "tsl/platform/errors.h"
+
+namespace tensorflow {
+namespace data {
+
+SplitReadHistory::SplitReadHistory(size_t capacity) : capacity_(capacity) {}
+
+void SplitReadHistory::RecordRead(uint64 split_hash,
+                                  absl::string_view worker_address) {
+  auto it = last_readers_.find(split_hash);
+  if (it != last_readers_.end()) {
+    it->second.worker_address = std::string(worker_address);
+    order_.splice(order_.end(), order_, it->second.position);
+    return;
+  }
+  order_.push_back(split_hash);
+  last_readers_[split_hash] =
+      Read{std::string(worker_address), std::prev(order_.end())};
+  while (last_readers_.size() > capacity_) {
+    last_readers_.erase(order_.front());
+    order_.pop_front();
+  }
+}
+
+const std::string* SplitReadHistory::LastReader(uint64 split_hash) const {
+  auto it = last_readers_.find(split_hash);
+  if (it == last_readers_.end()) {
+    return nullptr;
+  }
+  return &it->second.worker_address;
+}
+
+LocalitySplitScheduler::LocalitySplitScheduler(
+    SplitProvider* split_provider, int64_t window_size,
+    std::shared_ptr<SplitReadHistory> history)
+    : split_provider_(split_provider),
+      window_size_(window_size),
+      history_(std::move(history)) {}
+
+absl::Status LocalitySplitScheduler::GetNext(absl::string_view worker_address,
+                                             Tensor& split,
+                                             bool& end_of_splits) {
+  TF_RETURN_IF_ERROR(FillWindow());
+  if (window_.empty()) {
+    end_of_splits = true;
+    return absl::OkStatus();
+  }
+
+  size_t chosen = 0;
+  bool found_cold = false;
+  bool found_local = false;
+  for (size_t i = 0; i < window_.size(); ++i) {
+    const std::string* last_reader = history_->LastReader(window_[i].hash);
+    if (last_reader == nullptr) {
+      if (!found_cold) {
+        chosen = i;
+        found_cold = true;
+      }
+    } else if (*last_reader == worker_address) {
+      chosen = i;
+      found_local = true;
+      break;
+    }
+  }
+  if (found_local) {
+    ++num_local_splits_;
+  } else if (!found_cold) {
+    ++num_stolen_splits_;
+  }
+  VLOG(3) << "Assigning split " << window_[chosen].split.DebugString()
+          << " to worker " << worker_address << " ("
+          << (found_local ? "local" : found_cold ? "cold" : "stolen") << ").";
+
+  split = std::move(window_[chosen].split);
+  history_->RecordRead(window_[chosen].hash, worker_address);
+  window_.erase(window_.begin() + chosen);
+  end_of_splits = false;
+  return absl::OkStatus();
+}
+
+absl::Status LocalitySplitScheduler::Reset() {
+  window_.clear();
+  end_of_input_ = false;
+  return split_provider_->Reset();
+}
+
+absl::Status LocalitySplitScheduler::FillWindow() {
+  while (!end_of_input_ &&
+         static_cast<int64_t>(window_.size()) < window_size_) {
+    PendingSplit pending;
+    TF_RETURN_IF_ERROR(split_provider_->GetNext(&pending.split, &end_of_input_));
+    if (end_of_input_) {
+      break;
+    }
+    TF_RETURN_IF_ERROR(HashTensor(pending.split, &pending.hash));
+    window_.push_back(std::move(pending));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,129 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SERVICE_LOCALITY_SPLIT_SCHEDULER_H_
+#define TENSORFLOW_CORE_DATA_SERVICE_LOCALITY_SPLIT_SCHEDULER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace data {
+
+// Remembers which worker most recently read each split, for the `capacity`
+// most recently read splits. Splits are identified by a hash of their content,
+// so the history carries over across repetitions and iterations of a dataset.
+//
+// This class is thread-compatible.
+class SplitReadHistory {
+ public:
+  explicit SplitReadHistory(size_t capacity);
+  SplitReadHistory(const SplitReadHistory&) = delete;
+  SplitReadHistory& operator=(const SplitReadHistory&) = delete;
+
+  // Records that `worker_address` read the split with `split_hash`.
+  void RecordRead(uint64 split_hash, absl::string_view worker_address);
+
+  // Returns the worker that most recently read the split with `split_hash`, or
+  // nullptr if no worker read it or the history forgot about it.
+  const std::string* LastReader(uint64 split_hash) const;
+
+  size_t size() const { return last_readers_.size(); }
+
+ private:
+  struct Read {
+    std::string worker_address;
+    // Position of the split in `order_`.
+    std::list<uint64>::iterator position;
+  };
+
+  const size_t capacity_;
+  absl::flat_hash_map<uint64, Read> last_readers_;
+  // Split hashes, least recently read first.
+  std::list<uint64> order_;
+};
+
+// Hands out the splits of a split provider to workers, preferring to give each
+// worker splits it read before, which it is likely to still have in its page
+// cache.
+//
+// The scheduler reads up to `window_size` splits ahead of the workers. When a
+// worker asks for a split, it gets, in order of preference:
+//   1. the oldest split in the window that it read most recently,
+//   2. the oldest split in the window that no worker read recently,
+//   3. the oldest split in the window, which some other worker read recently.
+// Case 3 lets idle workers steal splits, so that a slow or lost worker can't
+// keep its splits from being processed.
+//
+// Every split is handed out exactly once per repetition, but not necessarily
+// in the order the split provider produces them.
+//
+// This class is thread-compatible.
+class LocalitySplitScheduler {
+ public:
+  // `split_provider` must outlive the scheduler. `history` may be shared with
+  // the schedulers of other iterations of the same dataset source.
+  LocalitySplitScheduler(SplitProvider* split_provider, int64_t window_size,
+                         std::shared_ptr<SplitReadHistory> history);
+  LocalitySplitScheduler(const LocalitySplitScheduler&) = delete;
+  LocalitySplitScheduler& operator=(const LocalitySplitScheduler&) = delete;
+
+  // Gets the next split for `worker_address`. Sets `end_of_splits` once all
+  // splits of the current repetition have been handed out.
+  absl::Status GetNext(absl::string_view worker_address, Tensor& split,
+                       bool& end_of_splits);
+
+  // Drops the splits in the window and resets the split provider.
+  absl::Status Reset();
+
+  // Number of splits handed out to the worker that read them most recently.
+  int64_t num_local_splits() const { return num_local_splits_; }
+  // Number of splits handed out to a worker other than the one that read them
+  // most recently.
+  int64_t num_stolen_splits() const { return num_stolen_splits_; }
+
+ private:
+  struct PendingSplit {
+    Tensor split;
+    uint64 hash = 0;
+  };
+
+  // Reads splits from the split provider until the window is full.
+  absl::Status FillWindow();
+
+  SplitProvider* const split_provider_;
+  const int64_t window_size_;
+  const std::shared_ptr<SplitReadHistory> history_;
+
+  std::deque<PendingSplit> window_;
+  bool end_of_input_ = false;
+  int64_t num_local_splits_ = 0;
+  int64_t num_stolen_splits_ = 0;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SERVICE_LOCALITY_SPLIT_SCHEDULER_H_
@@ -0,0 +1,208 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/locality_split_scheduler.h"
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/data/hash_utils.h"
+#include "tensorflow/core/data/split_utils.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::UnorderedElementsAreArray;
+
+uint64 SplitHash(int64_t index) {
+  uint64 hash = 0;
+  TF_CHECK_OK(HashTensor(Tensor(index), &hash));
+  return hash;
+}
+
+int64_t GetNext(LocalitySplitScheduler& scheduler,
+                const std::string& worker_address) {
+  Tensor split;
+  bool end_of_splits = false;
+  TF_CHECK_OK(scheduler.GetNext(worker_address, split, end_of_splits));
+  return end_of_splits ? -1 : split.scalar<int64_t>()();
+}
+
+TEST(SplitReadHistoryTest, RemembersLastReader) {
+  SplitReadHistory history(/*capacity=*/10);
+  EXPECT_EQ(history.LastReader(1), nullptr);
+  history.RecordRead(1, "worker_a");
+  ASSERT_NE(history.LastReader(1), nullptr);
+  EXPECT_EQ(*history.LastReader(1), "worker_a");
+  history.RecordRead(1, "worker_b");
+  EXPECT_EQ(*history.LastReader(1), "worker_b");
+  EXPECT_EQ(history.size(), 1);
+}
+
+TEST(SplitReadHistoryTest, ForgetsLeastRecentlyRead) {
+  SplitReadHistory history(/*capacity=*/2);
+  history.RecordRead(1, "worker_a");
+  history.RecordRead(2, "worker_a");
+  history.RecordRead(1, "worker_b");
+  history.RecordRead(3, "worker_a");
+  EXPECT_EQ(history.size(), 2);
+  EXPECT_NE(history.LastReader(1), nullptr);
+  EXPECT_EQ(history.LastReader(2), nullptr);
+  EXPECT_NE(history.LastReader(3), nullptr);
+}
+
+TEST(LocalitySplitSchedulerTest, PrefersLocalSplits) {
+  IndexSplitProvider split_provider(/*n=*/10);
+  auto history = std::make_shared<SplitReadHistory>(/*capacity=*/100);
+  history->RecordRead(SplitHash(0), "worker_b");
+  history->RecordRead(SplitHash(5), "worker_a");
+  LocalitySplitScheduler scheduler(&split_provider, /*window_size=*/10,
+                                   history);
+  EXPECT_EQ(GetNext(scheduler, "worker_a"), 5);
+  EXPECT_EQ(GetNext(scheduler, "worker_b"), 0);
+  EXPECT_EQ(scheduler.num_local_splits(), 2);
+  EXPECT_EQ(scheduler.num_stolen_splits(), 0);
+}
+
+TEST(LocalitySplitSchedulerTest, PrefersColdSplitsOverStealing) {
+  IndexSplitProvider split_provider(/*n=*/3);
+  auto history = std::make_shared<SplitReadHistory>(/*capacity=*/100);
+  history->RecordRead(SplitHash(0), "worker_b");
+  history->RecordRead(SplitHash(1), "worker_b");
+  LocalitySplitScheduler scheduler(&split_provider, /*window_size=*/3,
+                                   history);
+  EXPECT_EQ(GetNext(scheduler, "worker_a"), 2);
+  EXPECT_EQ(GetNext(scheduler, "worker_a"), 0);
+  EXPECT_EQ(scheduler.num_stolen_splits(), 1);
+  EXPECT_EQ(*history->LastReader(SplitHash(0)), "worker_a");
+}
+
+TEST(LocalitySplitSchedulerTest, WindowLimitsLookahead) {
+  IndexSplitProvider split_provider(/*n=*/10);
+  auto history = std::make_shared<SplitReadHistory>(/*capacity=*/100);
+  history->RecordRead(SplitHash(5), "worker_a");
+  LocalitySplitScheduler scheduler(&split_provider, /*window_size=*/2,
+                                   history);
+  EXPECT_EQ(GetNext(scheduler, "worker_a"), 0);
+}
+
+TEST(LocalitySplitSchedulerTest, HandsOutEverySplitOnce) {
+  const int64_t num_splits = 20;
+  IndexSplitProvider split_provider(num_splits);
+  auto history = std::make_shared<SplitReadHistory>(/*capacity=*/100);
+  LocalitySplitScheduler scheduler(&split_provider, /*window_size=*/4,
+                                   history);
+  std::vector<int64_t> expected;
+  for (int64_t i = 0; i < num_splits; ++i) {
+    expected.push_back(i);
+  }
+  for (int repetition = 0; repetition < 3; ++repetition) {
+    std::vector<int64_t> splits;
+    for (int64_t i = 0;; ++i) {
+      int64_t split = GetNext(scheduler, absl::StrCat("worker_", i % 3));
+      if (split < 0) {
+        break;
+      }
+      splits.push_back(split);
+    }
+    EXPECT_THAT(splits, UnorderedElementsAreArray(expected));
+    TF_ASSERT_OK(scheduler.Reset());
+  }
+}
+
+TEST(LocalitySplitSchedulerTest, ResetDropsWindow) {
+  IndexSplitProvider split_provider(/*n=*/5);
+  auto history = std::make_shared<SplitReadHistory>(/*capacity=*/100);
+  LocalitySplitScheduler scheduler(&split_provider, /*window_size=*/3,
+                                   history);
+  EXPECT_EQ(GetNext(scheduler, "worker_a"), 0);
+  TF_ASSERT_OK(scheduler.Reset());
+  std::vector<int64_t> splits;
+  for (int64_t split = GetNext(scheduler, "worker_b"); split >= 0;
+       split = GetNext(scheduler, "worker_b")) {
+    splits.push_back(split);
+  }
+  EXPECT_THAT(splits, ElementsAre(1, 2, 3, 4, 0));
+}
+
+// Simulates workers that read one file per split through an LRU page cache,
+// and returns the number of bytes they read from storage after the first
+// epoch. Workers ask for splits in a random order, as they would if they ran
+// at different speeds.
+int64_t SimulateBytesReread(int64_t window_size) {
+  const int64_t num_files = 64;
+  const int64_t file_size_bytes = 1 << 20;
+  const int num_workers = 4;
+  const int64_t page_cache_num_files = num_files / num_workers;
+  const int num_epochs = 5;
+
+  IndexSplitProvider split_provider(num_files);
+  auto history = std::make_shared<SplitReadHistory>(/*capacity=*/num_files);
+  LocalitySplitScheduler scheduler(&split_provider, window_size, history);
+  std::vector<std::list<int64_t>> page_caches(num_workers);
+  std::mt19937 rng(/*seed=*/1);
+  std::uniform_int_distribution<int> random_worker(0, num_workers - 1);
+  int64_t bytes_reread = 0;
+  for (int epoch = 0; epoch < num_epochs; ++epoch) {
+    while (true) {
+      const int worker = random_worker(rng);
+      const int64_t file =
+          GetNext(scheduler, absl::StrCat("/worker:", worker));
+      if (file < 0) {
+        break;
+      }
+      std::list<int64_t>& page_cache = page_caches[worker];
+      auto it = absl::c_find(page_cache, file);
+      if (it != page_cache.end()) {
+        page_cache.erase(it);
+      } else {
+        if (epoch > 0) {
+          bytes_reread += file_size_bytes;
+        }
+        if (static_cast<int64_t>(page_cache.size()) == page_cache_num_files) {
+          page_cache.pop_front();
+        }
+      }
+      page_cache.push_back(file);
+    }
+    TF_CHECK_OK(scheduler.Reset());
+  }
+  return bytes_reread;
+}
+
+TEST(LocalitySplitSchedulerTest, SimulatedBytesReread) {
+  const int64_t in_order_bytes = SimulateBytesReread(/*window_size=*/1);
+  const int64_t locality_bytes = SimulateBytesReread(/*window_size=*/16);
+  LOG(INFO) << "Bytes re-read after the first epoch: " << in_order_bytes
+            << " with in-order assignment, " << locality_bytes
+            << " with locality-aware assignment.";
+  EXPECT_LT(locality_bytes, in_order_bytes / 2);
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
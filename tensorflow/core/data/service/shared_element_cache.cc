@@ -0,0 +1,332 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/shared_element_cache.h"
+
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "tensorflow/core/data/service/data_transfer.h"
+#include "tensorflow/core/data/service/export.pb.h"
+#include "tensorflow/core/data/service/task_runner.h"
+#include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/framework/dataset_options.pb.h"
+#include "tensorflow/core/framework/function.pb.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/metrics.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/model.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/statusor.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+size_t EstimatedSizeBytes(const std::vector<Tensor>& element) {
+  GetElementResult result;
+  result.components = element;
+  return result.EstimatedMemoryUsageBytes();
+}
+
+// Returns whether `node` relaxes determinism.
+bool IsNondeterministic(const NodeDef& node) {
+  const auto& attrs = node.attr();
+  if (auto it = attrs.find("deterministic");
+      it != attrs.end() && it->second.s() == "false") {
+    return true;
+  }
+  // Legacy parallel interleave.
+  if (auto it = attrs.find("sloppy"); it != attrs.end() && it->second.b()) {
+    return true;
+  }
+  if (node.op() == "OptionsDataset") {
+    auto it = attrs.find("serialized_options");
+    Options options;
+    if (it == attrs.end() || !options.ParseFromString(it->second.s())) {
+      return true;
+    }
+    return options.optional_deterministic_case() ==
+               Options::kDeterministic &&
+           !options.deterministic();
+  }
+  return false;
+}
+
+}  // namespace
+
+// Reads one task's element sequence from the cache, producing missing elements
+// with the shared producer of the stream.
+class SharedElementCache::Iterator : public TaskIterator {
+ public:
+  Iterator(SharedElementCache& cache, uint64 fingerprint,
+           std::shared_ptr<Stream> stream, int64_t cardinality,
+           std::shared_ptr<model::Model> model)
+      : cache_(cache),
+        fingerprint_(fingerprint),
+        stream_(std::move(stream)),
+        cardinality_(cardinality),
+        model_(std::move(model)) {}
+
+  absl::Status GetNext(std::vector<Tensor>& element,
+                       bool& end_of_sequence) override {
+    if (private_iterator_) {
+      return GetNextFromPrivateIterator(element, end_of_sequence);
+    }
+    if (cache_.Lookup(stream_->id, next_index_, element)) {
+      cache_.RecordQuery(/*cache_hit=*/true);
+      ++next_index_;
+      end_of_sequence = false;
+      return absl::OkStatus();
+    }
+
+    {
+      mutex_lock l(stream_->mu);
+      // Another task may have produced the element while this one waited.
+      if (cache_.Lookup(stream_->id, next_index_, element)) {
+        cache_.RecordQuery(/*cache_hit=*/true);
+        ++next_index_;
+        end_of_sequence = false;
+        return absl::OkStatus();
+      }
+      if (next_index_ >= stream_->next_index) {
+        return GetNextFromProducer(element, end_of_sequence);
+      }
+    }
+
+    // The element has been produced and evicted already. This task has fallen
+    // too far behind the others to catch up through the cache.
+    VLOG(2) << "Element " << next_index_ << " of dataset " << fingerprint_
+            << " was evicted from the shared element cache. Producing the "
+            << "remaining elements with a private iterator.";
+    TF_ASSIGN_OR_RETURN(std::unique_ptr<TaskIterator> iterator,
+                        stream_->make_iterator());
+    for (int64_t i = 0; i < next_index_; ++i) {
+      std::vector<Tensor> skipped;
+      TF_RETURN_IF_ERROR(iterator->GetNext(skipped, end_of_sequence));
+      if (end_of_sequence) {
+        return errors::FailedPrecondition(
+            "Dataset ", fingerprint_, " produced ", i,
+            " elements, but the shared element cache had ", next_index_,
+            ". Shared element caches require deterministic datasets.");
+      }
+    }
+    private_iterator_ = std::move(iterator);
+    return GetNextFromPrivateIterator(element, end_of_sequence);
+  }
+
+  int64_t Cardinality() const override { return cardinality_; }
+
+  std::shared_ptr<model::Model> model() const override { return model_; }
+
+ private:
+  absl::Status GetNextFromProducer(std::vector<Tensor>& element,
+                                   bool& end_of_sequence)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(stream_->mu) {
+    while (!stream_->end_of_sequence && stream_->next_index <= next_index_) {
+      std::vector<Tensor> produced;
+      bool producer_end_of_sequence = false;
+      TF_RETURN_IF_ERROR(
+          stream_->producer->GetNext(produced, producer_end_of_sequence));
+      if (producer_end_of_sequence) {
+        stream_->end_of_sequence = true;
+        break;
+      }
+      cache_.Insert(stream_->id, stream_->next_index, produced);
+      if (stream_->next_index == next_index_) {
+        element = std::move(produced);
+      }
+      ++stream_->next_index;
+    }
+    if (next_index_ >= stream_->next_index) {
+      end_of_sequence = true;
+      return absl::OkStatus();
+    }
+    cache_.RecordQuery(/*cache_hit=*/false);
+    ++next_index_;
+    end_of_sequence = false;
+    return absl::OkStatus();
+  }
+
+  absl::Status GetNextFromPrivateIterator(std::vector<Tensor>& element,
+                                          bool& end_of_sequence) {
+    TF_RETURN_IF_ERROR(private_iterator_->GetNext(element, end_of_sequence));
+    if (!end_of_sequence) {
+      cache_.RecordQuery(/*cache_hit=*/false);
+      ++next_index_;
+    }
+    return absl::OkStatus();
+  }
+
+  SharedElementCache& cache_;
+  const uint64 fingerprint_;
+  const std::shared_ptr<Stream> stream_;
+  const int64_t cardinality_;
+  const std::shared_ptr<model::Model> model_;
+
+  // Index of the next element to return.
+  int64_t next_index_ = 0;
+  // Set if this task fell behind the cache.
+  std::unique_ptr<TaskIterator> private_iterator_;
+};
+
+SharedElementCache::SharedElementCache(size_t max_size_bytes)
+    : max_size_bytes_(max_size_bytes) {}
+
+absl::StatusOr<std::unique_ptr<TaskIterator>> SharedElementCache::MakeIterator(
+    uint64 fingerprint, IteratorFactory make_iterator) {
+  std::shared_ptr<Stream> stream;
+  {
+    mutex_lock l(mu_);
+    RemoveExpiredStreams();
+    auto it = streams_.find(fingerprint);
+    if (it != streams_.end()) {
+      stream = it->second.stream.lock();
+    }
+    if (!stream) {
+      stream = std::make_shared<Stream>();
+      stream->id = next_stream_id_++;
+      stream->make_iterator = std::move(make_iterator);
+      streams_[fingerprint] = StreamRef{stream->id, stream};
+    }
+  }
+
+  int64_t cardinality = 0;
+  std::shared_ptr<model::Model> model;
+  {
+    mutex_lock l(stream->mu);
+    if (!stream->producer) {
+      TF_ASSIGN_OR_RETURN(stream->producer, stream->make_iterator());
+    }
+    cardinality = stream->producer->Cardinality();
+    model = stream->producer->model();
+  }
+  return std::make_unique<Iterator>(*this, fingerprint, std::move(stream),
+                                    cardinality, std::move(model));
+}
+
+void SharedElementCache::RemoveExpiredStreams() {
+  absl::flat_hash_set<int64_t> expired_ids;
+  for (auto it = streams_.begin(); it != streams_.end();) {
+    if (it->second.stream.expired()) {
+      expired_ids.insert(it->second.id);
+      streams_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  if (expired_ids.empty()) {
+    return;
+  }
+  auto expired = [&expired_ids](const Key& key) {
+    return expired_ids.contains(key.first);
+  };
+  for (const Key& key : insertion_order_) {
+    if (!expired(key)) continue;
+    auto it = entries_.find(key);
+    size_bytes_ -= it->second.size_bytes;
+    entries_.erase(it);
+  }
+  insertion_order_.erase(std::remove_if(insertion_order_.begin(),
+                                        insertion_order_.end(), expired),
+                         insertion_order_.end());
+  metrics::RecordTFDataServiceSharedElementCacheSizeBytes(size_bytes_);
+}
+
+bool SharedElementCache::Lookup(int64_t stream_id, int64_t index,
+                                std::vector<Tensor>& element) {
+  tf_shared_lock l(mu_);
+  auto it = entries_.find(Key(stream_id, index));
+  if (it == entries_.end()) {
+    return false;
+  }
+  element = it->second.element;
+  return true;
+}
+
+void SharedElementCache::Insert(int64_t stream_id, int64_t index,
+                                const std::vector<Tensor>& element) {
+  Entry entry;
+  entry.element = element;
+  entry.size_bytes = EstimatedSizeBytes(element);
+  const size_t size_bytes = entry.size_bytes;
+  if (size_bytes > max_size_bytes_) {
+    return;
+  }
+
+  mutex_lock l(mu_);
+  const Key key(stream_id, index);
+  if (!entries_.emplace(key, std::move(entry)).second) {
+    return;
+  }
+  insertion_order_.push_back(key);
+  size_bytes_ += size_bytes;
+  while (size_bytes_ > max_size_bytes_) {
+    auto it = entries_.find(insertion_order_.front());
+    size_bytes_ -= it->second.size_bytes;
+    entries_.erase(it);
+    insertion_order_.pop_front();
+    ++evictions_;
+    metrics::RecordTFDataServiceSharedElementCacheEviction();
+  }
+  metrics::RecordTFDataServiceSharedElementCacheSizeBytes(size_bytes_);
+}
+
+void SharedElementCache::RecordQuery(bool cache_hit) {
+  {
+    mutex_lock l(mu_);
+    ++(cache_hit ? hits_ : misses_);
+  }
+  metrics::RecordTFDataServiceSharedElementCacheQuery(cache_hit);
+}
+
+SharedElementCacheExport SharedElementCache::ExportState() const {
+  SharedElementCacheExport state;
+  tf_shared_lock l(mu_);
+  state.set_hits(hits_);
+  state.set_misses(misses_);
+  state.set_evictions(evictions_);
+  state.set_num_elements(entries_.size());
+  state.set_size_bytes(size_bytes_);
+  return state;
+}
+
+bool ProducesDeterministicSequence(const GraphDef& graph) {
+  for (const NodeDef& node : graph.node()) {
+    if (IsNondeterministic(node)) return false;
+  }
+  for (const FunctionDef& function : graph.library().function()) {
+    for (const NodeDef& node : function.node_def()) {
+      if (IsNondeterministic(node)) return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,146 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SERVICE_SHARED_ELEMENT_CACHE_H_
+#define TENSORFLOW_CORE_DATA_SERVICE_SHARED_ELEMENT_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "tensorflow/core/data/service/export.pb.h"
+#include "tensorflow/core/data/service/task_runner.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace data {
+
+// Size-bounded element cache shared by all tasks of a worker. Unlike the
+// `CrossTrainerCache`, which is shared by the trainers of one job, this cache
+// is shared across jobs: tasks that iterate over the same dataset graph read
+// each other's elements instead of producing them again. This helps when
+// several jobs read the same dataset concurrently, for example in a
+// hyperparameter sweep.
+//
+// Tasks that iterate over graphs with the same fingerprint share a stream: one
+// producer iterator, so each element is produced once no matter how many tasks
+// read it. Elements are keyed by their stream and their index in the stream.
+// A stream is dropped, with its elements, once no task reads from it; later
+// tasks of the fingerprint start a new stream. When the cache is full, the
+// oldest elements are evicted. A task that needs an evicted element falls back
+// to producing the rest of its sequence with a private iterator, so the cache
+// should be large enough to cover the lag between concurrent jobs.
+//
+// Tasks only see the same sequence if the graph produces it deterministically.
+// Callers must not use the cache for graphs that relax determinism (see
+// `ProducesDeterministicSequence`) or for tasks with dynamic sharding.
+//
+// The `SharedElementCache` class is thread-safe.
+class SharedElementCache {
+ public:
+  // Creates an iterator over a dataset graph. Called to create the shared
+  // producer of a fingerprint, and the private iterator of a task that fell
+  // behind the cache.
+  using IteratorFactory =
+      std::function<absl::StatusOr<std::unique_ptr<TaskIterator>>()>;
+
+  explicit SharedElementCache(size_t max_size_bytes);
+  SharedElementCache(const SharedElementCache&) = delete;
+  SharedElementCache& operator=(const SharedElementCache&) = delete;
+
+  // Returns an iterator over the elements of the graph with `fingerprint`,
+  // reading from the cache where possible. `make_iterator` creates iterators
+  // over that graph.
+  absl::StatusOr<std::unique_ptr<TaskIterator>> MakeIterator(
+      uint64 fingerprint, IteratorFactory make_iterator);
+
+  // Returns the cache statistics.
+  SharedElementCacheExport ExportState() const;
+
+ private:
+  class Iterator;
+
+  // The element sequence of a fingerprint, shared by the tasks reading it.
+  struct Stream {
+    // Unique across the streams of the cache.
+    int64_t id = 0;
+    mutex mu;
+    IteratorFactory make_iterator;
+    std::unique_ptr<TaskIterator> producer TF_GUARDED_BY(mu);
+    // Index of the next element `producer` will produce.
+    int64_t next_index TF_GUARDED_BY(mu) = 0;
+    bool end_of_sequence TF_GUARDED_BY(mu) = false;
+  };
+
+  // Stream ID and element index.
+  using Key = std::pair<int64_t, int64_t>;
+
+  struct StreamRef {
+    int64_t id = 0;
+    std::weak_ptr<Stream> stream;
+  };
+
+  struct Entry {
+    std::vector<Tensor> element;
+    size_t size_bytes = 0;
+  };
+
+  // Looks up element `index` of stream `stream_id` and stores it in
+  // `element`. Returns whether the element was found.
+  bool Lookup(int64_t stream_id, int64_t index, std::vector<Tensor>& element)
+      TF_LOCKS_EXCLUDED(mu_);
+  // Adds element `index` of stream `stream_id`, evicting old elements as
+  // needed.
+  void Insert(int64_t stream_id, int64_t index,
+              const std::vector<Tensor>& element) TF_LOCKS_EXCLUDED(mu_);
+  // Removes the elements of the streams no task reads from anymore.
+  void RemoveExpiredStreams() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void RecordQuery(bool cache_hit) TF_LOCKS_EXCLUDED(mu_);
+
+  const size_t max_size_bytes_;
+
+  mutable mutex mu_;
+  absl::flat_hash_map<Key, Entry> entries_ TF_GUARDED_BY(mu_);
+  // Keys of `entries_`, oldest first.
+  std::deque<Key> insertion_order_ TF_GUARDED_BY(mu_);
+  size_t size_bytes_ TF_GUARDED_BY(mu_) = 0;
+  // Streams by fingerprint. Streams are removed once no task reads from them.
+  absl::flat_hash_map<uint64, StreamRef> streams_ TF_GUARDED_BY(mu_);
+  int64_t next_stream_id_ TF_GUARDED_BY(mu_) = 0;
+  int64_t hits_ TF_GUARDED_BY(mu_) = 0;
+  int64_t misses_ TF_GUARDED_BY(mu_) = 0;
+  int64_t evictions_ TF_GUARDED_BY(mu_) = 0;
+};
+
+// Returns whether iterating over `graph` always produces the same sequence, as
+// far as its determinism settings tell: no op or dataset option relaxes
+// determinism. The graph of a task must satisfy this for the task to read
+// through a `SharedElementCache`.
+bool ProducesDeterministicSequence(const GraphDef& graph);
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SERVICE_SHARED_ELEMENT_CACHE_H_
@@ -0,0 +1,308 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/shared_element_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "tensorflow/core/data/service/data_transfer.h"
+#include "tensorflow/core/data/service/export.pb.h"
+#include "tensorflow/core/data/service/task_runner.h"
+#include "tensorflow/core/framework/dataset_options.pb.h"
+#include "tensorflow/core/framework/function.pb.h"
+#include "tensorflow/core/framework/graph.pb.h"
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/status_matchers.h"
+#include "tensorflow/core/platform/test.h"
+#include "tsl/platform/statusor.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::tensorflow::monitoring::testing::CellReader;
+using ::tensorflow::testing::StatusIs;
+
+constexpr size_t kLargeCache = size_t{1} << 30;  // 1GB
+
+// Counts the elements produced by all iterators it creates.
+struct ProducerStats {
+  int64_t num_iterators = 0;
+  int64_t num_elements = 0;
+};
+
+class RangeIterator : public TaskIterator {
+ public:
+  RangeIterator(const int64_t range, ProducerStats& stats)
+      : range_(range), stats_(stats) {}
+
+  absl::Status GetNext(std::vector<Tensor>& element,
+                       bool& end_of_sequence) override {
+    end_of_sequence = (next_ >= range_);
+    if (end_of_sequence) {
+      return absl::OkStatus();
+    }
+    ++stats_.num_elements;
+    element = {Tensor{next_++}};
+    return absl::OkStatus();
+  }
+
+  int64_t Cardinality() const override { return range_; }
+
+ private:
+  const int64_t range_;
+  ProducerStats& stats_;
+  int64_t next_ = 0;
+};
+
+SharedElementCache::IteratorFactory RangeFactory(int64_t range,
+                                                 ProducerStats& stats) {
+  return [range, &stats]() -> absl::StatusOr<std::unique_ptr<TaskIterator>> {
+    ++stats.num_iterators;
+    return std::make_unique<RangeIterator>(range, stats);
+  };
+}
+
+// Reads `num_elements` elements from `iterator`.
+std::vector<int64_t> Read(TaskIterator& iterator, int64_t num_elements) {
+  std::vector<int64_t> result;
+  for (int64_t i = 0; i < num_elements; ++i) {
+    std::vector<Tensor> element;
+    bool end_of_sequence = false;
+    TF_CHECK_OK(iterator.GetNext(element, end_of_sequence));
+    if (end_of_sequence) {
+      break;
+    }
+    result.push_back(element[0].scalar<int64_t>()());
+  }
+  return result;
+}
+
+std::vector<int64_t> Range(int64_t begin, int64_t end) {
+  std::vector<int64_t> result;
+  for (int64_t i = begin; i < end; ++i) {
+    result.push_back(i);
+  }
+  return result;
+}
+
+size_t ElementSizeBytes() {
+  GetElementResult result;
+  result.components = {Tensor{int64_t{0}}};
+  return result.EstimatedMemoryUsageBytes();
+}
+
+TEST(SharedElementCacheTest, ReadersShareProducer) {
+  const int64_t range = 10;
+  ProducerStats stats;
+  SharedElementCache cache(kLargeCache);
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator1,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator2,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  EXPECT_EQ(iterator1->Cardinality(), range);
+  EXPECT_EQ(Read(*iterator1, range + 1), Range(0, range));
+  EXPECT_EQ(Read(*iterator2, range + 1), Range(0, range));
+  EXPECT_EQ(stats.num_iterators, 1);
+  EXPECT_EQ(stats.num_elements, range);
+
+  SharedElementCacheExport state = cache.ExportState();
+  EXPECT_EQ(state.hits(), range);
+  EXPECT_EQ(state.misses(), range);
+  EXPECT_EQ(state.evictions(), 0);
+  EXPECT_EQ(state.num_elements(), range);
+}
+
+TEST(SharedElementCacheTest, InterleavedReaders) {
+  const int64_t range = 10;
+  ProducerStats stats;
+  SharedElementCache cache(kLargeCache);
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator1,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator2,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  std::vector<int64_t> result1, result2;
+  for (int64_t i = 0; i < range; i += 2) {
+    for (int64_t value : Read(*iterator1, 2)) result1.push_back(value);
+    for (int64_t value : Read(*iterator2, 3)) result2.push_back(value);
+  }
+  EXPECT_EQ(result1, Range(0, range));
+  EXPECT_EQ(result2, Range(0, range));
+  EXPECT_EQ(stats.num_elements, range);
+}
+
+TEST(SharedElementCacheTest, DifferentFingerprints) {
+  const int64_t range = 5;
+  ProducerStats stats;
+  SharedElementCache cache(kLargeCache);
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator1,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator2,
+      cache.MakeIterator(/*fingerprint=*/2, RangeFactory(range, stats)));
+  EXPECT_EQ(Read(*iterator1, range), Range(0, range));
+  EXPECT_EQ(Read(*iterator2, range), Range(0, range));
+  EXPECT_EQ(stats.num_iterators, 2);
+  EXPECT_EQ(stats.num_elements, 2 * range);
+  EXPECT_EQ(cache.ExportState().hits(), 0);
+}
+
+TEST(SharedElementCacheTest, LaggingReaderFallsBack) {
+  const int64_t range = 10;
+  ProducerStats stats;
+  SharedElementCache cache(/*max_size_bytes=*/2 * ElementSizeBytes());
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator1,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator2,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  EXPECT_EQ(Read(*iterator1, 5), Range(0, 5));
+  EXPECT_EQ(Read(*iterator2, range + 1), Range(0, range));
+  EXPECT_EQ(Read(*iterator1, range + 1), Range(5, range));
+  EXPECT_EQ(stats.num_iterators, 2);
+
+  SharedElementCacheExport state = cache.ExportState();
+  EXPECT_GT(state.evictions(), 0);
+  EXPECT_EQ(state.num_elements(), 2);
+  EXPECT_EQ(state.size_bytes(), 2 * ElementSizeBytes());
+}
+
+TEST(SharedElementCacheTest, StreamOutlivesFirstReader) {
+  const int64_t range = 10;
+  ProducerStats stats;
+  SharedElementCache cache(kLargeCache);
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator1,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator2,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  EXPECT_EQ(Read(*iterator1, 3), Range(0, 3));
+  iterator1.reset();
+  EXPECT_EQ(Read(*iterator2, range + 1), Range(0, range));
+  EXPECT_EQ(stats.num_iterators, 1);
+  EXPECT_EQ(stats.num_elements, range);
+}
+
+TEST(SharedElementCacheTest, NewStreamDoesNotReadOldElements) {
+  ProducerStats stats;
+  SharedElementCache cache(kLargeCache);
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator1,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(/*range=*/10, stats)));
+  EXPECT_EQ(Read(*iterator1, 3), Range(0, 3));
+  iterator1.reset();
+
+  // The first stream has no readers left, so this starts a new one.
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator2,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(/*range=*/2, stats)));
+  EXPECT_EQ(Read(*iterator2, 10), Range(0, 2));
+  EXPECT_EQ(stats.num_iterators, 2);
+  EXPECT_EQ(stats.num_elements, 5);
+  EXPECT_EQ(cache.ExportState().num_elements(), 2);
+}
+
+TEST(SharedElementCacheTest, ProducerError) {
+  SharedElementCache cache(kLargeCache);
+  EXPECT_THAT(
+      cache.MakeIterator(
+          /*fingerprint=*/1,
+          []() -> absl::StatusOr<std::unique_ptr<TaskIterator>> {
+            return errors::InvalidArgument("Failed to make iterator");
+          }),
+      StatusIs(error::INVALID_ARGUMENT));
+}
+
+TEST(SharedElementCacheTest, Metrics) {
+  CellReader<int64_t> queries(
+      "/tensorflow/data/service/shared_element_cache_queries");
+  CellReader<int64_t> evictions(
+      "/tensorflow/data/service/shared_element_cache_evictions");
+  const int64_t range = 4;
+  ProducerStats stats;
+  SharedElementCache cache(/*max_size_bytes=*/2 * ElementSizeBytes());
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator1,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<TaskIterator> iterator2,
+      cache.MakeIterator(/*fingerprint=*/1, RangeFactory(range, stats)));
+  EXPECT_EQ(Read(*iterator1, 1), Range(0, 1));
+  EXPECT_EQ(Read(*iterator2, 1), Range(0, 1));
+  EXPECT_EQ(queries.Delta("true"), 1);
+  EXPECT_EQ(queries.Delta("false"), 1);
+  EXPECT_EQ(Read(*iterator1, 3), Range(1, 4));
+  EXPECT_EQ(evictions.Delta(), 2);
+}
+
+TEST(ProducesDeterministicSequenceTest, DeterministicGraph) {
+  GraphDef graph;
+  NodeDef* node = graph.add_node();
+  node->set_op("ParallelMapDatasetV2");
+  (*node->mutable_attr())["deterministic"].set_s("default");
+  EXPECT_TRUE(ProducesDeterministicSequence(graph));
+}
+
+TEST(ProducesDeterministicSequenceTest, NondeterministicOp) {
+  GraphDef graph;
+  NodeDef* node = graph.add_node();
+  node->set_op("ParallelMapDatasetV2");
+  (*node->mutable_attr())["deterministic"].set_s("false");
+  EXPECT_FALSE(ProducesDeterministicSequence(graph));
+}
+
+TEST(ProducesDeterministicSequenceTest, NondeterministicOpInFunction) {
+  GraphDef graph;
+  NodeDef* node = graph.mutable_library()->add_function()->add_node_def();
+  node->set_op("ParallelInterleaveDataset");
+  (*node->mutable_attr())["sloppy"].set_b(true);
+  EXPECT_FALSE(ProducesDeterministicSequence(graph));
+}
+
+TEST(ProducesDeterministicSequenceTest, NondeterministicOptions) {
+  Options options;
+  options.set_deterministic(false);
+  GraphDef graph;
+  NodeDef* node = graph.add_node();
+  node->set_op("OptionsDataset");
+  (*node->mutable_attr())["serialized_options"].set_s(
+      options.SerializeAsString());
+  EXPECT_FALSE(ProducesDeterministicSequence(graph));
+
+  options.set_deterministic(true);
+  (*node->mutable_attr())["serialized_options"].set_s(
+      options.SerializeAsString());
+  EXPECT_TRUE(ProducesDeterministicSequence(graph));
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,1012 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/shm_data_transfer.h"
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/data/service/data_transfer.h"
+#include "tensorflow/core/data/service/worker.pb.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/dataset.pb.h"
+#include "tensorflow/core/framework/metrics.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor.pb.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/framework/variant.h"
+#include "tensorflow/core/platform/coding.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/protobuf.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/platform/raw_coding.h"
+#include "tensorflow/core/platform/refcount.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/protobuf/service_config.pb.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tsl/platform/host_info.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+constexpr char kRingSizeEnvVar[] = "TF_DATA_SHM_TRANSFER_RING_SIZE_IN_MB";
+constexpr int64_t kDefaultRingSizeInMB = 256;
+
+// Alignment of the ring within the segment, and of every piece of data in the
+// ring. Tensors that alias the ring must satisfy Eigen's alignment.
+constexpr uint64_t kAlignment = 64;
+
+// Upper bound on the size of a frame header, to guard against reading a
+// corrupt length.
+constexpr uint64_t kMaxHeaderSize = uint64_t{1} << 30;
+
+// Maximum number of randomly chosen ports to try when the server is not given
+// a port.
+constexpr int kMaxBindAttempts = 16;
+
+// How a component is encoded.
+enum class Encoding : uint8_t {
+  // The tensor's bytes, for types that can be memcpy-ed.
+  kRaw = 0,
+  // A serialized TensorProto.
+  kTensorProto = 1,
+  // A serialized CompressedElement, wrapped in a scalar variant tensor.
+  kCompressed = 2,
+};
+
+// Where the bytes of a component are.
+enum class Location : uint8_t {
+  // In the shared-memory ring.
+  kRing = 0,
+  // Over the socket, right after the response header.
+  kInline = 1,
+};
+
+// Header at the start of every shared-memory segment.
+struct RingHeader {
+  // Number of bytes the client has handed back to the server, counted from the
+  // creation of the ring. Written by the client and read by the server.
+  std::atomic<uint64_t> released;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "The ring header is shared between processes.");
+static_assert(sizeof(RingHeader) <= kAlignment);
+
+uint64_t RoundUp(uint64_t n) {
+  return (n + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+absl::Status ErrnoError(absl::string_view context) {
+  return errors::Unavailable(context, ": ", std::strerror(errno));
+}
+
+// Returns the address of the socket for the server with port `port`. The
+// leading NUL byte puts the socket in the abstract namespace, so it does not
+// leave a file behind.
+sockaddr_un SocketAddress(int port, socklen_t* length) {
+  const std::string name = absl::StrCat("tf_data_shm_transfer_", port);
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path + 1, name.data(), name.size());
+  *length = offsetof(sockaddr_un, sun_path) + 1 + name.size();
+  return address;
+}
+
+// Returns an error unless the peer of the connected socket `fd` runs as user
+// `uid`. Any process in the network namespace can connect to the abstract
+// socket, so this is what keeps other users from reading the elements.
+absl::Status CheckPeerUid(int fd, uid_t uid) {
+  ucred credentials;
+  socklen_t length = sizeof(credentials);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+    return ErrnoError("Failed to get the credentials of a shm data transfer "
+                      "client");
+  }
+  if (credentials.uid != uid) {
+    return errors::PermissionDenied(
+        "The shm data transfer client runs as user ", credentials.uid,
+        ", but the worker runs as user ", uid);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status WriteFully(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return ErrnoError("Failed to write to shm data transfer socket");
+    }
+    data += n;
+    size -= n;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ReadFully(int fd, char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = recv(fd, data, size, 0);
+    if (n == 0) {
+      return errors::Unavailable("shm data transfer connection was closed.");
+    }
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return ErrnoError("Failed to read from shm data transfer socket");
+    }
+    data += n;
+    size -= n;
+  }
+  return absl::OkStatus();
+}
+
+// A frame is a fixed64 length followed by that many bytes.
+absl::Status WriteFrame(int fd, absl::string_view contents) {
+  std::string frame;
+  frame.reserve(sizeof(uint64_t) + contents.size());
+  core::PutFixed64(&frame, contents.size());
+  frame.append(contents.data(), contents.size());
+  return WriteFully(fd, frame.data(), frame.size());
+}
+
+absl::Status ReadFrame(int fd, std::string& contents) {
+  char length[sizeof(uint64_t)];
+  TF_RETURN_IF_ERROR(ReadFully(fd, length, sizeof(length)));
+  const uint64_t size = core::DecodeFixed64(length);
+  if (size > kMaxHeaderSize) {
+    return errors::DataLoss("Invalid shm data transfer frame size: ", size);
+  }
+  contents.resize(size);
+  return ReadFully(fd, contents.data(), size);
+}
+
+// Frames that carry a status start with its code; non-OK frames end with the
+// status message.
+bool EncodeStatus(const absl::Status& status, std::string& out) {
+  core::PutVarint32(&out, static_cast<uint32_t>(status.code()));
+  if (!status.ok()) {
+    out.append(status.message().data(), status.message().size());
+  }
+  return status.ok();
+}
+
+absl::Status DecodeStatus(absl::string_view& input) {
+  uint32_t code;
+  if (!core::GetVarint32(&input, &code)) {
+    return errors::DataLoss("Corrupt shm data transfer frame.");
+  }
+  if (code == 0) {
+    return absl::OkStatus();
+  }
+  return absl::Status(static_cast<absl::StatusCode>(code), input);
+}
+
+// A POSIX shared-memory segment holding a RingHeader followed by the ring.
+class ShmSegment {
+ public:
+  // Creates and maps a new segment called `name`.
+  static absl::StatusOr<std::unique_ptr<ShmSegment>> Create(
+      const std::string& name, uint64_t capacity) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+      return ErrnoError(absl::StrCat("Failed to create shm segment ", name));
+    }
+    const uint64_t size = kAlignment + capacity;
+    // Reserves the pages up front: running out of space in /dev/shm should
+    // fail here rather than raise SIGBUS when the ring is written.
+    int error = posix_fallocate(fd, 0, size);
+    if (error != 0) {
+      close(fd);
+      shm_unlink(name.c_str());
+      return errors::ResourceExhausted("Failed to allocate ", size,
+                                       " bytes for shm segment ", name, ": ",
+                                       std::strerror(error));
+    }
+    auto segment = Map(fd, name, capacity);
+    if (!segment.ok()) {
+      shm_unlink(name.c_str());
+    }
+    return segment;
+  }
+
+  // Maps the existing segment `name` and unlinks it, so that it is freed once
+  // both sides have unmapped it.
+  static absl::StatusOr<std::unique_ptr<ShmSegment>> Open(
+      const std::string& name, uint64_t capacity) {
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+      return ErrnoError(absl::StrCat("Failed to open shm segment ", name));
+    }
+    shm_unlink(name.c_str());
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < kAlignment + capacity) {
+      close(fd);
+      return errors::FailedPrecondition("shm segment ", name,
+                                        " is smaller than expected.");
+    }
+    return Map(fd, name, capacity);
+  }
+
+  ~ShmSegment() { munmap(base_, kAlignment + capacity_); }
+
+  RingHeader* header() const { return reinterpret_cast<RingHeader*>(base_); }
+  char* ring() const { return static_cast<char*>(base_) + kAlignment; }
+  uint64_t capacity() const { return capacity_; }
+
+ private:
+  ShmSegment(void* base, uint64_t capacity)
+      : base_(base), capacity_(capacity) {}
+
+  // Maps and closes `fd`.
+  static absl::StatusOr<std::unique_ptr<ShmSegment>> Map(
+      int fd, const std::string& name, uint64_t capacity) {
+    void* base = mmap(nullptr, kAlignment + capacity, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      return ErrnoError(absl::StrCat("Failed to map shm segment ", name));
+    }
+    return absl::WrapUnique(new ShmSegment(base, capacity));
+  }
+
+  void* const base_;
+  const uint64_t capacity_;
+};
+
+// Server side of a ring: hands out space that the client has released.
+// Offsets are counted from the creation of the ring and never wrap.
+class RingWriter {
+ public:
+  explicit RingWriter(const ShmSegment& segment) : segment_(segment) {}
+
+  // Reserves `size` contiguous bytes and returns their offset, or
+  // std::nullopt if the client holds too much of the ring.
+  std::optional<uint64_t> Allocate(uint64_t size) {
+    const uint64_t capacity = segment_.capacity();
+    const uint64_t aligned_size = RoundUp(size);
+    if (aligned_size > capacity) {
+      return std::nullopt;
+    }
+    uint64_t start = written_;
+    const uint64_t position = start % capacity;
+    if (position + aligned_size > capacity) {
+      // Skips the tail of the ring; it is released with this element.
+      start += capacity - position;
+    }
+    const uint64_t end = start + aligned_size;
+    const uint64_t released =
+        segment_.header()->released.load(std::memory_order_acquire);
+    if (end - released > capacity) {
+      return std::nullopt;
+    }
+    written_ = end;
+    return start;
+  }
+
+  char* At(uint64_t offset) const {
+    return segment_.ring() + offset % segment_.capacity();
+  }
+
+  // Offset up to which the ring has been handed out.
+  uint64_t written() const { return written_; }
+
+ private:
+  const ShmSegment& segment_;
+  uint64_t written_ = 0;
+};
+
+// Client side of a ring. Elements occupy consecutive parts of the ring and
+// are released in order, once every tensor aliasing them has been destroyed.
+// Elements that take no space in the ring are not tracked: their end would
+// be the same as the end of the element before them.
+class RingReader {
+ public:
+  explicit RingReader(std::unique_ptr<ShmSegment> segment)
+      : segment_(std::move(segment)) {}
+
+  const char* At(uint64_t offset) const {
+    return segment_->ring() + offset % segment_->capacity();
+  }
+
+  // Records that the next element occupies the ring up to `end`. Ends must be
+  // strictly increasing.
+  void Add(uint64_t end) TF_LOCKS_EXCLUDED(mu_) {
+    mutex_lock l(mu_);
+    DCHECK(outstanding_.empty() || outstanding_.back().end < end);
+    outstanding_.push_back({end, false});
+  }
+
+  // Marks the element occupying the ring up to `end` as no longer used, and
+  // hands back the longest released prefix of the ring to the server.
+  void Release(uint64_t end) TF_LOCKS_EXCLUDED(mu_) {
+    mutex_lock l(mu_);
+    for (auto& element : outstanding_) {
+      if (element.end == end) {
+        element.released = true;
+        break;
+      }
+    }
+    std::optional<uint64_t> released;
+    while (!outstanding_.empty() && outstanding_.front().released) {
+      released = outstanding_.front().end;
+      outstanding_.pop_front();
+    }
+    if (released.has_value()) {
+      segment_->header()->released.store(*released, std::memory_order_release);
+    }
+  }
+
+ private:
+  struct Element {
+    uint64_t end;
+    bool released;
+  };
+
+  const std::unique_ptr<ShmSegment> segment_;
+  mutex mu_;
+  std::deque<Element> outstanding_ TF_GUARDED_BY(mu_);
+};
+
+// Releases the part of the ring used by one element when destroyed.
+class ElementRegion {
+ public:
+  ElementRegion(std::shared_ptr<RingReader> ring, uint64_t end)
+      : ring_(std::move(ring)), end_(end) {
+    ring_->Add(end_);
+  }
+  ~ElementRegion() { ring_->Release(end_); }
+
+  const RingReader& ring() const { return *ring_; }
+
+ private:
+  const std::shared_ptr<RingReader> ring_;
+  const uint64_t end_;
+};
+
+// A tensor buffer that aliases the ring. Keeps the element's region, and with
+// it the mapping, alive.
+class ShmTensorBuffer : public TensorBuffer {
+ public:
+  ShmTensorBuffer(const char* data, size_t size,
+                  std::shared_ptr<ElementRegion> region)
+      : TensorBuffer(const_cast<char*>(data)),
+        size_(size),
+        region_(std::move(region)) {}
+
+  size_t size() const override { return size_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("shm_data_transfer");
+  }
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  const size_t size_;
+  const std::shared_ptr<ElementRegion> region_;
+};
+
+class ShmDataTransferServer : public DataTransferServer {
+ public:
+  explicit ShmDataTransferServer(DataTransferServer::GetElementT get_element)
+      : get_element_(std::move(get_element)),
+        ring_capacity_(RoundUp(RingSizeInMB() << 20)) {}
+
+  ~ShmDataTransferServer() override {
+    {
+      mutex_lock l(mu_);
+      cancelled_ = true;
+      for (const auto& [id, fd] : connection_fds_) {
+        shutdown(fd, SHUT_RDWR);
+      }
+    }
+    if (listen_fd_ >= 0) {
+      // Wakes up the accept thread.
+      shutdown(listen_fd_, SHUT_RDWR);
+    }
+    accept_thread_.reset();
+    absl::flat_hash_map<int64_t, std::unique_ptr<Thread>> connection_threads;
+    {
+      mutex_lock l(mu_);
+      connection_threads.swap(connection_threads_);
+    }
+    connection_threads.clear();
+    if (listen_fd_ >= 0) {
+      close(listen_fd_);
+    }
+  }
+
+  absl::Status Start(const experimental::WorkerConfig& config) override {
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+      return ErrnoError("Failed to create shm data transfer socket");
+    }
+    if (config.data_transfer_port() > 0) {
+      TF_RETURN_IF_ERROR(Bind(config.data_transfer_port()));
+    } else {
+      absl::Status s;
+      for (int i = 0; i < kMaxBindAttempts; ++i) {
+        s = Bind(1 + random::New64() % (std::numeric_limits<int>::max() - 1));
+        if (!absl::IsAlreadyExists(s)) break;
+      }
+      TF_RETURN_IF_ERROR(s);
+    }
+    if (listen(listen_fd_, SOMAXCONN) != 0) {
+      return ErrnoError("Failed to listen on shm data transfer socket");
+    }
+    accept_thread_ = absl::WrapUnique(Env::Default()->StartThread(
+        {}, "tf_data_shm_transfer_accept", [this] { AcceptLoop(); }));
+    return absl::OkStatus();
+  }
+
+  int Port() const override { return port_; }
+
+  absl::StatusOr<std::string> GetCompatibilityInfo() const override {
+    return tsl::port::Hostname();
+  }
+
+ private:
+  static int64_t RingSizeInMB() {
+    int64_t ring_size_in_mb;
+    absl::Status s = ReadInt64FromEnvVar(kRingSizeEnvVar, kDefaultRingSizeInMB,
+                                         &ring_size_in_mb);
+    if (!s.ok() || ring_size_in_mb <= 0) {
+      LOG(WARNING) << "Failed to read " << kRingSizeEnvVar << ": " << s;
+      return kDefaultRingSizeInMB;
+    }
+    return ring_size_in_mb;
+  }
+
+  absl::Status Bind(int port) {
+    socklen_t length;
+    sockaddr_un address = SocketAddress(port, &length);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), length) != 0) {
+      if (errno == EADDRINUSE) {
+        return errors::AlreadyExists("shm data transfer port ", port,
+                                     " is already in use.");
+      }
+      return ErrnoError(
+          absl::StrCat("Failed to bind shm data transfer socket for port ",
+                       port));
+    }
+    port_ = port;
+    return absl::OkStatus();
+  }
+
+  void AcceptLoop() TF_LOCKS_EXCLUDED(mu_) {
+    while (true) {
+      int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+      // Joined once `mu_` is released.
+      std::vector<std::unique_ptr<Thread>> finished_threads;
+      mutex_lock l(mu_);
+      for (int64_t id : finished_connections_) {
+        auto it = connection_threads_.find(id);
+        finished_threads.push_back(std::move(it->second));
+        connection_threads_.erase(it);
+      }
+      finished_connections_.clear();
+      if (cancelled_) {
+        if (fd >= 0) close(fd);
+        return;
+      }
+      if (fd < 0) {
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        LOG(WARNING) << ErrnoError("shm data transfer server stopped accepting "
+                                   "connections");
+        return;
+      }
+      const int64_t id = next_connection_id_++;
+      connection_fds_[id] = fd;
+      connection_threads_[id] = absl::WrapUnique(Env::Default()->StartThread(
+          {}, "tf_data_shm_transfer_connection",
+          [this, fd, id] { HandleConnection(fd, id); }));
+    }
+  }
+
+  void HandleConnection(int fd, int64_t id) TF_LOCKS_EXCLUDED(mu_) {
+    const std::string segment_name =
+        absl::StrCat("/tf_data_shm_transfer_", getpid(), "_", port_, "_", id);
+    absl::Status s = ServeConnection(fd, segment_name);
+    if (!s.ok() && !absl::IsUnavailable(s)) {
+      LOG(WARNING) << "shm data transfer connection failed: " << s;
+    }
+    // The client unlinks the segment once it has mapped it; this covers
+    // clients that went away before doing so.
+    shm_unlink(segment_name.c_str());
+    mutex_lock l(mu_);
+    connection_fds_.erase(id);
+    close(fd);
+    if (!cancelled_) {
+      // The accept loop joins the thread when the next client connects.
+      finished_connections_.push_back(id);
+    }
+  }
+
+  absl::Status ServeConnection(int fd, const std::string& segment_name) {
+    absl::Status peer_status = CheckPeerUid(fd, uid_);
+    if (!peer_status.ok()) {
+      std::string refusal;
+      EncodeStatus(peer_status, refusal);
+      TF_RETURN_IF_ERROR(WriteFrame(fd, refusal));
+      return peer_status;
+    }
+    absl::StatusOr<std::unique_ptr<ShmSegment>> segment =
+        ShmSegment::Create(segment_name, ring_capacity_);
+    std::string handshake;
+    if (!EncodeStatus(segment.status(), handshake)) {
+      return WriteFrame(fd, handshake);
+    }
+    core::PutVarint64(&handshake, ring_capacity_);
+    handshake.append(segment_name);
+    TF_RETURN_IF_ERROR(WriteFrame(fd, handshake));
+
+    RingWriter ring(**segment);
+    std::string request_bytes;
+    while (true) {
+      TF_RETURN_IF_ERROR(ReadFrame(fd, request_bytes));
+      GetElementRequest request;
+      if (!request.ParseFromString(request_bytes)) {
+        return errors::DataLoss("Failed to parse GetElementRequest.");
+      }
+      GetElementResult result;
+      absl::Status s = get_element_(&request, &result);
+      TF_RETURN_IF_ERROR(SendResponse(fd, s, result, ring));
+    }
+  }
+
+  // Copies the components of `result` to the ring and sends the response
+  // header, followed by the components that did not fit in the ring.
+  absl::Status SendResponse(int fd, const absl::Status& status,
+                            const GetElementResult& result, RingWriter& ring) {
+    std::string header;
+    if (!EncodeStatus(status, header)) {
+      return WriteFrame(fd, header);
+    }
+    std::string components;
+    std::vector<absl::string_view> inline_data;
+    std::vector<std::string> serialized;
+    serialized.reserve(result.components.size());
+    for (const Tensor& tensor : result.components) {
+      const CompressedElement* compressed = nullptr;
+      if (tensor.dtype() == DT_VARIANT && tensor.NumElements() == 1 &&
+          TensorShapeUtils::IsScalar(tensor.shape())) {
+        compressed = tensor.scalar<Variant>()().get<CompressedElement>();
+      }
+      if (DataTypeCanUseMemcpy(tensor.dtype())) {
+        absl::string_view data = tensor.tensor_data();
+        components.push_back(static_cast<char>(Encoding::kRaw));
+        core::PutVarint32(&components, tensor.dtype());
+        core::PutVarint32(&components, tensor.dims());
+        for (int64_t dim : tensor.shape().dim_sizes()) {
+          core::PutVarint64(&components, dim);
+        }
+        std::optional<uint64_t> offset = ring.Allocate(data.size());
+        if (offset.has_value()) {
+          std::memcpy(ring.At(*offset), data.data(), data.size());
+        } else {
+          inline_data.push_back(data);
+        }
+        EncodeLocation(offset, data.size(), components);
+        continue;
+      }
+      TensorProto proto;
+      const protobuf::MessageLite* message = compressed;
+      if (message != nullptr) {
+        components.push_back(static_cast<char>(Encoding::kCompressed));
+      } else {
+        tensor.AsProtoTensorContent(&proto);
+        message = &proto;
+        components.push_back(static_cast<char>(Encoding::kTensorProto));
+      }
+      const size_t size = message->ByteSizeLong();
+      std::optional<uint64_t> offset = ring.Allocate(size);
+      if (offset.has_value()) {
+        message->SerializeWithCachedSizesToArray(
+            reinterpret_cast<uint8_t*>(ring.At(*offset)));
+      } else {
+        serialized.push_back(message->SerializeAsString());
+        inline_data.push_back(serialized.back());
+      }
+      EncodeLocation(offset, size, components);
+    }
+
+    core::PutVarint64(&header, result.element_index);
+    header.push_back(result.end_of_sequence);
+    header.push_back(result.skip);
+    core::PutVarint64(&header, ring.written());
+    core::PutVarint32(&header, result.components.size());
+    header.append(components);
+    TF_RETURN_IF_ERROR(WriteFrame(fd, header));
+    for (absl::string_view data : inline_data) {
+      TF_RETURN_IF_ERROR(WriteFully(fd, data.data(), data.size()));
+    }
+    return absl::OkStatus();
+  }
+
+  static void EncodeLocation(std::optional<uint64_t> offset, uint64_t size,
+                             std::string& out) {
+    out.push_back(static_cast<char>(offset.has_value() ? Location::kRing
+                                                       : Location::kInline));
+    core::PutVarint64(&out, size);
+    if (offset.has_value()) {
+      core::PutVarint64(&out, *offset);
+    }
+  }
+
+  const DataTransferServer::GetElementT get_element_;
+  const uint64_t ring_capacity_;
+  // Only clients running as this user are served.
+  const uid_t uid_ = geteuid();
+  int listen_fd_ = -1;
+  int port_ = 0;
+  std::unique_ptr<Thread> accept_thread_;
+
+  mutex mu_;
+  bool cancelled_ TF_GUARDED_BY(mu_) = false;
+  int64_t next_connection_id_ TF_GUARDED_BY(mu_) = 0;
+  absl::flat_hash_map<int64_t, int> connection_fds_ TF_GUARDED_BY(mu_);
+  absl::flat_hash_map<int64_t, std::unique_ptr<Thread>> connection_threads_
+      TF_GUARDED_BY(mu_);
+  // Connections whose thread has finished but has not been joined yet.
+  std::vector<int64_t> finished_connections_ TF_GUARDED_BY(mu_);
+};
+
+class ShmDataTransferClient : public DataTransferClient {
+ public:
+  // Connects to the server whose port is given by `config.address`.
+  static absl::StatusOr<std::unique_ptr<ShmDataTransferClient>> Create(
+      const DataTransferClient::Config& config) {
+    int port = 0;
+    const size_t colon = config.address.rfind(':');
+    if (colon == std::string::npos ||
+        !absl::SimpleAtoi(config.address.substr(colon + 1), &port)) {
+      return errors::InvalidArgument(
+          "Expected a shm data transfer address of the form <host>:<port>, "
+          "got ",
+          config.address);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+      return ErrnoError("Failed to create shm data transfer socket");
+    }
+    auto client =
+        absl::WrapUnique(new ShmDataTransferClient(fd, config.allocator));
+    socklen_t length;
+    sockaddr_un address = SocketAddress(port, &length);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), length) != 0) {
+      return ErrnoError(absl::StrCat(
+          "Failed to connect to shm data transfer server ", config.address));
+    }
+    std::string handshake;
+    TF_RETURN_IF_ERROR(ReadFrame(fd, handshake));
+    absl::string_view input(handshake);
+    TF_RETURN_IF_ERROR(DecodeStatus(input));
+    uint64_t capacity;
+    if (!core::GetVarint64(&input, &capacity)) {
+      return errors::DataLoss("Corrupt shm data transfer handshake.");
+    }
+    TF_ASSIGN_OR_RETURN(std::unique_ptr<ShmSegment> segment,
+                        ShmSegment::Open(std::string(input), capacity));
+    client->ring_ = std::make_shared<RingReader>(std::move(segment));
+    VLOG(2) << "Create ShmDataTransferClient for worker " << config.address
+            << ".";
+    return client;
+  }
+
+  ~ShmDataTransferClient() override {
+    shutdown(fd_, SHUT_RDWR);
+    close(fd_);
+  }
+
+  absl::Status GetElement(const GetElementRequest& req,
+                          GetElementResult& result) override {
+    VLOG(3) << "GetElement for task " << req.task_id() << " from shm worker "
+            << "server.";
+    {
+      mutex_lock l(mu_);
+      if (cancelled_) {
+        return errors::Cancelled("Client was cancelled.");
+      }
+    }
+    mutex_lock l(io_mu_);
+    // A failed exchange leaves the connection in an unknown state.
+    TF_RETURN_IF_ERROR(status_);
+    int64_t start_time_us = env_->NowMicros();
+    absl::Status worker_status;
+    status_ = WriteFrame(fd_, req.SerializeAsString());
+    if (status_.ok()) {
+      status_ = ReadResponse(result, worker_status);
+    }
+    TF_RETURN_IF_ERROR(status_);
+    TF_RETURN_IF_ERROR(worker_status);
+    metrics::RecordTFDataServiceGetElementDuration(
+        kShmTransferProtocol, env_->NowMicros() - start_time_us);
+    return absl::OkStatus();
+  }
+
+  void TryCancel() override {
+    VLOG(2) << "Cancel ShmDataTransferClient.";
+    mutex_lock l(mu_);
+    cancelled_ = true;
+    // Unblocks in-flight reads.
+    shutdown(fd_, SHUT_RDWR);
+  }
+
+  absl::StatusOr<std::string> GetCompatibilityInfo() const override {
+    return tsl::port::Hostname();
+  }
+
+  absl::Status CheckCompatibility(
+      const std::string& server_compatibility_info) const override {
+    const std::string hostname = tsl::port::Hostname();
+    if (server_compatibility_info != hostname) {
+      return errors::FailedPrecondition(
+          "The shm data transfer protocol requires the client and the worker "
+          "to run on the same host, but the client runs on ",
+          hostname, " and the worker runs on ", server_compatibility_info);
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  ShmDataTransferClient(int fd, Allocator* allocator)
+      : fd_(fd), allocator_(allocator) {}
+
+  // Reads the response to a request. Returns an error if the connection
+  // failed, and stores the status returned by the worker in `worker_status`.
+  absl::Status ReadResponse(GetElementResult& result,
+                            absl::Status& worker_status)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(io_mu_) {
+    std::string header;
+    TF_RETURN_IF_ERROR(ReadFrame(fd_, header));
+    absl::string_view input(header);
+    if (input.empty()) return Corrupt();
+    worker_status = DecodeStatus(input);
+    if (!worker_status.ok()) {
+      return absl::OkStatus();
+    }
+    uint64_t element_index, ring_end;
+    uint32_t num_components;
+    if (!core::GetVarint64(&input, &element_index) || input.size() < 2) {
+      return Corrupt();
+    }
+    result.element_index = element_index;
+    result.end_of_sequence = input[0];
+    result.skip = input[1];
+    input.remove_prefix(2);
+    if (!core::GetVarint64(&input, &ring_end) ||
+        !core::GetVarint32(&input, &num_components)) {
+      return Corrupt();
+    }
+    if (ring_end < ring_end_) return Corrupt();
+    // Held by the tensors that alias the ring; released once they are all
+    // gone. Elements that take no space in the ring (end of sequence, empty
+    // tensors, or elements sent inline because the ring is full) have no
+    // region.
+    std::shared_ptr<ElementRegion> region;
+    if (ring_end > ring_end_) {
+      region = std::make_shared<ElementRegion>(ring_, ring_end);
+      ring_end_ = ring_end;
+    }
+    result.components.reserve(num_components);
+    for (uint32_t i = 0; i < num_components; ++i) {
+      if (input.empty()) return Corrupt();
+      const auto encoding = static_cast<Encoding>(input[0]);
+      input.remove_prefix(1);
+      switch (encoding) {
+        case Encoding::kRaw:
+          TF_RETURN_IF_ERROR(ReadRawTensor(input, region, result.components));
+          break;
+        case Encoding::kTensorProto:
+        case Encoding::kCompressed:
+          TF_RETURN_IF_ERROR(ReadMessageTensor(encoding, input, region,
+                                               result.components));
+          break;
+        default:
+          return Corrupt();
+      }
+    }
+    return absl::OkStatus();
+  }
+
+  // Reads where the bytes of a component are. Components in the ring must
+  // belong to `region`.
+  absl::Status ReadLocation(absl::string_view& input,
+                            const std::shared_ptr<ElementRegion>& region,
+                            Location& location, uint64_t& size,
+                            uint64_t& offset) {
+    if (input.empty()) return Corrupt();
+    location = static_cast<Location>(input[0]);
+    input.remove_prefix(1);
+    if (!core::GetVarint64(&input, &size)) return Corrupt();
+    if (location == Location::kRing) {
+      if (!core::GetVarint64(&input, &offset)) return Corrupt();
+      if (region == nullptr && size > 0) return Corrupt();
+    } else if (location != Location::kInline) {
+      return Corrupt();
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status ReadRawTensor(absl::string_view& input,
+                             const std::shared_ptr<ElementRegion>& region,
+                             std::vector<Tensor>& components)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(io_mu_) {
+    uint32_t dtype, dims;
+    if (!core::GetVarint32(&input, &dtype) ||
+        !core::GetVarint32(&input, &dims)) {
+      return Corrupt();
+    }
+    std::vector<int64_t> dim_sizes(dims);
+    for (int64_t& dim : dim_sizes) {
+      uint64_t dim_size;
+      if (!core::GetVarint64(&input, &dim_size)) return Corrupt();
+      dim = dim_size;
+    }
+    TensorShape shape;
+    TF_RETURN_IF_ERROR(TensorShape::BuildTensorShape(dim_sizes, &shape));
+    Location location;
+    uint64_t size, offset;
+    TF_RETURN_IF_ERROR(ReadLocation(input, region, location, size, offset));
+    const DataType type = static_cast<DataType>(dtype);
+    if (!DataTypeCanUseMemcpy(type) ||
+        size != shape.num_elements() * DataTypeSize(type)) {
+      return Corrupt();
+    }
+    if (location == Location::kRing && region != nullptr &&
+        allocator_ == nullptr) {
+      components.emplace_back(
+          type, shape,
+          core::RefCountPtr<TensorBuffer>(new ShmTensorBuffer(
+              region->ring().At(offset), size, region)));
+      return absl::OkStatus();
+    }
+    // Copies into a regular tensor, so that it lives in the requested
+    // allocator's memory.
+    Tensor tensor = allocator_ != nullptr ? Tensor(allocator_, type, shape)
+                                          : Tensor(type, shape);
+    char* data = const_cast<char*>(tensor.tensor_data().data());
+    if (location == Location::kRing) {
+      std::memcpy(data, region->ring().At(offset), size);
+    } else {
+      TF_RETURN_IF_ERROR(ReadFully(fd_, data, size));
+    }
+    components.push_back(std::move(tensor));
+    return absl::OkStatus();
+  }
+
+  absl::Status ReadMessageTensor(Encoding encoding, absl::string_view& input,
+                                 const std::shared_ptr<ElementRegion>& region,
+                                 std::vector<Tensor>& components)
+      TF_EXCLUSIVE_LOCKS_REQUIRED(io_mu_) {
+    Location location;
+    uint64_t size, offset;
+    TF_RETURN_IF_ERROR(ReadLocation(input, region, location, size, offset));
+    std::string inline_bytes;
+    absl::string_view bytes;
+    if (location == Location::kRing) {
+      bytes = absl::string_view(ring_->At(offset), size);
+    } else {
+      inline_bytes.resize(size);
+      TF_RETURN_IF_ERROR(ReadFully(fd_, inline_bytes.data(), size));
+      bytes = inline_bytes;
+    }
+    if (encoding == Encoding::kCompressed) {
+      CompressedElement compressed;
+      if (!compressed.ParseFromArray(bytes.data(), bytes.size())) {
+        return errors::DataLoss("Failed to parse CompressedElement.");
+      }
+      Tensor tensor(DT_VARIANT, TensorShape{});
+      tensor.scalar<Variant>()() = std::move(compressed);
+      components.push_back(std::move(tensor));
+      return absl::OkStatus();
+    }
+    TensorProto proto;
+    if (!proto.ParseFromArray(bytes.data(), bytes.size())) {
+      return errors::DataLoss("Failed to parse TensorProto.");
+    }
+    components.emplace_back();
+    bool success = allocator_ != nullptr
+                       ? components.back().FromProto(allocator_, proto)
+                       : components.back().FromProto(proto);
+    if (!success) {
+      return errors::DataLoss("Failed to parse tensor.");
+    }
+    return absl::OkStatus();
+  }
+
+  static absl::Status Corrupt() {
+    return errors::DataLoss("Corrupt shm data transfer response.");
+  }
+
+  const int fd_;
+  Allocator* const allocator_;
+  std::shared_ptr<RingReader> ring_;
+
+  mutex mu_;
+  // Indicates that the client has been cancelled, so no further requests
+  // should be accepted.
+  bool cancelled_ TF_GUARDED_BY(mu_) = false;
+
+  // Serializes exchanges over the connection.
+  mutex io_mu_;
+  absl::Status status_ TF_GUARDED_BY(io_mu_);
+  // End of the ring space used by the last element that took any.
+  uint64_t ring_end_ TF_GUARDED_BY(io_mu_) = 0;
+};
+
+class ShmTransferServerRegistrar {
+ public:
+  ShmTransferServerRegistrar() {
+    DataTransferServer::Register(
+        kShmTransferProtocol, [](DataTransferServer::GetElementT get_element,
+                                 std::shared_ptr<DataTransferServer>* server) {
+          *server = std::make_shared<ShmDataTransferServer>(get_element);
+          return absl::OkStatus();
+        });
+  }
+};
+static ShmTransferServerRegistrar shm_server_registrar;
+
+class ShmTransferClientRegistrar {
+ public:
+  ShmTransferClientRegistrar() {
+    DataTransferClient::Register(
+        kShmTransferProtocol, [](DataTransferClient::Config config,
+                                 std::unique_ptr<DataTransferClient>* client) {
+          TF_ASSIGN_OR_RETURN(*client, ShmDataTransferClient::Create(config));
+          return absl::OkStatus();
+        });
+  }
+};
+static ShmTransferClientRegistrar shm_client_registrar;
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // defined(__linux__)
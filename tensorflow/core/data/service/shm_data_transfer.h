@@ -0,0 +1,52 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
+#define TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
+
+namespace tensorflow {
+namespace data {
+
+// Data transfer protocol for clients running on the same host as the
+// tf.data service worker.
+//
+// The worker's transfer server listens on a Unix domain socket in the abstract
+// namespace, named after the port returned by `DataTransferServer::Port()`.
+// Each client connection gets its own POSIX shared-memory ring buffer, which
+// the server fills with the tensor contents of each element; only a small
+// header describing the element is sent over the socket. Tensors of
+// memcpy-able types are returned to the client as views into the ring, so they
+// are not copied on the client side. Their space in the ring is handed back to
+// the server once every tensor of the element has been destroyed. Elements that
+// do not fit in the free part of the ring are sent inline over the socket.
+//
+// Clients on a different host (or in a different network namespace) fail to
+// build or fail the compatibility check, which makes the data service client
+// fall back to gRPC.
+//
+// The abstract socket has no file permissions, so any process in the network
+// namespace of the worker can connect to it. The server checks the
+// credentials of each client with SO_PEERCRED and refuses clients that do not
+// run as the effective user of the worker. The shared-memory segments are
+// only accessible to that user as well.
+//
+// The size of each ring buffer can be set with the
+// TF_DATA_SHM_TRANSFER_RING_SIZE_IN_MB environment variable. The protocol is
+// only available on Linux.
+constexpr const char kShmTransferProtocol[] = "shm";
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SERVICE_SHM_DATA_TRANSFER_H_
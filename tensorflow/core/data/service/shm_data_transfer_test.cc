@@ -0,0 +1,295 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/shm_data_transfer.h"
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/substitute.h"
+#include "tensorflow/core/data/service/common.pb.h"
+#include "tensorflow/core/data/service/data_transfer.h"
+#include "tensorflow/core/data/service/dispatcher.pb.h"
+#include "tensorflow/core/data/service/dispatcher_client.h"
+#include "tensorflow/core/data/service/test_cluster.h"
+#include "tensorflow/core/data/service/test_util.h"
+#include "tensorflow/core/data/service/worker.pb.h"
+#include "tensorflow/core/data/service/worker_client.h"
+#include "tensorflow/core/data/service/worker_impl.h"
+#include "tensorflow/core/framework/dataset.pb.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/status_matchers.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/tstring.h"
+#include "tensorflow/core/protobuf/data_service.pb.h"
+#include "tensorflow/core/protobuf/error_codes.pb.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::tensorflow::data::testing::InterleaveTextlineDataset;
+using ::tensorflow::data::testing::LocalTempFilename;
+using ::tensorflow::data::testing::RangeSquareDataset;
+using ::tensorflow::testing::StatusIs;
+using ::testing::HasSubstr;
+
+constexpr const char kProtocol[] = "grpc";
+
+class ShmDataTransferTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    test_cluster_ = std::make_unique<TestCluster>(/*num_workers=*/1,
+                                                  kShmTransferProtocol);
+    TF_ASSERT_OK(test_cluster_->Initialize());
+    // Consider the worker to be remote so that local protocol isn't forced on.
+    LocalWorkers::Remove(test_cluster_->WorkerAddress(0));
+    dispatcher_client_ = std::make_unique<DataServiceDispatcherClient>(
+        test_cluster_->DispatcherAddress(), kProtocol);
+  }
+
+  // Registers `dataset_def` and returns the task to read for a new iteration.
+  absl::StatusOr<TaskInfo> StartIteration(const DatasetDef& dataset_def) {
+    std::string dataset_id;
+    TF_RETURN_IF_ERROR(dispatcher_client_->RegisterDataset(
+        dataset_def, DataServiceMetadata(),
+        /*requested_dataset_id=*/std::nullopt, dataset_id));
+    ProcessingModeDef processing_mode;
+    processing_mode.set_sharding_policy(ProcessingModeDef::OFF);
+    int64_t job_id = 0;
+    TF_RETURN_IF_ERROR(dispatcher_client_->GetOrCreateJob(
+        dataset_id, processing_mode, /*job_name=*/std::nullopt,
+        /*num_consumers=*/std::nullopt, /*use_cross_trainer_cache=*/false,
+        TARGET_WORKERS_AUTO, job_id));
+    int64_t iteration_client_id = 0;
+    TF_RETURN_IF_ERROR(dispatcher_client_->GetOrCreateIteration(
+        job_id, /*repetition=*/0, iteration_client_id));
+    ClientHeartbeatRequest request;
+    ClientHeartbeatResponse response;
+    request.set_iteration_client_id(iteration_client_id);
+    TF_RETURN_IF_ERROR(dispatcher_client_->ClientHeartbeat(request, response));
+    if (response.task_info().empty()) {
+      return errors::NotFound(absl::Substitute(
+          "No task found for iteration $0.", iteration_client_id));
+    }
+    return response.task_info(0);
+  }
+
+  // Returns the shm transfer server advertised by the worker of `task`.
+  absl::StatusOr<DataTransferServerInfo> GetShmServer(const TaskInfo& task) {
+    for (const DataTransferServerInfo& server : task.transfer_servers()) {
+      if (server.protocol() == kShmTransferProtocol) {
+        return server;
+      }
+    }
+    return errors::NotFound("The worker has no shm transfer server.");
+  }
+
+  absl::StatusOr<std::unique_ptr<DataServiceWorkerClient>> GetWorkerClient(
+      const TaskInfo& task) {
+    TF_ASSIGN_OR_RETURN(DataTransferServerInfo info, GetShmServer(task));
+    return CreateDataServiceWorkerClient(kProtocol, info,
+                                         /*accelerator_device_info=*/nullptr,
+                                         /*allocator=*/nullptr);
+  }
+
+  absl::StatusOr<GetElementResult> GetElement(DataServiceWorkerClient& client,
+                                              const int64_t task_id) {
+    GetElementRequest request;
+    GetElementResult result;
+    request.set_task_id(task_id);
+    TF_RETURN_IF_ERROR(client.GetElement(request, result));
+    return result;
+  }
+
+  std::unique_ptr<TestCluster> test_cluster_;
+  std::unique_ptr<DataServiceDispatcherClient> dispatcher_client_;
+};
+
+// Uses the smallest ring, so that tests can fill it.
+class ShmDataTransferSmallRingTest : public ShmDataTransferTest {
+ protected:
+  // Number of int64 scalar elements that fit in the ring.
+  static constexpr int64_t kRingElements = (int64_t{1} << 20) / 64;
+
+  void SetUp() override {
+    setenv("TF_DATA_SHM_TRANSFER_RING_SIZE_IN_MB", "1", /*overwrite=*/1);
+    ShmDataTransferTest::SetUp();
+  }
+
+  void TearDown() override {
+    unsetenv("TF_DATA_SHM_TRANSFER_RING_SIZE_IN_MB");
+  }
+};
+
+TEST_F(ShmDataTransferTest, ReadRange) {
+  const int64_t range = 10;
+  TF_ASSERT_OK_AND_ASSIGN(const TaskInfo task,
+                          StartIteration(RangeSquareDataset(range)));
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<DataServiceWorkerClient> client,
+                          GetWorkerClient(task));
+  EXPECT_EQ(client->GetDataTransferProtocol(), kShmTransferProtocol);
+  for (int64_t i = 0; i < range; ++i) {
+    TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                            GetElement(*client, task.task_id()));
+    ASSERT_EQ(result.components.size(), 1);
+    test::ExpectEqual(result.components[0], Tensor(int64_t{i * i}));
+    EXPECT_FALSE(result.end_of_sequence);
+  }
+  TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                          GetElement(*client, task.task_id()));
+  EXPECT_TRUE(result.end_of_sequence);
+}
+
+TEST_F(ShmDataTransferTest, ReadStrings) {
+  std::vector<tstring> filenames = {LocalTempFilename(), LocalTempFilename()};
+  TF_ASSERT_OK_AND_ASSIGN(
+      const DatasetDef dataset_def,
+      InterleaveTextlineDataset(filenames, {"0\n2\n4", "1\n3\n5"}));
+  TF_ASSERT_OK_AND_ASSIGN(const TaskInfo task, StartIteration(dataset_def));
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<DataServiceWorkerClient> client,
+                          GetWorkerClient(task));
+  for (int64_t i = 0; i < 6; ++i) {
+    TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                            GetElement(*client, task.task_id()));
+    ASSERT_EQ(result.components.size(), 1);
+    test::ExpectEqual(result.components[0], Tensor(tstring(absl::StrCat(i))));
+  }
+}
+
+TEST_F(ShmDataTransferTest, ElementsOutliveClient) {
+  const int64_t range = 100;
+  TF_ASSERT_OK_AND_ASSIGN(const TaskInfo task,
+                          StartIteration(RangeSquareDataset(range)));
+  std::vector<Tensor> elements;
+  {
+    TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<DataServiceWorkerClient> client,
+                            GetWorkerClient(task));
+    for (int64_t i = 0; i < range; ++i) {
+      TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                              GetElement(*client, task.task_id()));
+      elements.push_back(result.components[0]);
+    }
+  }
+  for (int64_t i = 0; i < range; ++i) {
+    test::ExpectEqual(elements[i], Tensor(int64_t{i * i}));
+  }
+}
+
+TEST_F(ShmDataTransferSmallRingTest, InlineElementsDoNotReleaseRing) {
+  const int64_t range = 2 * kRingElements + 1;
+  TF_ASSERT_OK_AND_ASSIGN(const TaskInfo task,
+                          StartIteration(RangeSquareDataset(range)));
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<DataServiceWorkerClient> client,
+                          GetWorkerClient(task));
+  std::vector<Tensor> elements;
+  for (int64_t i = 0; i < kRingElements; ++i) {
+    TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                            GetElement(*client, task.task_id()));
+    elements.push_back(result.components[0]);
+  }
+  // The ring is full, so this element is sent inline.
+  {
+    TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                            GetElement(*client, task.task_id()));
+    test::ExpectEqual(result.components[0],
+                      Tensor(int64_t{kRingElements * kRingElements}));
+  }
+  // Keeps only the last element in the ring. The server may reuse the rest
+  // of the ring, but not its slot.
+  const Tensor last = elements.back();
+  elements.clear();
+  for (int64_t i = kRingElements + 1; i < range; ++i) {
+    TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                            GetElement(*client, task.task_id()));
+    test::ExpectEqual(result.components[0], Tensor(int64_t{i * i}));
+  }
+  TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                          GetElement(*client, task.task_id()));
+  EXPECT_TRUE(result.end_of_sequence);
+  test::ExpectEqual(
+      last, Tensor(int64_t{(kRingElements - 1) * (kRingElements - 1)}));
+}
+
+TEST_F(ShmDataTransferTest, ReconnectManyClients) {
+  TF_ASSERT_OK_AND_ASSIGN(const TaskInfo task,
+                          StartIteration(RangeSquareDataset(/*range=*/100)));
+  for (int64_t i = 0; i < 100; ++i) {
+    TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<DataServiceWorkerClient> client,
+                            GetWorkerClient(task));
+    TF_ASSERT_OK_AND_ASSIGN(GetElementResult result,
+                            GetElement(*client, task.task_id()));
+    test::ExpectEqual(result.components[0], Tensor(int64_t{i * i}));
+  }
+}
+
+TEST_F(ShmDataTransferTest, OtherHostFailsCompatibilityCheck) {
+  TF_ASSERT_OK_AND_ASSIGN(const TaskInfo task,
+                          StartIteration(RangeSquareDataset(/*range=*/5)));
+  TF_ASSERT_OK_AND_ASSIGN(DataTransferServerInfo info, GetShmServer(task));
+  info.set_compatibility_info("some-other-host");
+  EXPECT_THAT(CreateDataServiceWorkerClient(
+                  kProtocol, info, /*accelerator_device_info=*/nullptr,
+                  /*allocator=*/nullptr),
+              StatusIs(error::FAILED_PRECONDITION,
+                       HasSubstr("to run on the same host")));
+}
+
+// Changing the effective user of the client needs root, so the test is skipped
+// otherwise. The worker keeps the user it was created with.
+TEST_F(ShmDataTransferTest, OtherUserIsRefused) {
+  if (geteuid() != 0) {
+    GTEST_SKIP() << "Changing the effective user requires root.";
+  }
+  TF_ASSERT_OK_AND_ASSIGN(const TaskInfo task,
+                          StartIteration(RangeSquareDataset(/*range=*/5)));
+  TF_ASSERT_OK_AND_ASSIGN(DataTransferServerInfo info, GetShmServer(task));
+  constexpr uid_t kNobody = 65534;
+  ASSERT_EQ(seteuid(kNobody), 0);
+  absl::StatusOr<std::unique_ptr<DataServiceWorkerClient>> client =
+      CreateDataServiceWorkerClient(kProtocol, info,
+                                    /*accelerator_device_info=*/nullptr,
+                                    /*allocator=*/nullptr);
+  ASSERT_EQ(seteuid(0), 0);
+  EXPECT_THAT(client, StatusIs(error::PERMISSION_DENIED,
+                               HasSubstr("runs as user 65534")));
+}
+
+TEST_F(ShmDataTransferTest, CancelClient) {
+  TF_ASSERT_OK_AND_ASSIGN(const TaskInfo task,
+                          StartIteration(RangeSquareDataset(/*range=*/5)));
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<DataServiceWorkerClient> client,
+                          GetWorkerClient(task));
+  TF_ASSERT_OK(GetElement(*client, task.task_id()).status());
+  client->TryCancel();
+  EXPECT_THAT(GetElement(*client, task.task_id()),
+              StatusIs(error::CANCELLED));
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
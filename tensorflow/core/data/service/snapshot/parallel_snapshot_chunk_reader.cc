@@ -0,0 +1,477 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/snapshot/parallel_snapshot_chunk_reader.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "tensorflow/core/data/snapshot_utils.h"
+#include "tensorflow/core/data/utils.h"
+#include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/metrics.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/platform/threadpool.h"
+#include "tsl/platform/tstring.h"
+#include "tsl/profiler/lib/traceme.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+constexpr char kNumChunks[] = "num_chunks";
+constexpr char kChunkFile[] = "chunk_file";
+constexpr char kNumReturned[] = "num_returned";
+constexpr char kSlot[] = "slot";
+constexpr char kCycleIndex[] = "cycle_index";
+// Bytes read are reported together with `SnapshotChunkDataset`, which reads
+// the same files one at a time.
+constexpr char kSnapshotChunkDataset[] = "SnapshotChunkDataset";
+
+constexpr int64_t kTFRecordReaderOutputBufferSize = 512 << 20;  // 512MB
+
+}  // namespace
+
+// Records the keys written by `SplitProvider::Save` without a prefix, so that
+// they can be written again with the prefix of a later `Save` call.
+class ParallelSnapshotChunkReader::ProviderState : public IteratorStateWriter {
+ public:
+  explicit ProviderState(SplitProvider& provider) {
+    status_ = provider.Save([](std::string key) { return key; }, this);
+  }
+
+  absl::Status WriteScalar(StringPiece key, const int64_t val) override {
+    Tensor tensor(DT_INT64, TensorShape({}));
+    tensor.scalar<int64_t>()() = val;
+    return WriteTensor(key, tensor);
+  }
+
+  absl::Status WriteScalar(StringPiece key, const tstring& val) override {
+    Tensor tensor(DT_STRING, TensorShape({}));
+    tensor.scalar<tstring>()() = val;
+    return WriteTensor(key, tensor);
+  }
+
+  absl::Status WriteTensor(StringPiece key, const Tensor& val) override {
+    tensors_.emplace_back(std::string(key), val);
+    return absl::OkStatus();
+  }
+
+  absl::Status WriteScalar(StringPiece name, StringPiece key,
+                           const int64_t val) override {
+    return Unsupported();
+  }
+
+  absl::Status WriteScalar(StringPiece name, StringPiece key,
+                           const tstring& val) override {
+    return Unsupported();
+  }
+
+  absl::Status WriteTensor(StringPiece name, StringPiece key,
+                           const Tensor& val) override {
+    return Unsupported();
+  }
+
+  // Writes the recorded keys prefixed by `full_name`, or returns the error of
+  // the provider's `Save`.
+  absl::Status WriteTo(std::function<std::string(std::string)> full_name,
+                       IteratorStateWriter* writer) const {
+    TF_RETURN_IF_ERROR(status_);
+    for (const auto& [key, tensor] : tensors_) {
+      TF_RETURN_IF_ERROR(writer->WriteTensor(full_name(key), tensor));
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  static absl::Status Unsupported() {
+    return absl::UnimplementedError(
+        "tf.data snapshot reader does not support saving chunk providers that "
+        "write named iterator state.");
+  }
+
+  absl::Status status_;
+  std::vector<std::pair<std::string, Tensor>> tensors_;
+};
+
+ParallelSnapshotChunkReader::ParallelSnapshotChunkReader(
+    std::shared_ptr<SplitProvider> chunk_provider, const Options& options,
+    tsl::Env* env)
+    : chunk_provider_(std::move(chunk_provider)),
+      options_(options),
+      env_(env),
+      cycle_(options.deterministic ? options.num_parallel_chunks : 0) {}
+
+ParallelSnapshotChunkReader::~ParallelSnapshotChunkReader() {
+  Cancel();
+  std::unique_ptr<tsl::thread::ThreadPool> thread_pool;
+  {
+    absl::MutexLock l(&mu_);
+    thread_pool = std::move(thread_pool_);
+  }
+  // Joins the decoding threads.
+  thread_pool.reset();
+}
+
+absl::Status ParallelSnapshotChunkReader::GetNext(std::vector<Tensor>& element,
+                                                  bool& end_of_sequence)
+    ABSL_LOCKS_EXCLUDED(mu_) {
+  absl::MutexLock l(&mu_);
+  EnsureThreadsStarted();
+  while (true) {
+    if (cancelled_) {
+      return absl::CancelledError("tf.data snapshot reader is cancelled.");
+    }
+    TF_RETURN_IF_ERROR(status_);
+    TF_ASSIGN_OR_RETURN(bool popped, PopElement(element));
+    if (popped) {
+      end_of_sequence = false;
+      return absl::OkStatus();
+    }
+    if (chunks_.empty() && num_reserved_ == 0 && end_of_chunks_) {
+      end_of_sequence = true;
+      return absl::OkStatus();
+    }
+    ready_to_pop_.Wait(&mu_);
+  }
+}
+
+absl::StatusOr<bool> ParallelSnapshotChunkReader::PopElement(
+    std::vector<Tensor>& element) {
+  if (options_.deterministic) {
+    return PopElementInCycle(element);
+  }
+  for (auto it = chunks_.begin(); it != chunks_.end();) {
+    Chunk& chunk = **it;
+    if (!chunk.buffer.empty()) {
+      element = std::move(chunk.buffer.front());
+      chunk.buffer.pop_front();
+      ++chunk.num_returned;
+      ready_to_push_.SignalAll();
+      return true;
+    }
+    if (chunk.finished) {
+      absl::Status status = std::move(chunk.status);
+      it = chunks_.erase(it);
+      ready_to_push_.SignalAll();
+      TF_RETURN_IF_ERROR(status);
+      continue;
+    }
+    ++it;
+  }
+  return false;
+}
+
+absl::StatusOr<bool> ParallelSnapshotChunkReader::PopElementInCycle(
+    std::vector<Tensor>& element) {
+  const int64_t cycle_length = cycle_.size();
+  int64_t num_skipped = 0;
+  while (num_skipped < cycle_length) {
+    std::shared_ptr<Chunk>& chunk = cycle_[cycle_index_];
+    if (chunk == nullptr) {
+      chunk = NextUnplacedChunk();
+      if (chunk == nullptr) {
+        if (!end_of_chunks_ || num_reserved_ > 0) {
+          // Waits for the next chunk to fill this slot.
+          return false;
+        }
+        cycle_index_ = (cycle_index_ + 1) % cycle_length;
+        ++num_skipped;
+        continue;
+      }
+      chunk->slot = cycle_index_;
+    }
+    if (!chunk->buffer.empty()) {
+      element = std::move(chunk->buffer.front());
+      chunk->buffer.pop_front();
+      ++chunk->num_returned;
+      cycle_index_ = (cycle_index_ + 1) % cycle_length;
+      ready_to_push_.SignalAll();
+      return true;
+    }
+    if (!chunk->finished) {
+      return false;
+    }
+    absl::Status status = std::move(chunk->status);
+    RemoveChunk(chunk);
+    chunk = nullptr;
+    cycle_index_ = (cycle_index_ + 1) % cycle_length;
+    ready_to_push_.SignalAll();
+    TF_RETURN_IF_ERROR(status);
+  }
+  return false;
+}
+
+std::shared_ptr<ParallelSnapshotChunkReader::Chunk>
+ParallelSnapshotChunkReader::NextUnplacedChunk() {
+  for (const std::shared_ptr<Chunk>& chunk : chunks_) {
+    if (chunk->slot < 0) {
+      return chunk;
+    }
+  }
+  return nullptr;
+}
+
+void ParallelSnapshotChunkReader::RemoveChunk(
+    const std::shared_ptr<Chunk>& chunk) {
+  auto it = std::find(chunks_.begin(), chunks_.end(), chunk);
+  if (it != chunks_.end()) {
+    chunks_.erase(it);
+  }
+}
+
+void ParallelSnapshotChunkReader::EnsureThreadsStarted() {
+  if (thread_pool_) {
+    return;
+  }
+  provider_state_ = std::make_unique<ProviderState>(*chunk_provider_);
+  thread_pool_ = std::make_unique<tsl::thread::ThreadPool>(
+      env_, tsl::ThreadOptions{}, "read_snapshot_chunk_thread",
+      options_.num_parallel_chunks);
+  for (int64_t i = 0; i < options_.num_parallel_chunks; ++i) {
+    thread_pool_->Schedule([this]() { ReadChunks(); });
+  }
+}
+
+void ParallelSnapshotChunkReader::ReadChunks() {
+  while (true) {
+    absl::StatusOr<std::shared_ptr<Chunk>> chunk = GetNextChunk();
+    if (!chunk.ok()) {
+      UpdateStatus(chunk.status());
+      return;
+    }
+    if (*chunk == nullptr) {
+      return;
+    }
+    absl::Status status = ReadChunk(**chunk);
+    absl::MutexLock l(&mu_);
+    (*chunk)->finished = true;
+    (*chunk)->status = std::move(status);
+    ready_to_pop_.SignalAll();
+  }
+}
+
+absl::StatusOr<std::shared_ptr<ParallelSnapshotChunkReader::Chunk>>
+ParallelSnapshotChunkReader::GetNextChunk() ABSL_LOCKS_EXCLUDED(mu_) {
+  {
+    absl::MutexLock l(&mu_);
+    while (true) {
+      if (cancelled_ || !status_.ok()) {
+        return nullptr;
+      }
+      for (const std::shared_ptr<Chunk>& chunk : chunks_) {
+        if (!chunk->assigned) {
+          chunk->assigned = true;
+          return chunk;
+        }
+      }
+      if (end_of_chunks_) {
+        return nullptr;
+      }
+      if (static_cast<int64_t>(chunks_.size()) + num_reserved_ <
+          options_.num_parallel_chunks) {
+        break;
+      }
+      ready_to_push_.Wait(&mu_);
+    }
+    ++num_reserved_;
+  }
+
+  absl::MutexLock provider_lock(&provider_mu_);
+  Tensor split;
+  bool end_of_splits = false;
+  absl::Status status = chunk_provider_->GetNext(&split, &end_of_splits);
+  std::unique_ptr<ProviderState> provider_state;
+  if (status.ok()) {
+    provider_state = std::make_unique<ProviderState>(*chunk_provider_);
+  }
+  absl::MutexLock l(&mu_);
+  --num_reserved_;
+  ready_to_push_.SignalAll();
+  ready_to_pop_.SignalAll();
+  TF_RETURN_IF_ERROR(status);
+  provider_state_ = std::move(provider_state);
+  if (end_of_splits) {
+    end_of_chunks_ = true;
+    return nullptr;
+  }
+  auto chunk = std::make_shared<Chunk>();
+  chunk->chunk_file = split.unaligned_flat<tsl::tstring>().data()[0];
+  chunk->assigned = true;
+  chunks_.push_back(chunk);
+  return chunk;
+}
+
+absl::Status ParallelSnapshotChunkReader::ReadChunk(Chunk& chunk)
+    ABSL_LOCKS_EXCLUDED(mu_) {
+  std::string chunk_file;
+  int64_t num_to_skip = 0;
+  {
+    absl::MutexLock l(&mu_);
+    chunk_file = chunk.chunk_file;
+    num_to_skip = chunk.num_to_skip;
+  }
+  tsl::profiler::TraceMe activity(
+      [&] {
+        return tsl::profiler::TraceMeEncode(
+            "ParallelSnapshotChunkReader::ReadChunk",
+            {{"chunk_file", chunk_file}});
+      },
+      tsl::profiler::kInfo);
+
+  snapshot_util::TFRecordReader reader(
+      TranslateFileName(chunk_file), options_.compression, options_.dtypes,
+      kTFRecordReaderOutputBufferSize);
+  TF_RETURN_IF_ERROR(reader.Initialize(env_));
+  absl::Status status = absl::OkStatus();
+  for (int64_t i = 0; i < num_to_skip && status.ok(); ++i) {
+    std::vector<Tensor> unused;
+    status = reader.ReadTensors(&unused);
+  }
+  while (status.ok()) {
+    std::vector<Tensor> element;
+    status = reader.ReadTensors(&element);
+    if (!status.ok()) {
+      break;
+    }
+    absl::MutexLock l(&mu_);
+    while (!cancelled_ && status_.ok() &&
+           static_cast<int64_t>(chunk.buffer.size()) >= options_.buffer_size) {
+      ready_to_push_.Wait(&mu_);
+    }
+    if (cancelled_ || !status_.ok()) {
+      return absl::OkStatus();
+    }
+    chunk.buffer.push_back(std::move(element));
+    ready_to_pop_.SignalAll();
+  }
+  metrics::GetTFDataBytesReadCounter(kSnapshotChunkDataset)
+      ->IncrementBy(reader.BytesRead());
+  if (absl::IsOutOfRange(status)) {
+    return absl::OkStatus();
+  }
+  TF_RETURN_WITH_CONTEXT_IF_ERROR(
+      status, " Failed to read tf.data snapshot file: ", chunk_file);
+  return status;
+}
+
+absl::Status ParallelSnapshotChunkReader::Save(
+    std::function<std::string(std::string)> full_name,
+    IteratorStateWriter* writer) ABSL_LOCKS_EXCLUDED(mu_) {
+  absl::MutexLock l(&mu_);
+  TF_RETURN_IF_ERROR(status_);
+  if (provider_state_) {
+    TF_RETURN_IF_ERROR(provider_state_->WriteTo(full_name, writer));
+  } else {
+    // The decoding threads have not been started, so the provider is not used.
+    TF_RETURN_IF_ERROR(chunk_provider_->Save(full_name, writer));
+  }
+  TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kCycleIndex), cycle_index_));
+  TF_RETURN_IF_ERROR(writer->WriteScalar(
+      full_name(kNumChunks), static_cast<int64_t>(chunks_.size())));
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    TF_RETURN_IF_ERROR(
+        writer->WriteScalar(full_name(absl::StrCat(kChunkFile, "[", i, "]")),
+                            chunks_[i]->chunk_file));
+    TF_RETURN_IF_ERROR(
+        writer->WriteScalar(full_name(absl::StrCat(kNumReturned, "[", i, "]")),
+                            chunks_[i]->num_returned));
+    TF_RETURN_IF_ERROR(writer->WriteScalar(
+        full_name(absl::StrCat(kSlot, "[", i, "]")), chunks_[i]->slot));
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ParallelSnapshotChunkReader::Restore(
+    std::function<std::string(std::string)> full_name,
+    IteratorStateReader* reader) ABSL_LOCKS_EXCLUDED(mu_) {
+  absl::MutexLock l(&mu_);
+  if (thread_pool_) {
+    return absl::FailedPreconditionError(
+        "tf.data snapshot reader can only be restored before reading.");
+  }
+  TF_RETURN_IF_ERROR(chunk_provider_->Restore(full_name, reader));
+  TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kCycleIndex), &cycle_index_));
+  if (cycle_index_ < 0 || cycle_index_ >= static_cast<int64_t>(cycle_.size())) {
+    // The checkpoint was written with a different number of parallel chunks
+    // or without determinism, so the cycle starts over.
+    cycle_index_ = 0;
+  }
+  int64_t num_chunks = 0;
+  TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kNumChunks), &num_chunks));
+  chunks_.clear();
+  std::fill(cycle_.begin(), cycle_.end(), nullptr);
+  for (int64_t i = 0; i < num_chunks; ++i) {
+    auto chunk = std::make_shared<Chunk>();
+    tsl::tstring chunk_file;
+    TF_RETURN_IF_ERROR(reader->ReadScalar(
+        full_name(absl::StrCat(kChunkFile, "[", i, "]")), &chunk_file));
+    chunk->chunk_file = chunk_file;
+    TF_RETURN_IF_ERROR(
+        reader->ReadScalar(full_name(absl::StrCat(kNumReturned, "[", i, "]")),
+                           &chunk->num_returned));
+    chunk->num_to_skip = chunk->num_returned;
+    TF_RETURN_IF_ERROR(reader->ReadScalar(
+        full_name(absl::StrCat(kSlot, "[", i, "]")), &chunk->slot));
+    if (chunk->slot >= static_cast<int64_t>(cycle_.size()) ||
+        (chunk->slot >= 0 && cycle_[chunk->slot] != nullptr)) {
+      chunk->slot = -1;
+    }
+    if (chunk->slot >= 0) {
+      cycle_[chunk->slot] = chunk;
+    }
+    chunks_.push_back(std::move(chunk));
+  }
+  end_of_chunks_ = false;
+  status_ = absl::OkStatus();
+  return absl::OkStatus();
+}
+
+void ParallelSnapshotChunkReader::Cancel() ABSL_LOCKS_EXCLUDED(mu_) {
+  {
+    absl::MutexLock l(&mu_);
+    cancelled_ = true;
+    ready_to_push_.SignalAll();
+    ready_to_pop_.SignalAll();
+  }
+  // Unblocks the threads waiting for new chunks.
+  chunk_provider_->Cancel();
+}
+
+void ParallelSnapshotChunkReader::UpdateStatus(absl::Status status)
+    ABSL_LOCKS_EXCLUDED(mu_) {
+  if (status.ok()) {
+    return;
+  }
+  absl::MutexLock l(&mu_);
+  status_.Update(std::move(status));
+  ready_to_push_.SignalAll();
+  ready_to_pop_.SignalAll();
+}
+
+}  // namespace data
+}  // namespace tensorflow
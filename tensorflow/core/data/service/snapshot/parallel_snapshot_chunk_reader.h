@@ -0,0 +1,194 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SERVICE_SNAPSHOT_PARALLEL_SNAPSHOT_CHUNK_READER_H_
+#define TENSORFLOW_CORE_DATA_SERVICE_SNAPSHOT_PARALLEL_SNAPSHOT_CHUNK_READER_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/threadpool.h"
+
+namespace tensorflow {
+namespace data {
+
+// Reads the chunks of a distributed snapshot with multiple threads. Each thread
+// takes a chunk file from `chunk_provider` and decodes its records into a
+// bounded per-chunk buffer, so decompression and parsing happen off the
+// consumer thread. This class is thread-safe.
+//
+// If `deterministic` is true, elements are returned in the order of
+// `interleave` with `cycle_length = num_parallel_chunks`: one element from each
+// open chunk in turn, and a finished chunk's slot in the cycle is filled by the
+// next chunk produced by `chunk_provider`. Otherwise, elements are returned from
+// whichever chunk has decoded elements first.
+//
+// Usage example:
+//
+// ParallelSnapshotChunkReader reader(
+//     std::make_shared<SnapshotChunkProvider>(snapshot_path, env), options,
+//     env);
+// std::vector<Tensor> element;
+// bool end_of_sequence = false;
+// TF_RETURN_IF_ERROR(reader.GetNext(element, end_of_sequence));
+// while (!end_of_sequence) {
+//   ...
+//   TF_RETURN_IF_ERROR(reader.GetNext(element, end_of_sequence));
+// }
+class ParallelSnapshotChunkReader {
+ public:
+  struct Options {
+    // Compression of the chunk files, as defined in
+    // tensorflow/core/lib/io/compression.h.
+    std::string compression;
+    DataTypeVector dtypes;
+    // Maximum number of chunks decoded concurrently, which is also the maximum
+    // number of chunks with buffered elements.
+    int64_t num_parallel_chunks = 4;
+    // Maximum number of decoded elements buffered per chunk.
+    int64_t buffer_size = 8;
+    bool deterministic = true;
+  };
+
+  ParallelSnapshotChunkReader(std::shared_ptr<SplitProvider> chunk_provider,
+                              const Options& options, tsl::Env* env);
+  // Cancels the reader and waits for the decoding threads to finish.
+  virtual ~ParallelSnapshotChunkReader();
+  ParallelSnapshotChunkReader(const ParallelSnapshotChunkReader&) = delete;
+  ParallelSnapshotChunkReader& operator=(const ParallelSnapshotChunkReader&) =
+      delete;
+
+  // Reads the next element. Blocks until an element is decoded, or all chunks
+  // have been read, in which case `end_of_sequence` is set to true.
+  absl::Status GetNext(std::vector<Tensor>& element, bool& end_of_sequence);
+
+  // Saves the state of the chunk provider and, for each chunk that is being
+  // read, the chunk file, its slot in the cycle, and the number of elements
+  // returned from it. Buffered elements are not saved: they are decoded again
+  // after restoring. Does not wait for the threads blocked on the provider.
+  absl::Status Save(std::function<std::string(std::string)> full_name,
+                    IteratorStateWriter* writer);
+
+  // Restores the state saved by `Save`. Must be called before `GetNext`.
+  absl::Status Restore(std::function<std::string(std::string)> full_name,
+                       IteratorStateReader* reader);
+
+  // Cancels the reader and the chunk provider. Pending and future `GetNext`
+  // calls return a `CancelledError`.
+  void Cancel();
+
+ private:
+  // A chunk assigned to a decoding thread, or restored and waiting for one.
+  // Guarded by `mu_`.
+  struct Chunk {
+    std::string chunk_file;
+    // Number of elements returned by `GetNext`.
+    int64_t num_returned = 0;
+    // Number of elements to skip before buffering, after restoring.
+    int64_t num_to_skip = 0;
+    // Index in `cycle_`, or -1 if the chunk has not been placed in the cycle.
+    int64_t slot = -1;
+    bool assigned = false;
+    bool finished = false;
+    absl::Status status;
+    std::deque<std::vector<Tensor>> buffer;
+  };
+
+  // Run by each decoding thread until all chunks are read or the reader is
+  // cancelled.
+  void ReadChunks();
+
+  // Returns the next chunk to decode: a restored chunk, or a new chunk from
+  // `chunk_provider_`. Returns nullptr if there are no more chunks.
+  absl::StatusOr<std::shared_ptr<Chunk>> GetNextChunk();
+
+  // Decodes the records of `chunk` into its buffer.
+  absl::Status ReadChunk(Chunk& chunk);
+
+  // Pops an element from the first chunk that has one, or from the next chunk
+  // in the cycle if `deterministic` is true. Removes chunks that have been
+  // fully returned, and returns the error of a failed chunk once its elements
+  // are returned. Returns false if no element is ready.
+  absl::StatusOr<bool> PopElement(std::vector<Tensor>& element)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  absl::StatusOr<bool> PopElementInCycle(std::vector<Tensor>& element)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns the first chunk that has not been placed in the cycle, or nullptr.
+  std::shared_ptr<Chunk> NextUnplacedChunk() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Removes a fully returned chunk.
+  void RemoveChunk(const std::shared_ptr<Chunk>& chunk)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Starts the decoding threads if they have not been started.
+  void EnsureThreadsStarted() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Updates the status of the reader and notifies waiters.
+  void UpdateStatus(absl::Status status);
+
+  const std::shared_ptr<SplitProvider> chunk_provider_;
+  const Options options_;
+  tsl::Env* const env_;
+
+  // The writes of a `chunk_provider_->Save` call, replayed by `Save`.
+  class ProviderState;
+
+  // Serializes the calls to `chunk_provider_` by the decoding threads with
+  // appending the chunks to `chunks_`, so that the order of `chunks_` is the
+  // order of the provider. Acquired before `mu_`. `Save` does not acquire it,
+  // since the provider may block until more chunks are written.
+  absl::Mutex provider_mu_;
+
+  mutable absl::Mutex mu_;
+  absl::CondVar ready_to_push_;
+  absl::CondVar ready_to_pop_;
+
+  // Chunks with elements that have not been returned, in the order they were
+  // produced by `chunk_provider_`. Bounded by `num_parallel_chunks`.
+  std::deque<std::shared_ptr<Chunk>> chunks_ ABSL_GUARDED_BY(mu_);
+  // If `deterministic` is true, the open chunks in the order their elements
+  // are returned. Empty slots are filled by the next chunks in `chunks_`.
+  std::vector<std::shared_ptr<Chunk>> cycle_ ABSL_GUARDED_BY(mu_);
+  // Index of the next slot to return an element from.
+  int64_t cycle_index_ ABSL_GUARDED_BY(mu_) = 0;
+  // State of `chunk_provider_` after the last chunk in `chunks_` was produced.
+  // Set when the decoding threads are started.
+  std::unique_ptr<ProviderState> provider_state_ ABSL_GUARDED_BY(mu_);
+  // Number of threads waiting for a chunk from `chunk_provider_`. Each of them
+  // holds a slot in `chunks_`.
+  int64_t num_reserved_ ABSL_GUARDED_BY(mu_) = 0;
+  bool end_of_chunks_ ABSL_GUARDED_BY(mu_) = false;
+  bool cancelled_ ABSL_GUARDED_BY(mu_) = false;
+  absl::Status status_ ABSL_GUARDED_BY(mu_);
+
+  std::unique_ptr<tsl::thread::ThreadPool> thread_pool_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SERVICE_SNAPSHOT_PARALLEL_SNAPSHOT_CHUNK_READER_H_
@@ -0,0 +1,318 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/snapshot/parallel_snapshot_chunk_reader.h"
+
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "xla/tsl/lib/core/status_test_util.h"
+#include "xla/tsl/lib/io/compression.h"
+#include "tensorflow/core/data/serialization_utils.h"
+#include "tensorflow/core/data/service/snapshot/file_utils.h"
+#include "tensorflow/core/data/service/snapshot/path_utils.h"
+#include "tensorflow/core/data/service/snapshot/snapshot_chunk_provider.h"
+#include "tensorflow/core/data/snapshot_utils.h"
+#include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/framework/variant_tensor_data.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/path.h"
+#include "tsl/platform/status_matchers.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/platform/test.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::testing::ElementsAreArray;
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAreArray;
+using ::tsl::testing::IsOkAndHolds;
+using ::tsl::testing::StatusIs;
+
+constexpr int64_t kNumChunks = 5;
+constexpr int64_t kChunkSize = 10;
+
+absl::StatusOr<std::string> CreateSnapshotDirectory() {
+  std::string snapshot_path;
+  if (!tsl::Env::Default()->LocalTempFilename(&snapshot_path)) {
+    return absl::FailedPreconditionError(
+        "Failed to create local temp file for snapshot.");
+  }
+  TF_RETURN_IF_ERROR(tsl::Env::Default()->RecursivelyCreateDir(
+      CommittedChunksDirectory(snapshot_path)));
+  return snapshot_path;
+}
+
+std::string ChunkFile(absl::string_view snapshot_path, int64_t chunk_index) {
+  return tsl::io::JoinPath(CommittedChunksDirectory(snapshot_path),
+                           absl::StrCat("chunk_0_", chunk_index, "_",
+                                        kChunkSize));
+}
+
+// Writes chunk `chunk_index`, with elements
+// [chunk_index * kChunkSize, (chunk_index + 1) * kChunkSize).
+absl::Status WriteChunk(absl::string_view snapshot_path, int64_t chunk_index,
+                        const std::string& compression) {
+  snapshot_util::TFRecordWriter writer(ChunkFile(snapshot_path, chunk_index),
+                                       compression);
+  TF_RETURN_IF_ERROR(writer.Initialize(tsl::Env::Default()));
+  for (int64_t i = 0; i < kChunkSize; ++i) {
+    TF_RETURN_IF_ERROR(
+        writer.WriteTensors({Tensor(chunk_index * kChunkSize + i)}));
+  }
+  return writer.Close();
+}
+
+absl::Status SetDone(absl::string_view snapshot_path) {
+  return AtomicallyWriteStringToFile(SnapshotDoneFilePath(snapshot_path), "",
+                                     tsl::Env::Default());
+}
+
+absl::StatusOr<std::string> CreateSnapshot(const std::string& compression) {
+  TF_ASSIGN_OR_RETURN(std::string snapshot_path, CreateSnapshotDirectory());
+  for (int64_t i = 0; i < kNumChunks; ++i) {
+    TF_RETURN_IF_ERROR(WriteChunk(snapshot_path, i, compression));
+  }
+  TF_RETURN_IF_ERROR(SetDone(snapshot_path));
+  return snapshot_path;
+}
+
+std::vector<int64_t> Range(int64_t range) {
+  std::vector<int64_t> result(range);
+  std::iota(result.begin(), result.end(), 0);
+  return result;
+}
+
+// Returns the elements of the snapshot in the order of `interleave` with
+// `cycle_length`: a slot is emptied when its chunk is found to be exhausted,
+// and is filled by the next chunk the next time it is visited.
+std::vector<int64_t> InterleaveOrder(int64_t cycle_length) {
+  std::vector<int64_t> result;
+  std::vector<int64_t> cycle(cycle_length, -1);
+  std::vector<int64_t> num_read(kNumChunks, 0);
+  int64_t next_chunk = 0;
+  for (int64_t slot = 0; static_cast<int64_t>(result.size()) <
+                         kNumChunks * kChunkSize;
+       slot = (slot + 1) % cycle_length) {
+    if (cycle[slot] >= 0 && num_read[cycle[slot]] == kChunkSize) {
+      cycle[slot] = -1;
+      continue;
+    }
+    if (cycle[slot] < 0) {
+      if (next_chunk == kNumChunks) {
+        continue;
+      }
+      cycle[slot] = next_chunk++;
+    }
+    result.push_back(cycle[slot] * kChunkSize + num_read[cycle[slot]]++);
+  }
+  return result;
+}
+
+std::unique_ptr<ParallelSnapshotChunkReader> CreateReader(
+    const std::string& snapshot_path,
+    const ParallelSnapshotChunkReader::Options& options) {
+  return std::make_unique<ParallelSnapshotChunkReader>(
+      std::make_shared<SnapshotChunkProvider>(snapshot_path,
+                                              tsl::Env::Default()),
+      options, tsl::Env::Default());
+}
+
+// Reads up to `max_num_elements` elements, or all elements if it is negative.
+absl::StatusOr<std::vector<int64_t>> Read(ParallelSnapshotChunkReader& reader,
+                                          int64_t max_num_elements = -1) {
+  std::vector<int64_t> result;
+  while (max_num_elements < 0 ||
+         static_cast<int64_t>(result.size()) < max_num_elements) {
+    std::vector<Tensor> element;
+    bool end_of_sequence = false;
+    TF_RETURN_IF_ERROR(reader.GetNext(element, end_of_sequence));
+    if (end_of_sequence) {
+      break;
+    }
+    result.push_back(element[0].scalar<int64_t>()());
+  }
+  return result;
+}
+
+std::string full_name(const std::string& name) {
+  return FullName("test", name);
+}
+
+class ParallelSnapshotChunkReaderParamTest
+    : public ::testing::TestWithParam<
+          std::tuple<int64_t, int64_t, bool, std::string>> {
+ protected:
+  ParallelSnapshotChunkReader::Options Options() const {
+    ParallelSnapshotChunkReader::Options options;
+    options.num_parallel_chunks = std::get<0>(GetParam());
+    options.buffer_size = std::get<1>(GetParam());
+    options.deterministic = std::get<2>(GetParam());
+    options.compression = Compression();
+    options.dtypes = {DT_INT64};
+    return options;
+  }
+
+  std::string Compression() const { return std::get<3>(GetParam()); }
+};
+
+TEST_P(ParallelSnapshotChunkReaderParamTest, ReadSnapshot) {
+  TF_ASSERT_OK_AND_ASSIGN(std::string snapshot_path,
+                          CreateSnapshot(Compression()));
+  std::unique_ptr<ParallelSnapshotChunkReader> reader =
+      CreateReader(snapshot_path, Options());
+  TF_ASSERT_OK_AND_ASSIGN(std::vector<int64_t> elements, Read(*reader));
+  if (Options().deterministic) {
+    EXPECT_THAT(elements, ElementsAreArray(InterleaveOrder(
+                              Options().num_parallel_chunks)));
+  } else {
+    EXPECT_THAT(elements,
+                UnorderedElementsAreArray(Range(kNumChunks * kChunkSize)));
+  }
+}
+
+TEST_P(ParallelSnapshotChunkReaderParamTest, SaveAndRestore) {
+  TF_ASSERT_OK_AND_ASSIGN(std::string snapshot_path,
+                          CreateSnapshot(Compression()));
+  std::vector<int64_t> elements;
+  VariantTensorDataWriter writer;
+  {
+    std::unique_ptr<ParallelSnapshotChunkReader> reader =
+        CreateReader(snapshot_path, Options());
+    TF_ASSERT_OK_AND_ASSIGN(elements,
+                            Read(*reader, /*max_num_elements=*/kChunkSize + 3));
+    TF_ASSERT_OK(reader->Save(full_name, &writer));
+  }
+
+  std::vector<const VariantTensorData*> data;
+  writer.GetData(&data);
+  VariantTensorDataReader state_reader(data);
+  std::unique_ptr<ParallelSnapshotChunkReader> reader =
+      CreateReader(snapshot_path, Options());
+  TF_ASSERT_OK(reader->Restore(full_name, &state_reader));
+  TF_ASSERT_OK_AND_ASSIGN(std::vector<int64_t> remaining, Read(*reader));
+  elements.insert(elements.end(), remaining.begin(), remaining.end());
+  if (Options().deterministic) {
+    EXPECT_THAT(elements, ElementsAreArray(InterleaveOrder(
+                              Options().num_parallel_chunks)));
+  } else {
+    EXPECT_THAT(elements,
+                UnorderedElementsAreArray(Range(kNumChunks * kChunkSize)));
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    ParallelSnapshotChunkReaderParams, ParallelSnapshotChunkReaderParamTest,
+    ::testing::Combine(
+        /*NumParallelChunks*/ ::testing::Values(1, 3, 10),
+        /*BufferSize*/ ::testing::Values(1, 4, 100),
+        /*Deterministic*/ ::testing::Bool(),
+        /*Compression*/
+        ::testing::Values(tsl::io::compression::kNone,
+                          tsl::io::compression::kSnappy,
+                          tsl::io::compression::kZlib)));
+
+TEST(ParallelSnapshotChunkReaderTest, EmptySnapshot) {
+  TF_ASSERT_OK_AND_ASSIGN(std::string snapshot_path, CreateSnapshotDirectory());
+  TF_ASSERT_OK(SetDone(snapshot_path));
+  ParallelSnapshotChunkReader::Options options;
+  options.dtypes = {DT_INT64};
+  std::unique_ptr<ParallelSnapshotChunkReader> reader =
+      CreateReader(snapshot_path, options);
+  EXPECT_THAT(Read(*reader), IsOkAndHolds(IsEmpty()));
+  EXPECT_THAT(Read(*reader), IsOkAndHolds(IsEmpty()));
+}
+
+TEST(ParallelSnapshotChunkReaderTest, InvalidChunk) {
+  TF_ASSERT_OK_AND_ASSIGN(std::string snapshot_path, CreateSnapshotDirectory());
+  TF_ASSERT_OK(WriteChunk(snapshot_path, 0, tsl::io::compression::kNone));
+  TF_ASSERT_OK(AtomicallyWriteStringToFile(ChunkFile(snapshot_path, 1),
+                                           "Invalid chunk",
+                                           tsl::Env::Default()));
+  TF_ASSERT_OK(SetDone(snapshot_path));
+
+  ParallelSnapshotChunkReader::Options options;
+  options.num_parallel_chunks = 1;
+  options.dtypes = {DT_INT64};
+  std::unique_ptr<ParallelSnapshotChunkReader> reader =
+      CreateReader(snapshot_path, options);
+  // The elements of the first chunk are returned before the error.
+  EXPECT_THAT(Read(*reader, kChunkSize),
+              IsOkAndHolds(ElementsAreArray(Range(kChunkSize))));
+  EXPECT_FALSE(Read(*reader).ok());
+}
+
+TEST(ParallelSnapshotChunkReaderTest, SaveWhileWaitingForChunks) {
+  TF_ASSERT_OK_AND_ASSIGN(std::string snapshot_path, CreateSnapshotDirectory());
+  TF_ASSERT_OK(WriteChunk(snapshot_path, 0, tsl::io::compression::kNone));
+  ParallelSnapshotChunkReader::Options options;
+  options.num_parallel_chunks = 2;
+  options.deterministic = false;
+  options.dtypes = {DT_INT64};
+  VariantTensorDataWriter writer;
+  {
+    std::unique_ptr<ParallelSnapshotChunkReader> reader =
+        CreateReader(snapshot_path, options);
+    EXPECT_THAT(Read(*reader, kChunkSize),
+                IsOkAndHolds(UnorderedElementsAreArray(Range(kChunkSize))));
+    // The snapshot is not done, so a thread is waiting for the next chunk.
+    TF_ASSERT_OK(reader->Save(full_name, &writer));
+  }
+
+  TF_ASSERT_OK(WriteChunk(snapshot_path, 1, tsl::io::compression::kNone));
+  TF_ASSERT_OK(SetDone(snapshot_path));
+  std::vector<const VariantTensorData*> data;
+  writer.GetData(&data);
+  VariantTensorDataReader state_reader(data);
+  std::unique_ptr<ParallelSnapshotChunkReader> reader =
+      CreateReader(snapshot_path, options);
+  TF_ASSERT_OK(reader->Restore(full_name, &state_reader));
+  std::vector<int64_t> expected = Range(2 * kChunkSize);
+  expected.erase(expected.begin(), expected.begin() + kChunkSize);
+  EXPECT_THAT(Read(*reader), IsOkAndHolds(UnorderedElementsAreArray(expected)));
+}
+
+TEST(ParallelSnapshotChunkReaderTest, Cancel) {
+  // The snapshot is not done, so the reader waits for more chunks.
+  TF_ASSERT_OK_AND_ASSIGN(std::string snapshot_path, CreateSnapshotDirectory());
+  ParallelSnapshotChunkReader::Options options;
+  options.dtypes = {DT_INT64};
+  std::unique_ptr<ParallelSnapshotChunkReader> reader =
+      CreateReader(snapshot_path, options);
+  std::unique_ptr<tsl::Thread> cancel_thread =
+      absl::WrapUnique(tsl::Env::Default()->StartThread(
+          /*thread_options=*/{}, /*name=*/"cancel_thread", [&reader]() {
+            tsl::Env::Default()->SleepForMicroseconds(100000);
+            reader->Cancel();
+          }));
+  EXPECT_THAT(Read(*reader), StatusIs(absl::StatusCode::kCancelled));
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,287 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/data/dataset_utils.h"
+#include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/data/service/snapshot/parallel_snapshot_chunk_reader.h"
+#include "tensorflow/core/data/service/snapshot/snapshot_chunk_provider.h"
+#include "tensorflow/core/data/split_utils.h"
+#include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/metrics.h"
+#include "tensorflow/core/framework/model.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/op_requires.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/graph/graph.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/platform/tstring.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+constexpr const char kParallelSnapshotChunksDataset[] =
+    "ParallelSnapshotChunksDataset";
+constexpr const char kSnapshotPath[] = "snapshot_path";
+constexpr const char kNumParallelChunks[] = "num_parallel_chunks";
+constexpr const char kBufferSize[] = "buffer_size";
+constexpr const char kCompression[] = "compression";
+constexpr const char kDeterministic[] = "deterministic";
+
+// Reads all chunks of a distributed snapshot, decoding `num_parallel_chunks`
+// chunks concurrently. The chunks come from the same `SnapshotChunkProvider`
+// as `ListSnapshotChunksDataset`, so it supports reading partially written
+// snapshots and dynamic sharding in the tf.data service.
+class ParallelSnapshotChunksDatasetOp : public DatasetOpKernel {
+ public:
+  explicit ParallelSnapshotChunksDatasetOp(OpKernelConstruction* ctx);
+
+ protected:
+  void MakeDataset(OpKernelContext* ctx, DatasetBase** output) override;
+
+ private:
+  class Dataset;
+
+  DataTypeVector output_types_;
+  std::vector<PartialTensorShape> output_shapes_;
+  std::string compression_;
+  DeterminismPolicy deterministic_;
+};
+
+class ParallelSnapshotChunksDatasetOp::Dataset : public DatasetBase {
+ public:
+  Dataset(OpKernelContext* ctx, tsl::tstring snapshot_path,
+          int64_t num_parallel_chunks, int64_t buffer_size,
+          const std::string& compression,
+          const DeterminismPolicy& deterministic,
+          const DataTypeVector& output_types,
+          const std::vector<PartialTensorShape>& output_shapes)
+      : DatasetBase(DatasetContext(ctx)),
+        snapshot_path_(std::move(snapshot_path)),
+        num_parallel_chunks_(num_parallel_chunks),
+        buffer_size_(buffer_size),
+        compression_(compression),
+        deterministic_(deterministic),
+        output_types_(output_types),
+        output_shapes_(output_shapes),
+        env_(ctx->env()) {}
+
+  absl::string_view snapshot_path() const { return snapshot_path_; }
+
+  const DataTypeVector& output_dtypes() const override { return output_types_; }
+
+  const std::vector<PartialTensorShape>& output_shapes() const override {
+    return output_shapes_;
+  }
+
+  absl::Status MakeSplitProviders(std::vector<std::unique_ptr<SplitProvider>>*
+                                      split_providers) const override {
+    split_providers->push_back(
+        std::make_unique<SnapshotChunkProvider>(snapshot_path_, env_));
+    return absl::OkStatus();
+  }
+
+  std::string DebugString() const override {
+    return name_utils::DatasetDebugString(kParallelSnapshotChunksDataset);
+  }
+
+  absl::Status InputDatasets(
+      std::vector<const DatasetBase*>* inputs) const override {
+    inputs->clear();
+    return absl::OkStatus();
+  }
+
+  absl::Status CheckExternalState() const override { return absl::OkStatus(); }
+
+ protected:
+  std::unique_ptr<IteratorBase> MakeIteratorInternal(
+      const std::string& prefix) const override;
+
+  absl::Status AsGraphDefInternal(SerializationContext* ctx,
+                                  DatasetGraphDefBuilder* b,
+                                  Node** output) const override {
+    Node* snapshot_path = nullptr;
+    TF_RETURN_IF_ERROR(b->AddScalar(snapshot_path_, &snapshot_path));
+    Node* num_parallel_chunks = nullptr;
+    TF_RETURN_IF_ERROR(
+        b->AddScalar(num_parallel_chunks_, &num_parallel_chunks));
+    Node* buffer_size = nullptr;
+    TF_RETURN_IF_ERROR(b->AddScalar(buffer_size_, &buffer_size));
+
+    AttrValue compression;
+    b->BuildAttrValue(compression_, &compression);
+    AttrValue deterministic;
+    b->BuildAttrValue(deterministic_.String(), &deterministic);
+
+    return b->AddDataset(this,
+                         /*inputs=*/
+                         {std::make_pair(0, snapshot_path),
+                          std::make_pair(1, num_parallel_chunks),
+                          std::make_pair(2, buffer_size)},
+                         /*list_inputs=*/{},
+                         /*attrs=*/
+                         {{kCompression, compression},
+                          {kDeterministic, deterministic}},
+                         /*use_dataset_name=*/true, output);
+  }
+
+ private:
+  class Iterator;
+
+  const tsl::tstring snapshot_path_;
+  const int64_t num_parallel_chunks_;
+  const int64_t buffer_size_;
+  const std::string compression_;
+  const DeterminismPolicy deterministic_;
+  const DataTypeVector output_types_;
+  const std::vector<PartialTensorShape> output_shapes_;
+  tsl::Env* const env_;
+};
+
+class ParallelSnapshotChunksDatasetOp::Dataset::Iterator
+    : public DatasetIterator<ParallelSnapshotChunksDatasetOp::Dataset> {
+ public:
+  explicit Iterator(const Params& params)
+      : DatasetIterator<ParallelSnapshotChunksDatasetOp::Dataset>(params),
+        deterministic_(params.dataset->deterministic_.IsDeterministic() ||
+                       params.dataset->deterministic_.IsDefault()) {}
+
+  ~Iterator() override {
+    if (deregister_fn_) deregister_fn_();
+    reader_.reset();
+  }
+
+  bool SymbolicCheckpointCompatible() const override { return false; }
+
+  absl::Status Initialize(IteratorContext* ctx) override {
+    std::shared_ptr<SplitProvider> split_provider;
+    if (ctx->split_providers().empty()) {
+      split_provider = std::make_shared<SnapshotChunkProvider>(
+          dataset()->snapshot_path(), ctx->env());
+    } else {
+      TF_ASSIGN_OR_RETURN(split_provider,
+                          GetSingleSplitProvider(ctx, dataset()));
+    }
+    ParallelSnapshotChunkReader::Options options;
+    options.compression = dataset()->compression_;
+    options.dtypes = dataset()->output_types_;
+    options.num_parallel_chunks = dataset()->num_parallel_chunks_;
+    if (options.num_parallel_chunks == model::kAutotune) {
+      options.num_parallel_chunks = GetAutotuneDefaultParallelism(ctx);
+    }
+    options.buffer_size = dataset()->buffer_size_;
+    options.deterministic = deterministic_;
+    reader_ = std::make_unique<ParallelSnapshotChunkReader>(
+        std::move(split_provider), options, ctx->env());
+    return RegisterCancellationCallback(
+        ctx->cancellation_manager(), [this]() { reader_->Cancel(); },
+        &deregister_fn_);
+  }
+
+ private:
+  absl::Status GetNextInternal(IteratorContext* ctx,
+                               std::vector<Tensor>* out_tensors,
+                               bool* end_of_sequence) override {
+    return reader_->GetNext(*out_tensors, *end_of_sequence);
+  }
+
+  std::shared_ptr<model::Node> CreateNode(
+      IteratorContext* ctx, model::Node::Args args) const override {
+    return model::MakeSourceNode(std::move(args));
+  }
+
+  absl::Status SaveInternal(SerializationContext* ctx,
+                            IteratorStateWriter* writer) override {
+    return reader_->Save(
+        [&](const std::string& key) { return full_name(key); }, writer);
+  }
+
+  absl::Status RestoreInternal(IteratorContext* ctx,
+                               IteratorStateReader* reader) override {
+    return reader_->Restore(
+        [&](const std::string& key) { return full_name(key); }, reader);
+  }
+
+  const bool deterministic_;
+  std::unique_ptr<ParallelSnapshotChunkReader> reader_;
+  std::function<void()> deregister_fn_;
+};
+
+ParallelSnapshotChunksDatasetOp::ParallelSnapshotChunksDatasetOp(
+    OpKernelConstruction* ctx)
+    : DatasetOpKernel(ctx) {
+  OP_REQUIRES_OK(ctx, ctx->GetAttr("output_types", &output_types_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr("output_shapes", &output_shapes_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kCompression, &compression_));
+  std::string deterministic;
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kDeterministic, &deterministic));
+  OP_REQUIRES_OK(ctx,
+                 DeterminismPolicy::FromString(deterministic, &deterministic_));
+}
+
+void ParallelSnapshotChunksDatasetOp::MakeDataset(OpKernelContext* ctx,
+                                                  DatasetBase** output) {
+  tsl::tstring snapshot_path;
+  OP_REQUIRES_OK(ctx, ParseScalarArgument(ctx, kSnapshotPath, &snapshot_path));
+  OP_REQUIRES(ctx, !snapshot_path.empty(),
+              absl::InvalidArgumentError(
+                  "snapshot_path is required to read snapshot chunks."));
+  int64_t num_parallel_chunks = 0;
+  OP_REQUIRES_OK(ctx, ParseScalarArgument(ctx, kNumParallelChunks,
+                                          &num_parallel_chunks));
+  OP_REQUIRES(
+      ctx, num_parallel_chunks > 0 || num_parallel_chunks == model::kAutotune,
+      absl::InvalidArgumentError(
+          "num_parallel_chunks must be greater than zero."));
+  int64_t buffer_size = 0;
+  OP_REQUIRES_OK(ctx, ParseScalarArgument(ctx, kBufferSize, &buffer_size));
+  OP_REQUIRES(ctx, buffer_size > 0,
+              absl::InvalidArgumentError(
+                  "buffer_size must be greater than zero."));
+  metrics::RecordTFDataServiceSnapshotOp(snapshot_path,
+                                         kParallelSnapshotChunksDataset);
+  *output = new ParallelSnapshotChunksDatasetOp::Dataset(
+      ctx, std::move(snapshot_path), num_parallel_chunks, buffer_size,
+      compression_, deterministic_, output_types_, output_shapes_);
+}
+
+std::unique_ptr<IteratorBase>
+ParallelSnapshotChunksDatasetOp::Dataset::MakeIteratorInternal(
+    const std::string& prefix) const {
+  return std::make_unique<ParallelSnapshotChunksDatasetOp::Dataset::Iterator>(
+      ParallelSnapshotChunksDatasetOp::Dataset::Iterator::Params{
+          this,
+          name_utils::IteratorPrefix(kParallelSnapshotChunksDataset, prefix)});
+}
+
+REGISTER_KERNEL_BUILDER(
+    Name(kParallelSnapshotChunksDataset).Device(DEVICE_CPU),
+    ParallelSnapshotChunksDatasetOp);
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
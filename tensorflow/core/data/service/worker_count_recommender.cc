@@ -0,0 +1,318 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/worker_count_recommender.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "tsl/platform/mutex.h"
+#include "tsl/platform/thread_annotations.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+// Same bound as the one `MultipleIterationsAutoScaler` applies to its metric.
+constexpr int64_t kMaxNumberOfWorkers = 100000;
+
+template <typename K, typename TimeSeries>
+void DropSamplesBefore(absl::flat_hash_map<K, TimeSeries>& time_series,
+                       absl::Time cutoff) {
+  for (auto it = time_series.begin(); it != time_series.end();) {
+    TimeSeries& samples = it->second;
+    while (!samples.empty() && samples.front().time < cutoff) {
+      samples.pop_front();
+    }
+    if (samples.empty()) {
+      time_series.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+double Median(std::vector<double>& values) {
+  std::nth_element(values.begin(), values.begin() + values.size() / 2,
+                   values.end());
+  return values[values.size() / 2];
+}
+
+template <typename TimeSeries>
+double Mean(const TimeSeries& samples) {
+  double sum = 0.0;
+  for (const auto& sample : samples) {
+    sum += sample.value;
+  }
+  return sum / static_cast<double>(samples.size());
+}
+
+// Returns the least-squares slope of `samples`, in units per second, or 0 if
+// they span no time.
+template <typename TimeSeries>
+double Slope(const TimeSeries& samples) {
+  const absl::Time origin = samples.front().time;
+  double mean_x = 0.0;
+  for (const auto& sample : samples) {
+    mean_x += absl::ToDoubleSeconds(sample.time - origin);
+  }
+  mean_x /= static_cast<double>(samples.size());
+  const double mean_y = Mean(samples);
+  double covariance = 0.0;
+  double variance = 0.0;
+  for (const auto& sample : samples) {
+    const double dx = absl::ToDoubleSeconds(sample.time - origin) - mean_x;
+    covariance += dx * (sample.value - mean_y);
+    variance += dx * dx;
+  }
+  if (variance == 0.0) return 0.0;
+  return covariance / variance;
+}
+
+absl::Status CheckPositive(absl::string_view name, absl::Duration duration) {
+  if (duration <= absl::ZeroDuration()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot update ", name,
+                     " with a ZeroDuration or negative value: ",
+                     absl::FormatDuration(duration)));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+WorkerCountRecommender::WorkerCountRecommender(const Options& options)
+    : options_(options) {}
+
+absl::Status WorkerCountRecommender::ReportProcessingTime(
+    int64_t iteration_id, const std::string& worker_address,
+    absl::Duration processing_time, absl::Time now) TF_LOCKS_EXCLUDED(mu_) {
+  absl::Status s = CheckPositive("processing_time", processing_time);
+  if (!s.ok()) return s;
+  tsl::mutex_lock l(mu_);
+  iterations_[iteration_id].worker_throughputs[worker_address].push_back(
+      {now, 1.0 / absl::ToDoubleSeconds(processing_time)});
+  return absl::OkStatus();
+}
+
+absl::Status WorkerCountRecommender::ReportTargetProcessingTime(
+    int64_t iteration_id, int64_t consumer_id,
+    absl::Duration target_processing_time, absl::Time now)
+    TF_LOCKS_EXCLUDED(mu_) {
+  absl::Status s =
+      CheckPositive("target_processing_time", target_processing_time);
+  if (!s.ok()) return s;
+  tsl::mutex_lock l(mu_);
+  iterations_[iteration_id].consumption_rates[consumer_id].push_back(
+      {now, 1.0 / absl::ToDoubleSeconds(target_processing_time)});
+  return absl::OkStatus();
+}
+
+absl::Status WorkerCountRecommender::ReportTransferTime(
+    int64_t iteration_id, int64_t consumer_id, absl::Duration transfer_time,
+    absl::Time now) TF_LOCKS_EXCLUDED(mu_) {
+  if (transfer_time < absl::ZeroDuration()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot update transfer_time with a negative value: ",
+                     absl::FormatDuration(transfer_time)));
+  }
+  tsl::mutex_lock l(mu_);
+  iterations_[iteration_id].transfer_times[consumer_id].push_back(
+      {now, absl::ToDoubleSeconds(transfer_time)});
+  return absl::OkStatus();
+}
+
+void WorkerCountRecommender::RemoveWorker(int64_t iteration_id,
+                                          const std::string& worker_address)
+    TF_LOCKS_EXCLUDED(mu_) {
+  tsl::mutex_lock l(mu_);
+  auto it = iterations_.find(iteration_id);
+  if (it != iterations_.end()) {
+    it->second.worker_throughputs.erase(worker_address);
+  }
+}
+
+void WorkerCountRecommender::RemoveConsumer(int64_t iteration_id,
+                                            int64_t consumer_id)
+    TF_LOCKS_EXCLUDED(mu_) {
+  tsl::mutex_lock l(mu_);
+  auto it = iterations_.find(iteration_id);
+  if (it != iterations_.end()) {
+    it->second.consumption_rates.erase(consumer_id);
+    it->second.transfer_times.erase(consumer_id);
+  }
+}
+
+void WorkerCountRecommender::UnregisterIteration(int64_t iteration_id)
+    TF_LOCKS_EXCLUDED(mu_) {
+  tsl::mutex_lock l(mu_);
+  iterations_.erase(iteration_id);
+}
+
+void WorkerCountRecommender::DropOldSamples(absl::Time now)
+    TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+  const absl::Time cutoff = now - options_.sample_window;
+  for (auto& [iteration_id, samples] : iterations_) {
+    DropSamplesBefore(samples.worker_throughputs, cutoff);
+    DropSamplesBefore(samples.consumption_rates, cutoff);
+    DropSamplesBefore(samples.transfer_times, cutoff);
+  }
+}
+
+std::optional<double> WorkerCountRecommender::OfferedLoad(
+    double& consumption_rate) const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+  const double startup_seconds =
+      absl::ToDoubleSeconds(options_.worker_startup_time);
+  std::optional<double> offered_load;
+  consumption_rate = 0.0;
+  for (const auto& [iteration_id, samples] : iterations_) {
+    if (samples.worker_throughputs.empty() ||
+        samples.consumption_rates.empty()) {
+      continue;
+    }
+    std::vector<double> worker_throughputs;
+    for (const auto& [address, throughputs] : samples.worker_throughputs) {
+      for (const Sample& sample : throughputs) {
+        worker_throughputs.push_back(sample.value);
+      }
+    }
+    const double worker_throughput = Median(worker_throughputs);
+
+    std::optional<double> transfer_time;
+    for (const auto& [consumer_id, transfer_times] : samples.transfer_times) {
+      for (const Sample& sample : transfer_times) {
+        transfer_time = std::min(transfer_time.value_or(sample.value),
+                                 sample.value);
+      }
+    }
+
+    double iteration_consumption_rate = 0.0;
+    double consumption_rate_growth = 0.0;
+    for (const auto& [consumer_id, rates] : samples.consumption_rates) {
+      iteration_consumption_rate += Mean(rates);
+      consumption_rate_growth += Slope(rates);
+    }
+    const double forecast_consumption_rate =
+        iteration_consumption_rate +
+        std::max(0.0, consumption_rate_growth) * startup_seconds;
+
+    const double service_time =
+        1.0 / worker_throughput + transfer_time.value_or(0.0);
+    offered_load =
+        offered_load.value_or(0.0) + forecast_consumption_rate * service_time;
+    consumption_rate += iteration_consumption_rate;
+  }
+  return offered_load;
+}
+
+int64_t WorkerCountRecommender::RequiredNumberOfWorkers(
+    double offered_load, double max_utilization, double max_wait_probability) {
+  if (offered_load <= 0.0) return 1;
+  // Computes Erlang B(c, a) with the recurrence
+  //   B(0, a) = 1, B(c, a) = a * B(c - 1, a) / (c + a * B(c - 1, a)),
+  // and derives Erlang C(c, a) = c * B / (c - a * (1 - B)) from it.
+  double erlang_b = 1.0;
+  for (int64_t c = 1; c < kMaxNumberOfWorkers; ++c) {
+    erlang_b = offered_load * erlang_b / (c + offered_load * erlang_b);
+    if (c <= offered_load || offered_load / c > max_utilization) continue;
+    const double erlang_c =
+        c * erlang_b / (c - offered_load * (1.0 - erlang_b));
+    if (erlang_c <= max_wait_probability) return c;
+  }
+  return kMaxNumberOfWorkers;
+}
+
+std::optional<WorkerCountRecommender::Recommendation>
+WorkerCountRecommender::Update(absl::Time now) TF_LOCKS_EXCLUDED(mu_) {
+  tsl::mutex_lock l(mu_);
+  DropOldSamples(now);
+  double consumption_rate = 0.0;
+  std::optional<double> offered_load = OfferedLoad(consumption_rate);
+  if (!offered_load.has_value()) {
+    recommendation_.reset();
+    above_since_.reset();
+    below_since_.reset();
+    return std::nullopt;
+  }
+
+  const int64_t model_num_workers = RequiredNumberOfWorkers(
+      *offered_load, options_.max_utilization, options_.max_wait_probability);
+  int64_t num_workers = model_num_workers;
+  if (recommendation_.has_value()) {
+    num_workers = recommendation_->num_workers;
+    if (model_num_workers > num_workers) {
+      below_since_.reset();
+      if (!above_since_.has_value()) {
+        above_since_ = now;
+        min_num_workers_above_ = model_num_workers;
+      }
+      min_num_workers_above_ =
+          std::min(min_num_workers_above_, model_num_workers);
+      if (now - *above_since_ >= options_.scale_up_delay) {
+        VLOG(1) << "Recommending to scale tf.data service workers up from "
+                << num_workers << " to " << min_num_workers_above_;
+        num_workers = min_num_workers_above_;
+        last_scale_up_ = now;
+        above_since_.reset();
+      }
+    } else if (model_num_workers < num_workers &&
+               model_num_workers <=
+                   num_workers * (1.0 - options_.scale_down_threshold)) {
+      above_since_.reset();
+      if (!below_since_.has_value()) {
+        below_since_ = now;
+        max_num_workers_below_ = model_num_workers;
+      }
+      max_num_workers_below_ =
+          std::max(max_num_workers_below_, model_num_workers);
+      if (now - *below_since_ >= options_.scale_down_delay &&
+          now - last_scale_up_ >= options_.worker_startup_time) {
+        VLOG(1) << "Recommending to scale tf.data service workers down from "
+                << num_workers << " to " << max_num_workers_below_;
+        num_workers = max_num_workers_below_;
+        below_since_.reset();
+      }
+    } else {
+      above_since_.reset();
+      below_since_.reset();
+    }
+  }
+
+  Recommendation recommendation;
+  recommendation.num_workers = num_workers;
+  recommendation.model_num_workers = model_num_workers;
+  recommendation.consumption_rate = consumption_rate;
+  recommendation.offered_load = *offered_load;
+  recommendation.utilization = *offered_load / num_workers;
+  recommendation_ = recommendation;
+  return recommendation_;
+}
+
+std::optional<WorkerCountRecommender::Recommendation>
+WorkerCountRecommender::GetRecommendation() const TF_LOCKS_EXCLUDED(mu_) {
+  tsl::mutex_lock l(mu_);
+  return recommendation_;
+}
+
+}  // namespace data
+}  // namespace tensorflow
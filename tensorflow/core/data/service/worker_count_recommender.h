@@ -0,0 +1,198 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_SERVICE_WORKER_COUNT_RECOMMENDER_H_
+#define TENSORFLOW_CORE_DATA_SERVICE_WORKER_COUNT_RECOMMENDER_H_
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "tsl/platform/mutex.h"
+#include "tsl/platform/thread_annotations.h"
+
+namespace tensorflow {
+namespace data {
+
+// Recommends a number of tf.data service workers from a queueing model of the
+// cluster. See `AutoScaler` for the glossary.
+//
+// **Model**
+//
+// The recommender keeps a time series of the processing times (PT) reported by
+// workers, and of the target processing times (TPT) and element transfer times
+// reported by consumers, over the last `Options::sample_window`. For each
+// Iteration, it fits:
+//  * the worker throughput WT as the median of the reported 1 / PT,
+//  * the transfer time T as the minimum of the reported transfer times. The
+//    minimum filters out time that consumers spent waiting for elements that
+//    were not produced yet, which would otherwise make an underprovisioned
+//    cluster look like a slow network,
+//  * the consumption rate CR as the sum over consumers of the mean of their
+//    reported 1 / TPT, extrapolated `Options::worker_startup_time` into the
+//    future if it is growing, so that new workers are up by the time they are
+//    needed.
+//
+// Since all Iterations share the CPU of every worker, the cluster is modeled as
+// a single M/M/c queue, where the offered load (in workers) is
+//   a = Sum over Iterations of CR * (1 / WT + T).
+// The transfer time is conservatively counted as worker busy time. The model
+// number of workers is the smallest c such that the utilization a / c is at
+// most `Options::max_utilization` and the Erlang C probability that a request
+// finds all workers busy is at most `Options::max_wait_probability`.
+//
+// **Hysteresis**
+//
+// The recommended number of workers follows the model number of workers with
+// hysteresis, to avoid oscillating on noisy reports:
+//  * It increases once the model has asked for more workers for
+//    `Options::scale_up_delay`, to the smallest number asked for in that time.
+//  * It decreases once the model has asked for at least
+//    `Options::scale_down_threshold` fewer workers for
+//    `Options::scale_down_delay`, to the largest number asked for in that time,
+//    and never within `Options::worker_startup_time` of an increase.
+//
+// WorkerCountRecommender is thread-safe.
+class WorkerCountRecommender {
+ public:
+  struct Options {
+    // How long reported times are remembered.
+    absl::Duration sample_window = absl::Minutes(2);
+    // Time it takes for a new worker to start serving elements.
+    absl::Duration worker_startup_time = absl::Minutes(1);
+    // Maximum fraction of time workers are expected to be busy.
+    double max_utilization = 0.9;
+    // Maximum probability that a request has to wait for a busy worker.
+    double max_wait_probability = 0.1;
+    // How long the model has to ask for more workers before recommending them.
+    absl::Duration scale_up_delay = absl::Seconds(30);
+    // How long the model has to ask for fewer workers before recommending them.
+    absl::Duration scale_down_delay = absl::Minutes(5);
+    // Minimum relative decrease of the model number of workers that is
+    // recommended.
+    double scale_down_threshold = 0.1;
+  };
+
+  struct Recommendation {
+    // Recommended number of workers, with hysteresis.
+    int64_t num_workers = 0;
+    // Number of workers the model asks for at the time of the recommendation.
+    int64_t model_num_workers = 0;
+    // Sum of the consumption rates of all Iterations, in elements per second.
+    double consumption_rate = 0.0;
+    // Offered load, in workers.
+    double offered_load = 0.0;
+    // Expected utilization of `num_workers` workers.
+    double utilization = 0.0;
+  };
+
+  WorkerCountRecommender() : WorkerCountRecommender(Options()) {}
+  explicit WorkerCountRecommender(const Options& options);
+  WorkerCountRecommender(const WorkerCountRecommender&) = delete;
+  WorkerCountRecommender& operator=(const WorkerCountRecommender&) = delete;
+
+  // Reports the processing time observed at `now` by the worker with
+  // `worker_address` for iteration with `iteration_id`. Returns an error if
+  // `processing_time` is ZeroDuration or negative.
+  absl::Status ReportProcessingTime(int64_t iteration_id,
+                                    const std::string& worker_address,
+                                    absl::Duration processing_time,
+                                    absl::Time now) TF_LOCKS_EXCLUDED(mu_);
+  // Reports the target processing time observed at `now` by the consumer
+  // identified by `consumer_id` for iteration with `iteration_id`. Returns an
+  // error if `target_processing_time` is ZeroDuration or negative.
+  absl::Status ReportTargetProcessingTime(int64_t iteration_id,
+                                          int64_t consumer_id,
+                                          absl::Duration target_processing_time,
+                                          absl::Time now)
+      TF_LOCKS_EXCLUDED(mu_);
+  // Reports the element transfer time observed at `now` by the consumer
+  // identified by `consumer_id` for iteration with `iteration_id`. Returns an
+  // error if `transfer_time` is negative.
+  absl::Status ReportTransferTime(int64_t iteration_id, int64_t consumer_id,
+                                  absl::Duration transfer_time, absl::Time now)
+      TF_LOCKS_EXCLUDED(mu_);
+
+  // Forgets the times reported by the worker with `worker_address` for
+  // iteration with `iteration_id`.
+  void RemoveWorker(int64_t iteration_id, const std::string& worker_address)
+      TF_LOCKS_EXCLUDED(mu_);
+  // Forgets the times reported by the consumer identified by `consumer_id` for
+  // iteration with `iteration_id`.
+  void RemoveConsumer(int64_t iteration_id, int64_t consumer_id)
+      TF_LOCKS_EXCLUDED(mu_);
+  // Forgets all times reported for iteration with `iteration_id`.
+  void UnregisterIteration(int64_t iteration_id) TF_LOCKS_EXCLUDED(mu_);
+
+  // Refits the model at `now` and updates the recommendation. Should be called
+  // periodically. Returns the updated recommendation, or nullopt if no
+  // Iteration has both processing and target processing times.
+  std::optional<Recommendation> Update(absl::Time now) TF_LOCKS_EXCLUDED(mu_);
+  // Returns the recommendation computed by the last call to `Update`.
+  std::optional<Recommendation> GetRecommendation() const
+      TF_LOCKS_EXCLUDED(mu_);
+
+  // Returns the smallest number of workers that serves an offered load of
+  // `offered_load` workers with at most `max_utilization` utilization and
+  // `max_wait_probability` probability of waiting, assuming an M/M/c queue.
+  static int64_t RequiredNumberOfWorkers(double offered_load,
+                                         double max_utilization,
+                                         double max_wait_probability);
+
+ private:
+  struct Sample {
+    absl::Time time;
+    double value = 0.0;
+  };
+  using TimeSeries = std::deque<Sample>;
+
+  struct IterationSamples {
+    // Worker throughputs, in elements per second, by worker address.
+    absl::flat_hash_map<std::string, TimeSeries> worker_throughputs;
+    // Consumption rates, in elements per second, by consumer id.
+    absl::flat_hash_map<int64_t, TimeSeries> consumption_rates;
+    // Transfer times, in seconds, by consumer id.
+    absl::flat_hash_map<int64_t, TimeSeries> transfer_times;
+  };
+
+  // Drops samples older than the sample window.
+  void DropOldSamples(absl::Time now) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Returns the offered load of all Iterations, in workers, and sets
+  // `consumption_rate`. Returns nullopt if no Iteration has enough samples.
+  std::optional<double> OfferedLoad(double& consumption_rate) const
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const Options options_;
+
+  mutable tsl::mutex mu_;
+  absl::flat_hash_map<int64_t, IterationSamples> iterations_ TF_GUARDED_BY(mu_);
+  std::optional<Recommendation> recommendation_ TF_GUARDED_BY(mu_);
+  // Start of the current run of model numbers of workers above (resp. below
+  // the scale-down threshold of) the recommendation, and the smallest (resp.
+  // largest) model number of workers seen in that run.
+  std::optional<absl::Time> above_since_ TF_GUARDED_BY(mu_);
+  int64_t min_num_workers_above_ TF_GUARDED_BY(mu_) = 0;
+  std::optional<absl::Time> below_since_ TF_GUARDED_BY(mu_);
+  int64_t max_num_workers_below_ TF_GUARDED_BY(mu_) = 0;
+  absl::Time last_scale_up_ TF_GUARDED_BY(mu_) = absl::InfinitePast();
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_SERVICE_WORKER_COUNT_RECOMMENDER_H_
@@ -0,0 +1,490 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/service/worker_count_recommender.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "xla/tsl/lib/core/status_test_util.h"
+#include "tensorflow/core/data/service/auto_scaler.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tsl/platform/status_matchers.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::testing::DoubleNear;
+using ::testing::Optional;
+using ::tsl::testing::StatusIs;
+
+constexpr absl::Time kStart = absl::FromUnixSeconds(1000000);
+
+WorkerCountRecommender::Options NoHysteresisOptions() {
+  WorkerCountRecommender::Options options;
+  options.worker_startup_time = absl::ZeroDuration();
+  options.scale_up_delay = absl::ZeroDuration();
+  options.scale_down_delay = absl::ZeroDuration();
+  options.scale_down_threshold = 0.0;
+  return options;
+}
+
+std::optional<int64_t> NumWorkers(WorkerCountRecommender& recommender,
+                                  absl::Time now) {
+  std::optional<WorkerCountRecommender::Recommendation> recommendation =
+      recommender.Update(now);
+  if (!recommendation.has_value()) return std::nullopt;
+  return recommendation->num_workers;
+}
+
+TEST(WorkerCountRecommenderTest, RequiredNumberOfWorkers) {
+  EXPECT_EQ(WorkerCountRecommender::RequiredNumberOfWorkers(
+                /*offered_load=*/0.0, /*max_utilization=*/0.9,
+                /*max_wait_probability=*/0.1),
+            1);
+  // C(2, 1) = 1/3 and C(3, 1) = 1/11.
+  EXPECT_EQ(WorkerCountRecommender::RequiredNumberOfWorkers(
+                /*offered_load=*/1.0, /*max_utilization=*/1.0,
+                /*max_wait_probability=*/0.5),
+            2);
+  EXPECT_EQ(WorkerCountRecommender::RequiredNumberOfWorkers(
+                /*offered_load=*/1.0, /*max_utilization=*/1.0,
+                /*max_wait_probability=*/0.3),
+            3);
+  EXPECT_EQ(WorkerCountRecommender::RequiredNumberOfWorkers(
+                /*offered_load=*/8.0, /*max_utilization=*/0.5,
+                /*max_wait_probability=*/1.0),
+            16);
+}
+
+TEST(WorkerCountRecommenderTest, RequiredNumberOfWorkersGrowsSublinearly) {
+  // With the same probability of waiting, larger clusters run at a higher
+  // utilization.
+  const int64_t small = WorkerCountRecommender::RequiredNumberOfWorkers(
+      /*offered_load=*/10.0, /*max_utilization=*/1.0,
+      /*max_wait_probability=*/0.1);
+  const int64_t large = WorkerCountRecommender::RequiredNumberOfWorkers(
+      /*offered_load=*/1000.0, /*max_utilization=*/1.0,
+      /*max_wait_probability=*/0.1);
+  EXPECT_GT(small, 10);
+  EXPECT_GT(large, 1000);
+  EXPECT_LT(10.0 / small, 1000.0 / large);
+}
+
+TEST(WorkerCountRecommenderTest, NoReports) {
+  WorkerCountRecommender recommender;
+  EXPECT_EQ(recommender.Update(kStart), std::nullopt);
+  EXPECT_EQ(recommender.GetRecommendation(), std::nullopt);
+}
+
+TEST(WorkerCountRecommenderTest, NoConsumers) {
+  WorkerCountRecommender recommender;
+  TF_ASSERT_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/0:20000", absl::Milliseconds(10),
+      kStart));
+  EXPECT_EQ(recommender.Update(kStart), std::nullopt);
+}
+
+TEST(WorkerCountRecommenderTest, InvalidReports) {
+  WorkerCountRecommender recommender;
+  EXPECT_THAT(recommender.ReportProcessingTime(
+                  /*iteration_id=*/0, "/worker/task/0:20000",
+                  absl::ZeroDuration(), kStart),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(recommender.ReportTargetProcessingTime(
+                  /*iteration_id=*/0, /*consumer_id=*/0,
+                  absl::Milliseconds(-1), kStart),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(
+      recommender.ReportTransferTime(/*iteration_id=*/0, /*consumer_id=*/0,
+                                     absl::Milliseconds(-1), kStart),
+      StatusIs(absl::StatusCode::kInvalidArgument));
+  TF_EXPECT_OK(recommender.ReportTransferTime(
+      /*iteration_id=*/0, /*consumer_id=*/0, absl::ZeroDuration(), kStart));
+}
+
+// Worker throughput = 10 [elements/s], consumption rate = 100 [elements/s], so
+// the offered load is 10 workers.
+TEST(WorkerCountRecommenderTest, FitsQueueingModel) {
+  WorkerCountRecommender recommender(NoHysteresisOptions());
+  TF_ASSERT_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/0:20000", absl::Milliseconds(100),
+      kStart));
+  TF_ASSERT_OK(recommender.ReportTargetProcessingTime(
+      /*iteration_id=*/0, /*consumer_id=*/0, absl::Milliseconds(10), kStart));
+  std::optional<WorkerCountRecommender::Recommendation> recommendation =
+      recommender.Update(kStart);
+  ASSERT_TRUE(recommendation.has_value());
+  EXPECT_THAT(recommendation->consumption_rate, DoubleNear(100.0, 1e-6));
+  EXPECT_THAT(recommendation->offered_load, DoubleNear(10.0, 1e-6));
+  EXPECT_EQ(recommendation->num_workers,
+            WorkerCountRecommender::RequiredNumberOfWorkers(
+                /*offered_load=*/10.0, /*max_utilization=*/0.9,
+                /*max_wait_probability=*/0.1));
+  EXPECT_EQ(recommendation->model_num_workers, recommendation->num_workers);
+  EXPECT_LE(recommendation->utilization, 0.9);
+  EXPECT_EQ(recommender.GetRecommendation()->num_workers,
+            recommendation->num_workers);
+}
+
+TEST(WorkerCountRecommenderTest, MedianWorkerThroughput) {
+  WorkerCountRecommender recommender(NoHysteresisOptions());
+  TF_ASSERT_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/0:20000", absl::Milliseconds(100),
+      kStart));
+  TF_ASSERT_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/1:20000", absl::Milliseconds(100),
+      kStart));
+  TF_ASSERT_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/2:20000", absl::Seconds(100), kStart));
+  TF_ASSERT_OK(recommender.ReportTargetProcessingTime(
+      /*iteration_id=*/0, /*consumer_id=*/0, absl::Milliseconds(10), kStart));
+  EXPECT_THAT(recommender.Update(kStart)->offered_load,
+              DoubleNear(10.0, 1e-6));
+}
+
+TEST(WorkerCountRecommenderTest, TransferTimeAddsToServiceTime) {
+  WorkerCountRecommender recommender(NoHysteresisOptions());
+  TF_ASSERT_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/0:20000", absl::Milliseconds(100),
+      kStart));
+  TF_ASSERT_OK(recommender.ReportTargetProcessingTime(
+      /*iteration_id=*/0, /*consumer_id=*/0, absl::Milliseconds(10), kStart));
+  TF_ASSERT_OK(recommender.ReportTransferTime(
+      /*iteration_id=*/0, /*consumer_id=*/0, absl::Milliseconds(50), kStart));
+  // Includes waiting for the element to be produced, so it is ignored.
+  TF_ASSERT_OK(recommender.ReportTransferTime(
+      /*iteration_id=*/0, /*consumer_id=*/0, absl::Seconds(2), kStart));
+  EXPECT_THAT(recommender.Update(kStart)->offered_load,
+              DoubleNear(15.0, 1e-6));
+}
+
+TEST(WorkerCountRecommenderTest, IterationsShareWorkers) {
+  WorkerCountRecommender recommender(NoHysteresisOptions());
+  for (int64_t iteration_id : {0, 1}) {
+    TF_ASSERT_OK(recommender.ReportProcessingTime(
+        iteration_id, "/worker/task/0:20000", absl::Milliseconds(100), kStart));
+    TF_ASSERT_OK(recommender.ReportTargetProcessingTime(
+        iteration_id, /*consumer_id=*/iteration_id, absl::Milliseconds(20),
+        kStart));
+  }
+  EXPECT_THAT(recommender.Update(kStart)->offered_load,
+              DoubleNear(10.0, 1e-6));
+
+  recommender.UnregisterIteration(/*iteration_id=*/1);
+  EXPECT_THAT(recommender.Update(kStart)->offered_load,
+              DoubleNear(5.0, 1e-6));
+  recommender.RemoveConsumer(/*iteration_id=*/0, /*consumer_id=*/0);
+  EXPECT_EQ(recommender.Update(kStart), std::nullopt);
+}
+
+TEST(WorkerCountRecommenderTest, ForgetsOldSamples) {
+  WorkerCountRecommender::Options options = NoHysteresisOptions();
+  options.sample_window = absl::Seconds(10);
+  WorkerCountRecommender recommender(options);
+  TF_ASSERT_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/0:20000", absl::Milliseconds(100),
+      kStart));
+  TF_ASSERT_OK(recommender.ReportTargetProcessingTime(
+      /*iteration_id=*/0, /*consumer_id=*/0, absl::Milliseconds(10), kStart));
+  EXPECT_NE(recommender.Update(kStart + absl::Seconds(10)), std::nullopt);
+  EXPECT_EQ(recommender.Update(kStart + absl::Seconds(11)), std::nullopt);
+}
+
+TEST(WorkerCountRecommenderTest, ForecastsGrowingConsumptionRate) {
+  WorkerCountRecommender::Options options = NoHysteresisOptions();
+  options.worker_startup_time = absl::Seconds(10);
+  WorkerCountRecommender recommender(options);
+  TF_ASSERT_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/0:20000", absl::Milliseconds(100),
+      kStart));
+  // The consumption rate grows by 1 [elements/s] every second, from a mean of
+  // 110 [elements/s], so it is forecast to be 120 [elements/s] once a new
+  // worker is up.
+  for (int64_t i = 0; i <= 2; ++i) {
+    TF_ASSERT_OK(recommender.ReportTargetProcessingTime(
+        /*iteration_id=*/0, /*consumer_id=*/0,
+        absl::Seconds(1) / (100 + 10 * i), kStart + absl::Seconds(10 * i)));
+  }
+  std::optional<WorkerCountRecommender::Recommendation> recommendation =
+      recommender.Update(kStart + absl::Seconds(20));
+  ASSERT_TRUE(recommendation.has_value());
+  EXPECT_THAT(recommendation->consumption_rate, DoubleNear(110.0, 1e-6));
+  EXPECT_THAT(recommendation->offered_load, DoubleNear(12.0, 1e-6));
+}
+
+WorkerCountRecommender::Options HysteresisOptions() {
+  WorkerCountRecommender::Options options;
+  options.sample_window = absl::Seconds(5);
+  options.worker_startup_time = absl::ZeroDuration();
+  options.max_utilization = 1.0;
+  options.max_wait_probability = 1.0;
+  options.scale_up_delay = absl::Seconds(30);
+  options.scale_down_delay = absl::Seconds(60);
+  options.scale_down_threshold = 0.1;
+  return options;
+}
+
+// Reports an offered load of `offered_load` workers at `now`, and returns the
+// recommended number of workers.
+std::optional<int64_t> ReportOfferedLoad(WorkerCountRecommender& recommender,
+                                         double offered_load, absl::Time now) {
+  TF_CHECK_OK(recommender.ReportProcessingTime(
+      /*iteration_id=*/0, "/worker/task/0:20000", absl::Seconds(1), now));
+  TF_CHECK_OK(recommender.ReportTargetProcessingTime(
+      /*iteration_id=*/0, /*consumer_id=*/0, absl::Seconds(1) / offered_load,
+      now));
+  return NumWorkers(recommender, now);
+}
+
+TEST(WorkerCountRecommenderTest, ScalesUpAfterDelay) {
+  WorkerCountRecommender recommender(HysteresisOptions());
+  EXPECT_THAT(ReportOfferedLoad(recommender, 9.5, kStart), Optional(10));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 19.5, kStart + absl::Seconds(10)),
+              Optional(10));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 29.5, kStart + absl::Seconds(20)),
+              Optional(10));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 29.5, kStart + absl::Seconds(40)),
+              Optional(20));
+}
+
+TEST(WorkerCountRecommenderTest, IgnoresShortSpikes) {
+  WorkerCountRecommender recommender(HysteresisOptions());
+  EXPECT_THAT(ReportOfferedLoad(recommender, 9.5, kStart), Optional(10));
+  for (int64_t i = 1; i < 20; ++i) {
+    const double offered_load = (i % 2 == 0) ? 9.5 : 19.5;
+    const absl::Time now = kStart + absl::Seconds(10 * i);
+    EXPECT_THAT(ReportOfferedLoad(recommender, offered_load, now),
+                Optional(10));
+  }
+}
+
+TEST(WorkerCountRecommenderTest, ScalesDownAfterDelay) {
+  WorkerCountRecommender recommender(HysteresisOptions());
+  EXPECT_THAT(ReportOfferedLoad(recommender, 19.5, kStart), Optional(20));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 9.5, kStart + absl::Seconds(10)),
+              Optional(20));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 14.5, kStart + absl::Seconds(40)),
+              Optional(20));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 9.5, kStart + absl::Seconds(70)),
+              Optional(15));
+}
+
+TEST(WorkerCountRecommenderTest, IgnoresSmallDecreases) {
+  WorkerCountRecommender recommender(HysteresisOptions());
+  EXPECT_THAT(ReportOfferedLoad(recommender, 19.5, kStart), Optional(20));
+  for (int64_t i = 1; i < 20; ++i) {
+    const absl::Time now = kStart + absl::Seconds(10 * i);
+    EXPECT_THAT(ReportOfferedLoad(recommender, 18.5, now), Optional(20));
+  }
+}
+
+TEST(WorkerCountRecommenderTest, NoScaleDownRightAfterScaleUp) {
+  WorkerCountRecommender::Options options = HysteresisOptions();
+  options.scale_up_delay = absl::ZeroDuration();
+  options.scale_down_delay = absl::ZeroDuration();
+  options.worker_startup_time = absl::Seconds(60);
+  WorkerCountRecommender recommender(options);
+  EXPECT_THAT(ReportOfferedLoad(recommender, 9.5, kStart), Optional(10));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 19.5, kStart + absl::Seconds(10)),
+              Optional(20));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 9.5, kStart + absl::Seconds(20)),
+              Optional(20));
+  EXPECT_THAT(ReportOfferedLoad(recommender, 9.5, kStart + absl::Seconds(70)),
+              Optional(10));
+}
+
+// Simulates a tf.data service cluster with one Iteration. Every 10 seconds,
+// each worker reports a noisy processing time, and each consumer a noisy
+// target processing time and transfer time. The cluster is resized to the
+// recommended number of workers, and new workers start reporting after the
+// worker startup time.
+class SyntheticLoadGenerator {
+ public:
+  struct Result {
+    // Recommended number of workers after each report.
+    std::vector<int64_t> recommendations;
+    // Number of workers estimated by `AutoScaler` after each report.
+    std::vector<int64_t> auto_scaler_estimates;
+  };
+
+  SyntheticLoadGenerator(WorkerCountRecommender& recommender,
+                         absl::Duration worker_startup_time,
+                         int64_t num_consumers, absl::Duration processing_time,
+                         absl::Duration transfer_time, double noise)
+      : recommender_(recommender),
+        worker_startup_time_(worker_startup_time),
+        num_consumers_(num_consumers),
+        processing_time_(processing_time),
+        transfer_time_(transfer_time),
+        noise_(-noise, noise) {}
+
+  // Runs the cluster for `duration` while each consumer consumes
+  // `consumption_rate` elements per second.
+  Result Run(absl::Duration duration, double consumption_rate) {
+    Result result;
+    const absl::Time end = now_ + duration;
+    while (now_ < end) {
+      now_ += absl::Seconds(10);
+      if (now_ >= pending_workers_ready_) {
+        num_workers_ = std::max(num_workers_, pending_num_workers_);
+      }
+      for (int64_t i = 0; i < num_workers_; ++i) {
+        const absl::Duration processing_time = processing_time_ * Noise();
+        const std::string address = absl::StrCat("/worker/task/", i, ":20000");
+        TF_CHECK_OK(recommender_.ReportProcessingTime(
+            /*iteration_id=*/0, address, processing_time, now_));
+        TF_CHECK_OK(auto_scaler_.ReportProcessingTime(address,
+                                                      processing_time));
+      }
+      for (int64_t i = 0; i < num_consumers_; ++i) {
+        const absl::Duration target_processing_time =
+            absl::Seconds(1) / (consumption_rate * Noise());
+        TF_CHECK_OK(recommender_.ReportTargetProcessingTime(
+            /*iteration_id=*/0, /*consumer_id=*/i, target_processing_time,
+            now_));
+        TF_CHECK_OK(auto_scaler_.ReportTargetProcessingTime(
+            /*consumer_id=*/i, target_processing_time));
+        // Consumers sometimes wait for elements, which adds to the transfer
+        // time they observe.
+        TF_CHECK_OK(recommender_.ReportTransferTime(
+            /*iteration_id=*/0, /*consumer_id=*/i,
+            transfer_time_ * (1.0 + std::abs(noise_(rng_)) * 10.0), now_));
+      }
+
+      std::optional<WorkerCountRecommender::Recommendation> recommendation =
+          recommender_.Update(now_);
+      CHECK(recommendation.has_value());
+      Resize(recommendation->num_workers);
+      result.recommendations.push_back(recommendation->num_workers);
+      result.auto_scaler_estimates.push_back(
+          auto_scaler_.GetOptimalNumberOfWorkers().value_or(0));
+    }
+    return result;
+  }
+
+  int64_t num_workers() const { return num_workers_; }
+
+ private:
+  double Noise() { return 1.0 + noise_(rng_); }
+
+  void Resize(int64_t num_workers) {
+    if (num_workers < num_workers_) {
+      for (int64_t i = num_workers; i < num_workers_; ++i) {
+        const std::string address = absl::StrCat("/worker/task/", i, ":20000");
+        recommender_.RemoveWorker(/*iteration_id=*/0, address);
+        TF_CHECK_OK(auto_scaler_.RemoveWorker(address));
+      }
+      num_workers_ = num_workers;
+      pending_num_workers_ = num_workers;
+    } else if (num_workers > pending_num_workers_) {
+      pending_num_workers_ = num_workers;
+      pending_workers_ready_ = now_ + worker_startup_time_;
+    }
+  }
+
+  WorkerCountRecommender& recommender_;
+  AutoScaler auto_scaler_;
+  const absl::Duration worker_startup_time_;
+  const int64_t num_consumers_;
+  const absl::Duration processing_time_;
+  const absl::Duration transfer_time_;
+  std::mt19937 rng_{/*seed=*/1};
+  std::uniform_real_distribution<double> noise_;
+
+  absl::Time now_ = kStart;
+  int64_t num_workers_ = 1;
+  int64_t pending_num_workers_ = 1;
+  absl::Time pending_workers_ready_ = absl::InfinitePast();
+};
+
+int64_t NumChanges(const std::vector<int64_t>& num_workers) {
+  int64_t num_changes = 0;
+  for (size_t i = 1; i < num_workers.size(); ++i) {
+    if (num_workers[i] != num_workers[i - 1]) {
+      ++num_changes;
+    }
+  }
+  return num_changes;
+}
+
+// 4 consumers consuming 100 [elements/s] each from workers that take 20 [ms]
+// per element and 1 [ms] to transfer it make an offered load of 8.4 workers.
+constexpr int64_t kNumConsumers = 4;
+constexpr double kConsumptionRate = 100.0;
+constexpr absl::Duration kProcessingTime = absl::Milliseconds(20);
+constexpr absl::Duration kTransferTime = absl::Milliseconds(1);
+constexpr double kOfferedLoad = 8.4;
+
+TEST(WorkerCountRecommenderSyntheticLoadTest, ConvergesWithoutOscillating) {
+  WorkerCountRecommender::Options options;
+  WorkerCountRecommender recommender(options);
+  SyntheticLoadGenerator load(recommender, options.worker_startup_time,
+                              kNumConsumers, kProcessingTime, kTransferTime,
+                              /*noise=*/0.3);
+  SyntheticLoadGenerator::Result result =
+      load.Run(absl::Hours(2), kConsumptionRate);
+
+  const int64_t expected = WorkerCountRecommender::RequiredNumberOfWorkers(
+      kOfferedLoad, options.max_utilization, options.max_wait_probability);
+  EXPECT_NEAR(result.recommendations.back(), expected, 1);
+  EXPECT_NEAR(load.num_workers(), expected, 1);
+  const int64_t num_changes = NumChanges(result.recommendations);
+  const int64_t num_auto_scaler_changes =
+      NumChanges(result.auto_scaler_estimates);
+  LOG(INFO) << "Number of changes in 2 hours: " << num_changes
+            << " recommended, " << num_auto_scaler_changes
+            << " estimated by AutoScaler.";
+  EXPECT_LE(num_changes, 3);
+  EXPECT_GT(num_auto_scaler_changes, 10 * num_changes);
+}
+
+TEST(WorkerCountRecommenderSyntheticLoadTest, FollowsLoadChanges) {
+  WorkerCountRecommender::Options options;
+  WorkerCountRecommender recommender(options);
+  SyntheticLoadGenerator load(recommender, options.worker_startup_time,
+                              kNumConsumers, kProcessingTime, kTransferTime,
+                              /*noise=*/0.3);
+  load.Run(absl::Minutes(30), kConsumptionRate);
+  const int64_t initial_num_workers = load.num_workers();
+
+  SyntheticLoadGenerator::Result result =
+      load.Run(absl::Minutes(30), 2 * kConsumptionRate);
+  EXPECT_NEAR(load.num_workers(),
+              WorkerCountRecommender::RequiredNumberOfWorkers(
+                  2 * kOfferedLoad, options.max_utilization,
+                  options.max_wait_probability),
+              1);
+  EXPECT_GT(load.num_workers(), initial_num_workers);
+  EXPECT_LE(NumChanges(result.recommendations), 3);
+
+  result = load.Run(absl::Minutes(30), kConsumptionRate);
+  EXPECT_NEAR(load.num_workers(), initial_num_workers, 1);
+  EXPECT_LE(NumChanges(result.recommendations), 3);
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -39,6 +39,7 @@ limitations under the License.
 #include "tensorflow/core/data/service/export.pb.h"
 #include "tensorflow/core/data/service/graph_rewriters.h"
 #include "tensorflow/core/data/service/grpc_util.h"
+#include "tensorflow/core/data/service/shared_element_cache.h"
 #include "tensorflow/core/data/service/snapshot/path_utils.h"
 #include "tensorflow/core/data/service/snapshot/snapshot_split_provider.h"
 #include "tensorflow/core/data/service/snapshot/snapshot_stream_writer.h"
@@ -46,8 +47,10 @@ limitations under the License.
 #include "tensorflow/core/data/service/task_runner.h"
 #include "tensorflow/core/data/service/utils.h"
 #include "tensorflow/core/data/service/worker.pb.h"
+#include "tensorflow/core/data/hash_utils.h"
 #include "tensorflow/core/data/standalone.h"
 #include "tensorflow/core/framework/dataset.pb.h"
+#include "tensorflow/core/framework/graph.pb.h"
 #include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/model.h"
 #include "tensorflow/core/framework/tensor.h"
@@ -161,6 +164,10 @@ LocalWorkers::AddressToWorkerMap* LocalWorkers::local_workers_ =
 DataServiceWorkerImpl::DataServiceWorkerImpl(const WorkerConfig& config)
     : config_(ApplyWorkerDefaults(config)), worker_uid_(port::JobUid()) {
   metrics::RecordTFDataServiceWorkerCreated();
+  if (config_.shared_element_cache_size_bytes() > 0) {
+    shared_element_cache_ = std::make_unique<SharedElementCache>(
+        config_.shared_element_cache_size_bytes());
+  }
 }
 
 DataServiceWorkerImpl::~DataServiceWorkerImpl() {
@@ -346,12 +353,19 @@ absl::Status DataServiceWorkerImpl::EnsureTaskInitialized(
     return absl::OkStatus();
   }
   TF_ASSIGN_OR_RETURN(DatasetDef dataset_def, GetDatasetDef(task.task_def));
-  TF_ASSIGN_OR_RETURN(std::unique_ptr<standalone::Dataset> dataset,
-                      MakeDataset(dataset_def, task.task_def));
-  TF_ASSIGN_OR_RETURN(std::unique_ptr<standalone::Iterator> iterator,
-                      MakeDatasetIterator(*dataset, task.task_def));
-  auto task_iterator = std::make_unique<StandaloneTaskIterator>(
-      std::move(dataset), std::move(iterator));
+  std::unique_ptr<TaskIterator> task_iterator;
+  if (shared_element_cache_ &&
+      !IsDynamicShard(task.task_def.processing_mode_def())) {
+    TF_ASSIGN_OR_RETURN(
+        task_iterator, MakeSharedCacheTaskIterator(dataset_def, task.task_def));
+  } else {
+    TF_ASSIGN_OR_RETURN(std::unique_ptr<standalone::Dataset> dataset,
+                        MakeDataset(dataset_def, task.task_def));
+    TF_ASSIGN_OR_RETURN(std::unique_ptr<standalone::Iterator> iterator,
+                        MakeDatasetIterator(*dataset, task.task_def));
+    task_iterator = std::make_unique<StandaloneTaskIterator>(
+        std::move(dataset), std::move(iterator));
+  }
   TF_RETURN_IF_ERROR(TaskRunner::Create(
       config_, task.task_def, std::move(task_iterator), task.task_runner));
 
@@ -408,9 +422,8 @@ absl::StatusOr<bool> DataServiceWorkerImpl::DisableCompressionAtRuntime(
   return response.compression_disabled_at_runtime();
 }
 
-absl::StatusOr<std::unique_ptr<standalone::Dataset>>
-DataServiceWorkerImpl::MakeDataset(const DatasetDef& dataset_def,
-                                   const TaskDef& task_def) const {
+absl::StatusOr<GraphDef> DataServiceWorkerImpl::MakeDatasetGraph(
+    const DatasetDef& dataset_def, const TaskDef& task_def) const {
   TF_ASSIGN_OR_RETURN(bool compression_disabled_at_runtime,
                       DisableCompressionAtRuntime(task_def.dataset_id()));
   GraphDef graph = dataset_def.graph();
@@ -429,12 +442,48 @@ DataServiceWorkerImpl::MakeDataset(const DatasetDef& dataset_def,
                       AutoShardRewriter::Create(task_def));
   // `ApplyAutoShardRewrite` does nothing if auto-sharding is disabled.
   TF_ASSIGN_OR_RETURN(graph, auto_shard_rewriter.ApplyAutoShardRewrite(graph));
+  return graph;
+}
+
+absl::StatusOr<std::unique_ptr<standalone::Dataset>>
+DataServiceWorkerImpl::MakeDataset(const DatasetDef& dataset_def,
+                                   const TaskDef& task_def) const {
+  TF_ASSIGN_OR_RETURN(GraphDef graph, MakeDatasetGraph(dataset_def, task_def));
   std::unique_ptr<standalone::Dataset> dataset;
   TF_RETURN_IF_ERROR(standalone::Dataset::FromGraph(
       standalone::Dataset::Params(), graph, &dataset));
   return dataset;
 }
 
+absl::StatusOr<std::unique_ptr<TaskIterator>>
+DataServiceWorkerImpl::MakeSharedCacheTaskIterator(
+    const DatasetDef& dataset_def, const TaskDef& task_def) const {
+  // The rewritten graph includes the static shard of this worker, so tasks
+  // share elements only if they read the same shard.
+  TF_ASSIGN_OR_RETURN(GraphDef graph, MakeDatasetGraph(dataset_def, task_def));
+  uint64 fingerprint = 0;
+  TF_RETURN_IF_ERROR(HashGraph(graph, &fingerprint));
+  const bool deterministic = ProducesDeterministicSequence(graph);
+  auto make_iterator =
+      [graph = std::move(graph)]()
+      -> absl::StatusOr<std::unique_ptr<TaskIterator>> {
+    std::unique_ptr<standalone::Dataset> dataset;
+    TF_RETURN_IF_ERROR(standalone::Dataset::FromGraph(
+        standalone::Dataset::Params(), graph, &dataset));
+    std::unique_ptr<standalone::Iterator> iterator;
+    TF_RETURN_IF_ERROR(dataset->MakeIterator(&iterator));
+    return std::make_unique<StandaloneTaskIterator>(std::move(dataset),
+                                                    std::move(iterator));
+  };
+  if (!deterministic) {
+    VLOG(2) << "Not sharing the elements of task " << task_def.task_id()
+            << " across jobs: its dataset relaxes determinism.";
+    return make_iterator();
+  }
+  return shared_element_cache_->MakeIterator(fingerprint,
+                                             std::move(make_iterator));
+}
+
 absl::StatusOr<std::unique_ptr<standalone::Iterator>>
 DataServiceWorkerImpl::MakeDatasetIterator(standalone::Dataset& dataset,
                                            const TaskDef& task_def) const {
@@ -451,7 +500,8 @@ DataServiceWorkerImpl::MakeDatasetIterator(standalone::Dataset& dataset,
     for (int i = 0; i < task_def.num_split_providers(); ++i) {
       split_providers.push_back(std::make_unique<DataServiceSplitProvider>(
           config_.dispatcher_address(), config_.protocol(),
-          task_def.iteration_id(), i, config_.dispatcher_timeout_ms()));
+          task_def.iteration_id(), i, config_.dispatcher_timeout_ms(),
+          worker_address_));
     }
     TF_RETURN_IF_ERROR(
         dataset.MakeIterator(std::move(split_providers), &iterator));
@@ -828,6 +878,10 @@ WorkerStateExport DataServiceWorkerImpl::ExportState() const {
   for (int64_t deleted_task : deleted_tasks_) {
     worker_state_export.add_deleted_task_ids(deleted_task);
   }
+  if (shared_element_cache_) {
+    *worker_state_export.mutable_shared_element_cache() =
+        shared_element_cache_->ExportState();
+  }
   return worker_state_export;
 }
 
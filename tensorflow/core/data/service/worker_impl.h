@@ -29,11 +29,13 @@ limitations under the License.
 #include "tensorflow/core/data/service/data_transfer.h"
 #include "tensorflow/core/data/service/dispatcher_client.h"
 #include "tensorflow/core/data/service/export.pb.h"
+#include "tensorflow/core/data/service/shared_element_cache.h"
 #include "tensorflow/core/data/service/snapshot/snapshot_stream_writer.h"
 #include "tensorflow/core/data/service/task_runner.h"
 #include "tensorflow/core/data/service/worker.pb.h"
 #include "tensorflow/core/data/standalone.h"
 #include "tensorflow/core/framework/cancellation.h"
+#include "tensorflow/core/framework/graph.pb.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/status.h"
@@ -166,9 +168,16 @@ class DataServiceWorkerImpl {
   std::vector<SnapshotTaskProgress> GetSnapshotTaskProgress() const;
   // Gets the DatasetDef for `task_def`.
   absl::StatusOr<DatasetDef> GetDatasetDef(const TaskDef& task_def) const;
+  // Returns the graph of `dataset_def`, rewritten for `task_def`.
+  absl::StatusOr<GraphDef> MakeDatasetGraph(const DatasetDef& dataset_def,
+                                            const TaskDef& task_def) const;
   // Creates a dataset from `dataset_def`.
   absl::StatusOr<std::unique_ptr<standalone::Dataset>> MakeDataset(
       const DatasetDef& dataset_def, const TaskDef& task_def) const;
+  // Creates a task iterator that reads from the shared element cache, or a
+  // private iterator if the dataset relaxes determinism.
+  absl::StatusOr<std::unique_ptr<TaskIterator>> MakeSharedCacheTaskIterator(
+      const DatasetDef& dataset_def, const TaskDef& task_def) const;
   // Creates an iterator for `dataset`.
   absl::StatusOr<std::unique_ptr<standalone::Iterator>> MakeDatasetIterator(
       standalone::Dataset& dataset, const TaskDef& task_def) const;
@@ -182,6 +191,9 @@ class DataServiceWorkerImpl {
   // The data transfer servers available to worker clients.
   std::vector<DataTransferServerInfo> transfer_servers_;
   std::unique_ptr<DataServiceDispatcherClient> dispatcher_;
+  // Elements shared by the tasks of this worker. Null if the cache is
+  // disabled.
+  std::unique_ptr<SharedElementCache> shared_element_cache_;
 
   mutable mutex mu_;
   condition_variable cv_;
@@ -49,9 +49,11 @@ limitations under the License.
 #include "tensorflow/core/platform/stringprintf.h"
 #include "tensorflow/core/profiler/lib/traceme.h"
 #include "tensorflow/core/protobuf/snapshot.pb.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tsl/platform/errors.h"
 #include "tsl/platform/status.h"
 #include "tsl/platform/statusor.h"
+#include "zstd.h"  // from @net_zstd
 
 namespace tensorflow {
 namespace data {
@@ -66,6 +68,11 @@ constexpr const char* const kCurrentCheckpointID = "current_checkpoint_id";
 constexpr const char* const kIndex = "index";
 constexpr const char* const kStartIndex = "start_index";
 
+// Number of threads compressing each snapshot file written in the TFRecord
+// format. Only Snappy compression is parallelized.
+constexpr char kNumCompressionThreadsEnvVar[] =
+    "TF_DATA_SNAPSHOT_NUM_COMPRESSION_THREADS";
+
 std::string ProtoSerializationErrorMessage(const TensorProto& proto,
                                            const std::string& output_file) {
   const auto proto_byte_size = proto.ByteSizeLong();
@@ -78,6 +85,73 @@ std::string ProtoSerializationErrorMessage(const TensorProto& proto,
   return error_message;
 }
 
+// Returns true if the custom snapshot format compresses each element as a
+// single block with `compression_type`.
+bool IsBlockCompressed(const std::string& compression_type) {
+  return compression_type == io::compression::kSnappy ||
+         compression_type == kZstdCompression;
+}
+
+absl::Status ZstdCompress(const char* input, size_t length,
+                          std::string* output) {
+  output->resize(ZSTD_compressBound(length));
+  const size_t compressed_size =
+      ZSTD_compress(output->data(), output->size(), input, length,
+                    ZSTD_CLEVEL_DEFAULT);
+  if (ZSTD_isError(compressed_size)) {
+    return errors::Internal("Failed to compress using zstd: ",
+                            ZSTD_getErrorName(compressed_size));
+  }
+  output->resize(compressed_size);
+  return absl::OkStatus();
+}
+
+// Uncompresses the zstd frame in `compressed` into the buffers in `iov`, which
+// must add up to exactly the uncompressed size.
+absl::Status ZstdUncompressToIOVec(absl::string_view compressed,
+                                   const std::vector<tsl::iovec>& iov) {
+  std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> context(
+      ZSTD_createDCtx(), &ZSTD_freeDCtx);
+  if (context == nullptr) {
+    return errors::ResourceExhausted("Failed to create zstd context.");
+  }
+  ZSTD_inBuffer input = {compressed.data(), compressed.size(), 0};
+  // Zero once the end of the frame has been decoded.
+  size_t result = 1;
+  for (const tsl::iovec& buffer : iov) {
+    ZSTD_outBuffer output = {buffer.iov_base, buffer.iov_len, 0};
+    while (output.pos < output.size) {
+      result = ZSTD_decompressStream(context.get(), &output, &input);
+      if (ZSTD_isError(result)) {
+        return errors::DataLoss("Failed to perform zstd decompression: ",
+                                ZSTD_getErrorName(result));
+      }
+      if (result == 0 && output.pos < output.size) {
+        return errors::DataLoss(
+            "Zstd decompressed size is smaller than the expected size.");
+      }
+    }
+  }
+  // Decode the rest of the frame, which must not produce any more output.
+  ZSTD_outBuffer no_output = {nullptr, 0, 0};
+  while (result != 0) {
+    const size_t previous_pos = input.pos;
+    result = ZSTD_decompressStream(context.get(), &no_output, &input);
+    if (ZSTD_isError(result)) {
+      return errors::DataLoss("Failed to perform zstd decompression: ",
+                              ZSTD_getErrorName(result));
+    }
+    if (result != 0 && input.pos == previous_pos) {
+      return errors::DataLoss(
+          "Zstd decompressed size does not match the expected size.");
+    }
+  }
+  if (input.pos != input.size) {
+    return errors::DataLoss("Unexpected data after the zstd frame.");
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace
 
 /* static */ constexpr const int64_t
@@ -143,9 +217,22 @@ TFRecordWriter::TFRecordWriter(const std::string& filename,
 absl::Status TFRecordWriter::Initialize(tensorflow::Env* env) {
   TF_RETURN_IF_ERROR(env->NewAppendableFile(filename_, &dest_));
 
-  record_writer_ = std::make_unique<io::RecordWriter>(
-      dest_.get(), io::RecordWriterOptions::CreateRecordWriterOptions(
-                       /*compression_type=*/compression_type_));
+  io::RecordWriterOptions options =
+      io::RecordWriterOptions::CreateRecordWriterOptions(
+          /*compression_type=*/compression_type_);
+#if !defined(IS_SLIM_BUILD)
+  int64_t num_compression_threads = 1;
+  absl::Status s = ReadInt64FromEnvVar(kNumCompressionThreadsEnvVar,
+                                       /*default_val=*/1,
+                                       &num_compression_threads);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to read " << kNumCompressionThreadsEnvVar << ": "
+                 << s;
+  }
+  options.snappy_options.num_compression_threads =
+      std::max<int64_t>(num_compression_threads, 1);
+#endif  // IS_SLIM_BUILD
+  record_writer_ = std::make_unique<io::RecordWriter>(dest_.get(), options);
   return absl::OkStatus();
 }
 
@@ -242,7 +329,7 @@ absl::Status CustomWriter::Initialize(tensorflow::Env* env) {
 }
 
 absl::Status CustomWriter::WriteTensors(const std::vector<Tensor>& tensors) {
-  if (compression_type_ != io::compression::kSnappy) {
+  if (!IsBlockCompressed(compression_type_)) {
     experimental::SnapshotRecord record;
     for (const auto& tensor : tensors) {
       TensorProto* t = record.add_tensor();
@@ -306,7 +393,10 @@ absl::Status CustomWriter::WriteTensors(const std::vector<Tensor>& tensors) {
   DCHECK_EQ(position, uncompressed.data() + total_size);
 
   string output;
-  if (!tsl::port::Snappy_Compress(uncompressed.data(), total_size, &output)) {
+  if (compression_type_ == kZstdCompression) {
+    TF_RETURN_IF_ERROR(ZstdCompress(uncompressed.data(), total_size, &output));
+  } else if (!tsl::port::Snappy_Compress(uncompressed.data(), total_size,
+                                         &output)) {
     return errors::Internal("Failed to compress using snappy.");
   }
 
@@ -842,6 +932,9 @@ absl::Status CustomReader::Initialize(Env* env) {
       input_stream_ =
           std::make_unique<io::BufferedInputStream>(file_.get(), 64 << 20);
     }
+  } else if (compression_type_ == kZstdCompression) {
+    input_stream_ =
+        std::make_unique<io::BufferedInputStream>(file_.get(), 64 << 20);
   }
 #endif  // IS_SLIM_BUILD
   simple_tensor_mask_.reserve(dtypes_.size());
@@ -862,13 +955,13 @@ absl::Status CustomReader::ReadTensors(std::vector<Tensor>* read_tensors) {
   tsl::profiler::TraceMe activity(
       [&]() { return absl::StrCat(kClassName, kSeparator, "ReadTensors"); },
       tsl::profiler::TraceMeLevel::kInfo);
-  if (version_ == 0 || compression_type_ != io::compression::kSnappy) {
+  if (version_ == 0 || !IsBlockCompressed(compression_type_)) {
     return ReadTensorsV0(read_tensors);
   }
   if (version_ != 1) {
     return errors::InvalidArgument("Version: ", version_, " is not supported.");
   }
-  if (compression_type_ != io::compression::kSnappy) {
+  if (!IsBlockCompressed(compression_type_)) {
     return errors::InvalidArgument("Compression ", compression_type_,
                                    " is not supported.");
   }
@@ -886,7 +979,7 @@ absl::Status CustomReader::ReadTensors(std::vector<Tensor>* read_tensors) {
   std::vector<std::pair<std::unique_ptr<char[]>, size_t>> tensor_proto_strs;
   tensor_proto_strs.reserve(num_complex_);
   TF_RETURN_IF_ERROR(
-      SnappyUncompress(&metadata, &simple_tensors, &tensor_proto_strs));
+      Uncompress(&metadata, &simple_tensors, &tensor_proto_strs));
 
   int simple_index = 0;
   int complex_index = 0;
@@ -933,18 +1026,13 @@ absl::Status CustomReader::ReadTensorsV0(std::vector<Tensor>* read_tensors) {
   return absl::OkStatus();
 }
 
-absl::Status CustomReader::SnappyUncompress(
+absl::Status CustomReader::Uncompress(
     const experimental::SnapshotTensorMetadata* metadata,
     std::vector<Tensor>* simple_tensors,
     std::vector<std::pair<std::unique_ptr<char[]>, size_t>>*
         tensor_proto_strs) {
   tstring compressed;
   TF_RETURN_IF_ERROR(ReadRecord(&compressed));
-  size_t size;
-  if (!tsl::port::Snappy_GetUncompressedLength(compressed.data(),
-                                               compressed.size(), &size)) {
-    return errors::Internal("Could not get snappy uncompressed length");
-  }
 
   int num_tensors = metadata->tensor_metadata_size();
   std::vector<tsl::iovec> iov(num_tensors);
@@ -970,6 +1058,15 @@ absl::Status CustomReader::SnappyUncompress(
     total_size += iov[index].iov_len;
     index++;
   }
+  if (compression_type_ == kZstdCompression) {
+    return ZstdUncompressToIOVec(compressed, iov);
+  }
+
+  size_t size;
+  if (!tsl::port::Snappy_GetUncompressedLength(compressed.data(),
+                                               compressed.size(), &size)) {
+    return errors::Internal("Could not get snappy uncompressed length");
+  }
   const int64_t size_int = size;
   if (size_int != total_size) {
     return errors::Internal("Uncompressed size mismatch. Snappy expects ", size,
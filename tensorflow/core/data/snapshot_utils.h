@@ -62,6 +62,10 @@ constexpr char kModeRead[] = "read";
 constexpr char kModePassthrough[] = "passthrough";
 constexpr char kShardDirectorySuffix[] = ".shard";
 
+// Compresses each element with zstd. Only supported by the custom (version 1)
+// snapshot file format; see `CustomWriter`.
+constexpr char kZstdCompression[] = "ZSTD";
+
 enum Mode { READER = 0, WRITER = 1, PASSTHROUGH = 2 };
 
 // Returns the name of the "hash" directory for the given base path and hash ID.
@@ -341,7 +345,9 @@ class CustomReader : public Reader {
  private:
   absl::Status ReadTensorsV0(std::vector<Tensor>* read_tensors);
 
-  absl::Status SnappyUncompress(
+  // Reads the compressed block of an element and uncompresses it into
+  // `simple_tensors` and `tensor_proto_strs`.
+  absl::Status Uncompress(
       const experimental::SnapshotTensorMetadata* metadata,
       std::vector<Tensor>* simple_tensors,
       std::vector<std::pair<std::unique_ptr<char[]>, size_t>>*
@@ -93,12 +93,49 @@ TEST(SnapshotUtilTest, CombinationRoundTripTest) {
   SnapshotRoundTrip(io::compression::kNone, 1);
   SnapshotRoundTrip(io::compression::kGzip, 1);
   SnapshotRoundTrip(io::compression::kSnappy, 1);
+  SnapshotRoundTrip(kZstdCompression, 1);
 
   SnapshotRoundTrip(io::compression::kNone, 2);
   SnapshotRoundTrip(io::compression::kGzip, 2);
   SnapshotRoundTrip(io::compression::kSnappy, 2);
 }
 
+TEST(SnapshotUtilTest, ParallelSnappyCompressionRoundTrip) {
+  setenv("TF_DATA_SNAPSHOT_NUM_COMPRESSION_THREADS", "4", /*overwrite=*/1);
+  SnapshotRoundTrip(io::compression::kSnappy, 2);
+  unsetenv("TF_DATA_SNAPSHOT_NUM_COMPRESSION_THREADS");
+}
+
+TEST(SnapshotUtilTest, ZstdEmptyTensorRoundTrip) {
+  const DataTypeVector dtypes = {DT_FLOAT, DT_INT64};
+  const std::vector<Tensor> tensors = {Tensor(DT_FLOAT, TensorShape({0})),
+                                       Tensor(DT_INT64, TensorShape({2, 0}))};
+  std::string filename;
+  EXPECT_TRUE(Env::Default()->LocalTempFilename(&filename));
+
+  std::unique_ptr<Writer> writer;
+  TF_ASSERT_OK(Writer::Create(Env::Default(), filename, kZstdCompression,
+                              /*version=*/1, dtypes, &writer));
+  for (int i = 0; i < 3; ++i) {
+    TF_ASSERT_OK(writer->WriteTensors(tensors));
+  }
+  TF_ASSERT_OK(writer->Close());
+
+  std::unique_ptr<Reader> reader;
+  TF_ASSERT_OK(Reader::Create(Env::Default(), filename, kZstdCompression,
+                              /*version=*/1, dtypes, &reader));
+  for (int i = 0; i < 3; ++i) {
+    std::vector<Tensor> read_tensors;
+    TF_ASSERT_OK(reader->ReadTensors(&read_tensors));
+    ASSERT_EQ(read_tensors.size(), 2);
+    EXPECT_EQ(read_tensors[0].shape(), TensorShape({0}));
+    EXPECT_EQ(read_tensors[1].shape(), TensorShape({2, 0}));
+  }
+  std::vector<Tensor> read_tensors;
+  EXPECT_TRUE(errors::IsOutOfRange(reader->ReadTensors(&read_tensors)));
+  TF_ASSERT_OK(Env::Default()->DeleteFile(filename));
+}
+
 TEST(SnapshotUtilTest, MetadataFileRoundTrip) {
   experimental::DistributedSnapshotMetadata metadata_in;
   metadata_in.set_compression(io::compression::kGzip);
@@ -162,6 +199,10 @@ void SnapshotCustomReaderSnappyBenchmark(::testing::benchmark::State& state) {
   SnapshotReaderBenchmarkLoop(state, io::compression::kSnappy, 1);
 }
 
+void SnapshotCustomReaderZstdBenchmark(::testing::benchmark::State& state) {
+  SnapshotReaderBenchmarkLoop(state, kZstdCompression, 1);
+}
+
 void SnapshotTFRecordReaderNoneBenchmark(::testing::benchmark::State& state) {
   SnapshotReaderBenchmarkLoop(state, io::compression::kNone, 2);
 }
@@ -173,6 +214,7 @@ void SnapshotTFRecordReaderGzipBenchmark(::testing::benchmark::State& state) {
 BENCHMARK(SnapshotCustomReaderNoneBenchmark);
 BENCHMARK(SnapshotCustomReaderGzipBenchmark);
 BENCHMARK(SnapshotCustomReaderSnappyBenchmark);
+BENCHMARK(SnapshotCustomReaderZstdBenchmark);
 BENCHMARK(SnapshotTFRecordReaderNoneBenchmark);
 BENCHMARK(SnapshotTFRecordReaderGzipBenchmark);
 
@@ -209,6 +251,10 @@ void SnapshotCustomWriterSnappyBenchmark(::testing::benchmark::State& state) {
   SnapshotWriterBenchmarkLoop(state, io::compression::kSnappy, 1);
 }
 
+void SnapshotCustomWriterZstdBenchmark(::testing::benchmark::State& state) {
+  SnapshotWriterBenchmarkLoop(state, kZstdCompression, 1);
+}
+
 void SnapshotTFRecordWriterNoneBenchmark(::testing::benchmark::State& state) {
   SnapshotWriterBenchmarkLoop(state, io::compression::kNone, 2);
 }
@@ -221,12 +267,21 @@ void SnapshotTFRecordWriterSnappyBenchmark(::testing::benchmark::State& state) {
   SnapshotWriterBenchmarkLoop(state, io::compression::kSnappy, 2);
 }
 
+void SnapshotTFRecordWriterParallelSnappyBenchmark(
+    ::testing::benchmark::State& state) {
+  setenv("TF_DATA_SNAPSHOT_NUM_COMPRESSION_THREADS", "4", /*overwrite=*/1);
+  SnapshotWriterBenchmarkLoop(state, io::compression::kSnappy, 2);
+  unsetenv("TF_DATA_SNAPSHOT_NUM_COMPRESSION_THREADS");
+}
+
 BENCHMARK(SnapshotCustomWriterNoneBenchmark);
 BENCHMARK(SnapshotCustomWriterGzipBenchmark);
 BENCHMARK(SnapshotCustomWriterSnappyBenchmark);
+BENCHMARK(SnapshotCustomWriterZstdBenchmark);
 BENCHMARK(SnapshotTFRecordWriterNoneBenchmark);
 BENCHMARK(SnapshotTFRecordWriterGzipBenchmark);
 BENCHMARK(SnapshotTFRecordWriterSnappyBenchmark);
+BENCHMARK(SnapshotTFRecordWriterParallelSnappyBenchmark);
 
 }  // namespace
 }  // namespace snapshot_util
@@ -16,6 +16,7 @@ limitations under the License.
 #include "tensorflow/core/data/standalone.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <iterator>
 #include <memory>
@@ -25,6 +26,7 @@ limitations under the License.
 #include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/strings/string_view.h"
 #include "tensorflow/core/common_runtime/device_mgr.h"
 #include "tensorflow/core/common_runtime/function.h"
 #include "tensorflow/core/common_runtime/graph_constructor.h"
@@ -32,6 +34,7 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/process_util.h"
 #include "tensorflow/core/common_runtime/rendezvous_mgr.h"
 #include "tensorflow/core/data/dataset_utils.h"
+#include "tensorflow/core/data/incremental_checkpoint.h"
 #include "tensorflow/core/data/root_dataset.h"
 #include "tensorflow/core/data/serialization_utils.h"
 #include "tensorflow/core/data/tf_data_memory_logger.h"
@@ -134,6 +137,27 @@ absl::Status Iterator::Restore(const std::vector<Tensor>& saved_iterator) {
   return iterator_->Restore(ctx_.get(), &reader);
 }
 
+absl::StatusOr<int64_t> Iterator::Save(IncrementalCheckpointWriter& writer) {
+  VariantTensorDataWriter state_writer;
+  TF_RETURN_IF_ERROR(iterator_->Save(serialization_ctx_.get(), &state_writer));
+  std::vector<const VariantTensorData*> data;
+  state_writer.GetData(&data);
+  return writer.Save(data);
+}
+
+absl::Status Iterator::Restore(absl::string_view directory, int64_t index) {
+  TF_ASSIGN_OR_RETURN(
+      std::vector<std::unique_ptr<VariantTensorData>> data,
+      ReadIncrementalCheckpoint(Env::Default(), directory, index));
+  std::vector<const VariantTensorData*> data_ptrs;
+  data_ptrs.reserve(data.size());
+  for (const auto& d : data) {
+    data_ptrs.push_back(d.get());
+  }
+  VariantTensorDataReader reader(data_ptrs);
+  return iterator_->Restore(ctx_.get(), &reader);
+}
+
 std::shared_ptr<model::Model> Iterator::model() const { return ctx_->model(); }
 
 absl::Status Dataset::FromGraph(Params params, const GraphDef& graph_def,
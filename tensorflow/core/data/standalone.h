@@ -15,12 +15,15 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_DATA_STANDALONE_H_
 #define TENSORFLOW_CORE_DATA_STANDALONE_H_
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <vector>
 
+#include "absl/strings/string_view.h"
 #include "tensorflow/core/common_runtime/device_mgr.h"
+#include "tensorflow/core/data/incremental_checkpoint.h"
 #include "tensorflow/core/data/tfdataz_metrics.h"
 #include "tensorflow/core/data/unbounded_thread_pool.h"
 #include "tensorflow/core/framework/cancellation.h"
@@ -94,6 +97,13 @@ class Iterator {
   // iterator saved by calling `Save()`.
   absl::Status Restore(const std::vector<Tensor>& saved_iterator);
 
+  // Saves a checkpoint of the iterator as the next incremental checkpoint of
+  // `writer`, which writes it in the background. Returns the checkpoint index.
+  absl::StatusOr<int64_t> Save(IncrementalCheckpointWriter& writer);
+
+  // Restores the iterator from incremental checkpoint `index` of `directory`.
+  absl::Status Restore(absl::string_view directory, int64_t index);
+
   // Returns the dataset model for performance analysis.
   std::shared_ptr<model::Model> model() const;
 
@@ -14,16 +14,20 @@ limitations under the License.
 ==============================================================================*/
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include "xla/tsl/lib/core/status_test_util.h"
 #include "xla/tsl/protobuf/error_codes.pb.h"
+#include "tensorflow/core/data/incremental_checkpoint.h"
 #include "tensorflow/core/data/service/common.pb.h"
 #include "tensorflow/core/data/service/test_util.h"
 #include "tensorflow/core/data/standalone.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tsl/platform/env.h"
 #include "tsl/platform/errors.h"
+#include "tsl/platform/path.h"
 #include "tsl/platform/status.h"
 #include "tsl/platform/status_matchers.h"
 #include "tsl/platform/statusor.h"
@@ -106,6 +110,27 @@ TEST(TaskRunnerCheckpointTest, EndOfSequenceIterator) {
   EXPECT_THAT(GetNext<int64_t>(*iterator), StatusIs(error::OUT_OF_RANGE));
 }
 
+TEST(TaskRunnerCheckpointTest, SaveAndRestoreFromIncrementalCheckpoints) {
+  const int64_t range = 10;
+  const std::string directory =
+      tsl::io::JoinPath(tsl::testing::TmpDir(), "incremental_checkpoints");
+  IncrementalCheckpointWriter::Options options;
+  options.full_checkpoint_period = 4;
+  IncrementalCheckpointWriter writer(tsl::Env::Default(), directory, options);
+  TestDataset dataset(testing::RangeDataset(range));
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<Iterator> iterator,
+                          dataset.MakeIterator());
+  TF_ASSERT_OK_AND_ASSIGN(int64_t index, iterator->Save(writer));
+
+  for (int64_t i = 0; i < range; ++i) {
+    TF_ASSERT_OK(writer.Wait());
+    TF_ASSERT_OK_AND_ASSIGN(iterator, dataset.MakeIterator());
+    TF_ASSERT_OK(iterator->Restore(directory, index));
+    EXPECT_THAT(GetNext<int64_t>(*iterator), IsOkAndHolds(i));
+    TF_ASSERT_OK_AND_ASSIGN(index, iterator->Save(writer));
+  }
+}
+
 }  // namespace
 }  // namespace standalone
 }  // namespace data
@@ -23,6 +23,10 @@ limitations under the License.
 
 #include "absl/base/call_once.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/framework/model.h"
+#include "tensorflow/core/framework/model.pb.h"
 #include "tensorflow/core/data/tfdataz_metrics.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/numbers.h"
@@ -38,6 +42,8 @@ const int64_t kLogFrequencyS = 30;  // How often to log.
 struct IteratorMemoryUsage {
   std::optional<std::string> dataset_name;
   int64_t memory_usage;
+  int64_t peak_memory_usage;
+  int64_t memory_limit;
   std::string model_proto;
 };
 
@@ -54,16 +60,19 @@ void LogDatasetMemoryUsage() {
       metric_collectors = TfDatazMetricsRegistry::GetIteratorMetricCollectors();
   std::vector<IteratorMemoryUsage> usages;
   for (const auto& metric_collector : metric_collectors) {
-    int64_t total_buffered_bytes =
-        metric_collector->GetModel()->output()->TotalBufferedBytes();
     model::ModelProto model_proto;
-    absl::Status s = metric_collector->GetModel()->ToProto(&model_proto);
-    if (!s.ok()) {
-      LOG(ERROR) << "Failed to convert model to proto: " << s;
+    if (std::shared_ptr<model::Model> model = metric_collector->GetModel()) {
+      absl::Status s = model->ToProto(&model_proto);
+      if (!s.ok()) {
+        LOG(ERROR) << "Failed to convert model to proto: " << s;
+      }
     }
-    usages.push_back(IteratorMemoryUsage{metric_collector->DatasetName(),
-                                         total_buffered_bytes,
-                                         model_proto.ShortDebugString()});
+    usages.push_back(IteratorMemoryUsage{
+        metric_collector->DatasetName(),
+        metric_collector->GetIteratorTotalMemoryUsage(),
+        metric_collector->GetIteratorPeakMemoryUsage(),
+        metric_collector->GetIteratorMemoryLimit(),
+        model_proto.ShortDebugString()});
   }
   std::sort(usages.begin(), usages.end(), [](const auto& a, const auto& b) {
     return a.memory_usage > b.memory_usage;
@@ -77,7 +86,14 @@ void LogDatasetMemoryUsage() {
       break;
     }
     std::string usage_string =
-        strings::HumanReadableNumBytes(usages[i].memory_usage);
+        absl::StrCat(strings::HumanReadableNumBytes(usages[i].memory_usage),
+                     " (peak: ",
+                     strings::HumanReadableNumBytes(usages[i].peak_memory_usage));
+    if (usages[i].memory_limit > 0) {
+      absl::StrAppend(&usage_string, ", limit: ",
+                      strings::HumanReadableNumBytes(usages[i].memory_limit));
+    }
+    absl::StrAppend(&usage_string, ")");
     if (usages[i].dataset_name.has_value()) {
       VLOG(4) << "Dataset " << usages[i].dataset_name.value() << ": "
               << usage_string;
@@ -131,9 +131,27 @@ std::optional<std::string> TfDatazMetricsCollector::DatasetName() {
 }
 
 int64_t TfDatazMetricsCollector::GetIteratorTotalMemoryUsage() {
+  // The RAM budget manager counts buffered bytes even when autotuning is off.
+  if (auto ram_budget_manager = iterator_->ram_budget_manager()) {
+    return ram_budget_manager->buffered_bytes();
+  }
   return iterator_->TotalBufferedBytes();
 }
 
+int64_t TfDatazMetricsCollector::GetIteratorPeakMemoryUsage() {
+  if (auto ram_budget_manager = iterator_->ram_budget_manager()) {
+    return ram_budget_manager->peak_buffered_bytes();
+  }
+  return 0;
+}
+
+int64_t TfDatazMetricsCollector::GetIteratorMemoryLimit() {
+  if (auto ram_budget_manager = iterator_->ram_budget_manager()) {
+    return ram_budget_manager->memory_limit();
+  }
+  return 0;
+}
+
 std::shared_ptr<model::Model> TfDatazMetricsCollector::GetModel() {
   return model_;
 }
@@ -118,6 +118,14 @@ class TfDatazMetricsCollector {
   // buffered in all nodes in the subtree.
   int64_t GetIteratorTotalMemoryUsage();
 
+  // Returns the largest total memory (in bytes) the iterator has used, or 0 if
+  // it is not known.
+  int64_t GetIteratorPeakMemoryUsage();
+
+  // Returns the hard limit (in bytes) on the memory used by the iterator, or 0
+  // if there is none.
+  int64_t GetIteratorMemoryLimit();
+
   std::shared_ptr<model::Model> GetModel();
 
  private:
@@ -0,0 +1,268 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/tfrecord_index.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/lib/hash/crc32c.h"
+#include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/platform/coding.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/threadpool.h"
+#include "tensorflow/core/platform/tstring.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+constexpr char kIndexSuffix[] = ".tfrecord_index";
+constexpr char kMagic[] = "TFRECIDX";
+constexpr size_t kMagicSize = 8;
+constexpr uint64_t kVersion = 1;
+constexpr size_t kIndexHeaderSize = kMagicSize + 2 * sizeof(uint64_t);
+constexpr size_t kOffsetSize = sizeof(uint64_t);
+// Buffer size used to scan TFRecord files and to write indices.
+constexpr size_t kScanBufferSize = 4 << 20;  // 4MB
+constexpr size_t kRecordHeaderSize = io::RecordReader::kHeaderSize;
+constexpr size_t kRecordFooterSize = io::RecordReader::kFooterSize;
+
+// Runs `fn(i)` for `i` in [0, n) on up to `num_threads` threads, and returns
+// the first error.
+absl::Status ParallelFor(Env* env, const std::string& name, int64_t n,
+                         int num_threads,
+                         const std::function<absl::Status(int64_t)>& fn) {
+  if (num_threads <= 1 || n <= 1) {
+    for (int64_t i = 0; i < n; ++i) {
+      TF_RETURN_IF_ERROR(fn(i));
+    }
+    return absl::OkStatus();
+  }
+  mutex mu;
+  absl::Status status;
+  {
+    thread::ThreadPool thread_pool(
+        env, name, static_cast<int>(std::min<int64_t>(num_threads, n)));
+    for (int64_t i = 0; i < n; ++i) {
+      thread_pool.Schedule([&, i]() {
+        absl::Status s = fn(i);
+        mutex_lock l(mu);
+        status.Update(s);
+      });
+    }
+  }
+  return status;
+}
+
+absl::Status WriteIndex(Env* env, const std::string& filename,
+                        uint64_t data_file_size,
+                        const std::vector<uint64_t>& offsets) {
+  const std::string index_filename = TFRecordIndexFilename(filename);
+  const std::string tmp_filename = absl::StrCat(index_filename, ".tmp");
+  std::unique_ptr<WritableFile> file;
+  TF_RETURN_IF_ERROR(env->NewWritableFile(tmp_filename, &file));
+  std::string buffer(kMagic, kMagicSize);
+  core::PutFixed64(&buffer, kVersion);
+  core::PutFixed64(&buffer, data_file_size);
+  for (uint64_t offset : offsets) {
+    core::PutFixed64(&buffer, offset);
+    if (buffer.size() >= kScanBufferSize) {
+      TF_RETURN_IF_ERROR(file->Append(buffer));
+      buffer.clear();
+    }
+  }
+  TF_RETURN_IF_ERROR(file->Append(buffer));
+  TF_RETURN_IF_ERROR(file->Close());
+  return env->RenameFile(tmp_filename, index_filename);
+}
+
+}  // namespace
+
+std::string TFRecordIndexFilename(absl::string_view filename) {
+  return absl::StrCat(filename, kIndexSuffix);
+}
+
+absl::Status BuildTFRecordIndex(Env* env, const std::string& filename) {
+  uint64_t data_file_size = 0;
+  TF_RETURN_IF_ERROR(env->GetFileSize(filename, &data_file_size));
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env->NewRandomAccessFile(filename, &file));
+  io::RecordReaderOptions options;
+  options.buffer_size = kScanBufferSize;
+  io::SequentialRecordReader reader(file.get(), options);
+  std::vector<uint64_t> offsets;
+  while (true) {
+    const uint64_t offset = reader.TellOffset();
+    int num_skipped = 0;
+    absl::Status s = reader.SkipRecords(/*num_to_skip=*/1, &num_skipped);
+    if (errors::IsOutOfRange(s) && num_skipped == 0) {
+      break;
+    }
+    if (!s.ok()) {
+      return absl::Status(
+          s.code(), absl::StrCat("Failed to index TFRecord file ", filename,
+                                 " at offset ", offset, ": ", s.message()));
+    }
+    offsets.push_back(offset);
+  }
+  TF_RETURN_IF_ERROR(WriteIndex(env, filename, data_file_size, offsets));
+  VLOG(1) << "Indexed " << offsets.size() << " records of " << filename;
+  return absl::OkStatus();
+}
+
+absl::Status BuildTFRecordIndices(Env* env,
+                                  const std::vector<std::string>& filenames,
+                                  int num_threads) {
+  return ParallelFor(env, "build_tfrecord_index", filenames.size(),
+                     num_threads, [&](int64_t i) {
+                       return BuildTFRecordIndex(env, filenames[i]);
+                     });
+}
+
+absl::StatusOr<std::unique_ptr<IndexedTFRecordReader>>
+IndexedTFRecordReader::Create(Env* env,
+                              const std::vector<std::string>& filenames,
+                              int num_threads) {
+  std::vector<File> files(filenames.size());
+  TF_RETURN_IF_ERROR(ParallelFor(env, "open_tfrecord_index", files.size(),
+                                 num_threads, [&](int64_t i) {
+                                   files[i].filename = filenames[i];
+                                   return OpenFile(env, files[i]);
+                                 }));
+  return absl::WrapUnique(new IndexedTFRecordReader(std::move(files)));
+}
+
+IndexedTFRecordReader::IndexedTFRecordReader(std::vector<File> files)
+    : files_(std::move(files)) {
+  first_records_.reserve(files_.size());
+  for (const File& file : files_) {
+    first_records_.push_back(num_records_);
+    num_records_ += file.num_records;
+  }
+}
+
+absl::Status IndexedTFRecordReader::OpenFile(Env* env, File& file) {
+  const std::string index_filename = TFRecordIndexFilename(file.filename);
+  TF_RETURN_IF_ERROR(env->GetFileSize(file.filename, &file.size));
+  uint64_t index_size = 0;
+  TF_RETURN_IF_ERROR(env->GetFileSize(index_filename, &index_size));
+  TF_RETURN_IF_ERROR(env->NewRandomAccessFile(file.filename, &file.data));
+  TF_RETURN_IF_ERROR(env->NewRandomAccessFile(index_filename, &file.index));
+
+  char scratch[kIndexHeaderSize];
+  absl::string_view header;
+  TF_RETURN_IF_ERROR(
+      file.index->Read(/*offset=*/0, kIndexHeaderSize, &header, scratch));
+  if (header.size() != kIndexHeaderSize ||
+      header.substr(0, kMagicSize) != absl::string_view(kMagic, kMagicSize) ||
+      (index_size - kIndexHeaderSize) % kOffsetSize != 0) {
+    return absl::DataLossError(
+        absl::StrCat(index_filename, " is not a valid TFRecord index."));
+  }
+  const uint64_t version = core::DecodeFixed64(header.data() + kMagicSize);
+  if (version != kVersion) {
+    return absl::UnimplementedError(absl::StrCat(
+        "Unsupported version ", version, " of TFRecord index ", index_filename,
+        ". Supported version: ", kVersion));
+  }
+  const uint64_t data_file_size =
+      core::DecodeFixed64(header.data() + kMagicSize + sizeof(uint64_t));
+  if (data_file_size != file.size) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "TFRecord index ", index_filename, " was built for a file of ",
+        data_file_size, " bytes, but ", file.filename, " has ", file.size,
+        " bytes. Rebuild the index."));
+  }
+  file.num_records = (index_size - kIndexHeaderSize) / kOffsetSize;
+  return absl::OkStatus();
+}
+
+absl::Status IndexedTFRecordReader::Read(int64_t index,
+                                         tstring& record) const {
+  if (index < 0 || index >= num_records_) {
+    return absl::OutOfRangeError(absl::StrCat(
+        "Record index ", index, " is out of range [0, ", num_records_, ")."));
+  }
+  const size_t file_index =
+      std::upper_bound(first_records_.begin(), first_records_.end(), index) -
+      first_records_.begin() - 1;
+  const File& file = files_[file_index];
+  const int64_t record_index = index - first_records_[file_index];
+
+  // Reads the offset of the record, and of the next one if there is one.
+  const bool is_last = record_index + 1 == file.num_records;
+  char offsets_scratch[2 * kOffsetSize];
+  absl::string_view offsets;
+  const size_t offsets_size = is_last ? kOffsetSize : 2 * kOffsetSize;
+  TF_RETURN_IF_ERROR(
+      file.index->Read(kIndexHeaderSize + record_index * kOffsetSize,
+                       offsets_size, &offsets, offsets_scratch));
+  if (offsets.size() != offsets_size) {
+    return absl::DataLossError(
+        absl::StrCat("Truncated TFRecord index of ", file.filename));
+  }
+  const uint64_t start = core::DecodeFixed64(offsets.data());
+  const uint64_t end =
+      is_last ? file.size : core::DecodeFixed64(offsets.data() + kOffsetSize);
+  if (end < start + kRecordHeaderSize + kRecordFooterSize || end > file.size) {
+    return absl::DataLossError(absl::StrCat(
+        "Invalid offsets [", start, ", ", end, ") in TFRecord index of ",
+        file.filename));
+  }
+
+  const size_t size = end - start;
+  std::string scratch(size, '\0');
+  absl::string_view result;
+  TF_RETURN_IF_ERROR(file.data->Read(start, size, &result, scratch.data()));
+  if (result.size() != size) {
+    return absl::DataLossError(absl::StrCat("Truncated record at ", start,
+                                            " in ", file.filename));
+  }
+  const uint64_t length = core::DecodeFixed64(result.data());
+  const uint32_t length_crc =
+      core::DecodeFixed32(result.data() + sizeof(uint64_t));
+  if (crc32c::Unmask(length_crc) !=
+          crc32c::Value(result.data(), sizeof(uint64_t)) ||
+      length != size - kRecordHeaderSize - kRecordFooterSize) {
+    return absl::DataLossError(absl::StrCat(
+        "Corrupted record header at ", start, " in ", file.filename,
+        ". The TFRecord index may be out of date."));
+  }
+  const char* data = result.data() + kRecordHeaderSize;
+  const uint32_t data_crc = core::DecodeFixed32(data + length);
+  if (crc32c::Unmask(data_crc) != crc32c::Value(data, length)) {
+    return absl::DataLossError(absl::StrCat("Corrupted record at ", start,
+                                            " in ", file.filename));
+  }
+  record.assign(data, length);
+  return absl::OkStatus();
+}
+
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,100 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_DATA_TFRECORD_INDEX_H_
+#define TENSORFLOW_CORE_DATA_TFRECORD_INDEX_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
+#include "tensorflow/core/platform/tstring.h"
+
+namespace tensorflow {
+namespace data {
+
+// Record-offset indices let uncompressed TFRecord files be read at random
+// record positions, e.g. to globally shuffle them.
+//
+// The index of `<filename>` is stored next to it, in
+// `<filename>.tfrecord_index`. It consists of a 24-byte header followed by the
+// offset of every record in the file:
+//
+//   magic: "TFRECIDX" (8 bytes)
+//   version: fixed64 (1)
+//   data_file_size: fixed64
+//   offsets: fixed64 * num_records
+//
+// `data_file_size` lets readers detect an index that is out of date. The
+// number of records follows from the size of the index file, so opening an
+// index only reads its header.
+
+// Returns the name of the index of the TFRecord file `filename`.
+std::string TFRecordIndexFilename(absl::string_view filename);
+
+// Scans the uncompressed TFRecord file `filename` and writes its index.
+absl::Status BuildTFRecordIndex(Env* env, const std::string& filename);
+
+// Builds the indices of `filenames` with `num_threads` parallel scans.
+absl::Status BuildTFRecordIndices(Env* env,
+                                  const std::vector<std::string>& filenames,
+                                  int num_threads);
+
+// Reads records at random positions from uncompressed TFRecord files that have
+// an up-to-date index. Records are numbered across files, in order.
+//
+// Each read issues one positional read of the index and one of the record,
+// and verifies the record's checksums.
+//
+// This class is thread-safe.
+class IndexedTFRecordReader {
+ public:
+  // Opens the files and their indices, with up to `num_threads` in parallel.
+  static absl::StatusOr<std::unique_ptr<IndexedTFRecordReader>> Create(
+      Env* env, const std::vector<std::string>& filenames, int num_threads);
+
+  int64_t num_records() const { return num_records_; }
+
+  // Reads record `index`, which must be in [0, num_records()).
+  absl::Status Read(int64_t index, tstring& record) const;
+
+ private:
+  struct File {
+    std::string filename;
+    uint64_t size = 0;
+    int64_t num_records = 0;
+    std::unique_ptr<RandomAccessFile> data;
+    std::unique_ptr<RandomAccessFile> index;
+  };
+
+  explicit IndexedTFRecordReader(std::vector<File> files);
+
+  static absl::Status OpenFile(Env* env, File& file);
+
+  const std::vector<File> files_;
+  // `first_records_[i]` is the index of the first record of `files_[i]`.
+  std::vector<int64_t> first_records_;
+  int64_t num_records_ = 0;
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_DATA_TFRECORD_INDEX_H_
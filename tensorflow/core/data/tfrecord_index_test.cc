@@ -0,0 +1,218 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/data/tfrecord_index.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/io/record_writer.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/random.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
+#include "tensorflow/core/platform/tstring.h"
+#include "tsl/platform/status_matchers.h"
+#include "tsl/platform/statusor.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+using ::testing::HasSubstr;
+using ::tsl::testing::StatusIs;
+
+std::string Record(int64_t file_index, int64_t record_index) {
+  // Records of different sizes, including empty ones.
+  return std::string(record_index % 7, 'a' + file_index % 26) +
+         absl::StrCat(file_index, "/", record_index);
+}
+
+std::string WriteTFRecordFile(int64_t file_index, int64_t num_records) {
+  std::string filename;
+  EXPECT_TRUE(Env::Default()->LocalTempFilename(&filename));
+  std::unique_ptr<WritableFile> file;
+  TF_EXPECT_OK(Env::Default()->NewWritableFile(filename, &file));
+  io::RecordWriter writer(file.get());
+  for (int64_t i = 0; i < num_records; ++i) {
+    TF_EXPECT_OK(writer.WriteRecord(Record(file_index, i)));
+  }
+  TF_EXPECT_OK(writer.Close());
+  TF_EXPECT_OK(file->Close());
+  return filename;
+}
+
+std::vector<std::string> WriteTFRecordFiles(
+    const std::vector<int64_t>& num_records) {
+  std::vector<std::string> filenames;
+  for (size_t i = 0; i < num_records.size(); ++i) {
+    filenames.push_back(WriteTFRecordFile(i, num_records[i]));
+  }
+  return filenames;
+}
+
+TEST(TFRecordIndexTest, ReadAllRecords) {
+  std::vector<std::string> filenames = WriteTFRecordFiles({10, 0, 1, 25});
+  TF_ASSERT_OK(BuildTFRecordIndices(Env::Default(), filenames,
+                                    /*num_threads=*/4));
+  TF_ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<IndexedTFRecordReader> reader,
+      IndexedTFRecordReader::Create(Env::Default(), filenames,
+                                    /*num_threads=*/4));
+  ASSERT_EQ(reader->num_records(), 36);
+
+  std::vector<std::string> expected;
+  for (int64_t i = 0; i < 10; ++i) expected.push_back(Record(0, i));
+  expected.push_back(Record(2, 0));
+  for (int64_t i = 0; i < 25; ++i) expected.push_back(Record(3, i));
+  // Reads in reverse order to exercise non-sequential access.
+  for (int64_t i = reader->num_records() - 1; i >= 0; --i) {
+    tstring record;
+    TF_ASSERT_OK(reader->Read(i, record));
+    EXPECT_EQ(record, expected[i]) << "Record " << i;
+  }
+}
+
+TEST(TFRecordIndexTest, EmptyFile) {
+  std::vector<std::string> filenames = WriteTFRecordFiles({0});
+  TF_ASSERT_OK(BuildTFRecordIndex(Env::Default(), filenames[0]));
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<IndexedTFRecordReader> reader,
+                          IndexedTFRecordReader::Create(
+                              Env::Default(), filenames, /*num_threads=*/1));
+  EXPECT_EQ(reader->num_records(), 0);
+  tstring record;
+  EXPECT_THAT(reader->Read(0, record), StatusIs(absl::StatusCode::kOutOfRange));
+}
+
+TEST(TFRecordIndexTest, IndexOutOfRange) {
+  std::vector<std::string> filenames = WriteTFRecordFiles({3});
+  TF_ASSERT_OK(BuildTFRecordIndex(Env::Default(), filenames[0]));
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<IndexedTFRecordReader> reader,
+                          IndexedTFRecordReader::Create(
+                              Env::Default(), filenames, /*num_threads=*/1));
+  tstring record;
+  EXPECT_THAT(reader->Read(-1, record),
+              StatusIs(absl::StatusCode::kOutOfRange));
+  EXPECT_THAT(reader->Read(3, record), StatusIs(absl::StatusCode::kOutOfRange));
+}
+
+TEST(TFRecordIndexTest, MissingIndex) {
+  std::vector<std::string> filenames = WriteTFRecordFiles({3});
+  EXPECT_THAT(IndexedTFRecordReader::Create(Env::Default(), filenames,
+                                            /*num_threads=*/1)
+                  .status(),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(TFRecordIndexTest, StaleIndex) {
+  std::vector<std::string> filenames = WriteTFRecordFiles({3});
+  TF_ASSERT_OK(BuildTFRecordIndex(Env::Default(), filenames[0]));
+  std::unique_ptr<WritableFile> file;
+  TF_ASSERT_OK(Env::Default()->NewAppendableFile(filenames[0], &file));
+  io::RecordWriter writer(file.get());
+  TF_ASSERT_OK(writer.WriteRecord("appended"));
+  TF_ASSERT_OK(writer.Close());
+  TF_ASSERT_OK(file->Close());
+
+  EXPECT_THAT(IndexedTFRecordReader::Create(Env::Default(), filenames,
+                                            /*num_threads=*/1)
+                  .status(),
+              StatusIs(absl::StatusCode::kFailedPrecondition,
+                       HasSubstr("Rebuild the index")));
+}
+
+TEST(TFRecordIndexTest, InvalidIndex) {
+  std::vector<std::string> filenames = WriteTFRecordFiles({3});
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(),
+                                 TFRecordIndexFilename(filenames[0]),
+                                 "not a TFRecord index"));
+  EXPECT_THAT(IndexedTFRecordReader::Create(Env::Default(), filenames,
+                                            /*num_threads=*/1)
+                  .status(),
+              StatusIs(absl::StatusCode::kDataLoss));
+}
+
+TEST(TFRecordIndexTest, CorruptedRecord) {
+  std::vector<std::string> filenames = WriteTFRecordFiles({3});
+  TF_ASSERT_OK(BuildTFRecordIndex(Env::Default(), filenames[0]));
+  std::string contents;
+  TF_ASSERT_OK(ReadFileToString(Env::Default(), filenames[0], &contents));
+  // Flips a byte of the data of the last record, keeping the file size.
+  contents[contents.size() - 6] ^= 1;
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), filenames[0], contents));
+
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<IndexedTFRecordReader> reader,
+                          IndexedTFRecordReader::Create(
+                              Env::Default(), filenames, /*num_threads=*/1));
+  tstring record;
+  TF_EXPECT_OK(reader->Read(0, record));
+  EXPECT_THAT(reader->Read(2, record), StatusIs(absl::StatusCode::kDataLoss));
+}
+
+TEST(TFRecordIndexTest, CorruptedFileFailsToIndex) {
+  std::string filename;
+  ASSERT_TRUE(Env::Default()->LocalTempFilename(&filename));
+  TF_ASSERT_OK(WriteStringToFile(Env::Default(), filename, "not a TFRecord"));
+  EXPECT_THAT(BuildTFRecordIndex(Env::Default(), filename),
+              StatusIs(absl::StatusCode::kDataLoss,
+                       HasSubstr("Failed to index TFRecord file")));
+}
+
+void RandomAccessReadBenchmark(::testing::benchmark::State& state) {
+  const int64_t num_files = 4;
+  const int64_t num_records_per_file = 10000;
+  const int64_t record_size = state.range(0);
+  std::vector<std::string> filenames;
+  for (int64_t i = 0; i < num_files; ++i) {
+    std::string filename;
+    EXPECT_TRUE(Env::Default()->LocalTempFilename(&filename));
+    std::unique_ptr<WritableFile> file;
+    TF_ASSERT_OK(Env::Default()->NewWritableFile(filename, &file));
+    io::RecordWriter writer(file.get());
+    for (int64_t j = 0; j < num_records_per_file; ++j) {
+      TF_ASSERT_OK(writer.WriteRecord(std::string(record_size, 'x')));
+    }
+    TF_ASSERT_OK(writer.Close());
+    TF_ASSERT_OK(file->Close());
+    filenames.push_back(filename);
+  }
+  TF_ASSERT_OK(BuildTFRecordIndices(Env::Default(), filenames, num_files));
+  TF_ASSERT_OK_AND_ASSIGN(std::unique_ptr<IndexedTFRecordReader> reader,
+                          IndexedTFRecordReader::Create(
+                              Env::Default(), filenames, num_files));
+
+  tstring record;
+  for (auto s : state) {
+    const int64_t index = random::New64() % reader->num_records();
+    TF_CHECK_OK(reader->Read(index, record));
+  }
+  state.SetBytesProcessed(state.iterations() * record_size);
+  state.SetItemsProcessed(state.iterations());
+
+  for (const std::string& filename : filenames) {
+    TF_ASSERT_OK(Env::Default()->DeleteFile(filename));
+    TF_ASSERT_OK(Env::Default()->DeleteFile(TFRecordIndexFilename(filename)));
+  }
+}
+
+BENCHMARK(RandomAccessReadBenchmark)->Arg(100)->Arg(10000)->Arg(100000);
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -537,6 +537,12 @@ Status IteratorBase::InitializeBase(IteratorContext* ctx,
   parent_ = parent;
   id_ =
       Hash64CombineUnordered(Hash64(prefix()), reinterpret_cast<uint64>(this));
+  ram_budget_manager_ = ctx->ram_budget_manager();
+  if (ram_budget_manager_) {
+    cleanup_fns_.push_back([this]() {
+      ram_budget_manager_->RecordBufferedBytes(-buffered_bytes_);
+    });
+  }
   if (parent_) {
     parent_id_ = Hash64CombineUnordered(Hash64(parent_->prefix()),
                                         reinterpret_cast<uint64>(parent_));
@@ -15,6 +15,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_FRAMEWORK_DATASET_H_
 #define TENSORFLOW_CORE_FRAMEWORK_DATASET_H_
 
+#include <atomic>
 #include <cstdlib>
 #include <deque>
 #include <functional>
@@ -1150,6 +1151,13 @@ class IteratorBase : public Checkpointable {
     return 0;
   }
 
+  // Returns the RAM budget manager of the pipeline this iterator belongs to,
+  // which counts the bytes buffered by all of the pipeline's iterators,
+  // regardless of whether autotuning is enabled. May be null.
+  virtual std::shared_ptr<model::RamBudgetManager> ram_budget_manager() const {
+    return ram_budget_manager_;
+  }
+
  protected:
   // Returns a node that models this iterator.
   virtual std::shared_ptr<model::Node> CreateNode(
@@ -1213,7 +1221,17 @@ class IteratorBase : public Checkpointable {
   friend class DatasetBase;
   friend class DatasetBaseIterator;  // for access to `node_`
 
+  // Records `delta_bytes` buffered bytes against `ram_budget_manager_`.
+  void RecordBufferedBytes(int64_t delta_bytes) {
+    buffered_bytes_ += delta_bytes;
+    ram_budget_manager_->RecordBufferedBytes(delta_bytes);
+  }
+
   std::vector<std::function<void()>> cleanup_fns_;
+  std::shared_ptr<model::RamBudgetManager> ram_budget_manager_;
+  // Bytes this iterator recorded against `ram_budget_manager_`. They are
+  // released when the iterator is destroyed.
+  std::atomic<int64_t> buffered_bytes_ = 0;
   const IteratorBase* parent_ = nullptr;  // Not owned.
   uint64_t id_ = 0;
   uint64_t parent_id_ = 0;
@@ -1603,23 +1621,48 @@ class DatasetBaseIterator : public IteratorBase {
     }
   }
 
-  // When modeling is enabled, this method records the fact that this iterator
-  // has dequeued an element from an internal buffer.
+  // Records the fact that this iterator has dequeued an element from an
+  // internal buffer, in the model (when modeling is enabled) and in the
+  // pipeline's RAM budget manager.
   void RecordBufferDequeue(IteratorContext* ctx,
                            const std::vector<Tensor>& element) {
-    if (collect_resource_usage(ctx)) {
-      node_->record_buffer_event(-GetAllocatedBytes(element), -1);
+    const bool collect_resource_usage = this->collect_resource_usage(ctx);
+    if (!collect_resource_usage && !ram_budget_manager_) {
+      return;
+    }
+    const int64_t num_bytes = GetAllocatedBytes(element);
+    if (collect_resource_usage) {
+      node_->record_buffer_event(-num_bytes, -1);
       DCHECK_GE(node_->buffered_elements(), 0);
     }
+    if (ram_budget_manager_) {
+      RecordBufferedBytes(-num_bytes);
+    }
   }
 
-  // When modeling is enabled, this method records the fact that this iterator
-  // has enqueued an element in an internal buffer.
+  // Records the fact that this iterator has enqueued an element in an internal
+  // buffer, in the model (when modeling is enabled) and in the pipeline's RAM
+  // budget manager.
   void RecordBufferEnqueue(IteratorContext* ctx,
                            const std::vector<Tensor>& element) {
-    if (collect_resource_usage(ctx)) {
-      node_->record_buffer_event(GetAllocatedBytes(element), 1);
+    const bool collect_resource_usage = this->collect_resource_usage(ctx);
+    if (!collect_resource_usage && !ram_budget_manager_) {
+      return;
+    }
+    const int64_t num_bytes = GetAllocatedBytes(element);
+    if (collect_resource_usage) {
+      node_->record_buffer_event(num_bytes, 1);
     }
+    if (ram_budget_manager_) {
+      RecordBufferedBytes(num_bytes);
+    }
+  }
+
+  // Returns whether the bytes buffered by the pipeline reached its memory
+  // limit. While this is true, iterators should only add elements to their
+  // buffer if it is empty.
+  bool MemoryLimitReached() const {
+    return ram_budget_manager_ && ram_budget_manager_->MemoryLimitReached();
   }
 
   // When modeling is enabled, this method records the fact that this iterator
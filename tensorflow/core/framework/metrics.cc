@@ -79,6 +79,13 @@ auto* graph_unused_outputs = tsl::monitoring::Counter<1>::New(
     "/tensorflow/core/graph_unused_outputs",
     "The number of unused outputs for ops of a given type.", "name");
 
+auto* static_arena_plan_allocations = tsl::monitoring::Counter<1>::New(
+    "/tensorflow/core/static_arena_plan_allocations",
+    "The number of allocations of executor steps with a static memory plan, "
+    "by whether they were served from the arena or fell back to the "
+    "allocator.",
+    "result");
+
 auto* tf_data_fetch_op_counter = tsl::monitoring::Counter<1>::New(
     "/tensorflow/data/fetch_op",
     "The number of times a tf.data operation that fetches output(s) of a "
@@ -104,6 +111,17 @@ auto* tf_data_bytes_fetched_counter = tsl::monitoring::Counter<0>::New(
     "/tensorflow/data/bytes_fetched",
     "The number of bytes fetched from tf.data Dataset iterator.");
 
+auto* tf_data_memory_cache_reads_counter = tsl::monitoring::Counter<1>::New(
+    "/tensorflow/data/memory_cache/reads",
+    "The number of elements read from the tf.data in-memory cache. The source "
+    "can be memory or spill.",
+    "source");
+
+auto* tf_data_memory_cache_spilled_bytes_counter =
+    tsl::monitoring::Counter<0>::New(
+        "/tensorflow/data/memory_cache/spilled_bytes",
+        "The number of bytes spilled to disk by the tf.data in-memory cache.");
+
 auto* tf_data_elements_counter = tsl::monitoring::Counter<1>::New(
     "/tensorflow/data/elements", "tf.data elements", "name");
 
@@ -177,6 +195,22 @@ auto* tf_data_buffered_vs_budget_ratio_histogram =
         {tsl::monitoring::Buckets::Explicit(
             {0.0, 0.2, 0.4, 0.6, 0.8, 1.0, 1.2, 1.4, 1.6, 1.8, 2.0})});
 
+auto* tf_data_interleave_cycle_histogram = tsl::monitoring::Sampler<1>::New(
+    {"/tensorflow/data/interleave_cycle",
+     "Sizes chosen by tf.data interleave iterators adapting to the latency "
+     "of their inputs {'active_cycle_length', 'prefetch_depth'}.",
+     "name"},
+    // Power of 2 with bucket count 12 (1 to 2048).
+    {tsl::monitoring::Buckets::Exponential(1, 2, 12)});
+
+auto* tf_data_interleave_input_open_latency_usecs_histogram =
+    tsl::monitoring::Sampler<0>::New(
+        {"/tensorflow/data/interleave_input_open_latency",
+         "Microseconds spent by tf.data interleave iterators to open an input "
+         "and get its first element."},
+        // Power of 2 with bucket count 25 (1 microsecond to about 16 seconds).
+        {tsl::monitoring::Buckets::Exponential(1, 2, 25)});
+
 auto* tf_data_iterator_busy_counter = tsl::monitoring::Counter<0>::New(
     "/tensorflow/data/iterator_busy",
     "The time (in microseconds) during which a "
@@ -225,6 +259,24 @@ auto* tf_data_service_cross_trainer_cache_size_bytes =
         "/tensorflow/data/service/cross_trainer_cache_size_bytes",
         "tf.data service cross-trainer cache memory usage in bytes.");
 
+auto* tf_data_service_shared_element_cache_queries_counter =
+    tsl::monitoring::Counter<1>::New(
+        "/tensorflow/data/service/shared_element_cache_queries",
+        "tf.data service shared element cache queries counter. The result can "
+        "be hit or miss.",
+        "cache_hit");
+
+auto* tf_data_service_shared_element_cache_evictions_counter =
+    tsl::monitoring::Counter<0>::New(
+        "/tensorflow/data/service/shared_element_cache_evictions",
+        "Number of elements evicted from the tf.data service shared element "
+        "cache.");
+
+auto* tf_data_service_shared_element_cache_size_bytes =
+    tsl::monitoring::Gauge<int64_t, 0>::New(
+        "/tensorflow/data/service/shared_element_cache_size_bytes",
+        "tf.data service shared element cache memory usage in bytes.");
+
 auto* tf_data_service_snapshot_bytes_committed =
     tsl::monitoring::Counter<0>::New(
         "/tensorflow/data/service/snapshot_bytes_committed",
@@ -530,6 +582,15 @@ void RecordTFDataBytesFetched(int64_t num_bytes) {
   tf_data_bytes_fetched_counter->GetCell()->IncrementBy(num_bytes);
 }
 
+void RecordTFDataMemoryCacheRead(bool spilled) {
+  tf_data_memory_cache_reads_counter->GetCell(spilled ? "spill" : "memory")
+      ->IncrementBy(1);
+}
+
+void RecordTFDataMemoryCacheSpilledBytes(int64_t num_bytes) {
+  tf_data_memory_cache_spilled_bytes_counter->GetCell()->IncrementBy(num_bytes);
+}
+
 void RecordTFDataExperiment(const string& name) {
   tf_data_experiment_counter->GetCell(name)->IncrementBy(1);
 }
@@ -586,6 +647,22 @@ void RecordTFDataAutotuneMaxBufferBudgetRatio(const double ratio) {
   tf_data_buffered_vs_budget_ratio_histogram_cell->Add(ratio);
 }
 
+void RecordTFDataInterleaveCycle(int64_t active_cycle_length,
+                                 int64_t prefetch_depth) {
+  static auto* active_cycle_length_cell =
+      tf_data_interleave_cycle_histogram->GetCell("active_cycle_length");
+  static auto* prefetch_depth_cell =
+      tf_data_interleave_cycle_histogram->GetCell("prefetch_depth");
+  active_cycle_length_cell->Add(active_cycle_length);
+  prefetch_depth_cell->Add(prefetch_depth);
+}
+
+void RecordTFDataInterleaveInputOpenLatency(uint64 duration_us) {
+  static auto* tf_data_interleave_input_open_latency_cell =
+      tf_data_interleave_input_open_latency_usecs_histogram->GetCell();
+  tf_data_interleave_input_open_latency_cell->Add(duration_us);
+}
+
 void RecordTFDataIteratorBusy(uint64 duration_us) {
   static auto* tf_data_iterator_busy_cell =
       tf_data_iterator_busy_counter->GetCell();
@@ -675,6 +752,22 @@ void RecordTFDataServiceCrossTrainerCacheSizeBytes(size_t bytes) {
       static_cast<int64_t>(bytes));
 }
 
+void RecordTFDataServiceSharedElementCacheQuery(bool cache_hit) {
+  std::string cache_hit_str = cache_hit ? "true" : "false";
+  tf_data_service_shared_element_cache_queries_counter->GetCell(cache_hit_str)
+      ->IncrementBy(1);
+}
+
+void RecordTFDataServiceSharedElementCacheEviction() {
+  tf_data_service_shared_element_cache_evictions_counter->GetCell()
+      ->IncrementBy(1);
+}
+
+void RecordTFDataServiceSharedElementCacheSizeBytes(size_t bytes) {
+  tf_data_service_shared_element_cache_size_bytes->GetCell()->Set(
+      static_cast<int64_t>(bytes));
+}
+
 void RecordTFDataServiceSnapshotBytesCommitted(int64_t bytes) {
   tf_data_service_snapshot_bytes_committed->GetCell()->IncrementBy(bytes);
 }
@@ -925,6 +1018,19 @@ void RecordUnusedOutput(const string& op_name) {
   graph_unused_outputs->GetCell(op_name)->IncrementBy(1);
 }
 
+void UpdateStaticArenaPlanAllocations(int64_t num_arena_allocations,
+                                      int64_t num_fallbacks) {
+  if (num_arena_allocations > 0) {
+    static auto* arena_cell = static_arena_plan_allocations->GetCell("arena");
+    arena_cell->IncrementBy(num_arena_allocations);
+  }
+  if (num_fallbacks > 0) {
+    static auto* fallback_cell =
+        static_arena_plan_allocations->GetCell("fallback");
+    fallback_cell->IncrementBy(num_fallbacks);
+  }
+}
+
 void RecordPipelineProcessingTime(const string& id,
                                   double pipeline_processing_time_usec) {
   GetTFDataPipelineProcessingTimeGauge(id)->Set(pipeline_processing_time_usec);
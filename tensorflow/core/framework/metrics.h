@@ -81,6 +81,13 @@ monitoring::GaugeCell<std::function<std::string()>>* GetTFDataModelGauge(
 // Records the number of bytes fetched from tf.data.Dataset iterator.
 void RecordTFDataBytesFetched(int64_t num_bytes);
 
+// Records a read from the tf.data in-memory cache. `spilled` indicates whether
+// the element was served from the on-disk spill segment instead of RAM.
+void RecordTFDataMemoryCacheRead(bool spilled);
+
+// Records the number of bytes spilled to disk by the tf.data in-memory cache.
+void RecordTFDataMemoryCacheSpilledBytes(int64_t num_bytes);
+
 // Records the number of times a tf.data experiment was applied.
 void RecordTFDataExperiment(const string& name);
 
@@ -110,6 +117,15 @@ void RecordTFDataAutotuneUsedRamBudgetRatio(const double ratio);
 // bytes over the ram budget.
 void RecordTFDataAutotuneMaxBufferBudgetRatio(const double ratio);
 
+// Records the active cycle length and the prefetch depth chosen by a tf.data
+// interleave iterator adapting to the latency of its inputs.
+void RecordTFDataInterleaveCycle(int64_t active_cycle_length,
+                                 int64_t prefetch_depth);
+
+// Records the time (in microseconds) a tf.data interleave iterator took to
+// open one of its inputs, i.e. to create it and get its first element.
+void RecordTFDataInterleaveInputOpenLatency(uint64 duration_us);
+
 // Records the number of times each tf.data fingerprint is used
 // to measure duplicate pre-processing.
 //
@@ -182,6 +198,15 @@ void RecordTFDataServiceCrossTrainerCacheQuery(bool cache_hit);
 // Records tf.data service cross-trainer cache memory usage in bytes.
 void RecordTFDataServiceCrossTrainerCacheSizeBytes(size_t bytes);
 
+// Records tf.data service shared element cache queries.
+void RecordTFDataServiceSharedElementCacheQuery(bool cache_hit);
+
+// Records that the tf.data service shared element cache evicted an element.
+void RecordTFDataServiceSharedElementCacheEviction();
+
+// Records tf.data service shared element cache memory usage in bytes.
+void RecordTFDataServiceSharedElementCacheSizeBytes(size_t bytes);
+
 // Records tf.data distributed snapshot bytes committed.
 void RecordTFDataServiceSnapshotBytesCommitted(int64_t bytes);
 
@@ -272,6 +297,12 @@ void UpdateGraphPendingQueueLength(uint64 len);
 // Records that one output of an op of type `op_name` was unused.
 void RecordUnusedOutput(const string& op_name);
 
+// Records the number of allocations of an executor step that were served from
+// the arena of its static memory plan, and the number that fell back to the
+// device allocator.
+void UpdateStaticArenaPlanAllocations(int64_t num_arena_allocations,
+                                      int64_t num_fallbacks);
+
 // Records the pipeline processing time in microseconds
 void RecordPipelineProcessingTime(const string& id,
                                   double pipeline_processing_time_usec);
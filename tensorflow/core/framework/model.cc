@@ -22,8 +22,18 @@ limitations under the License.
 #include <memory>
 #include <optional>
 #include <queue>
-
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/model.pb.h"
@@ -32,7 +42,9 @@ limitations under the License.
 #include "tensorflow/core/platform/host_info.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/mem.h"
+#include "tensorflow/core/platform/path.h"
 #include "tensorflow/core/platform/statusor.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tsl/platform/protobuf.h"
 
 namespace tensorflow {
@@ -65,6 +77,15 @@ constexpr double kBufferDownsizeMultipliter = 0.9;
 // upsizing.
 constexpr int64_t kBufferLowWatermarkThreshold = 2;
 
+// Environment variables and defaults for the host CPU budget coordinator.
+constexpr char kCpuBudgetLeaseDirEnvVar[] = "TF_DATA_CPU_BUDGET_LEASE_DIR";
+constexpr char kHostCpuBudgetEnvVar[] = "TF_DATA_HOST_CPU_BUDGET";
+constexpr char kDefaultCpuBudgetLeaseDir[] = "/dev/shm/tf_data_cpu_budget";
+constexpr char kCpuBudgetLeaseSuffix[] = ".lease";
+// Leases are renewed on every optimization, which happens at least once per
+// `Model::kOptimizationPeriodMaxMs` (one minute).
+constexpr absl::Duration kCpuBudgetLeaseTtl = absl::Minutes(3);
+
 constexpr char kDataService[] = "DataService";
 constexpr char kFlatMap[] = "FlatMap";
 constexpr char kInterleave[] = "Interleave";
@@ -361,6 +382,28 @@ inline void UpdateStateValues(Node::ModelParameters* parameters) {
   }
 }
 
+// Name of the lease a model holds with the host CPU budget coordinator.
+std::string CpuBudgetLeaseId(const std::string& model_id) {
+  return absl::StrCat(Env::Default()->GetProcessId(), "_", model_id);
+}
+
+// Parses a lease written by `HostCpuBudgetCoordinator::Update`.
+bool ParseCpuBudgetLease(absl::string_view contents,
+                         HostCpuBudgetCoordinator::Demand& demand) {
+  std::vector<absl::string_view> fields =
+      absl::StrSplit(contents, ' ', absl::SkipEmpty());
+  if (fields.empty() || !absl::SimpleAtoi(fields[0], &demand.min_threads)) {
+    return false;
+  }
+  demand.throughput.resize(fields.size() - 1);
+  for (size_t i = 1; i < fields.size(); ++i) {
+    if (!absl::SimpleAtod(fields[i], &demand.throughput[i - 1])) {
+      return false;
+    }
+  }
+  return true;
+}
+
 // Recursively produces protos for nodes in a subtree of `output` node and
 // appends them to nodes of the given model.
 Status ModelToProtoHelper(std::shared_ptr<Node> output, ModelProto* model) {
@@ -694,6 +737,11 @@ class AsyncInterleaveMany : public Node {
     if (parameter) {
       parallelism = std::min(parallelism, (*parameter)->value);
     }
+    auto* active_cycle_length =
+        gtl::FindOrNull(parameters_, kActiveCycleLength);
+    if (active_cycle_length) {
+      parallelism = std::min(parallelism, (*active_cycle_length)->value);
+    }
     double output_time_for_inputs =
         OutputTimeForInputs(*output_times) -
         (*output_times)[inputs_.front()->long_name()];
@@ -2255,6 +2303,144 @@ Status Node::FromProto(ModelProto::Node node_proto,
   return FromProtoHelper(node_proto, *node);
 }
 
+HostCpuBudgetCoordinator::HostCpuBudgetCoordinator(std::string lease_dir,
+                                                   int64_t cpu_budget,
+                                                   absl::Duration lease_ttl)
+    : lease_dir_(std::move(lease_dir)),
+      cpu_budget_(cpu_budget),
+      lease_ttl_(lease_ttl) {}
+
+HostCpuBudgetCoordinator& HostCpuBudgetCoordinator::Get() {
+  static HostCpuBudgetCoordinator* coordinator = [] {
+    std::string lease_dir;
+    Status s = ReadStringFromEnvVar(kCpuBudgetLeaseDirEnvVar,
+                                    kDefaultCpuBudgetLeaseDir, &lease_dir);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to read " << kCpuBudgetLeaseDirEnvVar << ": "
+                   << s;
+      lease_dir = kDefaultCpuBudgetLeaseDir;
+    }
+    int64_t cpu_budget;
+    s = ReadInt64FromEnvVar(kHostCpuBudgetEnvVar, port::NumSchedulableCPUs(),
+                            &cpu_budget);
+    if (!s.ok() || cpu_budget <= 0) {
+      LOG(WARNING) << "Failed to read " << kHostCpuBudgetEnvVar << ": " << s;
+      cpu_budget = port::NumSchedulableCPUs();
+    }
+    return new HostCpuBudgetCoordinator(lease_dir, cpu_budget,
+                                        kCpuBudgetLeaseTtl);
+  }();
+  return *coordinator;
+}
+
+absl::StatusOr<int64_t> HostCpuBudgetCoordinator::Update(
+    const std::string& lease_id, const Demand& demand) {
+  Env* env = Env::Default();
+  TF_RETURN_IF_ERROR(env->RecursivelyCreateDir(lease_dir_));
+  std::string contents = absl::StrCat(demand.min_threads);
+  for (double throughput : demand.throughput) {
+    absl::StrAppend(&contents, " ", throughput);
+  }
+  // Writes to a temporary file first so that other pipelines never read a
+  // partially written lease.
+  const std::string lease_path =
+      io::JoinPath(lease_dir_, absl::StrCat(lease_id, kCpuBudgetLeaseSuffix));
+  const std::string tmp_path = absl::StrCat(lease_path, ".tmp");
+  TF_RETURN_IF_ERROR(WriteStringToFile(env, tmp_path, contents));
+  TF_RETURN_IF_ERROR(env->RenameFile(tmp_path, lease_path));
+
+  std::vector<Demand> demands;
+  int64_t index = -1;
+  TF_RETURN_IF_ERROR(ReadLeases(lease_id, demands, index));
+  if (index < 0) {
+    return errors::Internal("The CPU budget lease ", lease_path,
+                            " disappeared after being written.");
+  }
+  return Split(cpu_budget_, demands)[index];
+}
+
+void HostCpuBudgetCoordinator::Release(const std::string& lease_id) {
+  Env::Default()
+      ->DeleteFile(io::JoinPath(lease_dir_,
+                                absl::StrCat(lease_id, kCpuBudgetLeaseSuffix)))
+      .IgnoreError();
+}
+
+absl::Status HostCpuBudgetCoordinator::ReadLeases(const std::string& lease_id,
+                                                  std::vector<Demand>& demands,
+                                                  int64_t& index) {
+  Env* env = Env::Default();
+  std::vector<std::string> children;
+  TF_RETURN_IF_ERROR(env->GetChildren(lease_dir_, &children));
+  // Sorting makes every pipeline see the leases, and break ties in `Split`, in
+  // the same order.
+  std::sort(children.begin(), children.end());
+  const std::string own_lease = absl::StrCat(lease_id, kCpuBudgetLeaseSuffix);
+  const int64_t now_nsec = env->NowNanos();
+  for (const std::string& child : children) {
+    if (!absl::EndsWith(child, kCpuBudgetLeaseSuffix)) {
+      continue;
+    }
+    const std::string path = io::JoinPath(lease_dir_, child);
+    FileStatistics stat;
+    std::string contents;
+    // Leases can be released while they are being read.
+    if (!env->Stat(path, &stat).ok() ||
+        !ReadFileToString(env, path, &contents).ok()) {
+      continue;
+    }
+    if (now_nsec - stat.mtime_nsec > absl::ToInt64Nanoseconds(lease_ttl_)) {
+      VLOG(2) << "Dropping expired CPU budget lease " << path;
+      env->DeleteFile(path).IgnoreError();
+      continue;
+    }
+    Demand demand;
+    if (!ParseCpuBudgetLease(contents, demand)) {
+      VLOG(2) << "Ignoring malformed CPU budget lease " << path;
+      continue;
+    }
+    if (child == own_lease) {
+      index = demands.size();
+    }
+    demands.push_back(std::move(demand));
+  }
+  return absl::OkStatus();
+}
+
+std::vector<int64_t> HostCpuBudgetCoordinator::Split(
+    int64_t cpu_budget, const std::vector<Demand>& demands) {
+  std::vector<int64_t> shares(demands.size());
+  int64_t remaining = cpu_budget;
+  for (size_t i = 0; i < demands.size(); ++i) {
+    shares[i] = demands[i].min_threads;
+    remaining -= shares[i];
+  }
+  // Handing out threads by largest marginal gain maximizes the combined
+  // throughput when throughput grows with diminishing returns.
+  while (remaining > 0) {
+    int64_t best = -1;
+    double best_gain = 0.0;
+    for (size_t i = 0; i < demands.size(); ++i) {
+      const std::vector<double>& throughput = demands[i].throughput;
+      const int64_t next = shares[i] - demands[i].min_threads + 1;
+      if (next <= 0 || next >= static_cast<int64_t>(throughput.size())) {
+        continue;
+      }
+      const double gain = throughput[next] - throughput[next - 1];
+      if (gain > best_gain) {
+        best_gain = gain;
+        best = i;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    ++shares[best];
+    --remaining;
+  }
+  return shares;
+}
+
 Model::Model(std::optional<std::string> dataset_name)
     : dataset_name_(std::move(dataset_name)),
       optimization_period_ms_(kOptimizationPeriodMinMs),
@@ -2293,6 +2479,9 @@ Model::Model(std::optional<std::string> dataset_name)
 }
 
 Model::~Model() {
+  if (holds_cpu_budget_lease_) {
+    HostCpuBudgetCoordinator::Get().Release(CpuBudgetLeaseId(model_id_));
+  }
   mutex_lock l(safe_to_collect_metrics_->mu);
   safe_to_collect_metrics_->val = false;
   // Reset the pipeline processing time to 0
@@ -2403,6 +2592,10 @@ void Model::Optimize(AutotuneAlgorithm algorithm,
       OptimizeStageBased(snapshot, optimization_params, cancellation_manager,
                          ram_budget_manager);
       break;
+    case AutotuneAlgorithm::SHARED_CPU_BUDGET:
+      OptimizeSharedCpuBudget(snapshot, optimization_params,
+                              cancellation_manager, ram_budget_manager);
+      break;
     default:
       VLOG(2) << "Autotuning algorithm was not recognized. Aborting "
                  "optimization.";
@@ -2471,8 +2664,11 @@ Model::ModelParameters Model::CollectTunableParameters(
 }
 
 void Model::MaybeSyncStateValuesToValues(std::shared_ptr<Node> snapshot) {
+  // Interleave iterators tune their active cycle length themselves.
+  snapshot->SyncStateValuesToParameterValues(kActiveCycleLength);
   auto subtree_nodes = snapshot->CollectNodes(TraversalOrder::BFS, IsAnyNode);
   for (const auto& node : subtree_nodes) {
+    node->SyncStateValuesToParameterValues(kActiveCycleLength);
     if (!absl::StartsWith(node->name(), kDataService)) {
       continue;
     }
@@ -3155,6 +3351,139 @@ void Model::OptimizeMaxParallelism(
                           should_stop);
 }
 
+void Model::OptimizeSharedCpuBudget(
+    std::shared_ptr<Node> snapshot,
+    const OptimizationParams& optimization_params,
+    CancellationManager* cancellation_manager,
+    RamBudgetManager& ram_budget_manager) {
+  VLOG(2) << "Starting optimization of tunable parameters with a shared CPU "
+             "budget.";
+  auto parameters = CollectTunableParameters(snapshot);
+  if (parameters.empty()) {
+    VLOG(2) << "There are no tunable parameters.";
+    return;
+  }
+  VLOG(2) << "Number of tunable parameters: " << parameters.size();
+
+  // Buffer size parameter will only be incremented if the output latency
+  // improvement is greater than this constant.
+  constexpr double kBufferSizeMinDelta = 1.0L;
+
+  // Skip buffer size optimization if we are running the new buffering
+  // algorithm.
+  const bool skip_buffer_sizes =
+      experiments_.contains("autotune_buffer_optimization");
+  ModelParameters parallelism_parameters, buffer_size_parameters;
+  for (auto& pair : parameters) {
+    if (pair.second->name == kParallelism) {
+      parallelism_parameters.push_back(pair);
+    } else if (pair.second->name == kBufferSize && !skip_buffer_sizes) {
+      buffer_size_parameters.push_back(pair);
+    } else {
+      continue;
+    }
+    pair.second->value = pair.second->min;
+  }
+
+  const double model_input_time = optimization_params.model_input_time();
+  const int64_t ram_budget = optimization_params.ram_budget();
+  // Returns the parameter among `candidates` whose increment decreases the
+  // output time the most, by more than `min_delta`, without exceeding the RAM
+  // budget.
+  auto best_increment = [&](ModelParameters& candidates, double output_time,
+                            double min_delta, double* new_output_time) {
+    Parameter* best_parameter = nullptr;
+    double best_delta = min_delta;
+    for (auto& pair : candidates) {
+      if (pair.second->value >= pair.second->max) {
+        continue;
+      }
+      pair.second->value++;
+      const double candidate_output_time =
+          OutputTime(snapshot, model_input_time, /*gradients=*/nullptr);
+      const bool within_ram_budget =
+          TotalMaximumBufferedBytes(snapshot) <= ram_budget;
+      pair.second->value--;
+      const double delta = output_time - candidate_output_time;
+      if (within_ram_budget && delta > best_delta) {
+        best_delta = delta;
+        best_parameter = pair.second.get();
+        *new_output_time = candidate_output_time;
+      }
+    }
+    return best_parameter;
+  };
+
+  // Adds one thread at a time, recording the output time reached with each
+  // number of threads.
+  HostCpuBudgetCoordinator& coordinator = HostCpuBudgetCoordinator::Get();
+  HostCpuBudgetCoordinator::Demand demand;
+  for (const auto& pair : parallelism_parameters) {
+    demand.min_threads += pair.second->min;
+  }
+  const int64_t max_threads =
+      std::min(optimization_params.cpu_budget(), coordinator.cpu_budget());
+  std::vector<Parameter*> steps;
+  std::vector<double> output_times = {
+      OutputTime(snapshot, model_input_time, /*gradients=*/nullptr)};
+  while (!cancellation_manager->IsCancelled() &&
+         demand.min_threads + static_cast<int64_t>(steps.size()) <
+             max_threads) {
+    double new_output_time;
+    Parameter* parameter = best_increment(
+        parallelism_parameters, output_times.back(), 0.0, &new_output_time);
+    if (parameter == nullptr) {
+      break;
+    }
+    parameter->value++;
+    steps.push_back(parameter);
+    output_times.push_back(new_output_time);
+  }
+  for (double output_time : output_times) {
+    demand.throughput.push_back(
+        output_time > 0 ? output_times.back() / output_time : 1.0);
+  }
+
+  int64_t threads = demand.min_threads + steps.size();
+  absl::StatusOr<int64_t> share =
+      coordinator.Update(CpuBudgetLeaseId(model_id_), demand);
+  if (share.ok()) {
+    holds_cpu_budget_lease_ = true;
+    threads = *share;
+  } else {
+    constexpr int TEN_MINUTES = 60 * 10;
+    LOG_EVERY_N_SEC(WARNING, TEN_MINUTES)
+        << "Failed to share the CPU budget with the other tf.data pipelines "
+           "on the host, so this pipeline uses up to "
+        << max_threads << " threads: " << share.status();
+  }
+  VLOG(2) << "Using " << threads << " threads out of a host budget of "
+          << coordinator.cpu_budget();
+  // Undoes the steps that do not fit in the share.
+  while (!steps.empty() &&
+         demand.min_threads + static_cast<int64_t>(steps.size()) > threads) {
+    steps.back()->value--;
+    steps.pop_back();
+  }
+
+  while (!cancellation_manager->IsCancelled()) {
+    const double output_time =
+        OutputTime(snapshot, model_input_time, /*gradients=*/nullptr);
+    double new_output_time;
+    Parameter* parameter =
+        best_increment(buffer_size_parameters, output_time,
+                       kBufferSizeMinDelta, &new_output_time);
+    if (parameter == nullptr) {
+      break;
+    }
+    parameter->value++;
+  }
+  if (ram_budget_manager.RequestModelAllocation(
+          TotalMaximumBufferedBytes(snapshot))) {
+    UpdateStateValues(&parameters);
+  }
+}
+
 double Model::OutputTime(std::shared_ptr<Node> node, double model_input_time,
                          Model::ParameterGradients* gradients) {
   // To store the input time for each node.
@@ -3428,6 +3757,10 @@ double ModelTiming::ComputeAsyncInterleaveManyInterleavedInputsTotalTime(
   if (cycle_length_param.ok()) {
     cycle_length = cycle_length_param.value();
   }
+  auto active_cycle_length_param = node.ParameterValue(kActiveCycleLength);
+  if (active_cycle_length_param.ok()) {
+    cycle_length = std::min(cycle_length, active_cycle_length_param.value());
+  }
   double input_total_time_nsec = 0.0;
   if (deterministic) {
     // If deterministic = true, then the total time is `max input total time /
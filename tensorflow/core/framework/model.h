@@ -16,6 +16,7 @@ limitations under the License.
 #define TENSORFLOW_CORE_FRAMEWORK_MODEL_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <deque>
 #include <functional>
@@ -31,6 +32,8 @@ limitations under the License.
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "tensorflow/core/framework/cancellation.h"
 #include "tensorflow/core/framework/metrics.h"
@@ -60,6 +63,9 @@ constexpr int64_t kAutotune = -1;
 constexpr char kParallelism[] = "parallelism";
 constexpr char kBufferSize[] = "buffer_size";
 constexpr char kCycleLength[] = "cycle_length";
+// Number of leading cycle elements an interleave keeps open, at most
+// `cycle_length`. Interleave iterators tune it to the latency of their inputs.
+constexpr char kActiveCycleLength[] = "active_cycle_length";
 constexpr char kDeterministic[] = "deterministic";
 constexpr char kMaxBufferedElements[] = "max_buffered_elements";
 
@@ -156,11 +162,18 @@ std::shared_ptr<Parameter> MakeNonTunableParameter(const string& name,
 // coordinating ram usage between the model-based autotuner and the legacy
 // prefetch autotuner. Once the legacy autotuner is retired we can remove this
 // class and move all ram budget management to the model autotuner.
+//
+// The manager also keeps an exact count of the bytes held in the buffers of the
+// iterator's subtree (see `RecordBufferedBytes()`). If a memory limit is set,
+// the budget never exceeds it, and iterators stop filling their buffers while
+// the buffered bytes are at or above it.
 class RamBudgetManager {
  public:
-  explicit RamBudgetManager(int64_t budget) : budget_(budget) {
-    if (budget <= 0) {
-      LOG(WARNING) << "RAM budget is " << budget
+  explicit RamBudgetManager(int64_t budget, int64_t memory_limit = 0)
+      : budget_(memory_limit > 0 ? std::min(budget, memory_limit) : budget),
+        memory_limit_(memory_limit) {
+    if (budget_ <= 0) {
+      LOG(WARNING) << "RAM budget is " << budget_
                    << " which could prevent autotuner from properly adjusting "
                       "buffer sizes.";
     }
@@ -238,25 +251,128 @@ class RamBudgetManager {
   }
 
   void UpdateBudget(int64_t budget) {
+    if (memory_limit_ > 0) {
+      budget = std::min(budget, memory_limit_);
+    }
     mutex_lock l(mu_);
     budget_ = budget;
     VLOG(2) << "Updated ram budget to " << budget;
   }
 
+  // Records that `delta_bytes` bytes were added to (or, if negative, removed
+  // from) the buffer of an iterator.
+  void RecordBufferedBytes(int64_t delta_bytes) {
+    int64_t buffered_bytes = buffered_bytes_ += delta_bytes;
+    if (delta_bytes > 0) {
+      UpdatePeak(buffered_bytes);
+    }
+  }
+
+  // Number of bytes currently held in the buffers of the iterators.
+  int64_t buffered_bytes() const { return buffered_bytes_; }
+
+  // Largest value `buffered_bytes()` has reached.
+  int64_t peak_buffered_bytes() const { return peak_buffered_bytes_; }
+
+  // Hard limit on `buffered_bytes()`, or 0 if there is none.
+  int64_t memory_limit() const { return memory_limit_; }
+
+  // Returns whether the buffered bytes reached the memory limit. Iterators
+  // should not buffer more elements while this is true, unless their buffer is
+  // empty.
+  bool MemoryLimitReached() const {
+    return memory_limit_ > 0 && buffered_bytes_ >= memory_limit_;
+  }
+
   std::string DebugString() {
     mutex_lock l(mu_);
     return absl::StrCat("RamBudgetManager: budget_: ", budget_,
                         " prefetch allocated: ", legacy_prefetch_allocated_,
-                        " model allocated: ", model_allocated_);
+                        " model allocated: ", model_allocated_,
+                        " buffered bytes: ", buffered_bytes_.load(),
+                        " memory limit: ", memory_limit_);
   }
 
  private:
+  // Only writes `peak_buffered_bytes_` when `buffered_bytes` is a new peak.
+  void UpdatePeak(int64_t buffered_bytes) {
+    int64_t peak_buffered_bytes =
+        peak_buffered_bytes_.load(std::memory_order_relaxed);
+    while (buffered_bytes > peak_buffered_bytes &&
+           !peak_buffered_bytes_.compare_exchange_weak(peak_buffered_bytes,
+                                                       buffered_bytes)) {
+    }
+  }
+
   mutable mutex mu_;
   int64_t budget_ TF_GUARDED_BY(mu_) = 0;
   // Number of bytes allocated by legacy prefetch autotuner.
   int64_t legacy_prefetch_allocated_ TF_GUARDED_BY(mu_) = 0;
   // Number of bytes allocated by the model.
   int64_t model_allocated_ TF_GUARDED_BY(mu_) = 0;
+  const int64_t memory_limit_;
+  std::atomic<int64_t> buffered_bytes_ = 0;
+  std::atomic<int64_t> peak_buffered_bytes_ = 0;
+};
+
+// Splits a CPU budget between the tf.data pipelines running on a host, which
+// may belong to different processes. Each pipeline that uses the
+// `SHARED_CPU_BUDGET` algorithm holds a lease: a file in a directory shared by
+// the processes on the host that describes how the pipeline's throughput grows
+// with the number of threads it gets. Every pipeline computes the same split
+// from the set of live leases and takes its own share.
+class HostCpuBudgetCoordinator {
+ public:
+  // How the throughput of a pipeline grows with the number of threads it gets.
+  struct Demand {
+    // Number of threads the pipeline uses when all of its parallelism
+    // parameters are at their minimum.
+    int64_t min_threads = 0;
+    // `throughput[i]` is the throughput of the pipeline with
+    // `min_threads + i` threads, relative to the best throughput it can reach.
+    std::vector<double> throughput;
+  };
+
+  // Leases that have not been renewed for `lease_ttl` are ignored, so that
+  // pipelines of processes that died without releasing their lease do not
+  // hold on to their share.
+  HostCpuBudgetCoordinator(std::string lease_dir, int64_t cpu_budget,
+                           absl::Duration lease_ttl);
+
+  // Returns the coordinator used by the pipelines of this process. The lease
+  // directory and the budget can be set with the TF_DATA_CPU_BUDGET_LEASE_DIR
+  // and TF_DATA_HOST_CPU_BUDGET environment variables, and default to
+  // /dev/shm/tf_data_cpu_budget and the number of schedulable CPUs.
+  static HostCpuBudgetCoordinator& Get();
+
+  // Total number of threads shared by the pipelines on the host.
+  int64_t cpu_budget() const { return cpu_budget_; }
+
+  // Publishes `demand` under `lease_id`, creating or renewing the lease, and
+  // returns the number of threads the pipeline holding the lease should use.
+  absl::StatusOr<int64_t> Update(const std::string& lease_id,
+                                 const Demand& demand);
+
+  // Drops the lease `lease_id`, if any.
+  void Release(const std::string& lease_id);
+
+  // Splits `cpu_budget` threads between pipelines with the given demands,
+  // maximizing the sum of their relative throughputs. Every pipeline gets at
+  // least its `min_threads`; the remaining threads are handed out one at a
+  // time to the pipeline whose throughput grows the most. Threads that do not
+  // improve any pipeline are left unassigned.
+  static std::vector<int64_t> Split(int64_t cpu_budget,
+                                    const std::vector<Demand>& demands);
+
+ private:
+  // Reads the demands of all live leases, in lease order, and stores the
+  // position of `lease_id` among them in `index`.
+  absl::Status ReadLeases(const std::string& lease_id,
+                          std::vector<Demand>& demands, int64_t& index);
+
+  const std::string lease_dir_;
+  const int64_t cpu_budget_;
+  const absl::Duration lease_ttl_;
 };
 
 // Abstract representation of a TensorFlow input pipeline node. It collects
@@ -1131,6 +1247,18 @@ class Model {
                           CancellationManager* cancellation_manager,
                           RamBudgetManager& ram_budget_manager);
 
+  // This optimization shares the host's CPUs with the other pipelines on the
+  // host through `HostCpuBudgetCoordinator`. It greedily increases the
+  // parallelism parameter that decreases the output time the most, recording
+  // how the throughput grows with each added thread, and publishes that curve
+  // to the coordinator. It then applies the parallelism reached within the
+  // share of threads the coordinator assigns to this pipeline, and hill climbs
+  // the buffer sizes within the RAM budget.
+  void OptimizeSharedCpuBudget(std::shared_ptr<Node> snapshot,
+                               const OptimizationParams& optimization_params,
+                               CancellationManager* cancellation_manager,
+                               RamBudgetManager& ram_budget_manager);
+
   // This is the first part of the stage-based optimization that optimizes
   // tunable parallelism parameters for async interleave many nodes only. We
   // separately optimize async interleave many nodes more aggressively because
@@ -1218,6 +1346,8 @@ class Model {
   OptimizationParams optimization_params_ TF_GUARDED_BY(mu_);
   // Stores the model id in the string format
   std::string model_id_;
+  // Set once the model has taken a lease from the host CPU budget coordinator.
+  std::atomic<bool> holds_cpu_budget_lease_ = false;
 };
 
 // Class to compute timing information for a model.
@@ -24,6 +24,7 @@ limitations under the License.
 #include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include "absl/status/status.h"
@@ -34,6 +35,9 @@ limitations under the License.
 #include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/monitoring/cell_reader.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/status_matchers.h"
 #include "tensorflow/core/platform/stringprintf.h"
 #include "tensorflow/core/platform/test.h"
 
@@ -43,6 +47,7 @@ namespace model {
 namespace {
 
 using ::tensorflow::monitoring::testing::CellReader;
+using ::tensorflow::testing::IsOkAndHolds;
 using ::testing::AllOf;
 using ::testing::HasSubstr;
 
@@ -154,6 +159,58 @@ INSTANTIATE_TEST_SUITE_P(Test, AsyncInterleaveManyTest,
                                             ::testing::Values(0, 50, 100,
                                                               200)));
 
+TEST(AsyncInterleaveManyTest, ActiveCycleLengthLimitsParallelism) {
+  std::shared_ptr<Parameter> active_cycle_length = model::MakeParameter(
+      kActiveCycleLength,
+      std::make_shared<SharedState>(/*value=*/2, nullptr, nullptr),
+      /*min=*/1, /*max=*/2);
+  std::shared_ptr<Node> async_interleave_many =
+      model::MakeAsyncInterleaveManyNode(
+          {0, "async_interleave_many", nullptr},
+          {model::MakeParameter("parallelism",
+                                std::make_shared<SharedState>(
+                                    /*value=*/2, nullptr, nullptr),
+                                /*min=*/1,
+                                /*max=*/2),
+           model::MakeParameter(kCycleLength, nullptr,
+                                /*min=*/2,
+                                /*max=*/2),
+           active_cycle_length});
+  std::shared_ptr<Node> meta_source =
+      model::MakeSourceNode({1, "meta_source", async_interleave_many});
+  async_interleave_many->add_input(meta_source);
+  auto cleanup_meta = gtl::MakeCleanup([async_interleave_many, meta_source]() {
+    async_interleave_many->remove_input(meta_source);
+  });
+  std::shared_ptr<Node> source1 =
+      model::MakeSourceNode({2, "source1", async_interleave_many});
+  async_interleave_many->add_input(source1);
+  auto cleanup1 = gtl::MakeCleanup([async_interleave_many, source1]() {
+    async_interleave_many->remove_input(source1);
+  });
+  std::shared_ptr<Node> source2 =
+      model::MakeSourceNode({3, "source2", async_interleave_many});
+  async_interleave_many->add_input(source2);
+  auto cleanup2 = gtl::MakeCleanup([async_interleave_many, source2]() {
+    async_interleave_many->remove_input(source2);
+  });
+  source1->add_processing_time(100);
+  source1->record_element();
+  source2->add_processing_time(100);
+  source2->record_element();
+  Model::NodeValues input_times;
+  input_times[kModelInputTimeKey] = 0;
+
+  const double full_cycle_output_time =
+      async_interleave_many->OutputTime(&input_times, nullptr);
+  EXPECT_GT(full_cycle_output_time, 0);
+  // Only one of the two inputs is open at a time, so they are produced one
+  // after the other despite the parallelism of 2.
+  active_cycle_length->value = 1;
+  EXPECT_DOUBLE_EQ(async_interleave_many->OutputTime(&input_times, nullptr),
+                   2 * full_cycle_output_time);
+}
+
 class AsyncKnownRatioTest
     : public ::testing::TestWithParam<std::tuple<int64_t, double, int64_t>> {};
 
@@ -1466,6 +1523,40 @@ TEST(ModelTest, ModelCollectAndDestroyRaceCondition) {
   threads.Schedule([&]() { delete model; });
 }
 
+TEST(RamBudgetManagerTest, MemoryLimit) {
+  RamBudgetManager ram_budget_manager(/*budget=*/100, /*memory_limit=*/50);
+  EXPECT_EQ(ram_budget_manager.AvailableModelRam(), 50);
+  ram_budget_manager.UpdateBudget(200);
+  EXPECT_EQ(ram_budget_manager.AvailableModelRam(), 50);
+
+  ram_budget_manager.RecordBufferedBytes(30);
+  EXPECT_FALSE(ram_budget_manager.MemoryLimitReached());
+  ram_budget_manager.RecordBufferedBytes(30);
+  EXPECT_TRUE(ram_budget_manager.MemoryLimitReached());
+  ram_budget_manager.RecordBufferedBytes(-40);
+  EXPECT_FALSE(ram_budget_manager.MemoryLimitReached());
+  EXPECT_EQ(ram_budget_manager.buffered_bytes(), 20);
+  EXPECT_EQ(ram_budget_manager.peak_buffered_bytes(), 60);
+}
+
+TEST(RamBudgetManagerTest, NoMemoryLimit) {
+  RamBudgetManager ram_budget_manager(/*budget=*/100);
+  ram_budget_manager.RecordBufferedBytes(1000);
+  EXPECT_FALSE(ram_budget_manager.MemoryLimitReached());
+  EXPECT_EQ(ram_budget_manager.AvailableModelRam(), 100);
+}
+
+TEST(RamBudgetManagerTest, PeakWithoutMemoryLimit) {
+  RamBudgetManager ram_budget_manager(/*budget=*/100);
+  ram_budget_manager.RecordBufferedBytes(1000);
+  ram_budget_manager.RecordBufferedBytes(-400);
+  EXPECT_EQ(ram_budget_manager.peak_buffered_bytes(), 1000);
+  ram_budget_manager.RecordBufferedBytes(500);
+  ram_budget_manager.RecordBufferedBytes(-1100);
+  EXPECT_EQ(ram_budget_manager.buffered_bytes(), 0);
+  EXPECT_EQ(ram_budget_manager.peak_buffered_bytes(), 1100);
+}
+
 class ModelTimingTest : public ::testing::Test {
  public:
   // Builds a Model from its text proto.
@@ -3158,6 +3249,78 @@ TEST_F(ModelTimingTest, OptimizeStageBased_PipelineRatioLessThanOne) {
   EXPECT_EQ(14, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
 }
 
+TEST_F(ModelTimingTest, OptimizeSharedCpuBudget_CappedByHostBudget) {
+  const std::string lease_dir =
+      io::JoinPath(::testing::TempDir(), "shared_cpu_budget_leases");
+  setenv("TF_DATA_CPU_BUDGET_LEASE_DIR", lease_dir.c_str(), /*overwrite=*/1);
+  setenv("TF_DATA_HOST_CPU_BUDGET", "2", /*overwrite=*/1);
+  BuildModelFromProto(R"pb(
+    nodes: {
+      key: 1
+      value: {
+        id: 1
+        name: "ParallelMapV2"
+        autotune: true
+        num_elements: 97
+        buffered_elements: 3
+        processing_time: 5000
+        bytes_produced: 10000
+        node_class: ASYNC_KNOWN_RATIO
+        ratio: 1
+        inputs: 2
+        parameters: {
+          name: "parallelism"
+          value: 4
+          min: 1
+          max: 16
+          tunable: true
+        }
+      }
+    }
+    nodes: {
+      key: 2
+      value: {
+        id: 2
+        name: "Map"
+        autotune: true
+        num_elements: 100
+        processing_time: 3000
+        node_class: KNOWN_RATIO
+        ratio: 1
+        inputs: 3
+      }
+    }
+    nodes: {
+      key: 3
+      value: {
+        id: 3
+        name: "SSTable"
+        autotune: true
+        num_elements: 100
+        processing_time: 1000
+        node_class: KNOWN_RATIO
+      }
+    }
+    output: 1
+  )pb");
+
+  CancellationManager cancellation_manager;
+  RamBudgetManager ram_budget_manager(0);
+  model_->Optimize(AutotuneAlgorithm::SHARED_CPU_BUDGET, CpuBudgetFunc(20),
+                   /*ram_budget_share=*/1.0,
+                   /*fixed_ram_budget=*/1000000,
+                   /*model_input_time=*/0, ram_budget_manager,
+                   &cancellation_manager);
+  EXPECT_EQ(2, GetNode(/*node_id=*/1)->parameter_value("parallelism"));
+
+  // Destroying the model releases its lease.
+  model_.reset();
+  std::vector<std::string> leases;
+  TF_ASSERT_OK(Env::Default()->GetChildren(lease_dir, &leases));
+  EXPECT_THAT(leases, ::testing::Not(::testing::Contains(
+                          ::testing::EndsWith(".lease"))));
+}
+
 TEST_F(ModelTimingTest, ComputeTargetTime) {
   model_ = std::make_unique<Model>();
 
@@ -3695,6 +3858,62 @@ TEST(NodeTest, TotalMaximumBufferedBytesNoValueWhenElementSizeNotProvided) {
   EXPECT_EQ(root->TotalMaximumBufferedBytes(), 0.);
 }
 
+HostCpuBudgetCoordinator::Demand MakeDemand(int64_t min_threads,
+                                            std::vector<double> throughput) {
+  HostCpuBudgetCoordinator::Demand demand;
+  demand.min_threads = min_threads;
+  demand.throughput = std::move(throughput);
+  return demand;
+}
+
+TEST(HostCpuBudgetCoordinatorTest, SplitFavorsLargestGains) {
+  // The first pipeline gains 0.25 per thread up to 4 threads; the second one
+  // gains 0.5 from its second thread and nothing after.
+  std::vector<HostCpuBudgetCoordinator::Demand> demands = {
+      MakeDemand(1, {0.25, 0.5, 0.75, 1.0}), MakeDemand(1, {0.5, 1.0})};
+  EXPECT_THAT(HostCpuBudgetCoordinator::Split(/*cpu_budget=*/3, demands),
+              ::testing::ElementsAre(1, 2));
+  EXPECT_THAT(HostCpuBudgetCoordinator::Split(/*cpu_budget=*/4, demands),
+              ::testing::ElementsAre(2, 2));
+  // Threads that do not help any pipeline are left unassigned.
+  EXPECT_THAT(HostCpuBudgetCoordinator::Split(/*cpu_budget=*/16, demands),
+              ::testing::ElementsAre(4, 2));
+}
+
+TEST(HostCpuBudgetCoordinatorTest, SplitGivesMinimumWhenOversubscribed) {
+  std::vector<HostCpuBudgetCoordinator::Demand> demands = {
+      MakeDemand(2, {0.5, 1.0}), MakeDemand(3, {0.5, 1.0})};
+  EXPECT_THAT(HostCpuBudgetCoordinator::Split(/*cpu_budget=*/4, demands),
+              ::testing::ElementsAre(2, 3));
+}
+
+TEST(HostCpuBudgetCoordinatorTest, SharesBudgetThroughLeases) {
+  const std::string lease_dir =
+      io::JoinPath(::testing::TempDir(), "cpu_budget_leases");
+  HostCpuBudgetCoordinator coordinator(lease_dir, /*cpu_budget=*/4,
+                                       absl::Minutes(1));
+  const auto first = MakeDemand(1, {0.25, 0.5, 0.75, 1.0});
+  const auto second = MakeDemand(1, {0.5, 1.0});
+  EXPECT_THAT(coordinator.Update("first", first), IsOkAndHolds(4));
+  EXPECT_THAT(coordinator.Update("second", second), IsOkAndHolds(2));
+  EXPECT_THAT(coordinator.Update("first", first), IsOkAndHolds(2));
+  coordinator.Release("second");
+  EXPECT_THAT(coordinator.Update("first", first), IsOkAndHolds(4));
+  coordinator.Release("first");
+}
+
+TEST(HostCpuBudgetCoordinatorTest, IgnoresExpiredLeases) {
+  const std::string lease_dir =
+      io::JoinPath(::testing::TempDir(), "expired_cpu_budget_leases");
+  HostCpuBudgetCoordinator coordinator(lease_dir, /*cpu_budget=*/4,
+                                       absl::Seconds(1));
+  TF_ASSERT_OK(coordinator.Update("stale", MakeDemand(1, {0.5, 1.0})).status());
+  Env::Default()->SleepForMicroseconds(2 * EnvTime::kSecondsToMicros);
+  EXPECT_THAT(coordinator.Update("fresh", MakeDemand(1, {0.25, 0.5, 0.75, 1.0})),
+              IsOkAndHolds(4));
+  coordinator.Release("fresh");
+}
+
 }  // namespace
 }  // namespace model
 }  // namespace data
@@ -624,6 +624,11 @@ class OpKernelContext {
     bool track_allocations = false;
     bool log_memory = false;
 
+    // If not null, serves the allocations with default attributes instead of
+    // the device allocator. Set by executors that plan the memory of a step
+    // (see StaticArenaPlanner).
+    Allocator* planned_allocator = nullptr;
+
     // Array indexed by output number for this node
     const AllocatorAttributes* output_attr_array = nullptr;
 
@@ -20,6 +20,7 @@ limitations under the License.
 #include <algorithm>
 #include <cmath>
 #include <list>
+#include <limits>
 #include <memory>
 
 #include "unsupported/Eigen/CXX11/Tensor"  // from @eigen_archive
@@ -40,6 +41,9 @@ namespace {
 static constexpr int32_t kMaxConcurrentHandlers = 128;
 // LINT.ThenChange(//tensorflow/core/framework/run_handler_test.cc)
 
+// Deadline of the requests without a latency budget.
+static constexpr uint64 kNoDeadline = std::numeric_limits<uint64>::max();
+
 typedef typename internal::RunHandlerEnvironment::Task Task;
 typedef Eigen::RunQueue<Task, 1024> Queue;
 
@@ -166,6 +170,13 @@ Task ThreadWorkSource::EnqueueTask(Task t, bool is_blocking) {
     t = task_queue->PushFront(std::move(t));
   }
 
+  WakeUpWaiter();
+  VLOG(3) << "Added " << (is_blocking ? "inter" : "intra") << " work from "
+          << traceme_id_.load(std::memory_order_relaxed);
+  return t;
+}
+
+void ThreadWorkSource::WakeUpWaiter() {
   Waiter* w = nullptr;
   static const bool use_sub_thread_pool =
       ParamFromEnvBoolWithDefault("TF_RUN_HANDLER_USE_SUB_THREAD_POOL", false);
@@ -211,9 +222,6 @@ Task ThreadWorkSource::EnqueueTask(Task t, bool is_blocking) {
     // period of time in case a notification is missed.
     w->cv.notify_one();
   }
-  VLOG(3) << "Added " << (is_blocking ? "inter" : "intra") << " work from "
-          << traceme_id_.load(std::memory_order_relaxed);
-  return t;
 }
 
 Task ThreadWorkSource::PopBlockingTask() {
@@ -400,6 +408,67 @@ void RunHandlerThreadPool::AddWorkToQueue(ThreadWorkSource* tws,
   }
 }
 
+void RunHandlerThreadPool::AddWorkToLocalQueue(ThreadWorkSource* tws,
+                                               std::function<void()> fn) {
+  const PerThread* pt = GetPerThread();
+  if (pt->pool != this || pt->thread_id >= num_blocking_threads_) {
+    AddWorkToQueue(tws, /*is_blocking=*/true, std::move(fn));
+    return;
+  }
+  ThreadData& data = thread_data_[pt->thread_id];
+  // The local queue holds the tasks of one request at a time, so that the
+  // thread can check the rank of that request before draining it.
+  if (!data.local_queue.Empty() &&
+      data.local_work_source.load(std::memory_order_relaxed) != tws) {
+    AddWorkToQueue(tws, /*is_blocking=*/true, std::move(fn));
+    return;
+  }
+  data.local_work_source.store(tws, std::memory_order_relaxed);
+  // The task may be stolen by any blocking thread, so it tracks the inflight
+  // count of its request itself.
+  Task t = env_.CreateTask([tws, fn = std::move(fn)]() {
+    tws->IncrementInflightTaskCount(/*is_blocking=*/true);
+    fn();
+    tws->DecrementInflightTaskCount(/*is_blocking=*/true);
+  });
+  t = data.local_queue.PushFront(std::move(t));
+  if (t.f) {
+    // The local queue is full.
+    env_.ExecuteTask(t);
+    return;
+  }
+  // Lets an idle thread steal the task if this one stays busy.
+  tws->WakeUpWaiter();
+}
+
+bool RunHandlerThreadPool::LocalWorkHasPriority(
+    int thread_id,
+    const Eigen::MaxSizeVector<ThreadWorkSource*>& thread_work_sources) {
+  const ThreadWorkSource* local_work_source =
+      thread_data_[thread_id].local_work_source.load(std::memory_order_relaxed);
+  for (int i = 0; i < thread_work_sources.size(); ++i) {
+    if (thread_work_sources[i] == local_work_source) {
+      return true;
+    }
+    if (thread_work_sources[i]->TaskQueueSize(/*is_blocking=*/true) > 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Task RunHandlerThreadPool::StealLocalTask(int thread_id) {
+  for (int i = 1; i < num_blocking_threads_; ++i) {
+    Task t =
+        thread_data_[(thread_id + i) % num_blocking_threads_].local_queue
+            .PopBack();
+    if (t.f) {
+      return t;
+    }
+  }
+  return Task();
+}
+
 // TODO(donglin) Change the task steal order to be round-robin such that if
 // an attempt to steal task from request i failed, then attempt to steal task
 // from the next request in terms of the arrival time. This approach may
@@ -550,6 +619,17 @@ void RunHandlerThreadPool::WorkerLoop(int thread_id,
     }
     Eigen::MaxSizeVector<ThreadWorkSource*>* thread_work_sources =
         thread_data_[thread_id].current_thread_work_sources.get();
+    if (may_steal_blocking_work &&
+        LocalWorkHasPriority(thread_id, *thread_work_sources)) {
+      // The tasks pushed by this thread come first, the most recent first,
+      // since their inputs are likely to still be in cache, unless a request
+      // ranked before theirs has queued inter-op tasks.
+      t = thread_data_[thread_id].local_queue.PopFront();
+      if (t.f) {
+        env_.ExecuteTask(t);
+        continue;
+      }
+    }
     if (use_sub_thread_pool_) {
       sub_thread_pool_id = thread_data_[thread_id].sub_thread_pool_id;
       int active_requests = thread_work_sources->size();
@@ -622,6 +702,13 @@ void RunHandlerThreadPool::WorkerLoop(int thread_id,
         }
       }
     }
+    if (!t.f && may_steal_blocking_work) {
+      t = StealLocalTask(thread_id);
+      if (t.f) {
+        env_.ExecuteTask(t);
+        continue;
+      }
+    }
     if (t.f) {
       tsl::profiler::TraceMe activity(
           [=] {
@@ -737,11 +824,16 @@ class RunHandler::Impl {
   // requested via RunHandlerPool::Get().
   uint64 start_time_us() const { return start_time_us_; }
   int64_t step_id() const { return step_id_; }
+  // Time (in microseconds since unix epoch) by which the request should
+  // complete, or kNoDeadline if it has no latency budget.
+  uint64 deadline_us() const { return deadline_us_; }
   void ScheduleInterOpClosure(std::function<void()> fn);
+  void ScheduleLocalInterOpClosure(std::function<void()> fn);
   void ScheduleIntraOpClosure(std::function<void()> fn);
 
   void Reset(int64_t step_id,
-             const RunOptions::Experimental::RunHandlerPoolOptions& options);
+             const RunOptions::Experimental::RunHandlerPoolOptions& options,
+             uint64 deadline_us = kNoDeadline);
 
   RunHandlerPool::Impl* pool_impl() { return pool_impl_; }
 
@@ -765,6 +857,7 @@ class RunHandler::Impl {
 
   RunHandlerPool::Impl* pool_impl_;  // NOT OWNED.
   uint64 start_time_us_;
+  uint64 deadline_us_;
   int64_t step_id_;
   std::unique_ptr<thread::ThreadPoolInterface> thread_pool_interface_;
   internal::ThreadWorkSource tws_;
@@ -845,6 +938,10 @@ class RunHandlerPool::Impl {
     uint64 version;
     int num_active_requests;
     RunHandler::Impl* handler_impl;
+    const uint64 deadline_us =
+        options.latency_budget_ms() > 0
+            ? EnvTime::NowMicros() + options.latency_budget_ms() * 1000
+            : kNoDeadline;
     {
       mutex_lock l(mu_);
       if (!has_free_handler()) {
@@ -858,28 +955,49 @@ class RunHandlerPool::Impl {
             strings::StrCat("RunHandlerPool::Impl::Get waiting for a handler "
                             "with timeout in millisecond",
                             timeout_in_ms));
-        if (timeout_in_ms == 0) {
+        uint64 wait_deadline_ns =
+            deadline_us == kNoDeadline ? 0 : deadline_us * 1000;
+        if (timeout_in_ms > 0) {
+          const uint64 timeout_ns =
+              EnvTime::NowNanos() + timeout_in_ms * 1000 * 1000;
+          if (wait_deadline_ns == 0 || timeout_ns < wait_deadline_ns) {
+            wait_deadline_ns = timeout_ns;
+          }
+        }
+        if (wait_deadline_ns == 0) {
           mu_.Await(Condition(this, &Impl::has_free_handler));
         } else if (!mu_.AwaitWithDeadline(
                        Condition(this, &Impl::has_free_handler),
-                       EnvTime::NowNanos() + timeout_in_ms * 1000 * 1000)) {
+                       wait_deadline_ns)) {
+          return nullptr;
+        }
+        if (EnvTime::NowMicros() >= deadline_us) {
+          // The request cannot meet its deadline anymore, so it leaves the
+          // handler to a request that can.
+          VLOG(1) << "Dropping request " << step_id
+                  << " that missed its deadline while waiting for a handler";
           return nullptr;
         }
       }
       // Remove the last entry from free_handlers_ and add to the end of
       // sorted_active_handlers_.
       handler_impl = free_handlers_.back();
-      handler_impl->Reset(step_id, options);
+      handler_impl->Reset(step_id, options, deadline_us);
       free_handlers_.pop_back();
 
       num_active_requests = sorted_active_handlers_.size() + 1;
       thread_work_sources->resize(num_active_requests);
+      // Handlers are sorted by decreasing priority and, among handlers with
+      // the same priority, by increasing deadline, i.e. by increasing slack.
       int priority = options.priority();
       auto it = sorted_active_handlers_.cbegin();
       bool new_handler_inserted = false;
       for (int i = 0; i < num_active_requests; ++i) {
-        if (!new_handler_inserted && (it == sorted_active_handlers_.cend() ||
-                                      priority > (*it)->priority())) {
+        if (!new_handler_inserted &&
+            (it == sorted_active_handlers_.cend() ||
+             priority > (*it)->priority() ||
+             (priority == (*it)->priority() &&
+              deadline_us < (*it)->deadline_us()))) {
           sorted_active_handlers_.insert(it, handler_impl);
           new_handler_inserted = true;
           // Point to the newly added handler.
@@ -935,6 +1053,16 @@ class RunHandlerPool::Impl {
     return ret;
   }
 
+  std::vector<int64_t> GetActiveHandlerStepIdsForTesting()
+      TF_LOCKS_EXCLUDED(mu_) {
+    mutex_lock l(mu_);
+    std::vector<int64_t> ret;
+    for (const auto& handler_impl : sorted_active_handlers_) {
+      ret.push_back(handler_impl->step_id());
+    }
+    return ret;
+  }
+
  private:
   void RecomputePoolStats(
       int num_active_requests, uint64 version,
@@ -1069,6 +1197,12 @@ void RunHandler::Impl::ScheduleInterOpClosure(std::function<void()> fn) {
                                                         std::move(fn));
 }
 
+void RunHandler::Impl::ScheduleLocalInterOpClosure(std::function<void()> fn) {
+  VLOG(3) << "Scheduling local inter work for " << tws()->GetTracemeId();
+  pool_impl_->run_handler_thread_pool()->AddWorkToLocalQueue(tws(),
+                                                             std::move(fn));
+}
+
 void RunHandler::Impl::ScheduleIntraOpClosure(std::function<void()> fn) {
   VLOG(3) << "Scheduling intra work for " << tws()->GetTracemeId();
   pool_impl_->run_handler_thread_pool()->AddWorkToQueue(tws(), false,
@@ -1077,8 +1211,10 @@ void RunHandler::Impl::ScheduleIntraOpClosure(std::function<void()> fn) {
 
 void RunHandler::Impl::Reset(
     int64_t step_id,
-    const RunOptions::Experimental::RunHandlerPoolOptions& options) {
+    const RunOptions::Experimental::RunHandlerPoolOptions& options,
+    uint64 deadline_us) {
   start_time_us_ = tensorflow::Env::Default()->NowMicros();
+  deadline_us_ = deadline_us;
   step_id_ = step_id;
   options_ = options;
   tws_.SetTracemeId(step_id);
@@ -1104,12 +1240,21 @@ std::vector<int64_t> RunHandlerPool::GetActiveHandlerPrioritiesForTesting()
   return impl_->GetActiveHandlerPrioritiesForTesting();
 }
 
+std::vector<int64_t> RunHandlerPool::GetActiveHandlerStepIdsForTesting()
+    const {
+  return impl_->GetActiveHandlerStepIdsForTesting();
+}
+
 RunHandler::RunHandler(Impl* impl) : impl_(impl) {}
 
 void RunHandler::ScheduleInterOpClosure(std::function<void()> fn) {
   impl_->ScheduleInterOpClosure(std::move(fn));
 }
 
+void RunHandler::ScheduleLocalInterOpClosure(std::function<void()> fn) {
+  impl_->ScheduleLocalInterOpClosure(std::move(fn));
+}
+
 thread::ThreadPoolInterface* RunHandler::AsIntraThreadPoolInterface() {
   return impl_->thread_pool_interface();
 }
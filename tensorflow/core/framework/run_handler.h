@@ -62,7 +62,9 @@ class RunHandlerPool {
   // and is being used by a client.  It becomes 'inactive' once more when the
   // unique_ptr is destroyed.
   //
-  // Will block unless there is an inactive handler.
+  // Will block unless there is an inactive handler. Returns nullptr if
+  // `timeout_in_ms` is positive and elapses first, or if the latency budget
+  // in `options` runs out before a handler is available.
   std::unique_ptr<RunHandler> Get(
       int64_t step_id = 0, int64_t timeout_in_ms = 0,
       const RunOptions::Experimental::RunHandlerPoolOptions& options =
@@ -72,6 +74,10 @@ class RunHandlerPool {
   // order of the active handler list.
   std::vector<int64_t> GetActiveHandlerPrioritiesForTesting() const;
 
+  // Get the step ids of the active handlers, in the order of the active
+  // handler list.
+  std::vector<int64_t> GetActiveHandlerStepIdsForTesting() const;
+
  private:
   class Impl;
   friend class RunHandler;
@@ -94,6 +100,14 @@ class RunHandlerPool {
 class RunHandler {
  public:
   void ScheduleInterOpClosure(std::function<void()> fn);
+  // Like ScheduleInterOpClosure, but if called from an inter-op thread of the
+  // pool, e.g. by a closure that just ran a node, pushes `fn` to the local
+  // queue of that thread. A local queue holds the closures of one handler at a
+  // time. A thread runs them, the most recent first, before looking for other
+  // work, unless a handler ranked before theirs has queued inter-op closures.
+  // Idle threads steal the oldest closures from the local queues of other
+  // threads.
+  void ScheduleLocalInterOpClosure(std::function<void()> fn);
   thread::ThreadPoolInterface* AsIntraThreadPoolInterface();
 
   ~RunHandler();
@@ -166,6 +180,9 @@ class ThreadWorkSource {
 
   Task PopNonBlockingTask(int start_index, bool search_from_all_queue);
 
+  // Wakes up one of the threads waiting for work, if any.
+  void WakeUpWaiter();
+
   void WaitForWork(int max_sleep_micros);
 
   int TaskQueueSize(bool is_blocking);
@@ -235,6 +252,11 @@ class RunHandlerThreadPool {
   void AddWorkToQueue(ThreadWorkSource* tws, bool is_blocking,
                       std::function<void()> fn);
 
+  // Pushes the inter-op closure `fn` of `tws` to the local queue of the
+  // current thread if it is a blocking thread of this pool, and to the queue
+  // of `tws` otherwise.
+  void AddWorkToLocalQueue(ThreadWorkSource* tws, std::function<void()> fn);
+
   // Set work queues from which the thread 'tid' can steal its work.
   // The request with start_request_idx will be attempted first. Other requests
   // will be attempted in FIFO order based on their arrival time.
@@ -270,6 +292,16 @@ class RunHandlerThreadPool {
   void WaitForWorkInSubThreadPool(bool is_blocking, int sub_thread_pool_id);
 
  private:
+  // Returns true if no request ranked before the request of the local queue of
+  // `thread_id` in `thread_work_sources` has queued inter-op tasks.
+  bool LocalWorkHasPriority(
+      int thread_id,
+      const Eigen::MaxSizeVector<ThreadWorkSource*>& thread_work_sources);
+
+  // Steals the oldest task of the local queue of a blocking thread other than
+  // `thread_id`.
+  Task StealLocalTask(int thread_id);
+
   struct ThreadData {
     ThreadData();
     mutex mu;
@@ -286,6 +318,13 @@ class RunHandlerThreadPool {
         current_thread_work_sources;
 
     int sub_thread_pool_id;
+
+    // Inter-op tasks pushed by this thread. Only this thread pushes and pops
+    // at the front; other threads steal from the back.
+    Queue local_queue;
+    // The request of the tasks in `local_queue`. Only compared, never
+    // dereferenced.
+    std::atomic<ThreadWorkSource*> local_work_source{nullptr};
   };
 
   const int num_threads_;
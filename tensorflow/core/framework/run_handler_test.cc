@@ -17,6 +17,8 @@ limitations under the License.
 
 #include "tensorflow/core/framework/run_handler.h"
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -28,11 +30,14 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/graph/testlib.h"
+#include "tensorflow/core/lib/histogram/histogram.h"
 #include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/blocking_counter.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 #include "tensorflow/core/public/session.h"
 #include "tensorflow/core/public/session_options.h"
 
@@ -113,6 +118,39 @@ TEST(RunHandlerUtilTest, PrioritySchedulingTest) {
   EXPECT_EQ(sorted_active_list[3], 1);
 }
 
+TEST(RunHandlerUtilTest, DeadlineSchedulingTest) {
+  int num_threads = 2;
+  std::unique_ptr<RunHandlerPool> pool(
+      new RunHandlerPool(num_threads, num_threads));
+
+  RunOptions::Experimental::RunHandlerPoolOptions options =
+      RunOptions::Experimental::RunHandlerPoolOptions();
+  options.set_priority(1);
+  auto handler1 = pool->Get(/*step_id=*/1, /*timeout_in_ms=*/0, options);
+  options.set_latency_budget_ms(60000);
+  auto handler2 = pool->Get(/*step_id=*/2, /*timeout_in_ms=*/0, options);
+  options.set_latency_budget_ms(10000);
+  auto handler3 = pool->Get(/*step_id=*/3, /*timeout_in_ms=*/0, options);
+  options.set_latency_budget_ms(0);
+  auto handler4 = pool->Get(/*step_id=*/4, /*timeout_in_ms=*/0, options);
+  options.set_priority(2);
+  auto handler5 = pool->Get(/*step_id=*/5, /*timeout_in_ms=*/0, options);
+
+  // The active requests should be ordered by priorities, then by deadlines.
+  // Requests without a latency budget come last, in arrival order.
+  EXPECT_EQ(pool->GetActiveHandlerPrioritiesForTesting(),
+            std::vector<int64_t>({2, 1, 1, 1, 1}));
+  EXPECT_EQ(pool->GetActiveHandlerStepIdsForTesting(),
+            std::vector<int64_t>({5, 3, 2, 1, 4}));
+
+  handler3.reset();
+  options.set_priority(1);
+  options.set_latency_budget_ms(30000);
+  auto handler6 = pool->Get(/*step_id=*/6, /*timeout_in_ms=*/0, options);
+  EXPECT_EQ(pool->GetActiveHandlerStepIdsForTesting(),
+            std::vector<int64_t>({5, 6, 2, 1, 4}));
+}
+
 TEST(RunHandlerThreadPool, EnqueueTask) {
   Eigen::MaxSizeVector<mutex> waiters_mu(2);
   waiters_mu.resize(2);
@@ -495,6 +533,60 @@ TEST(RunHandlerThreadPool, RoundRobinExecution) {
   delete run_handler_thread_pool;
 }
 
+TEST(RunHandlerThreadPool, LocalQueueYieldsToHigherRankedRequest) {
+  setenv("TF_RUN_HANDLER_USE_SUB_THREAD_POOL", "false", true);
+
+  Eigen::MaxSizeVector<mutex> waiters_mu(1);
+  waiters_mu.resize(1);
+  Eigen::MaxSizeVector<internal::Waiter> waiters(1);
+  waiters.resize(1);
+  auto run_handler_thread_pool =
+      std::make_unique<internal::RunHandlerThreadPool>(
+          /*num_blocking_threads=*/1, /*num_non_blocking_threads=*/0,
+          Env::Default(), ThreadOptions(), "tf_run_handler_pool", &waiters_mu,
+          &waiters);
+  // Request 0 is ranked before request 1.
+  Eigen::MaxSizeVector<internal::ThreadWorkSource*> thread_work_sources(2);
+  thread_work_sources.resize(2);
+  internal::ThreadWorkSource tws[2];
+  for (int i = 0; i < 2; ++i) {
+    tws[i].SetWaiter(1, &waiters[0], &waiters_mu[0]);
+    thread_work_sources[i] = &tws[i];
+  }
+
+  mutex mu;
+  std::vector<string> order;
+  BlockingCounter counter(2);
+  auto record = [&](const string& name) {
+    return [&, name]() {
+      {
+        mutex_lock l(mu);
+        order.push_back(name);
+      }
+      counter.DecrementCount();
+    };
+  };
+  // A closure of request 1 running on the pool thread pushes a successor to
+  // the local queue, then request 0 gets a closure.
+  run_handler_thread_pool->AddWorkToQueue(
+      &tws[1], /*is_blocking=*/true, [&]() {
+        run_handler_thread_pool->AddWorkToLocalQueue(&tws[1],
+                                                     record("local"));
+        run_handler_thread_pool->AddWorkToQueue(&tws[0], /*is_blocking=*/true,
+                                                record("ranked_first"));
+      });
+  run_handler_thread_pool->Start();
+  run_handler_thread_pool->SetThreadWorkSources(
+      /*tid=*/0, /*start_request_idx=*/0, /*version=*/1, thread_work_sources);
+  counter.Wait();
+  {
+    mutex_lock l(mu);
+    EXPECT_EQ(order, std::vector<string>({"ranked_first", "local"}));
+  }
+  // Stops the pool thread before the work sources are destroyed.
+  run_handler_thread_pool.reset();
+}
+
 TEST(RunHandlerThreadPool, MultipleSubThreadPool) {
   // Set up environment for 2 sub thread pools.
   setenv("TF_RUN_HANDLER_USE_SUB_THREAD_POOL", "true", true);
@@ -811,5 +903,111 @@ TEST_F(RunHandlerTest, TestWaitTimeout) {
   EXPECT_NE(next_handle.get(), nullptr);
 }
 
+TEST_F(RunHandlerTest, TestDropRequestAfterDeadline) {
+  std::unique_ptr<RunHandlerPool> pool(new RunHandlerPool(1, 1));
+
+  // Get all the handlers in the pool.
+  std::vector<std::unique_ptr<RunHandler>> blocking_handles;
+  const int32_t kMaxConcurrentHandlers = 128;  // Copied from run_handler.cc.
+  blocking_handles.reserve(kMaxConcurrentHandlers);
+  for (int i = 0; i < kMaxConcurrentHandlers; ++i) {
+    blocking_handles.push_back(pool->Get(i));
+  }
+
+  // A subsequent request without a timeout is dropped once its latency budget
+  // runs out.
+  RunOptions::Experimental::RunHandlerPoolOptions options;
+  options.set_latency_budget_ms(1);
+  auto null_handle = pool->Get(128, 0, options);
+  EXPECT_EQ(null_handle.get(), nullptr);
+
+  // A request with a latency budget succeeds if a handler is free.
+  blocking_handles[0].reset();
+  auto next_handle = pool->Get(129, 0, options);
+  EXPECT_NE(next_handle.get(), nullptr);
+}
+
+// Issues a mix of batch requests, which run many closures and have no latency
+// budget, and of latency-critical requests, which run a few closures, with the
+// same priority, and reports the median and tail latencies of each kind of
+// request. With `state.range(0)` set, the latency-critical requests have a
+// latency budget, so that their closures are picked ahead of those of the
+// batch requests.
+void BM_MixedWorkloadLatency(::testing::benchmark::State& state) {
+  const bool use_deadlines = state.range(0) != 0;
+  constexpr int kNumThreads = 4;
+  constexpr int kNumBatchRequests = 8;
+  constexpr int kNumBatchClosures = 256;
+  constexpr int kNumCriticalRequests = 8;
+  constexpr int kNumCriticalClosures = 4;
+  constexpr int64_t kLatencyBudgetMs = 1000;
+  constexpr uint64 kClosureMicros = 20;
+
+  RunHandlerPool pool(kNumThreads, kNumThreads);
+  thread::ThreadPool clients(Env::Default(), "clients",
+                             kNumBatchRequests + kNumCriticalRequests);
+  mutex mu;
+  histogram::Histogram batch_latency_ms;
+  histogram::Histogram critical_latency_ms;
+  std::atomic<int64_t> num_dropped{0};
+  std::atomic<int64_t> step_id{0};
+
+  auto run_request = [&](bool critical) {
+    RunOptions::Experimental::RunHandlerPoolOptions options;
+    if (critical && use_deadlines) {
+      options.set_latency_budget_ms(kLatencyBudgetMs);
+    }
+    const uint64 start_us = EnvTime::NowMicros();
+    auto handler = pool.Get(step_id.fetch_add(1), 0, options);
+    if (handler == nullptr) {
+      num_dropped.fetch_add(1);
+      return;
+    }
+    const int num_closures =
+        critical ? kNumCriticalClosures : kNumBatchClosures;
+    BlockingCounter done(num_closures);
+    for (int i = 0; i < num_closures; ++i) {
+      handler->ScheduleInterOpClosure([&done]() {
+        const uint64 closure_start_us = EnvTime::NowMicros();
+        while (EnvTime::NowMicros() - closure_start_us < kClosureMicros) {
+        }
+        done.DecrementCount();
+      });
+    }
+    done.Wait();
+    handler.reset();
+    const double latency_ms = (EnvTime::NowMicros() - start_us) / 1000.0;
+    mutex_lock l(mu);
+    (critical ? critical_latency_ms : batch_latency_ms).Add(latency_ms);
+  };
+
+  for (auto s : state) {
+    BlockingCounter requests_done(kNumBatchRequests + kNumCriticalRequests);
+    for (int i = 0; i < kNumBatchRequests; ++i) {
+      clients.Schedule([&]() {
+        run_request(/*critical=*/false);
+        requests_done.DecrementCount();
+      });
+    }
+    for (int i = 0; i < kNumCriticalRequests; ++i) {
+      clients.Schedule([&]() {
+        // Arrives while the batch requests are running.
+        Env::Default()->SleepForMicroseconds(500);
+        run_request(/*critical=*/true);
+        requests_done.DecrementCount();
+      });
+    }
+    requests_done.Wait();
+  }
+
+  state.SetLabel(use_deadlines ? "deadlines" : "no deadlines");
+  state.counters["batch_p50_ms"] = batch_latency_ms.Median();
+  state.counters["batch_p99_ms"] = batch_latency_ms.Percentile(99);
+  state.counters["critical_p50_ms"] = critical_latency_ms.Median();
+  state.counters["critical_p99_ms"] = critical_latency_ms.Percentile(99);
+  state.counters["dropped"] = num_dropped.load();
+}
+BENCHMARK(BM_MixedWorkloadLatency)->UseRealTime()->Arg(0)->Arg(1);
+
 }  // namespace
 }  // namespace tensorflow
@@ -50,14 +50,17 @@ namespace data {
 /* static */ constexpr const char* const BatchDatasetOp::kParallelCopy;
 /* static */ constexpr const char* const BatchDatasetOp::kOutputTypes;
 /* static */ constexpr const char* const BatchDatasetOp::kOutputShapes;
+/* static */ constexpr const char* const BatchDatasetOp::kRaggedDatasetType;
 
 constexpr char kInputImplEmpty[] = "input_impl_empty";
 constexpr char kBatchDataset[] = "BatchDataset";
+constexpr char kRaggedBatchDataset[] = "RaggedBatchDataset";
 
 class BatchDatasetOp::Dataset : public DatasetBase {
  public:
   Dataset(OpKernelContext* ctx, int64_t batch_size, bool drop_remainder,
-          bool parallel_copy, const DatasetBase* input, int op_version)
+          bool parallel_copy, bool ragged, const DatasetBase* input,
+          int op_version)
       : DatasetBase(DatasetContext(ctx)),
         batch_size_(batch_size),
         // Dataset batch is sometimes used to stack all elements in the
@@ -68,6 +71,7 @@ class BatchDatasetOp::Dataset : public DatasetBase {
                                      : std::min<int64_t>(batch_size, 1 << 16)),
         drop_remainder_(drop_remainder),
         parallel_copy_(parallel_copy),
+        ragged_(ragged),
         input_(input),
         op_version_(op_version),
         traceme_metadata_(
@@ -81,9 +85,23 @@ class BatchDatasetOp::Dataset : public DatasetBase {
     // we could tell statically that the input dataset is infinite,
     // then we could always report `batch_size` as the 0th dimension.
     const auto& input_shapes = input_->output_shapes();
+    const bool known_batch_size =
+        drop_remainder_ || input_->Cardinality() == kInfiniteCardinality;
     output_shapes_.reserve(input_shapes.size());
-    for (const auto& input_shape : input_shapes) {
-      if (drop_remainder_ || input_->Cardinality() == kInfiniteCardinality) {
+    for (size_t i = 0; i < input_shapes.size(); ++i) {
+      const PartialTensorShape& input_shape = input_shapes[i];
+      ragged_components_.push_back(ragged_ && input_shape.dims() >= 1);
+      output_dtypes_.push_back(input_->output_dtypes()[i]);
+      if (ragged_components_.back()) {
+        // Ragged components are output as `values` followed by `row_splits`.
+        PartialTensorShape row_shape(input_shape);
+        row_shape.RemoveDim(0);
+        output_shapes_.push_back(
+            PartialTensorShape({-1}).Concatenate(row_shape));
+        output_dtypes_.push_back(DT_INT64);
+        output_shapes_.push_back(
+            PartialTensorShape({known_batch_size ? batch_size_ + 1 : -1}));
+      } else if (known_batch_size) {
         output_shapes_.emplace_back(
             PartialTensorShape({batch_size_}).Concatenate(input_shape));
       } else {
@@ -113,7 +131,7 @@ class BatchDatasetOp::Dataset : public DatasetBase {
   }
 
   const DataTypeVector& output_dtypes() const override {
-    return input_->output_dtypes();
+    return output_dtypes_;
   }
 
   const std::vector<PartialTensorShape>& output_shapes() const override {
@@ -124,7 +142,8 @@ class BatchDatasetOp::Dataset : public DatasetBase {
     name_utils::DatasetDebugStringParams params;
     params.op_version = op_version_;
     params.set_args(batch_size_);
-    return name_utils::DatasetDebugString(kDatasetType, params);
+    return name_utils::DatasetDebugString(
+        ragged_ ? kRaggedDatasetType : kDatasetType, params);
   }
 
   int64_t CardinalityInternal(CardinalityOptions options) const override {
@@ -161,8 +180,8 @@ class BatchDatasetOp::Dataset : public DatasetBase {
       TF_RETURN_IF_ERROR(input_->Get(ctx, i, &batch_element_tuple));
       batch_elements.emplace_back(std::move(batch_element_tuple));
     }
-    TF_RETURN_IF_ERROR(CopyBatch(AnyContext(ctx), std::move(batch_elements),
-                                 parallel_copy_, out_tensors));
+    TF_RETURN_IF_ERROR(
+        CopyElements(AnyContext(ctx), std::move(batch_elements), out_tensors));
     return absl::OkStatus();
   }
 
@@ -249,8 +268,8 @@ class BatchDatasetOp::Dataset : public DatasetBase {
       // respective slice locations. This would require a different GetNext()
       // overload that supports zero-copy, and might make sense in an
       // optimization pass.
-      TF_RETURN_IF_ERROR(CopyBatch(AnyContext(ctx), std::move(batch_elements),
-                                   dataset()->parallel_copy_, out_tensors));
+      TF_RETURN_IF_ERROR(dataset()->CopyElements(
+          AnyContext(ctx), std::move(batch_elements), out_tensors));
 
       *end_of_sequence = false;
       return absl::OkStatus();
@@ -324,12 +343,30 @@ class BatchDatasetOp::Dataset : public DatasetBase {
     std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_);
   };
 
+  // Copies `batch_elements` into one batch, or into `values` and `row_splits`
+  // for the ragged components.
+  absl::Status CopyElements(AnyContext ctx,
+                            std::vector<std::vector<Tensor>>&& batch_elements,
+                            std::vector<Tensor>* out_tensors) const {
+    if (ragged_) {
+      return CopyRaggedBatch(ctx, std::move(batch_elements), ragged_components_,
+                             parallel_copy_, out_tensors);
+    }
+    return CopyBatch(ctx, std::move(batch_elements), parallel_copy_,
+                     out_tensors);
+  }
+
   const int64_t batch_size_;
   const int64_t reserve_size_;
   const bool drop_remainder_;
   const bool parallel_copy_;
+  const bool ragged_;
   const DatasetBase* const input_;
   const int op_version_;
+  // `ragged_components_[i]` is set if component `i` of the input is batched as
+  // a ragged tensor.
+  std::vector<bool> ragged_components_;
+  DataTypeVector output_dtypes_;
   std::vector<PartialTensorShape> output_shapes_;
   absl::Status random_indexing_compatible_;
   const TraceMeMetadata traceme_metadata_;
@@ -337,7 +374,8 @@ class BatchDatasetOp::Dataset : public DatasetBase {
 
 BatchDatasetOp::BatchDatasetOp(OpKernelConstruction* ctx)
     : UnaryDatasetOpKernel(ctx),
-      op_version_(ctx->def().op() == kBatchDataset ? 1 : 2) {
+      op_version_(ctx->def().op() == kBatchDataset ? 1 : 2),
+      ragged_(ctx->def().op() == kRaggedBatchDataset) {
   if (ctx->HasAttr(kParallelCopy)) {
     OP_REQUIRES_OK(ctx, ctx->GetAttr(kParallelCopy, &parallel_copy_));
   }
@@ -357,8 +395,8 @@ void BatchDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
         ctx, ParseScalarArgument<bool>(ctx, kDropRemainder, &drop_remainder));
   }
 
-  *output = new Dataset(ctx, batch_size, drop_remainder, parallel_copy_, input,
-                        op_version_);
+  *output = new Dataset(ctx, batch_size, drop_remainder, parallel_copy_,
+                        ragged_, input, op_version_);
 }
 
 namespace {
@@ -367,6 +405,9 @@ REGISTER_KERNEL_BUILDER(Name("BatchDataset").Device(DEVICE_CPU),
 
 REGISTER_KERNEL_BUILDER(Name("BatchDatasetV2").Device(DEVICE_CPU),
                         BatchDatasetOp);
+
+REGISTER_KERNEL_BUILDER(Name("RaggedBatchDataset").Device(DEVICE_CPU),
+                        BatchDatasetOp);
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
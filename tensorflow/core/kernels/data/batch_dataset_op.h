@@ -29,6 +29,7 @@ class BatchDatasetOp : public UnaryDatasetOpKernel {
   static constexpr const char* const kParallelCopy = "parallel_copy";
   static constexpr const char* const kOutputTypes = "output_types";
   static constexpr const char* const kOutputShapes = "output_shapes";
+  static constexpr const char* const kRaggedDatasetType = "RaggedBatch";
 
   explicit BatchDatasetOp(OpKernelConstruction* ctx);
 
@@ -39,6 +40,9 @@ class BatchDatasetOp : public UnaryDatasetOpKernel {
  private:
   class Dataset;
   const int op_version_;
+  // Set for `RaggedBatchDataset`, which batches the components whose elements
+  // have a first dimension as ragged tensors.
+  const bool ragged_;
   bool parallel_copy_ = false;
 };
 
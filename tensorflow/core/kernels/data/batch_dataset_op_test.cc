@@ -23,6 +23,7 @@ namespace data {
 namespace {
 
 constexpr char kNodeName[] = "batch_dataset";
+constexpr char kRaggedNodeName[] = "ragged_batch_dataset";
 
 class BatchDatasetOpTest : public DatasetOpsTestBase {};
 
@@ -288,6 +289,87 @@ IteratorSaveAndRestoreTestCases() {
 ITERATOR_SAVE_AND_RESTORE_TEST_P(BatchDatasetOpTest, BatchDatasetParams,
                                  IteratorSaveAndRestoreTestCases())
 
+class RaggedBatchDatasetParams : public BatchDatasetParams {
+ public:
+  using BatchDatasetParams::BatchDatasetParams;
+
+  string op_name() const override { return "RaggedBatchDataset"; }
+};
+
+// Batches the variable-length batches of `BatchDatasetParams3()` into ragged
+// tensors.
+RaggedBatchDatasetParams RaggedBatchDatasetParams1() {
+  return RaggedBatchDatasetParams(BatchDatasetParams3(),
+                                  /*batch_size=*/2,
+                                  /*drop_remainder=*/false,
+                                  /*parallel_copy=*/true,
+                                  /*output_dtypes=*/{DT_INT64, DT_INT64},
+                                  /*output_shapes=*/
+                                  {PartialTensorShape({-1}),
+                                   PartialTensorShape({-1})},
+                                  /*node_name=*/kRaggedNodeName);
+}
+
+// Batches strings of a known shape as ragged tensors, and scalars densely.
+RaggedBatchDatasetParams RaggedBatchDatasetParams2() {
+  auto tensor_slice_dataset_params = TensorSliceDatasetParams(
+      /*components=*/{CreateTensor<tstring>(TensorShape({3, 2}),
+                                            {"a", "b", "c", "d", "e", "f"}),
+                      CreateTensor<int64_t>(TensorShape({3}), {1, 2, 3})},
+      /*node_name=*/"tensor_slice");
+  return RaggedBatchDatasetParams(
+      std::move(tensor_slice_dataset_params),
+      /*batch_size=*/2,
+      /*drop_remainder=*/true,
+      /*parallel_copy=*/false,
+      /*output_dtypes=*/{DT_STRING, DT_INT64, DT_INT64},
+      /*output_shapes=*/
+      {PartialTensorShape({-1}), PartialTensorShape({3}),
+       PartialTensorShape({2})},
+      /*node_name=*/kRaggedNodeName);
+}
+
+TEST_F(BatchDatasetOpTest, RaggedBatch) {
+  auto dataset_params = RaggedBatchDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetOutputDtypes({DT_INT64, DT_INT64}));
+  TF_ASSERT_OK(CheckDatasetOutputShapes(
+      {PartialTensorShape({-1}), PartialTensorShape({-1})}));
+  TF_ASSERT_OK(CheckDatasetCardinality(2));
+  TF_ASSERT_OK(CheckIteratorGetNext(
+      {CreateTensor<int64_t>(TensorShape({6}), {0, 1, 2, 3, 4, 5}),
+       CreateTensor<int64_t>(TensorShape({3}), {0, 3, 6}),
+       CreateTensor<int64_t>(TensorShape({4}), {6, 7, 8, 9}),
+       CreateTensor<int64_t>(TensorShape({3}), {0, 3, 4})},
+      /*compare_order=*/true));
+}
+
+TEST_F(BatchDatasetOpTest, RaggedBatchWithDenseComponents) {
+  auto dataset_params = RaggedBatchDatasetParams2();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetOutputDtypes({DT_STRING, DT_INT64, DT_INT64}));
+  TF_ASSERT_OK(CheckDatasetOutputShapes({PartialTensorShape({-1}),
+                                         PartialTensorShape({3}),
+                                         PartialTensorShape({2})}));
+  TF_ASSERT_OK(CheckIteratorGetNext(
+      {CreateTensor<tstring>(TensorShape({4}), {"a", "b", "c", "d"}),
+       CreateTensor<int64_t>(TensorShape({3}), {0, 2, 4}),
+       CreateTensor<int64_t>(TensorShape({2}), {1, 2})},
+      /*compare_order=*/true));
+}
+
+TEST_F(BatchDatasetOpTest, RaggedBatchSaveAndRestore) {
+  auto dataset_params = RaggedBatchDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckIteratorSaveAndRestore(
+      dataset_params.iterator_prefix(),
+      {CreateTensor<int64_t>(TensorShape({6}), {0, 1, 2, 3, 4, 5}),
+       CreateTensor<int64_t>(TensorShape({3}), {0, 3, 6}),
+       CreateTensor<int64_t>(TensorShape({4}), {6, 7, 8, 9}),
+       CreateTensor<int64_t>(TensorShape({3}), {0, 3, 4})},
+      /*breakpoints=*/{0, 1, 3}, /*compare_order=*/true));
+}
+
 TEST_F(BatchDatasetOpTest, InvalidBatchSize) {
   auto batch_dataset_params = InvalidBatchSizeBatchDatasetParams();
   EXPECT_EQ(Initialize(batch_dataset_params).code(),
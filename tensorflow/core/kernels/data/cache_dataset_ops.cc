@@ -28,6 +28,7 @@ limitations under the License.
 #include "tensorflow/core/data/serialization_utils.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/dataset_options.pb.h"
+#include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
@@ -38,6 +39,7 @@ limitations under the License.
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/refcount.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tensorflow/core/util/tensor_bundle/naming.h"
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
@@ -70,12 +72,26 @@ constexpr char kCacheCompleted[] = "cache_completed";
 constexpr char kIndex[] = "index";
 constexpr char kImpl[] = "Impl";
 constexpr char kCacheDataset[] = "CacheDataset";
+constexpr char kFileCacheUseMmapEnvVar[] = "TF_DATA_FILE_CACHE_USE_MMAP";
 constexpr char kIncompleteCacheErrorMessage[] =
     "The calling iterator did not fully read the dataset being cached. In "
     "order to avoid unexpected truncation of the dataset, the partially cached "
     "contents of the dataset  will be discarded. This can happen if you have "
     "an input pipeline similar to `dataset.cache().take(k).repeat()`. You "
     "should use `dataset.take(k).cache().repeat()` instead.";
+
+// Writes the elements of `elements` to the checkpoint one at a time, so that
+// elements spilled to disk are not all read back into memory at once.
+template <typename T>
+absl::Status WriteCachedElementsToCheckpoint(IteratorStateWriter* writer,
+                                             StringPiece key_prefix,
+                                             T& elements) {
+  return WriteElementsToCheckpoint(
+      writer, key_prefix, elements.size(),
+      [&elements](int64_t index, std::vector<Tensor>* element) {
+        return elements.Get(index, element);
+      });
+}
 }  // namespace
 
 class DatasetRandomAccessCache {
@@ -181,6 +197,11 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
                                               tensor_index_padding_size_)) {
     input_->Ref();
     DCHECK_EQ(item_index_padding_size_, 7);
+    absl::Status s =
+        ReadBoolFromEnvVar(kFileCacheUseMmapEnvVar, false, &use_mmap_);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to read " << kFileCacheUseMmapEnvVar << ": " << s;
+    }
   }
 
   ~FileDatasetBase() override { input_->Unref(); }
@@ -235,6 +256,22 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
                            tensor_index);
   }
 
+  // In mmap mode, tensor data is aligned in the cache files so that the reader
+  // can hand out tensors aliasing the mapped pages.
+  BundleWriter::Options WriterOptions() const {
+    BundleWriter::Options options;
+    if (use_mmap_) {
+      options.data_alignment = EIGEN_MAX_ALIGN_BYTES;
+    }
+    return options;
+  }
+
+  BundleReader::Options ReaderOptions() const {
+    BundleReader::Options options;
+    options.use_mmap = use_mmap_;
+    return options;
+  }
+
   class FileIterator : public DatasetIterator<FileDatasetBase> {
    public:
     explicit FileIterator(const Params& params)
@@ -475,7 +512,8 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
         }
         filename_ = strings::StrCat(dataset()->filename_, "_", shard_id_);
         lockfile_ = strings::StrCat(filename_, kLockFileSuffix);
-        writer_ = std::make_unique<BundleWriter>(dataset()->env_, filename_);
+        writer_ = std::make_unique<BundleWriter>(
+            dataset()->env_, filename_, dataset()->WriterOptions());
         return absl::OkStatus();
       }
 
@@ -537,7 +575,8 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
         // conditions are not met since BundleWriter's constructor creates
         // new temp files which can delete the temp files created by a
         // BundleWriter in another Session.
-        writer_ = std::make_unique<BundleWriter>(dataset()->env_, filename_);
+        writer_ = std::make_unique<BundleWriter>(
+            dataset()->env_, filename_, dataset()->WriterOptions());
         lockfile_created_ = true;
         return absl::OkStatus();
       }
@@ -591,7 +630,8 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
       explicit FileReaderIterator(const Params& params)
           : DatasetIterator<FileDatasetBase>(params),
             cur_index_(0),
-            reader_(dataset()->env_, dataset()->filename_),
+            reader_(dataset()->env_, dataset()->filename_,
+                    dataset()->ReaderOptions()),
             iterator_restored_(false) {}
 
       absl::Status GetNextInternal(IteratorContext* ctx,
@@ -707,6 +747,8 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
   };  // FileIterator
 
   Env* const env_;
+  // Whether the cache files are read through memory-mapping.
+  bool use_mmap_ = false;
   const size_t num_tensors_;
   const size_t tensor_index_padding_size_;
   static constexpr size_t kMaxItems = 10000000;  // 10 million
@@ -880,7 +922,7 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       if (cache_->IsCompleted()) {
         TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kCacheCompleted, ""));
         TF_RETURN_IF_ERROR(
-            WriteElementsToCheckpoint(writer, prefix(), cache_->data()));
+            WriteCachedElementsToCheckpoint(writer, prefix(), *cache_));
       }
       TF_RETURN_IF_ERROR(global_shuffle_iterator_.Save(prefix(), ctx, writer));
       return SaveInput(ctx, writer, iterator_);
@@ -895,10 +937,14 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       iterator_.reset();
       cache_->Reset();
       if (reader->Contains(prefix(), kCacheCompleted)) {
-        std::vector<std::vector<Tensor>> temp_cache;
-        TF_RETURN_IF_ERROR(
-            ReadElementsFromCheckpoint(ctx, reader, prefix(), &temp_cache));
-        cache_->Complete(std::move(temp_cache));
+        auto elements = std::make_unique<SpillableElementBuffer>(
+            cache_->options(), ctx->env());
+        TF_RETURN_IF_ERROR(ReadElementsFromCheckpoint(
+            ctx, reader, prefix(), [&elements](std::vector<Tensor> element) {
+              return elements->Append(element);
+            }));
+        TF_RETURN_IF_ERROR(elements->Finalize());
+        cache_->Complete(std::move(elements));
       }
       TF_RETURN_IF_ERROR(InitializeIterator(ctx));
       return RestoreInput(ctx, reader, iterator_);
@@ -912,13 +958,19 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
 
       ~MemoryWriterIterator() override {
         mutex_lock l(mu_);
-        if (!temp_cache_.empty() && !cache_->IsCompleted()) {
+        if (temp_cache_ != nullptr && !temp_cache_->empty() &&
+            !cache_->IsCompleted()) {
           LOG(WARNING) << kIncompleteCacheErrorMessage;
           cache_->Reset();
         }
       }
 
       absl::Status Initialize(IteratorContext* ctx) override {
+        {
+          mutex_lock l(mu_);
+          temp_cache_ = std::make_unique<SpillableElementBuffer>(
+              cache_->options(), ctx->env());
+        }
         return dataset()->input_->MakeIterator(ctx, this, prefix(),
                                                &input_impl_);
       }
@@ -930,18 +982,24 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         TF_RETURN_IF_ERROR(
             input_impl_->GetNext(ctx, out_tensors, end_of_sequence));
         if (*end_of_sequence) {
-          if (!cache_->IsCompleted()) {
+          if (!cache_->IsCompleted() && temp_cache_ != nullptr) {
             VLOG(2) << "Finalizing the cache because EOF has been reached.";
-            cache_->Complete(std::move(temp_cache_));
+            TF_RETURN_IF_ERROR(CompleteCache());
           }
           return absl::OkStatus();
         }
-        RecordBufferEnqueue(ctx, *out_tensors);
-        temp_cache_.emplace_back(*out_tensors);
-        if (temp_cache_.size() == dataset()->input_->Cardinality()) {
+        if (temp_cache_ == nullptr) {
+          // The cache has already been completed.
+          return absl::OkStatus();
+        }
+        TF_RETURN_IF_ERROR(temp_cache_->Append(*out_tensors));
+        if (temp_cache_->IsResident(temp_cache_->size() - 1)) {
+          RecordBufferEnqueue(ctx, *out_tensors);
+        }
+        if (temp_cache_->size() == dataset()->input_->Cardinality()) {
           VLOG(2) << "Finalizing the cache because its size matches the "
                      "expected input cardinality.";
-          cache_->Complete(std::move(temp_cache_));
+          TF_RETURN_IF_ERROR(CompleteCache());
         }
         return absl::OkStatus();
       }
@@ -957,8 +1015,12 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                                 IteratorStateWriter* writer) override {
         mutex_lock l(mu_);
         if (!cache_->IsCompleted()) {
-          TF_RETURN_IF_ERROR(
-              WriteElementsToCheckpoint(writer, prefix(), temp_cache_));
+          if (temp_cache_ != nullptr) {
+            TF_RETURN_IF_ERROR(WriteCachedElementsToCheckpoint(
+                writer, prefix(), *temp_cache_));
+          } else {
+            TF_RETURN_IF_ERROR(WriteElementsToCheckpoint(writer, prefix(), {}));
+          }
         }
         return SaveInput(ctx, writer, input_impl_);
       }
@@ -967,17 +1029,31 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                                    IteratorStateReader* reader) override {
         mutex_lock l(mu_);
         if (!reader->Contains(prefix(), kCacheCompleted)) {
-          TF_RETURN_IF_ERROR(
-              ReadElementsFromCheckpoint(ctx, reader, prefix(), &temp_cache_));
+          temp_cache_ = std::make_unique<SpillableElementBuffer>(
+              cache_->options(), ctx->env());
+          SpillableElementBuffer* elements = temp_cache_.get();
+          TF_RETURN_IF_ERROR(ReadElementsFromCheckpoint(
+              ctx, reader, prefix(), [elements](std::vector<Tensor> element) {
+                return elements->Append(element);
+              }));
         }
         return RestoreInput(ctx, reader, input_impl_);
       }
 
      private:
+      // Transfers the buffered elements to the shared cache.
+      absl::Status CompleteCache() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        TF_RETURN_IF_ERROR(temp_cache_->Finalize());
+        cache_->Complete(std::move(temp_cache_));
+        return absl::OkStatus();
+      }
+
       mutex mu_;
       std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_);
       MemoryCache* const cache_ TF_GUARDED_BY(mu_);  // not owned.
-      std::vector<std::vector<Tensor>> temp_cache_ TF_GUARDED_BY(mu_);
+      // Elements buffered until the input is exhausted. Null once they have
+      // been transferred to `cache_`.
+      std::unique_ptr<SpillableElementBuffer> temp_cache_ TF_GUARDED_BY(mu_);
     };  // MemoryWriterIterator
 
     class MemoryReaderIterator : public DatasetIterator<MemoryDatasetBase> {
@@ -992,10 +1068,15 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         // dataset but performance modeling uses the iterator abstraction and
         // thus we record the memory allocated for the cache here. The caveat
         // is that this is incorrect if there are concurrent instances of this
-        // iterator.
+        // iterator. Elements that have been spilled to disk are not recorded.
         tf_shared_lock l(mu_);
         for (size_t i = 0; i < cache_->size(); ++i) {
-          RecordBufferEnqueue(ctx, cache_->at(i));
+          if (!cache_->IsResident(i)) {
+            continue;
+          }
+          std::vector<Tensor> element;
+          TF_RETURN_IF_ERROR(cache_->Get(i, &element));
+          RecordBufferEnqueue(ctx, element);
         }
         return absl::OkStatus();
       }
@@ -1005,9 +1086,13 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                                    bool* end_of_sequence) override {
         mutex_lock l(mu_);
         if (index_ < cache_->size()) {
-          const std::vector<Tensor>& cache_tensors = cache_->at(index_);
-          out_tensors->insert(out_tensors->begin(), cache_tensors.begin(),
-                              cache_tensors.end());
+          std::vector<Tensor> cache_tensors;
+          TF_RETURN_IF_ERROR(cache_->Get(index_, &cache_tensors));
+          metrics::RecordTFDataMemoryCacheRead(
+              /*spilled=*/!cache_->IsResident(index_));
+          out_tensors->insert(out_tensors->begin(),
+                              std::make_move_iterator(cache_tensors.begin()),
+                              std::make_move_iterator(cache_tensors.end()));
           index_++;
           *end_of_sequence = false;
           return absl::OkStatus();
@@ -14,29 +14,202 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/cache_ops.h"
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "tensorflow/core/data/compression_utils.h"
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/dataset.pb.h"
+#include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/random/random_distributions.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 namespace data {
 namespace {
 
 constexpr char kMemoryCache[] = "MemoryCache";
+constexpr char kMemoryCacheBudgetEnvVar[] = "TF_DATA_MEMORY_CACHE_BUDGET_IN_MB";
+constexpr char kMemoryCacheSpillDirEnvVar[] = "TF_DATA_MEMORY_CACHE_SPILL_DIR";
+constexpr char kSegmentFilePrefix[] = "tf_data_memory_cache_";
+constexpr char kSegmentFileSuffix[] = ".segment";
 
 }  // namespace
 
 string MemoryCacheManager::DebugString() const { return kMemoryCache; }
 
-void MemoryCache::Complete(std::vector<std::vector<Tensor>>&& cache) {
+MemoryCacheOptions MemoryCacheOptions::FromEnvironment() {
+  MemoryCacheOptions options;
+  int64_t budget_in_mb = 0;
+  absl::Status s =
+      ReadInt64FromEnvVar(kMemoryCacheBudgetEnvVar, 0, &budget_in_mb);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to read " << kMemoryCacheBudgetEnvVar << ": " << s;
+  }
+  options.memory_budget_bytes = budget_in_mb * 1024 * 1024;
+  s = ReadStringFromEnvVar(kMemoryCacheSpillDirEnvVar, "",
+                           &options.spill_directory);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to read " << kMemoryCacheSpillDirEnvVar << ": "
+                 << s;
+  }
+  return options;
+}
+
+SpillableElementBuffer::SpillableElementBuffer(
+    const MemoryCacheOptions& options, Env* env)
+    : options_(options), env_(env) {}
+
+SpillableElementBuffer::~SpillableElementBuffer() {
+  segment_region_.reset();
+  if (segment_writer_) {
+    absl::Status s = segment_writer_->Close();
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to close " << segment_filename_ << ": " << s;
+    }
+  }
+  if (!segment_filename_.empty()) {
+    absl::Status s = env_->DeleteFile(segment_filename_);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to delete " << segment_filename_ << ": " << s;
+    }
+  }
+}
+
+absl::Status SpillableElementBuffer::Append(
+    const std::vector<Tensor>& element) {
+  if (finalized_) {
+    return errors::FailedPrecondition(
+        "Cannot append to a memory cache buffer that has been finalized.");
+  }
+  const int64_t num_bytes = GetTotalBytes(element);
+  if (options_.memory_budget_bytes <= 0 ||
+      resident_bytes_ + num_bytes <= options_.memory_budget_bytes) {
+    Entry& entry = entries_.emplace_back();
+    entry.element = element;
+    resident_bytes_ += num_bytes;
+    return absl::OkStatus();
+  }
+  return Spill(element);
+}
+
+absl::Status SpillableElementBuffer::Finalize() {
+  if (finalized_) {
+    return absl::OkStatus();
+  }
+  finalized_ = true;
+  if (!segment_writer_) {
+    return absl::OkStatus();
+  }
+  TF_RETURN_IF_ERROR(segment_writer_->Close());
+  segment_writer_.reset();
+  return env_->NewReadOnlyMemoryRegionFromFile(segment_filename_,
+                                               &segment_region_);
+}
+
+absl::Status SpillableElementBuffer::Get(
+    size_t index, std::vector<Tensor>* out_tensors) const {
+  if (index >= entries_.size()) {
+    return errors::OutOfRange("Index out of range [0, ", entries_.size(),
+                              "): ", index);
+  }
+  const Entry& entry = entries_[index];
+  if (!entry.spilled) {
+    *out_tensors = entry.element;
+    return absl::OkStatus();
+  }
+  return ReadSpilled(entry, out_tensors);
+}
+
+absl::Status SpillableElementBuffer::Spill(const std::vector<Tensor>& element) {
+  if (!segment_writer_) {
+    TF_RETURN_IF_ERROR(CreateSegmentFile());
+  }
+  CompressedElement compressed;
+  TF_RETURN_IF_ERROR(CompressElement(element, &compressed));
+  std::string serialized;
+  if (!compressed.SerializeToString(&serialized)) {
+    return errors::Internal("Failed to serialize a spilled cache element.");
+  }
+  TF_RETURN_IF_ERROR(segment_writer_->Append(serialized));
+  Entry& entry = entries_.emplace_back();
+  entry.spilled = true;
+  entry.offset = spilled_bytes_;
+  entry.length = serialized.size();
+  spilled_bytes_ += serialized.size();
+  metrics::RecordTFDataMemoryCacheSpilledBytes(serialized.size());
+  return absl::OkStatus();
+}
+
+absl::Status SpillableElementBuffer::CreateSegmentFile() {
+  std::string filename;
+  if (options_.spill_directory.empty()) {
+    if (!env_->LocalTempFilename(&filename)) {
+      return errors::Unavailable(
+          "Failed to create a local temporary file for spilling the memory "
+          "cache. Set ",
+          kMemoryCacheSpillDirEnvVar, " to choose a spill directory.");
+    }
+  } else {
+    TF_RETURN_IF_ERROR(env_->RecursivelyCreateDir(options_.spill_directory));
+    filename = io::JoinPath(options_.spill_directory, kSegmentFilePrefix);
+    if (!env_->CreateUniqueFileName(&filename, kSegmentFileSuffix)) {
+      return errors::Unavailable("Failed to create a unique file name in ",
+                                 options_.spill_directory);
+    }
+  }
+  TF_RETURN_IF_ERROR(env_->NewWritableFile(filename, &segment_writer_));
+  segment_filename_ = std::move(filename);
+  VLOG(2) << "Spilling memory cache elements to " << segment_filename_;
+  return absl::OkStatus();
+}
+
+absl::Status SpillableElementBuffer::ReadSpilled(
+    const Entry& entry, std::vector<Tensor>* out_tensors) const {
+  CompressedElement compressed;
+  if (segment_region_) {
+    const char* data =
+        static_cast<const char*>(segment_region_->data()) + entry.offset;
+    if (!compressed.ParseFromArray(data, entry.length)) {
+      return errors::DataLoss("Failed to parse a spilled cache element from ",
+                              segment_filename_);
+    }
+    return UncompressElement(compressed, out_tensors);
+  }
+  // The segment has not been memory-mapped yet. This only happens when the
+  // buffer is read before it has been finalized, e.g. while checkpointing.
+  TF_RETURN_IF_ERROR(segment_writer_->Flush());
+  std::unique_ptr<RandomAccessFile> file;
+  TF_RETURN_IF_ERROR(env_->NewRandomAccessFile(segment_filename_, &file));
+  std::string scratch(entry.length, '\0');
+  absl::string_view result;
+  TF_RETURN_IF_ERROR(
+      file->Read(entry.offset, entry.length, &result, scratch.data()));
+  if (!compressed.ParseFromArray(result.data(), result.size())) {
+    return errors::DataLoss("Failed to parse a spilled cache element from ",
+                            segment_filename_);
+  }
+  return UncompressElement(compressed, out_tensors);
+}
+
+void MemoryCache::Complete(std::unique_ptr<SpillableElementBuffer> elements) {
   mutex_lock l(mu_);
   if (!completed_) {
-    cache_ = std::move(cache);
+    cache_ = std::move(elements);
     completed_ = true;
   }
 }
@@ -49,23 +222,26 @@ bool MemoryCache::IsCompleted() {
 void MemoryCache::Reset() {
   mutex_lock l(mu_);
   completed_ = false;
-  cache_.clear();
+  cache_.reset();
 }
 
-const std::vector<Tensor>& MemoryCache::at(int64_t index) {
+absl::Status MemoryCache::Get(int64_t index, std::vector<Tensor>* out_tensors) {
   tf_shared_lock l(mu_);
-  DCHECK(index < cache_.size());
-  return cache_[index];
+  if (!cache_) {
+    return errors::FailedPrecondition("The memory cache is not completed.");
+  }
+  return cache_->Get(index, out_tensors);
 }
 
-size_t MemoryCache::size() {
+bool MemoryCache::IsResident(int64_t index) {
   tf_shared_lock l(mu_);
-  return cache_.size();
+  DCHECK(cache_ != nullptr && index < cache_->size());
+  return cache_->IsResident(index);
 }
 
-const std::vector<std::vector<Tensor>>& MemoryCache::data() {
+size_t MemoryCache::size() {
   tf_shared_lock l(mu_);
-  return cache_;
+  return cache_ ? cache_->size() : 0;
 }
 
 AnonymousMemoryCacheHandleOp::AnonymousMemoryCacheHandleOp(
@@ -16,23 +16,120 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_KERNELS_DATA_CACHE_OPS_H_
 #define TENSORFLOW_CORE_KERNELS_DATA_CACHE_OPS_H_
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/framework/resource_mgr.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/file_system.h"
 
 namespace tensorflow {
 namespace data {
 
+// Options for `MemoryCache`.
+struct MemoryCacheOptions {
+  // The maximum number of bytes of element data that the cache keeps in RAM.
+  // Elements produced after the budget is exhausted are spilled to a segment
+  // file on local disk. A non-positive value means the cache is unbounded.
+  int64_t memory_budget_bytes = 0;
+  // The directory in which spill segment files are created. If empty, a local
+  // temporary directory is used.
+  std::string spill_directory;
+
+  // Returns the options configured by the `TF_DATA_MEMORY_CACHE_BUDGET_IN_MB`
+  // and `TF_DATA_MEMORY_CACHE_SPILL_DIR` environment variables.
+  static MemoryCacheOptions FromEnvironment();
+};
+
+// An append-only sequence of dataset elements with a bounded RAM footprint.
+//
+// Elements are held in RAM as-is, without any serialization, as long as they
+// fit into the memory budget. Elements that do not fit are compressed and
+// appended to a segment file, which is memory-mapped once the buffer is
+// finalized. The segment file is deleted when the buffer is destroyed.
+//
+// This class is not thread-safe.
+class SpillableElementBuffer {
+ public:
+  SpillableElementBuffer(const MemoryCacheOptions& options, Env* env);
+  ~SpillableElementBuffer();
+
+  SpillableElementBuffer(const SpillableElementBuffer&) = delete;
+  SpillableElementBuffer& operator=(const SpillableElementBuffer&) = delete;
+
+  // Appends `element` to the buffer. Must not be called after `Finalize`.
+  absl::Status Append(const std::vector<Tensor>& element);
+
+  // Flushes and memory-maps the spill segment, if any. No more elements can be
+  // appended afterwards.
+  absl::Status Finalize();
+
+  // Returns the element at the given index. Elements that are resident in RAM
+  // are returned without copying their buffers.
+  absl::Status Get(size_t index, std::vector<Tensor>* out_tensors) const;
+
+  // Returns whether the element at the given index is resident in RAM.
+  bool IsResident(size_t index) const { return !entries_[index].spilled; }
+
+  // Returns the number of elements in the buffer.
+  size_t size() const { return entries_.size(); }
+
+  bool empty() const { return entries_.empty(); }
+
+  // Returns the number of element bytes resident in RAM.
+  int64_t resident_bytes() const { return resident_bytes_; }
+
+  // Returns the number of bytes written to the spill segment.
+  int64_t spilled_bytes() const { return spilled_bytes_; }
+
+ private:
+  struct Entry {
+    // The element, if it is resident in RAM.
+    std::vector<Tensor> element;
+    // The location of the element within the segment file, if it was spilled.
+    bool spilled = false;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+  };
+
+  absl::Status Spill(const std::vector<Tensor>& element);
+  absl::Status CreateSegmentFile();
+  absl::Status ReadSpilled(const Entry& entry,
+                           std::vector<Tensor>* out_tensors) const;
+
+  const MemoryCacheOptions options_;
+  Env* const env_;
+  std::vector<Entry> entries_;
+  int64_t resident_bytes_ = 0;
+  int64_t spilled_bytes_ = 0;
+  bool finalized_ = false;
+  std::string segment_filename_;
+  std::unique_ptr<WritableFile> segment_writer_;
+  std::unique_ptr<ReadOnlyMemoryRegion> segment_region_;
+};
+
 // A thread-safe data structure for caching dataset elements.
 //
-// The expected use is that a single `MemoryWriterIterator` populates the
-// cache with dataset elements. Once all elements are cached, the cache can
-// be used by one or more `MemoryReaderIterator`s.
+// The expected use is that a single `MemoryWriterIterator` populates a
+// `SpillableElementBuffer` with dataset elements. Once all elements are
+// buffered, the buffer is handed to the cache, which can then be used by one
+// or more `MemoryReaderIterator`s.
 class MemoryCache {
  public:
   MemoryCache() = default;
+  explicit MemoryCache(const MemoryCacheOptions& options) : options_(options) {}
+
+  // Returns the options the cache was created with.
+  const MemoryCacheOptions& options() const { return options_; }
 
-  // Marks the cache as completed.
-  void Complete(std::vector<std::vector<Tensor>>&& cache);
+  // Marks the cache as completed, taking ownership of `elements`. If the cache
+  // is already completed, `elements` is discarded.
+  void Complete(std::unique_ptr<SpillableElementBuffer> elements);
 
   // Returns whether the cache is completed.
   bool IsCompleted();
@@ -41,26 +138,28 @@ class MemoryCache {
   void Reset();
 
   // Returns the element at the given index.
-  const std::vector<Tensor>& at(int64_t index);
+  absl::Status Get(int64_t index, std::vector<Tensor>* out_tensors);
+
+  // Returns whether the element at the given index is resident in RAM.
+  bool IsResident(int64_t index);
 
   // Returns the size of the cache.
   size_t size();
 
-  // Returns a reference to the cache's data. The returned reference will be
-  // invalidated by any call to Reset().
-  const std::vector<std::vector<Tensor>>& data();
-
  private:
+  const MemoryCacheOptions options_;
   mutex mu_;
   // Determines whether all elements of the dataset have been cached.
   bool completed_ TF_GUARDED_BY(mu_) = false;
-  std::vector<std::vector<Tensor>> cache_ TF_GUARDED_BY(mu_);
+  std::unique_ptr<SpillableElementBuffer> cache_ TF_GUARDED_BY(mu_);
 };
 
 // A resource wrapping a shared instance of a memory cache.
 class MemoryCacheManager : public ResourceBase {
  public:
-  MemoryCacheManager() : cache_(std::make_shared<MemoryCache>()) {}
+  MemoryCacheManager()
+      : cache_(std::make_shared<MemoryCache>(
+            MemoryCacheOptions::FromEnvironment())) {}
 
   string DebugString() const override;
 
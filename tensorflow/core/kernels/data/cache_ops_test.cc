@@ -0,0 +1,161 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/cache_ops.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/data/dataset_test_base.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+std::vector<Tensor> MakeElement(int64_t value) {
+  return {CreateTensor<int64_t>(TensorShape{4}, {value, value, value, value}),
+          CreateTensor<tstring>(TensorShape{1}, {"element"})};
+}
+
+MemoryCacheOptions SpillOptions(int64_t memory_budget_bytes) {
+  MemoryCacheOptions options;
+  options.memory_budget_bytes = memory_budget_bytes;
+  options.spill_directory =
+      io::JoinPath(testing::TmpDir(), "memory_cache_spill");
+  return options;
+}
+
+void ExpectElement(const SpillableElementBuffer& buffer, size_t index,
+                   int64_t value) {
+  std::vector<Tensor> element;
+  TF_ASSERT_OK(buffer.Get(index, &element));
+  std::vector<Tensor> expected = MakeElement(value);
+  ASSERT_EQ(element.size(), expected.size());
+  for (size_t i = 0; i < element.size(); ++i) {
+    test::ExpectEqual(element[i], expected[i]);
+  }
+}
+
+TEST(SpillableElementBufferTest, UnboundedKeepsEverythingResident) {
+  SpillableElementBuffer buffer(MemoryCacheOptions(), Env::Default());
+  for (int64_t i = 0; i < 10; ++i) {
+    TF_ASSERT_OK(buffer.Append(MakeElement(i)));
+  }
+  TF_ASSERT_OK(buffer.Finalize());
+  EXPECT_EQ(buffer.size(), 10);
+  EXPECT_EQ(buffer.spilled_bytes(), 0);
+  for (int64_t i = 0; i < 10; ++i) {
+    EXPECT_TRUE(buffer.IsResident(i));
+    ExpectElement(buffer, i, i);
+  }
+}
+
+TEST(SpillableElementBufferTest, ResidentElementsShareBuffers) {
+  SpillableElementBuffer buffer(MemoryCacheOptions(), Env::Default());
+  std::vector<Tensor> element = MakeElement(1);
+  TF_ASSERT_OK(buffer.Append(element));
+  std::vector<Tensor> result;
+  TF_ASSERT_OK(buffer.Get(0, &result));
+  EXPECT_TRUE(result[0].SharesBufferWith(element[0]));
+}
+
+TEST(SpillableElementBufferTest, SpillsOverBudget) {
+  const int64_t element_bytes = GetTotalBytes(MakeElement(0));
+  SpillableElementBuffer buffer(SpillOptions(3 * element_bytes),
+                                Env::Default());
+  for (int64_t i = 0; i < 10; ++i) {
+    TF_ASSERT_OK(buffer.Append(MakeElement(i)));
+  }
+  TF_ASSERT_OK(buffer.Finalize());
+  EXPECT_EQ(buffer.size(), 10);
+  EXPECT_EQ(buffer.resident_bytes(), 3 * element_bytes);
+  EXPECT_GT(buffer.spilled_bytes(), 0);
+  for (int64_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(buffer.IsResident(i), i < 3);
+    ExpectElement(buffer, i, i);
+  }
+}
+
+TEST(SpillableElementBufferTest, ReadSpilledBeforeFinalize) {
+  SpillableElementBuffer buffer(SpillOptions(/*memory_budget_bytes=*/1),
+                                Env::Default());
+  for (int64_t i = 0; i < 5; ++i) {
+    TF_ASSERT_OK(buffer.Append(MakeElement(i)));
+  }
+  for (int64_t i = 0; i < 5; ++i) {
+    EXPECT_FALSE(buffer.IsResident(i));
+    ExpectElement(buffer, i, i);
+  }
+}
+
+TEST(SpillableElementBufferTest, AppendAfterFinalize) {
+  SpillableElementBuffer buffer(MemoryCacheOptions(), Env::Default());
+  TF_ASSERT_OK(buffer.Finalize());
+  EXPECT_TRUE(errors::IsFailedPrecondition(buffer.Append(MakeElement(0))));
+}
+
+TEST(SpillableElementBufferTest, DeletesSegmentFile) {
+  MemoryCacheOptions options = SpillOptions(/*memory_budget_bytes=*/1);
+  options.spill_directory =
+      io::JoinPath(testing::TmpDir(), "memory_cache_spill_cleanup");
+  {
+    SpillableElementBuffer buffer(options, Env::Default());
+    TF_ASSERT_OK(buffer.Append(MakeElement(0)));
+    TF_ASSERT_OK(buffer.Finalize());
+    std::vector<string> children;
+    TF_ASSERT_OK(Env::Default()->GetChildren(options.spill_directory,
+                                             &children));
+    EXPECT_EQ(children.size(), 1);
+  }
+  std::vector<string> children;
+  TF_ASSERT_OK(
+      Env::Default()->GetChildren(options.spill_directory, &children));
+  EXPECT_TRUE(children.empty());
+}
+
+TEST(MemoryCacheTest, CompleteAndReset) {
+  const int64_t element_bytes = GetTotalBytes(MakeElement(0));
+  MemoryCache cache(SpillOptions(2 * element_bytes));
+  EXPECT_FALSE(cache.IsCompleted());
+  EXPECT_EQ(cache.size(), 0);
+
+  auto elements =
+      std::make_unique<SpillableElementBuffer>(cache.options(), Env::Default());
+  for (int64_t i = 0; i < 4; ++i) {
+    TF_ASSERT_OK(elements->Append(MakeElement(i)));
+  }
+  TF_ASSERT_OK(elements->Finalize());
+  cache.Complete(std::move(elements));
+  EXPECT_TRUE(cache.IsCompleted());
+  EXPECT_EQ(cache.size(), 4);
+  EXPECT_TRUE(cache.IsResident(1));
+  EXPECT_FALSE(cache.IsResident(2));
+  std::vector<Tensor> element;
+  TF_ASSERT_OK(cache.Get(3, &element));
+  test::ExpectEqual(element[0], MakeElement(3)[0]);
+
+  cache.Reset();
+  EXPECT_FALSE(cache.IsCompleted());
+  EXPECT_EQ(cache.size(), 0);
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
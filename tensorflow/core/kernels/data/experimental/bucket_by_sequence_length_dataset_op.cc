@@ -0,0 +1,575 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/experimental/bucket_by_sequence_length_dataset_op.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "tensorflow/core/data/dataset_utils.h"
+#include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_util.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/stringprintf.h"
+#include "tensorflow/core/util/batch_util.h"
+
+namespace tensorflow {
+namespace data {
+namespace experimental {
+
+// Constants declared in bucket_by_sequence_length_dataset_op.h and used both
+// here and in test cases.
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kDatasetType;
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kInputDataset;
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kBucketBoundaries;
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kBucketTokenBudgets;
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kPaddingValues;
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kDropRemainder;
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kLengthComponent;
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kToutputTypes;
+/* static */ constexpr const char* const
+    BucketBySequenceLengthDatasetOp::kOutputShapes;
+
+namespace {
+
+constexpr char kInputExhausted[] = "input_exhausted";
+constexpr char kBucketSize[] = "bucket_size";
+constexpr char kBucketElement[] = "bucket_element";
+
+// Fills `num_values` values of `value_size` bytes each, starting at `dst`,
+// with copies of the value at `value`.
+void FillWithValue(const char* value, size_t value_size, int64_t num_values,
+                   char* dst) {
+  if (num_values <= 0) {
+    return;
+  }
+  std::memcpy(dst, value, value_size);
+  const size_t total_size = value_size * num_values;
+  size_t filled = value_size;
+  while (filled < total_size) {
+    const size_t n = std::min(filled, total_size - filled);
+    std::memcpy(dst + filled, dst, n);
+    filled += n;
+  }
+}
+
+}  // namespace
+
+class BucketBySequenceLengthDatasetOp::Dataset : public DatasetBase {
+ public:
+  Dataset(OpKernelContext* ctx, std::vector<int64_t> bucket_boundaries,
+          std::vector<int64_t> bucket_token_budgets,
+          std::vector<Tensor> padding_values, bool drop_remainder,
+          int64_t length_component, const DatasetBase* input)
+      : DatasetBase(DatasetContext(ctx)),
+        bucket_boundaries_(std::move(bucket_boundaries)),
+        bucket_token_budgets_(std::move(bucket_token_budgets)),
+        padding_values_(std::move(padding_values)),
+        drop_remainder_(drop_remainder),
+        length_component_(length_component),
+        input_(input),
+        traceme_metadata_(
+            {{"num_buckets",
+              strings::Printf("%lld", static_cast<long long>(
+                                          bucket_token_budgets_.size()))},
+             {"drop_remainder", drop_remainder ? "true" : "false"}}) {
+    input_->Ref();
+    // Every dimension of a batch is padded to the largest element in the
+    // batch, so only the rank of the input components is known statically.
+    const auto& input_shapes = input_->output_shapes();
+    output_shapes_.reserve(input_shapes.size());
+    for (const PartialTensorShape& input_shape : input_shapes) {
+      PartialTensorShape output_shape({-1});
+      if (input_shape.unknown_rank()) {
+        output_shape = PartialTensorShape();
+      } else {
+        for (int dim = 0; dim < input_shape.dims(); ++dim) {
+          output_shape.AddDim(-1);
+        }
+      }
+      output_shapes_.push_back(std::move(output_shape));
+    }
+  }
+
+  ~Dataset() override { input_->Unref(); }
+
+  std::unique_ptr<IteratorBase> MakeIteratorInternal(
+      const string& prefix) const override {
+    return std::make_unique<Iterator>(Iterator::Params{
+        this, name_utils::IteratorPrefix(kDatasetType, prefix)});
+  }
+
+  const DataTypeVector& output_dtypes() const override {
+    return input_->output_dtypes();
+  }
+
+  const std::vector<PartialTensorShape>& output_shapes() const override {
+    return output_shapes_;
+  }
+
+  string DebugString() const override {
+    return name_utils::DatasetDebugString(kDatasetType);
+  }
+
+  int64_t CardinalityInternal(CardinalityOptions options) const override {
+    int64_t n = input_->Cardinality(options);
+    if (n == kInfiniteCardinality) {
+      return n;
+    }
+    return kUnknownCardinality;
+  }
+
+  absl::Status InputDatasets(
+      std::vector<const DatasetBase*>* inputs) const override {
+    inputs->push_back(input_);
+    return absl::OkStatus();
+  }
+
+  absl::Status CheckExternalState() const override {
+    return input_->CheckExternalState();
+  }
+
+ protected:
+  absl::Status AsGraphDefInternal(SerializationContext* ctx,
+                                  DatasetGraphDefBuilder* b,
+                                  Node** output) const override {
+    Node* input_graph_node = nullptr;
+    TF_RETURN_IF_ERROR(b->AddInputDataset(ctx, input_, &input_graph_node));
+    Node* bucket_boundaries = nullptr;
+    TF_RETURN_IF_ERROR(b->AddVector(bucket_boundaries_, &bucket_boundaries));
+    Node* bucket_token_budgets = nullptr;
+    TF_RETURN_IF_ERROR(
+        b->AddVector(bucket_token_budgets_, &bucket_token_budgets));
+
+    std::vector<Node*> padding_values;
+    padding_values.reserve(padding_values_.size());
+    for (const Tensor& t : padding_values_) {
+      Node* node;
+      TF_RETURN_IF_ERROR(b->AddTensor(t, &node));
+      padding_values.emplace_back(node);
+    }
+
+    Node* drop_remainder = nullptr;
+    TF_RETURN_IF_ERROR(b->AddScalar(drop_remainder_, &drop_remainder));
+
+    AttrValue length_component;
+    b->BuildAttrValue(length_component_, &length_component);
+    AttrValue output_types;
+    b->BuildAttrValue(output_dtypes(), &output_types);
+
+    TF_RETURN_IF_ERROR(b->AddDataset(
+        this,
+        {{0, input_graph_node},
+         {1, bucket_boundaries},
+         {2, bucket_token_budgets},
+         {4, drop_remainder}},
+        {{3, padding_values}},
+        {{kLengthComponent, length_component}, {kToutputTypes, output_types}},
+        output));
+    return absl::OkStatus();
+  }
+
+ private:
+  class Iterator : public DatasetIterator<Dataset> {
+   public:
+    explicit Iterator(const Params& params)
+        : DatasetIterator<Dataset>(params),
+          buckets_(params.dataset->bucket_token_budgets_.size()) {}
+
+    absl::Status Initialize(IteratorContext* ctx) override {
+      return dataset()->input_->MakeIterator(ctx, this, prefix(), &input_impl_);
+    }
+
+    absl::Status GetNextInternal(IteratorContext* ctx,
+                                 std::vector<Tensor>* out_tensors,
+                                 bool* end_of_sequence) override {
+      std::vector<std::vector<Tensor>> batch;
+      {
+        mutex_lock l(mu_);
+        while (batch.empty()) {
+          if (!input_impl_) {
+            if (!dataset()->drop_remainder_) {
+              for (Bucket& bucket : buckets_) {
+                if (!bucket.elements.empty()) {
+                  batch = TakeBatch(ctx, bucket);
+                  break;
+                }
+              }
+            }
+            break;
+          }
+          std::vector<Tensor> element;
+          bool end_of_input = false;
+          TF_RETURN_IF_ERROR(input_impl_->GetNext(ctx, &element, &end_of_input));
+          if (end_of_input) {
+            input_impl_.reset();
+            continue;
+          }
+          TF_ASSIGN_OR_RETURN(const int64_t length, ElementLength(element));
+          const size_t index = BucketIndex(length);
+          Bucket& bucket = buckets_[index];
+          const int64_t token_budget = dataset()->bucket_token_budgets_[index];
+          // Emit the bucket before `element` would push it over its budget.
+          const int64_t bucket_size = bucket.elements.size();
+          if (bucket_size > 0 &&
+              (bucket_size + 1) * std::max(bucket.max_length, length) >
+                  token_budget) {
+            batch = TakeBatch(ctx, bucket);
+          }
+          RecordBufferEnqueue(ctx, element);
+          bucket.elements.push_back(std::move(element));
+          bucket.max_length = std::max(bucket.max_length, length);
+          if (batch.empty() &&
+              static_cast<int64_t>(bucket.elements.size()) *
+                      bucket.max_length >=
+                  token_budget) {
+            batch = TakeBatch(ctx, bucket);
+          }
+        }
+      }
+
+      if (batch.empty()) {
+        *end_of_sequence = true;
+        return absl::OkStatus();
+      }
+      *end_of_sequence = false;
+      return CopyBatch(ctx, batch, out_tensors);
+    }
+
+   protected:
+    std::shared_ptr<model::Node> CreateNode(
+        IteratorContext* ctx, model::Node::Args args) const override {
+      return model::MakeUnknownRatioNode(std::move(args));
+    }
+
+    absl::Status SaveInternal(SerializationContext* ctx,
+                              IteratorStateWriter* writer) override {
+      mutex_lock l(mu_);
+      TF_RETURN_IF_ERROR(writer->WriteScalar(
+          prefix(), kInputExhausted, static_cast<int64_t>(!input_impl_)));
+      if (input_impl_) {
+        TF_RETURN_IF_ERROR(SaveInput(ctx, writer, input_impl_));
+      }
+      for (size_t i = 0; i < buckets_.size(); ++i) {
+        const std::vector<std::vector<Tensor>>& elements =
+            buckets_[i].elements;
+        TF_RETURN_IF_ERROR(
+            writer->WriteScalar(prefix(), absl::StrCat(kBucketSize, "[", i, "]"),
+                                static_cast<int64_t>(elements.size())));
+        for (size_t j = 0; j < elements.size(); ++j) {
+          for (size_t k = 0; k < elements[j].size(); ++k) {
+            TF_RETURN_IF_ERROR(writer->WriteTensor(
+                prefix(),
+                absl::StrCat(kBucketElement, "[", i, "][", j, "][", k, "]"),
+                elements[j][k]));
+          }
+        }
+      }
+      return absl::OkStatus();
+    }
+
+    absl::Status RestoreInternal(IteratorContext* ctx,
+                                 IteratorStateReader* reader) override {
+      mutex_lock l(mu_);
+      int64_t input_exhausted;
+      TF_RETURN_IF_ERROR(
+          reader->ReadScalar(prefix(), kInputExhausted, &input_exhausted));
+      if (static_cast<bool>(input_exhausted)) {
+        input_impl_.reset();
+      } else {
+        TF_RETURN_IF_ERROR(
+            dataset()->input_->MakeIterator(ctx, this, prefix(), &input_impl_));
+        TF_RETURN_IF_ERROR(RestoreInput(ctx, reader, input_impl_));
+      }
+      const size_t num_components = dataset()->output_dtypes().size();
+      for (size_t i = 0; i < buckets_.size(); ++i) {
+        Bucket& bucket = buckets_[i];
+        for (const std::vector<Tensor>& element : bucket.elements) {
+          RecordBufferDequeue(ctx, element);
+        }
+        bucket = Bucket();
+        int64_t bucket_size;
+        TF_RETURN_IF_ERROR(reader->ReadScalar(
+            prefix(), absl::StrCat(kBucketSize, "[", i, "]"), &bucket_size));
+        bucket.elements.reserve(bucket_size);
+        for (int64_t j = 0; j < bucket_size; ++j) {
+          std::vector<Tensor> element(num_components);
+          for (size_t k = 0; k < num_components; ++k) {
+            TF_RETURN_IF_ERROR(reader->ReadTensor(
+                ctx->flr(), prefix(),
+                absl::StrCat(kBucketElement, "[", i, "][", j, "][", k, "]"),
+                &element[k]));
+          }
+          TF_ASSIGN_OR_RETURN(const int64_t length, ElementLength(element));
+          bucket.max_length = std::max(bucket.max_length, length);
+          RecordBufferEnqueue(ctx, element);
+          bucket.elements.push_back(std::move(element));
+        }
+      }
+      return absl::OkStatus();
+    }
+
+    TraceMeMetadata GetTraceMeMetadata() const override {
+      return dataset()->traceme_metadata_;
+    }
+
+   private:
+    // Elements waiting to be batched together.
+    struct Bucket {
+      std::vector<std::vector<Tensor>> elements;
+      // Largest length of an element of `elements`.
+      int64_t max_length = 0;
+    };
+
+    // Returns the length of `element`, which is the size of the first
+    // dimension of its length component.
+    absl::StatusOr<int64_t> ElementLength(
+        const std::vector<Tensor>& element) const {
+      const Tensor& component = element[dataset()->length_component_];
+      if (component.dims() < 1) {
+        return errors::InvalidArgument(
+            "The length component (", dataset()->length_component_,
+            ") of each element must have rank at least 1, but got an element "
+            "with shape ",
+            component.shape().DebugString(), ".");
+      }
+      return component.dim_size(0);
+    }
+
+    // Returns the index of the bucket of elements of length `length`. Bucket
+    // `i` holds the lengths in [bucket_boundaries[i - 1], bucket_boundaries[i]).
+    size_t BucketIndex(int64_t length) const {
+      const std::vector<int64_t>& boundaries = dataset()->bucket_boundaries_;
+      return std::upper_bound(boundaries.begin(), boundaries.end(), length) -
+             boundaries.begin();
+    }
+
+    // Empties `bucket`, returning its elements.
+    std::vector<std::vector<Tensor>> TakeBatch(IteratorContext* ctx,
+                                               Bucket& bucket)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      std::vector<std::vector<Tensor>> batch = std::move(bucket.elements);
+      for (const std::vector<Tensor>& element : batch) {
+        RecordBufferDequeue(ctx, element);
+      }
+      bucket = Bucket();
+      return batch;
+    }
+
+    // Writes the elements of `batch` into one output tensor per tuple
+    // component, padding every dimension to the largest element in the batch.
+    absl::Status CopyBatch(IteratorContext* ctx,
+                           const std::vector<std::vector<Tensor>>& batch,
+                           std::vector<Tensor>* out_tensors) {
+      const size_t num_components = batch[0].size();
+      const int64_t batch_size = batch.size();
+      out_tensors->reserve(num_components);
+      for (size_t component_index = 0; component_index < num_components;
+           ++component_index) {
+        const TensorShape& first_shape = batch[0][component_index].shape();
+        TensorShape component_shape = first_shape;
+        // Whether the elements differ in more than their first dimension.
+        bool pad_inner_dims = false;
+        for (int64_t i = 1; i < batch_size; ++i) {
+          const TensorShape& element_shape = batch[i][component_index].shape();
+          if (element_shape.dims() != component_shape.dims()) {
+            return errors::InvalidArgument(
+                "All elements in a batch must have the same rank for "
+                "component ",
+                component_index, ": got elements with shapes ",
+                first_shape.DebugString(), " and ",
+                element_shape.DebugString(), ".");
+          }
+          for (int dim = 0; dim < element_shape.dims(); ++dim) {
+            if (element_shape.dim_size(dim) != component_shape.dim_size(dim)) {
+              pad_inner_dims |= dim > 0;
+              component_shape.set_dim(dim,
+                                      std::max(component_shape.dim_size(dim),
+                                               element_shape.dim_size(dim)));
+            }
+          }
+        }
+        TensorShape batch_component_shape({batch_size});
+        batch_component_shape.AppendShape(component_shape);
+        out_tensors->emplace_back(ctx->allocator({}),
+                                  output_dtypes()[component_index],
+                                  batch_component_shape);
+        Tensor& batch_component = out_tensors->back();
+        const Tensor& padding_value =
+            dataset()->padding_values_[component_index];
+
+        if (pad_inner_dims || !DataTypeCanUseMemcpy(batch_component.dtype())) {
+          // Elements need padding in more than one dimension, or can't be
+          // copied bytewise: pad the whole batch, then copy each element into
+          // its slice.
+          TF_RETURN_IF_ERROR(
+              batch_util::SetElementZero(&batch_component, padding_value));
+          for (int64_t i = 0; i < batch_size; ++i) {
+            const Tensor& element = batch[i][component_index];
+            if (element.shape() == component_shape) {
+              TF_RETURN_IF_ERROR(batch_util::CopyElementToSlice(
+                  element, &batch_component, i));
+            } else {
+              TF_RETURN_IF_ERROR(batch_util::CopyElementToLargerSlice(
+                  element, &batch_component, i));
+            }
+          }
+          continue;
+        }
+
+        // Elements only differ in their first dimension, so each of them is a
+        // prefix of its slice: copy it and pad the rest of the slice in place,
+        // writing every byte of the batch once.
+        const size_t value_size = DataTypeSize(batch_component.dtype());
+        const int64_t slice_num_values = component_shape.num_elements();
+        char* dst = const_cast<char*>(batch_component.tensor_data().data());
+        const char* padding = padding_value.tensor_data().data();
+        for (int64_t i = 0; i < batch_size; ++i) {
+          const Tensor& element = batch[i][component_index];
+          const int64_t element_num_values = element.NumElements();
+          char* slice = dst + i * slice_num_values * value_size;
+          if (element_num_values > 0) {
+            std::memcpy(slice, element.tensor_data().data(),
+                        element_num_values * value_size);
+          }
+          FillWithValue(padding, value_size,
+                        slice_num_values - element_num_values,
+                        slice + element_num_values * value_size);
+        }
+      }
+      return absl::OkStatus();
+    }
+
+    mutex mu_;
+    std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_);
+    std::vector<Bucket> buckets_ TF_GUARDED_BY(mu_);
+  };
+
+  const std::vector<int64_t> bucket_boundaries_;
+  const std::vector<int64_t> bucket_token_budgets_;
+  const std::vector<Tensor> padding_values_;
+  const bool drop_remainder_;
+  const int64_t length_component_;
+  const DatasetBase* const input_;
+  std::vector<PartialTensorShape> output_shapes_;
+  const TraceMeMetadata traceme_metadata_;
+};
+
+BucketBySequenceLengthDatasetOp::BucketBySequenceLengthDatasetOp(
+    OpKernelConstruction* ctx)
+    : UnaryDatasetOpKernel(ctx) {
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kLengthComponent, &length_component_));
+}
+
+void BucketBySequenceLengthDatasetOp::MakeDataset(OpKernelContext* ctx,
+                                                  DatasetBase* input,
+                                                  DatasetBase** output) {
+  const int64_t num_components = input->output_dtypes().size();
+  OP_REQUIRES(ctx, length_component_ < num_components,
+              errors::InvalidArgument(
+                  "`length_component` (", length_component_,
+                  ") must be smaller than the number of components in the "
+                  "input dataset's elements (",
+                  num_components, ")."));
+
+  std::vector<int64_t> bucket_boundaries;
+  OP_REQUIRES_OK(ctx, ParseVectorArgument<int64_t>(ctx, kBucketBoundaries,
+                                                   &bucket_boundaries));
+  for (size_t i = 1; i < bucket_boundaries.size(); ++i) {
+    OP_REQUIRES(
+        ctx, bucket_boundaries[i - 1] < bucket_boundaries[i],
+        errors::InvalidArgument("`bucket_boundaries` must be increasing, got [",
+                                absl::StrJoin(bucket_boundaries, ", "), "]."));
+  }
+  std::vector<int64_t> bucket_token_budgets;
+  OP_REQUIRES_OK(ctx, ParseVectorArgument<int64_t>(ctx, kBucketTokenBudgets,
+                                                   &bucket_token_budgets));
+  OP_REQUIRES(
+      ctx, bucket_token_budgets.size() == bucket_boundaries.size() + 1,
+      errors::InvalidArgument(
+          "`bucket_token_budgets` must have one more entry than "
+          "`bucket_boundaries`, got ",
+          bucket_token_budgets.size(), " and ", bucket_boundaries.size(), "."));
+  for (int64_t token_budget : bucket_token_budgets) {
+    OP_REQUIRES(ctx, token_budget > 0,
+                errors::InvalidArgument(
+                    "`bucket_token_budgets` must be positive, got [",
+                    absl::StrJoin(bucket_token_budgets, ", "), "]."));
+  }
+
+  OpInputList padding_values_list;
+  OP_REQUIRES_OK(ctx, ctx->input_list(kPaddingValues, &padding_values_list));
+  OP_REQUIRES(ctx, padding_values_list.size() == num_components,
+              errors::InvalidArgument(
+                  "Number of padding values (", padding_values_list.size(),
+                  ") must match the number of components in the input "
+                  "dataset's elements (",
+                  num_components, ")"));
+  std::vector<Tensor> padding_values;
+  padding_values.reserve(num_components);
+  for (int i = 0; i < padding_values_list.size(); ++i) {
+    const Tensor& padding_value_t = padding_values_list[i];
+    OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(padding_value_t.shape()),
+                errors::InvalidArgument("All padding values must be scalars"));
+    OP_REQUIRES(ctx, padding_value_t.dtype() == input->output_dtypes()[i],
+                errors::InvalidArgument(
+                    "Mismatched type between padding value ", i,
+                    " and input dataset's component ", i, ": ",
+                    DataTypeString(padding_value_t.dtype()), " vs. ",
+                    DataTypeString(input->output_dtypes()[i])));
+    padding_values.push_back(tensor::DeepCopy(padding_value_t));
+  }
+
+  bool drop_remainder = false;
+  OP_REQUIRES_OK(
+      ctx, ParseScalarArgument<bool>(ctx, kDropRemainder, &drop_remainder));
+
+  *output = new Dataset(ctx, std::move(bucket_boundaries),
+                        std::move(bucket_token_budgets),
+                        std::move(padding_values), drop_remainder,
+                        length_component_, input);
+}
+
+namespace {
+REGISTER_KERNEL_BUILDER(
+    Name("BucketBySequenceLengthDataset").Device(DEVICE_CPU),
+    BucketBySequenceLengthDatasetOp);
+}  // namespace
+}  // namespace experimental
+}  // namespace data
+}  // namespace tensorflow
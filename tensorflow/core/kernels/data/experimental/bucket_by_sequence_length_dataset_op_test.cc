@@ -0,0 +1,334 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/experimental/bucket_by_sequence_length_dataset_op.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/data/dataset_test_base.h"
+
+namespace tensorflow {
+namespace data {
+namespace experimental {
+namespace {
+
+constexpr char kNodeName[] = "bucket_by_sequence_length_dataset";
+
+// Produces a fixed list of elements, which may have different shapes.
+class SequenceListDatasetParams : public DatasetParams {
+ public:
+  SequenceListDatasetParams(std::vector<std::vector<Tensor>> elements,
+                            DataTypeVector output_dtypes,
+                            std::vector<PartialTensorShape> output_shapes)
+      : DatasetParams(std::move(output_dtypes), std::move(output_shapes),
+                      "list_dataset") {
+    for (auto& element : elements) {
+      for (auto& tensor : element) {
+        input_types_.push_back(tensor.dtype());
+        tensors_.push_back(std::move(tensor));
+      }
+    }
+  }
+
+  std::vector<Tensor> GetInputTensors() const override { return tensors_; }
+
+  absl::Status GetInputNames(std::vector<string>* input_names) const override {
+    input_names->clear();
+    for (int i = 0; i < tensors_.size(); ++i) {
+      input_names->push_back(absl::StrCat("tensors_", i));
+    }
+    return absl::OkStatus();
+  }
+
+  absl::Status GetAttributes(AttributeVector* attr_vector) const override {
+    *attr_vector = {{"Tinput_types", input_types_},
+                    {"output_types", output_dtypes_},
+                    {"output_shapes", output_shapes_},
+                    {"metadata", ""}};
+    return absl::OkStatus();
+  }
+
+  string dataset_type() const override { return "List"; }
+
+ private:
+  std::vector<Tensor> tensors_;
+  DataTypeVector input_types_;
+};
+
+class BucketBySequenceLengthDatasetParams : public DatasetParams {
+ public:
+  template <typename T>
+  BucketBySequenceLengthDatasetParams(
+      T input_dataset_params, std::vector<int64_t> bucket_boundaries,
+      std::vector<int64_t> bucket_token_budgets,
+      std::vector<Tensor> padding_values, bool drop_remainder,
+      int64_t length_component, DataTypeVector output_dtypes,
+      std::vector<PartialTensorShape> output_shapes, string node_name)
+      : DatasetParams(std::move(output_dtypes), std::move(output_shapes),
+                      std::move(node_name)),
+        bucket_boundaries_(std::move(bucket_boundaries)),
+        bucket_token_budgets_(std::move(bucket_token_budgets)),
+        padding_values_(std::move(padding_values)),
+        drop_remainder_(drop_remainder),
+        length_component_(length_component) {
+    input_dataset_params_.push_back(std::make_unique<T>(input_dataset_params));
+    iterator_prefix_ =
+        name_utils::IteratorPrefix(input_dataset_params.dataset_type(),
+                                   input_dataset_params.iterator_prefix());
+  }
+
+  std::vector<Tensor> GetInputTensors() const override {
+    std::vector<Tensor> input_tensors = {
+        CreateTensor<int64_t>(
+            TensorShape({static_cast<int64_t>(bucket_boundaries_.size())}),
+            bucket_boundaries_),
+        CreateTensor<int64_t>(
+            TensorShape({static_cast<int64_t>(bucket_token_budgets_.size())}),
+            bucket_token_budgets_)};
+    for (const Tensor& padding_value : padding_values_) {
+      input_tensors.push_back(padding_value);
+    }
+    input_tensors.push_back(
+        CreateTensor<bool>(TensorShape({}), {drop_remainder_}));
+    return input_tensors;
+  }
+
+  absl::Status GetInputNames(std::vector<string>* input_names) const override {
+    *input_names = {BucketBySequenceLengthDatasetOp::kInputDataset,
+                    BucketBySequenceLengthDatasetOp::kBucketBoundaries,
+                    BucketBySequenceLengthDatasetOp::kBucketTokenBudgets};
+    for (int i = 0; i < padding_values_.size(); ++i) {
+      input_names->push_back(
+          absl::StrCat(BucketBySequenceLengthDatasetOp::kPaddingValues, "_", i));
+    }
+    input_names->push_back(BucketBySequenceLengthDatasetOp::kDropRemainder);
+    return absl::OkStatus();
+  }
+
+  absl::Status GetAttributes(AttributeVector* attr_vector) const override {
+    *attr_vector = {
+        {BucketBySequenceLengthDatasetOp::kLengthComponent, length_component_},
+        {BucketBySequenceLengthDatasetOp::kToutputTypes, output_dtypes_},
+        {BucketBySequenceLengthDatasetOp::kOutputShapes, output_shapes_},
+        {"metadata", ""}};
+    return absl::OkStatus();
+  }
+
+  string dataset_type() const override {
+    return BucketBySequenceLengthDatasetOp::kDatasetType;
+  }
+
+ private:
+  std::vector<int64_t> bucket_boundaries_;
+  std::vector<int64_t> bucket_token_budgets_;
+  std::vector<Tensor> padding_values_;
+  bool drop_remainder_;
+  int64_t length_component_;
+};
+
+class BucketBySequenceLengthDatasetOpTest : public DatasetOpsTestBase {};
+
+// Sequences of lengths 1, 2, 3, 5, 1, 6 and 2, each paired with a name.
+SequenceListDatasetParams SequencesParams() {
+  std::vector<std::vector<Tensor>> elements;
+  const std::vector<int64_t> lengths = {1, 2, 3, 5, 1, 6, 2};
+  const std::vector<int64_t> values = {1, 2, 3, 5, 4, 6, 7};
+  for (int i = 0; i < lengths.size(); ++i) {
+    elements.push_back(
+        {CreateTensor<int64_t>(TensorShape({lengths[i]}),
+                               std::vector<int64_t>(lengths[i], values[i])),
+         CreateTensor<tstring>(TensorShape({}),
+                               {tstring(absl::StrCat("s", i))})});
+  }
+  return SequenceListDatasetParams(
+      std::move(elements), {DT_INT64, DT_STRING},
+      {PartialTensorShape({-1}), PartialTensorShape({})});
+}
+
+// Sequences shorter than 3 go to the first bucket, with a budget of 4 tokens;
+// longer ones go to the second, with a budget of 12 tokens.
+BucketBySequenceLengthDatasetParams TwoBucketsParams(bool drop_remainder) {
+  return BucketBySequenceLengthDatasetParams(
+      SequencesParams(),
+      /*bucket_boundaries=*/{3},
+      /*bucket_token_budgets=*/{4, 12},
+      /*padding_values=*/
+      {CreateTensor<int64_t>(TensorShape({}), {-1}),
+       CreateTensor<tstring>(TensorShape({}), {""})},
+      drop_remainder,
+      /*length_component=*/0,
+      /*output_dtypes=*/{DT_INT64, DT_STRING},
+      /*output_shapes=*/{PartialTensorShape({-1, -1}), PartialTensorShape({-1})},
+      /*node_name=*/kNodeName);
+}
+
+// Every sequence exceeds the budget on its own, so each one is a batch.
+BucketBySequenceLengthDatasetParams TinyBudgetParams() {
+  return BucketBySequenceLengthDatasetParams(
+      SequencesParams(),
+      /*bucket_boundaries=*/{},
+      /*bucket_token_budgets=*/{1},
+      /*padding_values=*/
+      {CreateTensor<int64_t>(TensorShape({}), {-1}),
+       CreateTensor<tstring>(TensorShape({}), {""})},
+      /*drop_remainder=*/false,
+      /*length_component=*/0,
+      /*output_dtypes=*/{DT_INT64, DT_STRING},
+      /*output_shapes=*/{PartialTensorShape({-1, -1}), PartialTensorShape({-1})},
+      /*node_name=*/kNodeName);
+}
+
+BucketBySequenceLengthDatasetParams InvalidParams(
+    std::vector<int64_t> bucket_boundaries,
+    std::vector<int64_t> bucket_token_budgets, int64_t length_component) {
+  return BucketBySequenceLengthDatasetParams(
+      SequencesParams(), std::move(bucket_boundaries),
+      std::move(bucket_token_budgets),
+      /*padding_values=*/
+      {CreateTensor<int64_t>(TensorShape({}), {-1}),
+       CreateTensor<tstring>(TensorShape({}), {""})},
+      /*drop_remainder=*/false, length_component,
+      /*output_dtypes=*/{DT_INT64, DT_STRING},
+      /*output_shapes=*/{PartialTensorShape({-1, -1}), PartialTensorShape({-1})},
+      /*node_name=*/kNodeName);
+}
+
+std::vector<Tensor> TwoBucketsOutputs(bool drop_remainder) {
+  std::vector<Tensor> outputs = {
+      CreateTensor<int64_t>(TensorShape({2, 2}), {1, -1, 2, 2}),
+      CreateTensor<tstring>(TensorShape({2}), {"s0", "s1"}),
+      CreateTensor<int64_t>(TensorShape({2, 5}),
+                            {3, 3, 3, -1, -1, 5, 5, 5, 5, 5}),
+      CreateTensor<tstring>(TensorShape({2}), {"s2", "s3"}),
+      CreateTensor<int64_t>(TensorShape({2, 2}), {4, -1, 7, 7}),
+      CreateTensor<tstring>(TensorShape({2}), {"s4", "s6"})};
+  if (!drop_remainder) {
+    outputs.push_back(
+        CreateTensor<int64_t>(TensorShape({1, 6}), {6, 6, 6, 6, 6, 6}));
+    outputs.push_back(CreateTensor<tstring>(TensorShape({1}), {"s5"}));
+  }
+  return outputs;
+}
+
+std::vector<GetNextTestCase<BucketBySequenceLengthDatasetParams>>
+GetNextTestCases() {
+  return {{/*dataset_params=*/TwoBucketsParams(/*drop_remainder=*/false),
+           /*expected_outputs=*/TwoBucketsOutputs(/*drop_remainder=*/false)},
+          {/*dataset_params=*/TwoBucketsParams(/*drop_remainder=*/true),
+           /*expected_outputs=*/TwoBucketsOutputs(/*drop_remainder=*/true)},
+          {/*dataset_params=*/TinyBudgetParams(),
+           /*expected_outputs=*/
+           {CreateTensor<int64_t>(TensorShape({1, 1}), {1}),
+            CreateTensor<tstring>(TensorShape({1}), {"s0"}),
+            CreateTensor<int64_t>(TensorShape({1, 2}), {2, 2}),
+            CreateTensor<tstring>(TensorShape({1}), {"s1"}),
+            CreateTensor<int64_t>(TensorShape({1, 3}), {3, 3, 3}),
+            CreateTensor<tstring>(TensorShape({1}), {"s2"}),
+            CreateTensor<int64_t>(TensorShape({1, 5}), {5, 5, 5, 5, 5}),
+            CreateTensor<tstring>(TensorShape({1}), {"s3"}),
+            CreateTensor<int64_t>(TensorShape({1, 1}), {4}),
+            CreateTensor<tstring>(TensorShape({1}), {"s4"}),
+            CreateTensor<int64_t>(TensorShape({1, 6}), {6, 6, 6, 6, 6, 6}),
+            CreateTensor<tstring>(TensorShape({1}), {"s5"}),
+            CreateTensor<int64_t>(TensorShape({1, 2}), {7, 7}),
+            CreateTensor<tstring>(TensorShape({1}), {"s6"})}}};
+}
+
+ITERATOR_GET_NEXT_TEST_P(BucketBySequenceLengthDatasetOpTest,
+                         BucketBySequenceLengthDatasetParams,
+                         GetNextTestCases())
+
+TEST_F(BucketBySequenceLengthDatasetOpTest, DatasetNodeName) {
+  auto dataset_params = TwoBucketsParams(/*drop_remainder=*/false);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetNodeName(dataset_params.node_name()));
+}
+
+TEST_F(BucketBySequenceLengthDatasetOpTest, DatasetTypeString) {
+  auto dataset_params = TwoBucketsParams(/*drop_remainder=*/false);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetTypeString(
+      name_utils::OpName(BucketBySequenceLengthDatasetOp::kDatasetType)));
+}
+
+TEST_F(BucketBySequenceLengthDatasetOpTest, DatasetOutputShapes) {
+  auto dataset_params = TwoBucketsParams(/*drop_remainder=*/false);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetOutputShapes(
+      {PartialTensorShape({-1, -1}), PartialTensorShape({-1})}));
+}
+
+TEST_F(BucketBySequenceLengthDatasetOpTest, Cardinality) {
+  auto dataset_params = TwoBucketsParams(/*drop_remainder=*/false);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetCardinality(kUnknownCardinality));
+}
+
+TEST_F(BucketBySequenceLengthDatasetOpTest, IteratorPrefix) {
+  auto dataset_params = TwoBucketsParams(/*drop_remainder=*/false);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckIteratorPrefix(
+      name_utils::IteratorPrefix(BucketBySequenceLengthDatasetOp::kDatasetType,
+                                 dataset_params.iterator_prefix())));
+}
+
+std::vector<IteratorSaveAndRestoreTestCase<BucketBySequenceLengthDatasetParams>>
+IteratorSaveAndRestoreTestCases() {
+  return {{/*dataset_params=*/TwoBucketsParams(/*drop_remainder=*/false),
+           /*breakpoints=*/{0, 1, 2, 4},
+           /*expected_outputs=*/TwoBucketsOutputs(/*drop_remainder=*/false)}};
+}
+
+ITERATOR_SAVE_AND_RESTORE_TEST_P(BucketBySequenceLengthDatasetOpTest,
+                                 BucketBySequenceLengthDatasetParams,
+                                 IteratorSaveAndRestoreTestCases())
+
+TEST_F(BucketBySequenceLengthDatasetOpTest, InvalidArguments) {
+  std::vector<BucketBySequenceLengthDatasetParams> invalid_params = {
+      InvalidParams(/*bucket_boundaries=*/{3, 2},
+                    /*bucket_token_budgets=*/{4, 4, 4}, /*length_component=*/0),
+      InvalidParams(/*bucket_boundaries=*/{3},
+                    /*bucket_token_budgets=*/{4}, /*length_component=*/0),
+      InvalidParams(/*bucket_boundaries=*/{3},
+                    /*bucket_token_budgets=*/{4, 0}, /*length_component=*/0),
+      InvalidParams(/*bucket_boundaries=*/{3},
+                    /*bucket_token_budgets=*/{4, 4}, /*length_component=*/2)};
+  for (const auto& dataset_params : invalid_params) {
+    EXPECT_EQ(Initialize(dataset_params).code(),
+              absl::StatusCode::kInvalidArgument);
+  }
+}
+
+TEST_F(BucketBySequenceLengthDatasetOpTest, ScalarLengthComponent) {
+  auto dataset_params = InvalidParams(/*bucket_boundaries=*/{3},
+                                      /*bucket_token_budgets=*/{4, 4},
+                                      /*length_component=*/1);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  EXPECT_EQ(
+      iterator_->GetNext(iterator_ctx_.get(), &out_tensors, &end_of_sequence)
+          .code(),
+      absl::StatusCode::kInvalidArgument);
+}
+
+}  // namespace
+}  // namespace experimental
+}  // namespace data
+}  // namespace tensorflow
@@ -14,8 +14,13 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parallel_filter_dataset_op.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <deque>
+#include <memory>
 #include <utility>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "tensorflow/core/common_runtime/function.h"
@@ -31,6 +36,7 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/str_util.h"
 #include "tensorflow/core/profiler/lib/traceme.h"
 #include "tensorflow/core/profiler/lib/traceme_encode.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 namespace data {
@@ -59,6 +65,22 @@ constexpr char kSize[] = "size";
 constexpr char kEndOfInput[] = "end_of_input";
 constexpr char kErrorCode[] = "code";
 constexpr char kErrorMessage[] = "error_message";
+constexpr char kPredicateBatchSizeEnvVar[] =
+    "TF_DATA_PARALLEL_FILTER_PREDICATE_BATCH_SIZE";
+
+namespace {
+
+// Returns an error if `predicate_values` is not a scalar bool.
+absl::Status CheckPredicateValues(const std::vector<Tensor>& predicate_values) {
+  if (predicate_values.size() != 1 || predicate_values[0].dtype() != DT_BOOL ||
+      predicate_values[0].NumElements() != 1) {
+    return errors::InvalidArgument(
+        "Filter predicate `predicate` must return a scalar bool.");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
 
 class ParallelFilterDatasetOp::Dataset : public DatasetBase {
  public:
@@ -71,6 +93,14 @@ class ParallelFilterDatasetOp::Dataset : public DatasetBase {
         deterministic_(deterministic),
         captured_func_(std::move(captured_func)) {
     input_->Ref();
+    absl::Status s = ReadInt64FromEnvVar(kPredicateBatchSizeEnvVar,
+                                         /*default_val=*/1,
+                                         &predicate_batch_size_);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to read " << kPredicateBatchSizeEnvVar << ": "
+                   << s;
+    }
+    predicate_batch_size_ = std::max<int64_t>(predicate_batch_size_, 1);
   }
 
   ~Dataset() override { input_->Unref(); }
@@ -144,7 +174,8 @@ class ParallelFilterDatasetOp::Dataset : public DatasetBase {
               params.dataset->num_parallel_calls_, mu_, cond_var_)),
           deterministic_(params.dataset->deterministic_.IsDeterministic() ||
                          params.dataset->deterministic_.IsDefault()),
-          autotune_(params.dataset->num_parallel_calls_ == model::kAutotune) {}
+          autotune_(params.dataset->num_parallel_calls_ == model::kAutotune),
+          predicate_batch_size_(params.dataset->predicate_batch_size_) {}
 
     ~Iterator() override {
       CancelThreads(/*wait=*/true);
@@ -354,11 +385,8 @@ class ParallelFilterDatasetOp::Dataset : public DatasetBase {
         result->status.Update(status);
         // Callback is not a predicate function, set the error status of this
         // result.
-        if (status.ok() && (result->predicate_values.size() != 1 ||
-                            result->predicate_values[0].dtype() != DT_BOOL ||
-                            result->predicate_values[0].NumElements() != 1)) {
-          result->status.Update(errors::InvalidArgument(
-              "Filter predicate `predicate` must return a scalar bool."));
+        if (status.ok()) {
+          result->status.Update(CheckPredicateValues(result->predicate_values));
         }
         RecordBufferEnqueue(ctx.get(), result->return_values);
         CallCompleted(ctx, result);
@@ -398,6 +426,107 @@ class ParallelFilterDatasetOp::Dataset : public DatasetBase {
       }
     }
 
+    // Like `CallFunction()`, but evaluates the predicate for all of `results`
+    // and completes them together. If the function uses the single-threaded
+    // executor, the predicate is evaluated back to back in a single closure
+    // scheduled on `ctx->runner()`, which amortizes the scheduling and
+    // recording overhead, which dominates for cheap predicates, across the
+    // batch. Otherwise, each evaluation runs asynchronously on the inter-op
+    // thread pool, and the batch completes once the last one is done.
+    void CallFunctionBatch(
+        const std::shared_ptr<IteratorContext>& ctx,
+        std::vector<std::shared_ptr<InvocationResult>> results)
+        TF_LOCKS_EXCLUDED(*mu_) {
+      tsl::profiler::TraceMe traceme([&] {
+        return tsl::profiler::TraceMeEncode(
+            "ParallelFilterProduceBatch",
+            {{"element_id", results.front()->uid},
+             {"batch_size", results.size()}});
+      });
+      // Get the next input elements.
+      std::vector<std::vector<Tensor>> input_elements(results.size());
+      for (size_t i = 0; i < results.size(); ++i) {
+        InvocationResult* result = results[i].get();
+        result->status = input_impl_->GetNext(ctx.get(), &input_elements[i],
+                                              &result->end_of_input);
+        if (!result->end_of_input && result->status.ok()) {
+          result->return_values = input_elements[i];
+        }
+      }
+      if (dataset()->captured_func_->use_inter_op_parallelism()) {
+        auto shared_results =
+            std::make_shared<std::vector<std::shared_ptr<InvocationResult>>>(
+                std::move(results));
+        // Counts the pending evaluations, plus one for this loop, so that the
+        // batch does not complete before all evaluations have started.
+        auto num_pending = std::make_shared<std::atomic<int64_t>>(1);
+        auto evaluation_done = [this, shared_results, num_pending]() {
+          if (num_pending->fetch_sub(1) == 1) {
+            BatchCompleted(*shared_results);
+          }
+        };
+        for (size_t i = 0; i < shared_results->size(); ++i) {
+          InvocationResult* result = (*shared_results)[i].get();
+          if (result->end_of_input || !result->status.ok()) {
+            continue;
+          }
+          num_pending->fetch_add(1);
+          instantiated_captured_func_->RunAsync(
+              ctx.get(), std::move(input_elements[i]),
+              &result->predicate_values,
+              [this, ctx, result, evaluation_done](absl::Status status) {
+                result->status.Update(status);
+                if (status.ok()) {
+                  result->status.Update(
+                      CheckPredicateValues(result->predicate_values));
+                }
+                RecordBufferEnqueue(ctx.get(), result->return_values);
+                evaluation_done();
+              },
+              model_node());
+        }
+        evaluation_done();
+        return;
+      }
+      (*ctx->runner())([this, ctx, results = std::move(results),
+                        input_elements = std::move(input_elements)]() mutable {
+        // Check whether we are already recording to prevent invalid nesting of
+        // `RecordStart` calls.
+        const bool is_recording = IsRecording(ctx.get());
+        if (!is_recording) {
+          RecordStart(ctx.get());
+        }
+        for (size_t i = 0; i < results.size(); ++i) {
+          InvocationResult* result = results[i].get();
+          if (result->end_of_input || !result->status.ok()) {
+            continue;
+          }
+          result->status = instantiated_captured_func_->Run(
+              ctx.get(), std::move(input_elements[i]),
+              &result->predicate_values, model_node());
+          if (result->status.ok()) {
+            result->status = CheckPredicateValues(result->predicate_values);
+          }
+          RecordBufferEnqueue(ctx.get(), result->return_values);
+        }
+        if (!is_recording) {
+          RecordStop(ctx.get());
+        }
+        BatchCompleted(results);
+      });
+    }
+
+    void BatchCompleted(
+        const std::vector<std::shared_ptr<InvocationResult>>& results)
+        TF_LOCKS_EXCLUDED(*mu_) {
+      mutex_lock l(*mu_);
+      num_calls_ -= results.size();
+      for (const auto& result : results) {
+        result->notification.Notify();
+      }
+      cond_var_->notify_all();
+    }
+
     absl::Status ProcessResult(IteratorContext* ctx,
                                const std::shared_ptr<InvocationResult>& result,
                                std::vector<Tensor>* out_tensors,
@@ -432,10 +561,20 @@ class ParallelFilterDatasetOp::Dataset : public DatasetBase {
         return num_calls_ >= num_parallel_calls ||
                invocation_results_.size() >= num_parallel_calls;
       };
+      // When predicate calls are batched, wait until a full batch of slots is
+      // free so that calls are not dispatched one element at a time.
+      auto batch_ready = [this]() TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) -> bool {
+        int64_t num_parallel_calls = num_parallel_calls_->value;
+        int64_t min_free_slots =
+            std::min(predicate_batch_size_, num_parallel_calls);
+        return num_calls_ + min_free_slots <= num_parallel_calls &&
+               invocation_results_.size() + min_free_slots <=
+                   num_parallel_calls;
+      };
       while (true) {
         {
           mutex_lock l(*mu_);
-          while (!cancelled_ && busy()) {
+          while (!cancelled_ && !batch_ready()) {
             RecordStop(ctx.get());
             cond_var_->wait(l);
             RecordStart(ctx.get());
@@ -450,8 +589,19 @@ class ParallelFilterDatasetOp::Dataset : public DatasetBase {
           }
           cond_var_->notify_all();
         }
-        for (const auto& call : new_calls) {
-          CallFunction(ctx, call);
+        if (predicate_batch_size_ > 1) {
+          for (size_t i = 0; i < new_calls.size(); i += predicate_batch_size_) {
+            auto end = new_calls.begin() +
+                       std::min<size_t>(i + predicate_batch_size_,
+                                        new_calls.size());
+            CallFunctionBatch(
+                ctx, std::vector<std::shared_ptr<InvocationResult>>(
+                         new_calls.begin() + i, end));
+          }
+        } else {
+          for (const auto& call : new_calls) {
+            CallFunction(ctx, call);
+          }
         }
         new_calls.clear();
       }
@@ -600,6 +750,9 @@ class ParallelFilterDatasetOp::Dataset : public DatasetBase {
     const std::shared_ptr<model::SharedState> num_parallel_calls_;
     const bool deterministic_;
     const bool autotune_;
+    // Number of input elements whose predicates are evaluated by a single
+    // scheduled closure.
+    const int64_t predicate_batch_size_;
     // Counts the number of outstanding calls.
     int64_t num_calls_ TF_GUARDED_BY(*mu_) = 0;
     // Controls cancellation of `input_impl_`. Must be ordered before
@@ -629,6 +782,9 @@ class ParallelFilterDatasetOp::Dataset : public DatasetBase {
   const int64_t num_parallel_calls_;
   const DeterminismPolicy deterministic_;
   const std::unique_ptr<CapturedFunction> captured_func_;
+  // Read from `TF_DATA_PARALLEL_FILTER_PREDICATE_BATCH_SIZE`. Values greater
+  // than 1 group that many input elements into each predicate task.
+  int64_t predicate_batch_size_ = 1;
 };
 
 ParallelFilterDatasetOp::ParallelFilterDatasetOp(OpKernelConstruction* ctx)
@@ -14,8 +14,10 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parallel_filter_dataset_op.h"
 
+#include <cstdlib>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "tensorflow/core/data/dataset_test_base.h"
 
@@ -24,6 +26,8 @@ namespace data {
 namespace {
 
 constexpr char kNodeName[] = "parallel_map_dataset";
+constexpr char kPredicateBatchSizeEnvVar[] =
+    "TF_DATA_PARALLEL_FILTER_PREDICATE_BATCH_SIZE";
 
 class ParallelFilterDatasetParams : public DatasetParams {
  public:
@@ -426,6 +430,76 @@ INSTANTIATE_TEST_SUITE_P(
                          InvalidPredFuncFilterDatasetParams2(),
                          InvalidPredFuncFilterDatasetParams3()}));
 
+// Groups input elements so that a single scheduled closure evaluates the
+// predicates of several elements.
+class BatchedPredicateParallelFilterDatasetOpTest
+    : public ParallelFilterDatasetOpTest {
+ protected:
+  void SetUp() override {
+    setenv(kPredicateBatchSizeEnvVar, "4", /*overwrite=*/1);
+  }
+
+  void TearDown() override { unsetenv(kPredicateBatchSizeEnvVar); }
+};
+
+class ParameterizedBatchedPredicateGetNextTest
+    : public BatchedPredicateParallelFilterDatasetOpTest,
+      public ::testing::WithParamInterface<
+          GetNextTestCase<ParallelFilterDatasetParams>> {};
+
+TEST_P(ParameterizedBatchedPredicateGetNextTest, GetNext) {
+  auto test_case = GetParam();
+  TF_ASSERT_OK(Initialize(test_case.dataset_params));
+  TF_ASSERT_OK(CheckIteratorGetNext(test_case.expected_outputs,
+                                    /*compare_order=*/test_case.compare_order));
+}
+
+INSTANTIATE_TEST_SUITE_P(BatchedPredicateParallelFilterDatasetOpTest,
+                         ParameterizedBatchedPredicateGetNextTest,
+                         ::testing::ValuesIn(GetNextTestCases()));
+
+class ParameterizedBatchedPredicateSaveAndRestoreTest
+    : public BatchedPredicateParallelFilterDatasetOpTest,
+      public ::testing::WithParamInterface<
+          IteratorSaveAndRestoreTestCase<ParallelFilterDatasetParams>> {};
+
+TEST_P(ParameterizedBatchedPredicateSaveAndRestoreTest,
+       IteratorSaveAndRestore) {
+  auto test_case = GetParam();
+  TF_ASSERT_OK(Initialize(test_case.dataset_params));
+  TF_ASSERT_OK(CheckIteratorSaveAndRestore(
+      test_case.dataset_params.iterator_prefix(), test_case.expected_outputs,
+      test_case.breakpoints, test_case.compare_order));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    BatchedPredicateParallelFilterDatasetOpTest,
+    ParameterizedBatchedPredicateSaveAndRestoreTest,
+    ::testing::ValuesIn(IteratorSaveAndRestoreTestCases()));
+
+class ParameterizedBatchedInvalidPredicateFuncTest
+    : public BatchedPredicateParallelFilterDatasetOpTest,
+      public ::testing::WithParamInterface<ParallelFilterDatasetParams> {};
+
+TEST_P(ParameterizedBatchedInvalidPredicateFuncTest, InvalidPredicateFunc) {
+  auto dataset_params = GetParam();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  EXPECT_EQ(
+      iterator_->GetNext(iterator_ctx_.get(), &out_tensors, &end_of_sequence)
+          .code(),
+      absl::StatusCode::kInvalidArgument);
+  EXPECT_TRUE(out_tensors.empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    BatchedPredicateParallelFilterDatasetOpTest,
+    ParameterizedBatchedInvalidPredicateFuncTest,
+    ::testing::ValuesIn({InvalidPredFuncFilterDatasetParams1(),
+                         InvalidPredFuncFilterDatasetParams2(),
+                         InvalidPredFuncFilterDatasetParams3()}));
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
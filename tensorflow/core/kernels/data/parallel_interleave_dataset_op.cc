@@ -45,6 +45,7 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/blocking_counter.h"
 #include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env_time.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/stringprintf.h"
 #include "tensorflow/core/profiler/lib/traceme.h"
@@ -109,6 +110,11 @@ constexpr char kParallelInterleaveDatasetV2[] = "ParallelInterleaveDatasetV2";
 constexpr char kParallelInterleaveDatasetV3[] = "ParallelInterleaveDatasetV3";
 constexpr char kParallelInterleaveDatasetV4[] = "ParallelInterleaveDatasetV4";
 
+// Experiment that adapts the active cycle length and the prefetch depth of the
+// iterator to the observed latency of opening and reading its inputs.
+constexpr char kAdaptiveInterleaveCycleExperiment[] =
+    "adaptive_interleave_cycle";
+
 // `kCyclePrefetchFactor * cycle_length` is the default number of future cycle
 // elements that will be prefetched ahead of time. The purpose of prefetching
 // future cycle elements is to overlap expensive initialization (e.g. opening of
@@ -120,6 +126,16 @@ constexpr int kDefaultCyclePrefetchFactor = 2;
 // match the behavior of the original implementation.
 constexpr double kDefaultPerIteratorPrefetchFactor = 2.0L;
 
+// `kMaxCyclePrefetchFactor * cycle_length` is the maximum number of future
+// cycle elements when the prefetch depth adapts to the input latency.
+constexpr int kMaxCyclePrefetchFactor = 4;
+
+// Weight of the latest sample in the moving averages of the input latencies.
+constexpr double kInputLatencyEmaWeight = 0.1;
+
+// Minimum period between adaptations to the input latency.
+constexpr int64_t kInputLatencyAdaptationPeriodMicros = 100 * 1000;
+
 // Period between reporting dataset statistics.
 constexpr int kStatsReportingPeriodMillis = 1000;
 
@@ -177,6 +193,41 @@ int64_t ComputeMaxBufferedElements(int64_t prefetch_input_elements,
   return (prefetch_input_elements + cycle_length) * buffer_output_elements;
 }
 
+// Returns the number of cycle elements needed to keep `parallelism` of them
+// producing, when each input spends `open_latency_us` being opened and then
+// `read_time_us` producing its elements. The extra elements let workers move
+// on to other inputs while some are still being opened.
+int64_t ComputeActiveCycleLength(double open_latency_us, double read_time_us,
+                                 int64_t parallelism, int64_t cycle_length) {
+  if (read_time_us <= 0) {
+    return cycle_length;
+  }
+  const double busy_fraction = read_time_us / (open_latency_us + read_time_us);
+  const int64_t active_cycle_length =
+      std::ceil(static_cast<double>(parallelism) / busy_fraction);
+  return std::clamp<int64_t>(active_cycle_length, 1, cycle_length);
+}
+
+// Returns the number of inputs to open ahead of the cycle so that opening an
+// input overlaps with consuming the inputs opened before it. `parallelism`
+// inputs are consumed concurrently, each in `read_time_us`.
+int64_t ComputePrefetchDepth(double open_latency_us, double read_time_us,
+                             int64_t parallelism,
+                             int64_t max_prefetch_input_elements) {
+  if (read_time_us <= 0) {
+    return max_prefetch_input_elements;
+  }
+  const int64_t prefetch_depth =
+      std::ceil(open_latency_us * parallelism / read_time_us) + 1;
+  return std::min(prefetch_depth, max_prefetch_input_elements);
+}
+
+void UpdateMovingAverage(double sample, double& average) {
+  average = average == 0 ? sample
+                         : (1.0 - kInputLatencyEmaWeight) * average +
+                               kInputLatencyEmaWeight * sample;
+}
+
 int64_t OpVersionFromOpName(absl::string_view op_name) {
   if (op_name == kParallelInterleaveDatasetV2) {
     return 2;
@@ -213,6 +264,8 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
             ComputeBufferOutputElements(buffer_output_elements, block_length)),
         prefetch_input_elements_(ComputePrefetchInputElements(
             prefetch_input_elements, cycle_length_)),
+        adapt_to_input_latency_(
+            GetExperiments().contains(kAdaptiveInterleaveCycleExperiment)),
         num_parallel_calls_(num_parallel_calls),
         deterministic_(deterministic),
         output_types_(output_types),
@@ -365,6 +418,18 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
               params.dataset->num_parallel_calls_, mu_,
               num_parallel_calls_cond_var_)),
           deterministic_(deterministic),
+          adapt_cycle_length_(params.dataset->adapt_to_input_latency_ &&
+                              !deterministic),
+          active_cycle_length_(std::make_shared<model::SharedState>(
+              params.dataset->cycle_length_, mu_,
+              std::make_shared<condition_variable>())),
+          max_prefetch_depth_(
+              params.dataset->adapt_to_input_latency_
+                  ? std::max<int64_t>(params.dataset->prefetch_input_elements_,
+                                      kMaxCyclePrefetchFactor *
+                                          params.dataset->cycle_length_)
+                  : params.dataset->prefetch_input_elements_),
+          prefetch_depth_(params.dataset->prefetch_input_elements_),
           current_elements_(params.dataset->cycle_length_) {}
 
     ~ParallelInterleaveIterator() override { CancelThreads(/*wait=*/true); }
@@ -386,10 +451,9 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       //
       // Allocate one thread for the worker manager, one thread for stats
       // collection, `cycle_length_` threads for the current workers, and
-      // `future_elements_prefetch_` for the future workers.
+      // `max_prefetch_depth_ + cycle_length_` for the future workers.
       int max_current_workers = dataset()->cycle_length_;
-      int future_workers =
-          dataset()->prefetch_input_elements_ + dataset()->cycle_length_;
+      int future_workers = max_prefetch_depth_ + dataset()->cycle_length_;
       int num_threads = 1 + max_current_workers + future_workers;
       if (ctx->stats_aggregator()) {
         num_threads++;
@@ -481,11 +545,16 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
                                 /*max=*/dataset()->cycle_length_),
            model::MakeNonTunableParameter(kCycleLength,
                                           dataset()->cycle_length_),
+           // The active cycle length is tuned by the iterator itself (see
+           // `AdaptToInputLatency()`), so it is not tunable by the model.
+           model::MakeParameter(model::kActiveCycleLength,
+                                active_cycle_length_, /*min=*/1,
+                                /*max=*/dataset()->cycle_length_),
            model::MakeNonTunableParameter(kDeterministic,
                                           deterministic_ ? 1.0 : 0.0),
            model::MakeNonTunableParameter(
                kMaxBufferedElements,
-               ComputeMaxBufferedElements(dataset()->prefetch_input_elements_,
+               ComputeMaxBufferedElements(max_prefetch_depth_,
                                           dataset()->buffer_output_elements_,
                                           dataset()->cycle_length_))});
     }
@@ -586,10 +655,12 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       int64_t parallelism = -1;
       int64_t results_ready = -1;
       int64_t active_elements = -1;
+      int64_t active_cycle_length = -1;
       // NOTE: We only set the parallelism value if the lock can be acquired
       // right away to avoid introducing tracing overhead.
       if (mu_->try_lock()) {
         parallelism = num_parallel_calls_->value;
+        active_cycle_length = active_cycle_length_->value;
         results_ready = 0;
         active_elements = 0;
         for (int i = 0; i < current_elements_.size(); ++i) {
@@ -618,6 +689,12 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           results_ready == -1 ? kTraceInfoUnavailable
                               : strings::Printf("%lld", static_cast<long long>(
                                                             active_elements))));
+      result.push_back(std::make_pair(
+          "active_cycle_length",
+          active_cycle_length == -1
+              ? kTraceInfoUnavailable
+              : strings::Printf("%lld",
+                                static_cast<long long>(active_cycle_length))));
       result.push_back(std::make_pair(
           "interleave_depth",
           strings::Printf("%lld", static_cast<long long>(interleave_depth_))));
@@ -668,6 +745,14 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       // Whether we tried to initialize the element, but the input iterator
       // was exhausted so we could produce no inputs.
       bool no_input TF_GUARDED_BY(&ParallelInterleaveIterator::mu_) = false;
+      // Time spent getting the input element and creating the iterator. Only
+      // measured when adapting to the input latency.
+      int64_t initialization_time_us
+          TF_GUARDED_BY(&ParallelInterleaveIterator::mu_) = 0;
+      // Whether `iterator` has returned from its first `GetNext` call.
+      bool opened TF_GUARDED_BY(&ParallelInterleaveIterator::mu_) = false;
+      // Number of results produced by `iterator`.
+      int64_t num_results TF_GUARDED_BY(&ParallelInterleaveIterator::mu_) = 0;
       // Condition variable for communicating between current worker threads
       // and GetNext.
       condition_variable cond_var;
@@ -762,6 +847,9 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       if (deterministic_) {
         return ConsumeHelper(ctx, result);
       }
+      if (adapt_cycle_length_) {
+        FillActiveCycle(ctx);
+      }
       // If we are allowed to be nondeterministic (i.e. return results out of
       // order), try to find an element in the cycle that has a result
       // available.
@@ -814,8 +902,10 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
         }
         // We've consumed all results from the element. Get a new element from
         // future_elements, or create a new element if no future elements are
-        // available.
-        if (!future_elements_.empty()) {
+        // available. If the slot is past the active cycle, leave it empty.
+        const bool in_active_cycle =
+            cycle_index_ < static_cast<int64_t>(active_cycle_length_->value);
+        if (in_active_cycle && !future_elements_.empty()) {
           std::shared_ptr<Element> future_element =
               std::move(future_elements_.front());
           future_elements_.pop_front();
@@ -829,7 +919,8 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
             current_workers_cond_var_.notify_one();
           }
         } else {
-          current_elements_[cycle_index_] = MakeElement(ctx);
+          current_elements_[cycle_index_] =
+              in_active_cycle ? MakeElement(ctx) : nullptr;
           if (current_elements_[cycle_index_]) {
             current_elements_[cycle_index_]->cycle_index = cycle_index_;
             elements_to_process_.push_back(cycle_index_);
@@ -852,6 +943,39 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       }
     }
 
+    // Fills the empty slots of the active cycle, e.g. after it has grown.
+    void FillActiveCycle(IteratorContext* ctx)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const int64_t active_cycle_length = active_cycle_length_->value;
+      for (int64_t i = 0; i < active_cycle_length && !end_of_input_; ++i) {
+        if (current_elements_[i]) {
+          continue;
+        }
+        std::shared_ptr<Element> element;
+        if (!future_elements_.empty()) {
+          element = std::move(future_elements_.front());
+          future_elements_.pop_front();
+          if (element->iterator) {
+            EnableAutotune(ctx, element->iterator.get());
+          }
+          future_workers_cond_var_.notify_one();
+        } else {
+          element = MakeElement(ctx);
+          if (!element) {
+            break;
+          }
+        }
+        element->cycle_index = i;
+        if (!element->active) {
+          elements_to_process_.push_back(i);
+          current_workers_cond_var_.notify_one();
+        }
+        current_elements_[i] = std::move(element);
+        last_valid_current_element_ =
+            std::max(last_valid_current_element_, i);
+      }
+    }
+
     // Creates a new element.
     std::shared_ptr<Element> MakeElement(IteratorContext* ctx)
         TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
@@ -881,8 +1005,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       // `cycle_length_` future workers to guarantee that whenever
       // `future_element_.size() < future_elements_prefetch_`, there will be a
       // future worker available to create a new future element.
-      int future_workers =
-          dataset()->prefetch_input_elements_ + dataset()->cycle_length_;
+      int future_workers = max_prefetch_depth_ + dataset()->cycle_length_;
       {
         mutex_lock l(*mu_);
         initial_current_workers = num_parallel_calls_->value;
@@ -1036,8 +1159,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
               current_workers_cond_var_.notify_one();
             }
           }
-          while (!cancelled_ && (future_elements_.size() >=
-                                     dataset()->prefetch_input_elements_ ||
+          while (!cancelled_ && (future_elements_.size() >= prefetch_depth_ ||
                                  wait_for_checkpoint_)) {
             WaitWorkerThread(ctx.get(), &future_workers_cond_var_, &l);
           }
@@ -1091,11 +1213,17 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
         });
         bool end_of_input = false;
         IteratorContext nested_ctx = MakeNestedIteratorContext(ctx);
+        const int64_t start_us =
+            dataset()->adapt_to_input_latency_ ? EnvTime::NowMicros() : 0;
         result->status = iterator->GetNext(&nested_ctx, &result->return_values,
                                            &end_of_input);
+        const int64_t latency_us =
+            dataset()->adapt_to_input_latency_ ? EnvTime::NowMicros() - start_us
+                                               : 0;
         result->checkpoint.Merge(nested_ctx.checkpoint());
         if (result->status.ok() && end_of_input) {
           mutex_lock l(*mu_);
+          RecordInputLatency(*element, latency_us, /*end_of_input=*/true);
           element->iterator.reset();
           // If symbolic checkpointing is enabled, element inputs can only be
           // garbage collected after all element results have been consumed.
@@ -1107,6 +1235,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
         }
         RecordBufferEnqueue(ctx, result->return_values);
         mutex_lock l(*mu_);
+        RecordInputLatency(*element, latency_us, /*end_of_input=*/false);
         element->results.push_back(std::move(result));
         NotifyElementUpdate(*element);
         if (element->results.size() == dataset()->buffer_output_elements_) {
@@ -1129,6 +1258,8 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
             "ParallelInterleaveInitializeInput",
             {{"input_element_id", input_element_id}});
       });
+      const int64_t start_us =
+          dataset()->adapt_to_input_latency_ ? EnvTime::NowMicros() : 0;
       std::vector<Tensor> inputs;
       // TODO(aaudibert): Refactor the implementation to move calls of
       // `GetNext` out of the scope of `mu_`.
@@ -1161,6 +1292,69 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       if (element.cycle_index == -1) {
         DisableAutotune(ctx, element.iterator.get());
       }
+      if (dataset()->adapt_to_input_latency_) {
+        element.initialization_time_us = EnvTime::NowMicros() - start_us;
+      }
+    }
+
+    // Records the latency of a `GetNext` call on the iterator of `element`.
+    // The first call typically opens the underlying input (e.g. a file), so it
+    // counts towards the time to open the input.
+    void RecordInputLatency(Element& element, int64_t latency_us,
+                            bool end_of_input)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!dataset()->adapt_to_input_latency_) {
+        return;
+      }
+      if (!element.opened) {
+        element.opened = true;
+        const int64_t open_latency_us =
+            element.initialization_time_us + latency_us;
+        UpdateMovingAverage(open_latency_us, input_open_latency_us_);
+        metrics::RecordTFDataInterleaveInputOpenLatency(open_latency_us);
+      } else if (!end_of_input) {
+        UpdateMovingAverage(latency_us, input_read_latency_us_);
+      }
+      if (end_of_input) {
+        UpdateMovingAverage(element.num_results, elements_per_input_);
+      } else {
+        ++element.num_results;
+      }
+      AdaptToInputLatency();
+    }
+
+    // Resizes the prefetch depth, and the active cycle if it is adaptive, so
+    // that the time to open inputs overlaps with reading other inputs.
+    void AdaptToInputLatency() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const int64_t now_us = EnvTime::NowMicros();
+      // Nothing is known about the time to read an input until one of them
+      // has been read to the end.
+      if (elements_per_input_ == 0 || input_read_latency_us_ == 0 ||
+          now_us - last_adaptation_time_us_ <
+              kInputLatencyAdaptationPeriodMicros) {
+        return;
+      }
+      last_adaptation_time_us_ = now_us;
+      const double read_time_us = elements_per_input_ * input_read_latency_us_;
+      const int64_t parallelism = num_parallel_calls_->value;
+      const int64_t prefetch_depth =
+          ComputePrefetchDepth(input_open_latency_us_, read_time_us,
+                               parallelism, max_prefetch_depth_);
+      if (prefetch_depth > prefetch_depth_) {
+        future_workers_cond_var_.notify_all();
+      }
+      prefetch_depth_ = prefetch_depth;
+      if (adapt_cycle_length_) {
+        active_cycle_length_->value =
+            ComputeActiveCycleLength(input_open_latency_us_, read_time_us,
+                                     parallelism, dataset()->cycle_length_);
+      }
+      VLOG(3) << "Adapted to input open latency " << input_open_latency_us_
+              << "us and read time " << read_time_us << "us: active cycle "
+              << "length " << active_cycle_length_->value
+              << ", prefetch depth " << prefetch_depth_;
+      metrics::RecordTFDataInterleaveCycle(active_cycle_length_->value,
+                                           prefetch_depth_);
     }
 
     // Adds an error result for the given element.
@@ -1672,6 +1866,31 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
     // Determines whether outputs can be produced in deterministic order.
     const bool deterministic_;
 
+    // Whether the active cycle length adapts to the input latency. Changing it
+    // changes the order of the outputs, so this requires `!deterministic_`.
+    const bool adapt_cycle_length_;
+
+    // Number of leading `current_elements_` slots that are kept filled. When
+    // it shrinks, slots past it are left empty once their elements are
+    // exhausted. Equal to `cycle_length_` unless `adapt_cycle_length_`.
+    const std::shared_ptr<model::SharedState> active_cycle_length_;
+
+    // Maximum value of `prefetch_depth_`, which sizes the future workers.
+    const int64_t max_prefetch_depth_;
+
+    // Target number of `future_elements_`.
+    int64_t prefetch_depth_ TF_GUARDED_BY(mu_);
+
+    // Moving averages of the time it takes to open an input, i.e. to create
+    // its iterator and get its first element, of the time it takes to get any
+    // later element, and of the number of elements per input.
+    double input_open_latency_us_ TF_GUARDED_BY(mu_) = 0;
+    double input_read_latency_us_ TF_GUARDED_BY(mu_) = 0;
+    double elements_per_input_ TF_GUARDED_BY(mu_) = 0;
+
+    // Time of the last adaptation to the input latency.
+    int64_t last_adaptation_time_us_ TF_GUARDED_BY(mu_) = 0;
+
     // Controls cancellation of `input_impl_`. Must be ordered before
     // `input_impl_` so that `input_impl_` is destroyed first.
     std::unique_ptr<CancellationManager> cancellation_manager_;
@@ -1745,6 +1964,11 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
   const int64_t block_length_;
   const int64_t buffer_output_elements_;
   const int64_t prefetch_input_elements_;
+  // Whether iterators adapt their prefetch depth, and their active cycle length
+  // if they are not deterministic, to the latency of their inputs. The
+  // configured `cycle_length_` and `prefetch_input_elements_` are then the
+  // initial values.
+  const bool adapt_to_input_latency_;
   const int64_t num_parallel_calls_;
   const DeterminismPolicy deterministic_;
   const DataTypeVector output_types_;
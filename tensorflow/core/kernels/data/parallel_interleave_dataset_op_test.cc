@@ -13,6 +13,9 @@ limitations under the License.
 
 #include <algorithm>
 #include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
 
 #include "tensorflow/core/data/dataset_test_base.h"
 #include "tensorflow/core/graph/graph_def_builder.h"
@@ -429,6 +432,35 @@ ParallelInterleaveDatasetParams LongCycleDeterministicParams() {
       /*node_name=*/kNodeName);
 }
 
+// Interleaves 16 inputs of 2 elements each, with a cycle that is longer than
+// needed by its parallelism.
+ParallelInterleaveDatasetParams AdaptiveCycleParams(
+    const std::string& deterministic) {
+  std::vector<int64_t> values(32);
+  std::iota(values.begin(), values.end(), 0);
+  auto tensor_slice_dataset_params = TensorSliceDatasetParams(
+      /*components=*/{CreateTensor<int64_t>(TensorShape{16, 2, 1}, values)},
+      /*node_name=*/"tensor_slice");
+  return ParallelInterleaveDatasetParams(
+      tensor_slice_dataset_params,
+      /*other_arguments=*/{},
+      /*cycle_length=*/4,
+      /*block_length=*/1,
+      /*buffer_output_elements=*/1,
+      /*prefetch_input_elements=*/1,
+      /*num_parallel_calls=*/1,
+      /*func=*/
+      MakeTensorSliceDatasetFunc(
+          DataTypeVector({DT_INT64}),
+          std::vector<PartialTensorShape>({PartialTensorShape({1})})),
+      /*func_lib=*/{test::function::MakeTensorSliceDataset()},
+      /*type_arguments=*/{},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({1})},
+      /*deterministic=*/deterministic,
+      /*node_name=*/kNodeName);
+}
+
 ParallelInterleaveDatasetParams
 ParallelInterleaveDatasetParamsWithInvalidCycleLength() {
   auto tensor_slice_dataset_params = TensorSliceDatasetParams(
@@ -729,6 +761,37 @@ TEST_F(ParallelInterleaveDatasetOpTest, InputCycleLengthPreservedInGraphDef) {
   unsetenv("TF_DATA_EXPERIMENT_OPT_IN");
 }
 
+// Tests that adapting to the input latency keeps the order of the outputs of
+// a deterministic iterator, and the set of outputs of a nondeterministic one.
+TEST_F(ParallelInterleaveDatasetOpTest, AdaptToInputLatency) {
+  setenv("TF_JOB_NAME", "test_job", /*overwrite=*/1);
+  setenv("TF_TASK_ID", "0", /*overwrite=*/1);
+  setenv("TF_DATA_EXPERIMENT_OPT_IN", "adaptive_interleave_cycle",
+         /*overwrite=*/1);
+  // Input `n` consists of `2 * n` and `2 * n + 1`.
+  std::vector<Tensor> deterministic_outputs;
+  for (int64_t i = 0; i < 4; ++i) {
+    for (int64_t j = 0; j < 2; ++j) {
+      for (int64_t k = 0; k < 4; ++k) {
+        deterministic_outputs.push_back(
+            CreateTensor<int64_t>(TensorShape{1}, {(4 * i + k) * 2 + j}));
+      }
+    }
+  }
+  for (const std::string& deterministic :
+       {DeterminismPolicy::kDeterministic,
+        DeterminismPolicy::kNondeterministic}) {
+    auto dataset_params = AdaptiveCycleParams(deterministic);
+    TF_ASSERT_OK(Initialize(dataset_params));
+    TF_EXPECT_OK(CheckIteratorGetNext(
+        deterministic_outputs,
+        /*compare_order=*/deterministic == DeterminismPolicy::kDeterministic));
+  }
+  unsetenv("TF_JOB_NAME");
+  unsetenv("TF_TASK_ID");
+  unsetenv("TF_DATA_EXPERIMENT_OPT_IN");
+}
+
 TEST_F(ParallelInterleaveDatasetOpTest, DatasetNodeName) {
   auto dataset_params = ParallelInterleaveDatasetParams1();
   TF_ASSERT_OK(Initialize(dataset_params));
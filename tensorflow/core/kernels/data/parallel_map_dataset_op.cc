@@ -92,6 +92,31 @@ constexpr int kStatsReportingPeriodMillis = 1000;
 // large values for the parallelism, e.g. creating 300k threads.
 constexpr int kUnboundedThreadpoolAutotuningFactor = 10;
 
+constexpr char kJitCompileMapExperiment[] = "jit_compile_map";
+
+// Returns an error explaining why the map function can not be compiled for
+// `input`: XLA needs the shapes of all arguments up front, and it can not
+// compile strings, variants or resources.
+absl::Status CheckJitCompilable(const DatasetBase* input,
+                                const OpInputList& captured) {
+  for (int i = 0; i < input->output_shapes().size(); ++i) {
+    const PartialTensorShape& shape = input->output_shapes()[i];
+    if (!shape.IsFullyDefined()) {
+      return errors::Unimplemented("component ", i, " of its input has shape ",
+                                   shape.DebugString(),
+                                   ", which is not fully defined");
+    }
+  }
+  for (int i = 0; i < captured.size(); ++i) {
+    const DataType dtype = captured[i].dtype();
+    if (dtype == DT_STRING || dtype == DT_VARIANT || dtype == DT_RESOURCE) {
+      return errors::Unimplemented("captured input ", i, " has type ",
+                                   DataTypeString(dtype));
+    }
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace
 
 class ParallelMapDatasetOp::Dataset : public DatasetBase {
@@ -482,6 +507,10 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
       result.push_back(
           std::make_pair("use_unbounded_threadpool",
                          use_unbounded_threadpool_ ? "true" : "false"));
+      const bool jit_compile = instantiated_captured_func_ &&
+                               instantiated_captured_func_->jit_compile();
+      result.push_back(
+          std::make_pair("jit_compile", jit_compile ? "true" : "false"));
       result.push_back(std::make_pair(
           "parallelism",
           parallelism == -1
@@ -648,10 +677,13 @@ class ParallelMapDatasetOp::Dataset : public DatasetBase {
         tf_shared_lock l(*mu_);  // mu_ == num_parallel_calls_->mu
         new_calls.reserve(num_parallel_calls_->value);
       }
+      // While the pipeline is at its memory limit, no new calls are started
+      // unless there are no results to wait for.
       auto busy = [this]() TF_EXCLUSIVE_LOCKS_REQUIRED(*mu_) -> bool {
         int64_t num_parallel_calls = num_parallel_calls_->value;
         return num_calls_ >= num_parallel_calls ||
-               invocation_results_.size() >= num_parallel_calls;
+               invocation_results_.size() >= num_parallel_calls ||
+               (!invocation_results_.empty() && MemoryLimitReached());
       };
       while (true) {
         {
@@ -840,6 +872,11 @@ ParallelMapDatasetOp::ParallelMapDatasetOp(OpKernelConstruction* ctx)
                                    &params.use_inter_op_parallelism));
   OP_REQUIRES_OK(ctx,
                  FunctionMetadata::Create(ctx, kFunc, params, &func_metadata_));
+  if (GetExperiments().contains(kJitCompileMapExperiment)) {
+    params.jit_compile = true;
+    OP_REQUIRES_OK(ctx, FunctionMetadata::Create(ctx, kFunc, params,
+                                                 &jit_func_metadata_));
+  }
   OP_REQUIRES_OK(ctx, ctx->GetAttr(kOutputTypes, &output_types_));
   OP_REQUIRES_OK(ctx, ctx->GetAttr(kOutputShapes, &output_shapes_));
   if (op_version_ == 1) {
@@ -882,9 +919,23 @@ void ParallelMapDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
       ctx, num_parallel_calls > 0 || num_parallel_calls == model::kAutotune,
       errors::InvalidArgument("num_parallel_calls must be greater than zero."));
 
+  // Runs the XLA-compiled function if it can be compiled for the input, and
+  // falls back to the executor otherwise.
+  std::shared_ptr<FunctionMetadata> func_metadata = func_metadata_;
+  if (jit_func_metadata_ && jit_func_metadata_->jit_compile()) {
+    OpInputList captured;
+    OP_REQUIRES_OK(ctx, ctx->input_list(kOtherArguments, &captured));
+    absl::Status s = CheckJitCompilable(input, captured);
+    if (s.ok()) {
+      func_metadata = jit_func_metadata_;
+    } else {
+      VLOG(1) << "Running " << func_metadata_->func().name()
+              << " without XLA because " << s.message() << ".";
+    }
+  }
   std::unique_ptr<CapturedFunction> captured_func;
   OP_REQUIRES_OK(ctx,
-                 CapturedFunction::Create(ctx, func_metadata_, kOtherArguments,
+                 CapturedFunction::Create(ctx, func_metadata, kOtherArguments,
                                           &captured_func));
 
   if (num_parallel_calls == model::kAutotune) {
@@ -51,6 +51,9 @@ class ParallelMapDatasetOp : public UnaryDatasetOpKernel {
   class Dataset;
   const int op_version_;
   std::shared_ptr<FunctionMetadata> func_metadata_ = nullptr;
+  // Metadata of the XLA-compiled version of the function, used for inputs
+  // with static shapes. Only set if the `jit_compile_map` experiment is on.
+  std::shared_ptr<FunctionMetadata> jit_func_metadata_ = nullptr;
   DataTypeVector output_types_;
   std::vector<PartialTensorShape> output_shapes_;
   bool sloppy_;
@@ -11,19 +11,45 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parallel_map_dataset_op.h"
 
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <gtest/gtest.h>
+#include "absl/cleanup/cleanup.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
 #include "xla/tsl/lib/core/status_test_util.h"
 #include "tensorflow/core/data/dataset_test_base.h"
 #include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/framework/common_shape_fns.h"
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/monitoring/cell_reader.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace data {
 namespace {
 
+using ::tensorflow::monitoring::testing::CellReader;
+
 constexpr char kNodeName[] = "parallel_map_dataset";
 constexpr int kOpVersion = 2;
 
+// Whether XLA JIT is linked in, as in `parallel_map_dataset_op_jit_test`.
+#ifdef TF_DATA_TEST_XLA_JIT
+constexpr bool kXlaJitLinked = true;
+#else
+constexpr bool kXlaJitLinked = false;
+#endif  // TF_DATA_TEST_XLA_JIT
+
 class ParallelMapDatasetParams : public DatasetParams {
  public:
   template <typename T>
@@ -457,6 +483,285 @@ TEST_F(ParallelMapDatasetOpTest, InvalidNumParallelCalls) {
             absl::StatusCode::kInvalidArgument);
 }
 
+// Returns a map function `f(x, c)` that applies `num_layers` elementwise
+// layers `y = tanh(y * c + c)` to `y = c * x`, where `c` is a float vector.
+FunctionDef ElementwiseLayers(int num_layers) {
+  std::vector<FunctionDefHelper::Node> nodes = {
+      {{"x_float"}, "Cast", {"x"}, {{"SrcT", DT_INT64}, {"DstT", DT_FLOAT}}},
+      {{"y_0"}, "Mul", {"c", "x_float"}, {{"T", DT_FLOAT}}}};
+  for (int i = 0; i < num_layers; ++i) {
+    const std::string mul = absl::StrCat("mul_", i);
+    const std::string add = absl::StrCat("add_", i);
+    const std::string y =
+        i + 1 == num_layers ? "y" : absl::StrCat("y_", i + 1);
+    nodes.push_back(
+        {{mul}, "Mul", {absl::StrCat("y_", i), "c"}, {{"T", DT_FLOAT}}});
+    nodes.push_back({{add}, "Add", {mul, "c"}, {{"T", DT_FLOAT}}});
+    nodes.push_back({{y}, "Tanh", {add}, {{"T", DT_FLOAT}}});
+  }
+  return FunctionDefHelper::Define(
+      /*function_name=*/"ElementwiseLayers",
+      /*arg_def=*/{"x: int64", "c: float"},
+      /*ret_def=*/{"y: float"},
+      /*attr_def=*/{}, nodes);
+}
+
+ParallelMapDatasetParams ElementwiseLayersParams(int64_t num_elements,
+                                                 int64_t vector_size,
+                                                 int num_layers) {
+  return ParallelMapDatasetParams(
+      RangeDatasetParams(0, num_elements, 1),
+      /*other_arguments=*/
+      {CreateTensor<float>(TensorShape({vector_size}),
+                           std::vector<float>(vector_size, 0.5f))},
+      /*num_parallel_calls=*/4,
+      /*func=*/FunctionDefHelper::FunctionRef("ElementwiseLayers"),
+      /*func_lib=*/{ElementwiseLayers(num_layers)},
+      /*type_arguments=*/{DT_FLOAT},
+      /*output_dtypes=*/{DT_FLOAT},
+      /*output_shapes=*/{PartialTensorShape({vector_size})},
+      /*use_inter_op_parallelism=*/true,
+      /*deterministic=*/DeterminismPolicy::kDeterministic,
+      /*preserve_cardinality=*/true,
+      /*node_name=*/kNodeName);
+}
+
+// Opts into the `jit_compile_map` experiment until the returned object is
+// destroyed.
+auto OptIntoJitCompileMap() {
+  setenv("TF_JOB_NAME", "test_job", /*overwrite=*/1);
+  setenv("TF_TASK_ID", "0", /*overwrite=*/1);
+  setenv("TF_DATA_EXPERIMENT_OPT_IN", "jit_compile_map", /*overwrite=*/1);
+  return absl::MakeCleanup([] {
+    unsetenv("TF_JOB_NAME");
+    unsetenv("TF_TASK_ID");
+    unsetenv("TF_DATA_EXPERIMENT_OPT_IN");
+  });
+}
+
+// Returns whether the map iterator `iterator` runs the XLA-compiled function,
+// according to its trace metadata.
+bool UsesJitFunction(IteratorBase* iterator) {
+  return absl::StrContains(
+      static_cast<DatasetBaseIterator*>(iterator)->BuildTraceMeName(),
+      ",jit_compile=true");
+}
+
+// Compiling the map function with XLA falls back to the executor when XLA is
+// not linked in, so the outputs are the same either way.
+TEST_F(ParallelMapDatasetOpTest, JitCompileMap) {
+  auto experiment = OptIntoJitCompileMap();
+  auto dataset_params = ParallelMapDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  EXPECT_EQ(UsesJitFunction(iterator_.get()), kXlaJitLinked);
+  TF_EXPECT_OK(CheckIteratorGetNext(
+      CreateTensors<int64_t>(TensorShape{}, {{0}, {6}, {12}, {18}}),
+      /*compare_order=*/true));
+
+  auto layers_params = ElementwiseLayersParams(
+      /*num_elements=*/3, /*vector_size=*/2, /*num_layers=*/1);
+  TF_ASSERT_OK(Initialize(layers_params));
+  for (int64_t i = 0; i < 3; ++i) {
+    std::vector<Tensor> next;
+    bool end_of_sequence = false;
+    TF_ASSERT_OK(
+        iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+    ASSERT_FALSE(end_of_sequence);
+    ASSERT_EQ(next.size(), 1);
+    const float y = std::tanh(0.5f * i * 0.5f + 0.5f);
+    test::ExpectTensorNear<float>(
+        next[0], CreateTensor<float>(TensorShape({2}), {y, y}), 1e-6);
+  }
+}
+
+TEST_F(ParallelMapDatasetOpTest, JitCompileMapFallsBackForDynamicShapes) {
+  auto experiment = OptIntoJitCompileMap();
+  // The inner map hides the static shape of the range elements.
+  auto dynamic_shape_params = ParallelMapDatasetParams(
+      RangeDatasetParams(0, 10, 3),
+      /*other_arguments=*/{},
+      /*num_parallel_calls=*/1,
+      /*func=*/MapFunc("XTimesTwo", DT_INT64),
+      /*func_lib*/ {test::function::XTimesTwo()},
+      /*type_arguments=*/{},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape()},
+      /*use_inter_op_parallelism=*/false,
+      /*deterministic=*/DeterminismPolicy::kDeterministic,
+      /*preserve_cardinality=*/false,
+      /*node_name=*/"inner_map");
+  auto dataset_params = ParallelMapDatasetParams(
+      std::move(dynamic_shape_params),
+      /*other_arguments=*/{},
+      /*num_parallel_calls=*/1,
+      /*func=*/MapFunc("XTimesTwo", DT_INT64),
+      /*func_lib*/ {test::function::XTimesTwo()},
+      /*type_arguments=*/{},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape()},
+      /*use_inter_op_parallelism=*/false,
+      /*deterministic=*/DeterminismPolicy::kDeterministic,
+      /*preserve_cardinality=*/false,
+      /*node_name=*/kNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  EXPECT_FALSE(UsesJitFunction(iterator_.get()));
+  TF_EXPECT_OK(CheckIteratorGetNext(
+      CreateTensors<int64_t>(TensorShape{}, {{0}, {12}, {24}, {36}}),
+      /*compare_order=*/true));
+}
+
+TEST_F(ParallelMapDatasetOpTest, NoJitCompileWithoutExperiment) {
+  auto dataset_params = ParallelMapDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  EXPECT_FALSE(UsesJitFunction(iterator_.get()));
+}
+
+#ifdef TF_DATA_TEST_XLA_JIT
+// XLA compiles the map function once per input shape and reuses the
+// executable for every element of that shape.
+TEST_F(ParallelMapDatasetOpTest, JitCompileMapCompilesPerShape) {
+  auto experiment = OptIntoJitCompileMap();
+  CellReader<int64_t> compilations("/tensorflow/core/xla_compilations");
+  auto get_all = [this](int64_t vector_size) {
+    auto dataset_params = ElementwiseLayersParams(
+        /*num_elements=*/8, vector_size, /*num_layers=*/2);
+    TF_ASSERT_OK(Initialize(dataset_params));
+    EXPECT_TRUE(UsesJitFunction(iterator_.get()));
+    bool end_of_sequence = false;
+    int64_t num_elements = 0;
+    while (!end_of_sequence) {
+      std::vector<Tensor> next;
+      TF_ASSERT_OK(
+          iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+      if (!end_of_sequence) {
+        ASSERT_EQ(next.size(), 1);
+        EXPECT_EQ(next[0].NumElements(), vector_size);
+        ++num_elements;
+      }
+    }
+    EXPECT_EQ(num_elements, 8);
+  };
+
+  get_all(/*vector_size=*/2);
+  EXPECT_GT(compilations.Delta(), 0);
+  get_all(/*vector_size=*/2);
+  EXPECT_EQ(compilations.Delta(), 0);
+  get_all(/*vector_size=*/3);
+  EXPECT_GT(compilations.Delta(), 0);
+}
+#endif  // TF_DATA_TEST_XLA_JIT
+
+// An op that XLA has no kernel for.
+REGISTER_OP("ParallelMapDatasetOpTest>TimesTwo")
+    .Input("x: int64")
+    .Output("y: int64")
+    .SetShapeFn(shape_inference::UnchangedShape);
+
+class TimesTwoOp : public OpKernel {
+ public:
+  explicit TimesTwoOp(OpKernelConstruction* ctx) : OpKernel(ctx) {}
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& x = ctx->input(0);
+    Tensor* y;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, x.shape(), &y));
+    y->flat<int64_t>() = x.flat<int64_t>() * int64_t{2};
+  }
+};
+
+REGISTER_KERNEL_BUILDER(
+    Name("ParallelMapDatasetOpTest>TimesTwo").Device(DEVICE_CPU), TimesTwoOp);
+
+FunctionDef TimesTwoWithoutXlaKernel() {
+  return FunctionDefHelper::Define(
+      /*function_name=*/"TimesTwoWithoutXlaKernel",
+      /*arg_def=*/{"x: int64"},
+      /*ret_def=*/{"y: int64"},
+      /*attr_def=*/{},
+      {{{"y"}, "ParallelMapDatasetOpTest>TimesTwo", {"x"}}});
+}
+
+TEST_F(ParallelMapDatasetOpTest, JitCompileMapFallsBackForOpsWithoutXla) {
+  auto experiment = OptIntoJitCompileMap();
+  auto dataset_params = ParallelMapDatasetParams(
+      RangeDatasetParams(0, 10, 3),
+      /*other_arguments=*/{},
+      /*num_parallel_calls=*/2,
+      /*func=*/FunctionDefHelper::FunctionRef("TimesTwoWithoutXlaKernel"),
+      /*func_lib*/ {TimesTwoWithoutXlaKernel()},
+      /*type_arguments=*/{},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({})},
+      /*use_inter_op_parallelism=*/false,
+      /*deterministic=*/DeterminismPolicy::kDeterministic,
+      /*preserve_cardinality=*/false,
+      /*node_name=*/kNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  EXPECT_FALSE(UsesJitFunction(iterator_.get()));
+  TF_EXPECT_OK(CheckIteratorGetNext(
+      CreateTensors<int64_t>(TensorShape{}, {{0}, {6}, {12}, {18}}),
+      /*compare_order=*/true));
+}
+
+// Maps `range(1024)` with `state.range(1)` elementwise layers over vectors of
+// `state.range(0)` floats, with the function compiled by XLA if
+// `state.range(2)` is 1. The XLA rows are only registered in
+// `parallel_map_dataset_op_jit_test`, which links XLA JIT in.
+class ParallelMapDatasetBenchmark : public ParallelMapDatasetOpTest {
+ public:
+  void TestBody() override {}
+
+  void Run(::testing::benchmark::State& state) {
+    constexpr int64_t kNumElements = 1024;
+    const int64_t vector_size = state.range(0);
+    const int num_layers = state.range(1);
+    if (state.range(2)) {
+      setenv("TF_JOB_NAME", "test_job", /*overwrite=*/1);
+      setenv("TF_TASK_ID", "0", /*overwrite=*/1);
+      setenv("TF_DATA_EXPERIMENT_OPT_IN", "jit_compile_map", /*overwrite=*/1);
+    }
+    auto dataset_params =
+        ElementwiseLayersParams(kNumElements, vector_size, num_layers);
+    TF_CHECK_OK(Initialize(dataset_params));
+    unsetenv("TF_JOB_NAME");
+    unsetenv("TF_TASK_ID");
+    unsetenv("TF_DATA_EXPERIMENT_OPT_IN");
+    for (auto s : state) {
+      std::unique_ptr<IteratorBase> iterator;
+      TF_CHECK_OK(dataset_->MakeIterator(iterator_ctx_.get(),
+                                         /*parent=*/nullptr,
+                                         dataset_params.iterator_prefix(),
+                                         &iterator));
+      bool end_of_sequence = false;
+      while (!end_of_sequence) {
+        std::vector<Tensor> next;
+        TF_CHECK_OK(
+            iterator->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+      }
+    }
+    state.SetItemsProcessed(state.iterations() * kNumElements);
+    state.SetBytesProcessed(state.iterations() * kNumElements * vector_size *
+                            sizeof(float));
+  }
+};
+
+void BM_ElementwiseMap(::testing::benchmark::State& state) {
+  ParallelMapDatasetBenchmark benchmark;
+  benchmark.Run(state);
+}
+
+BENCHMARK(BM_ElementwiseMap)
+    ->Args({1 << 10, 16, 0})
+    ->Args({1 << 16, 16, 0})
+    ->Args({1 << 16, 64, 0});
+
+#ifdef TF_DATA_TEST_XLA_JIT
+BENCHMARK(BM_ElementwiseMap)
+    ->Args({1 << 10, 16, 1})
+    ->Args({1 << 16, 16, 1})
+    ->Args({1 << 16, 64, 1});
+#endif  // TF_DATA_TEST_XLA_JIT
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
@@ -516,10 +516,13 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
       // Keep track of where we are in an iteration "burst"
       int num_produced = 0;
       while (true) {
-        // 1. Wait for a slot in the buffer.
+        // 1. Wait for a slot in the buffer. While the pipeline is at its
+        // memory limit, the buffer is not allowed to grow unless it is empty.
         {
           mutex_lock l(*mu_);
-          while (!cancelled_ && buffer_.size() >= buffer_limit()) {
+          while (!cancelled_ &&
+                 (buffer_.size() >= buffer_limit() ||
+                  (!buffer_.empty() && MemoryLimitReached()))) {
             RecordStop(ctx.get());
             cond_var_->wait(l);
             RecordStart(ctx.get());
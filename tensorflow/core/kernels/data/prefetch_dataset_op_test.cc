@@ -12,7 +12,16 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/data/prefetch_dataset_op.h"
 
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
 #include "tensorflow/core/data/dataset_test_base.h"
+#include "tensorflow/core/framework/dataset.h"
+#include "tensorflow/core/framework/model.h"
+#include "tensorflow/core/platform/env.h"
 
 namespace tensorflow {
 namespace data {
@@ -331,6 +340,41 @@ TEST_F(PrefetchDatasetOpTest, InvalidBufferSize) {
   EXPECT_EQ(Initialize(dataset_params).code(), error::INVALID_ARGUMENT);
 }
 
+TEST_F(PrefetchDatasetOpTest, MemoryLimit) {
+  auto dataset_params = PrefetchDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  IteratorContext::Params params(iterator_ctx_.get());
+  auto ram_budget_manager = std::make_shared<model::RamBudgetManager>(
+      /*budget=*/std::numeric_limits<int64_t>::max(), /*memory_limit=*/1);
+  params.ram_budget_manager = ram_budget_manager;
+  IteratorContext iterator_ctx(std::move(params));
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(dataset_->MakeIterator(&iterator_ctx, /*parent=*/nullptr,
+                                      "Iterator", &iterator));
+
+  std::vector<Tensor> out_tensors;
+  bool end_of_sequence = false;
+  TF_ASSERT_OK(
+      iterator->GetNext(&iterator_ctx, &out_tensors, &end_of_sequence));
+  ASSERT_FALSE(end_of_sequence);
+  // The input has 10 elements.
+  for (int i = 1; i < 10; ++i) {
+    // Waits for the prefetch thread to buffer the next element. The buffer
+    // holds at most one element once the limit has been reached.
+    while (ram_budget_manager->buffered_bytes() == 0) {
+      Env::Default()->SleepForMicroseconds(1000);
+    }
+    EXPECT_LE(ram_budget_manager->peak_buffered_bytes(),
+              GetAllocatedBytes(out_tensors));
+    TF_ASSERT_OK(
+        iterator->GetNext(&iterator_ctx, &out_tensors, &end_of_sequence));
+    ASSERT_FALSE(end_of_sequence);
+  }
+
+  iterator.reset();
+  EXPECT_EQ(ram_budget_manager->buffered_bytes(), 0);
+}
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
@@ -16,6 +16,7 @@ limitations under the License.
 
 #include <cstdint>
 #include <deque>
+#include <functional>
 #include <memory>
 #include <numeric>
 #include <string>
@@ -34,11 +35,13 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/kernels/data/random_seed_ops.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/random/random_distributions.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/stringprintf.h"
+#include "tensorflow/core/util/env_var.h"
 
 namespace tensorflow {
 namespace data {
@@ -75,6 +78,7 @@ constexpr char kSlicesEnd[] = "slices_end";
 constexpr char kSlicesReachedEndOfSequence[] = "slices_reached_end_of_sequence";
 constexpr char kSeedGenerator[] = "SeedGenerator";
 constexpr char kEpochNumRandomSamples[] = "epoch_num_random_samples";
+constexpr char kNumFillThreadsEnvVar[] = "TF_DATA_SHUFFLE_NUM_FILL_THREADS";
 constexpr char kShuffleDatasetV1[] = "ShuffleDataset";
 constexpr char kShuffleDatasetV2[] = "ShuffleDatasetV2";
 constexpr char kShuffleDatasetV3[] = "ShuffleDatasetV3";
@@ -100,6 +104,11 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
             {{"buffer_size",
               strings::Printf("%lld", static_cast<long long>(buffer_size))}}) {
     input_->Ref();
+    absl::Status s = ReadInt64FromEnvVar(kNumFillThreadsEnvVar,
+                                         /*default_val=*/0, &num_fill_threads_);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to read " << kNumFillThreadsEnvVar << ": " << s;
+    }
   }
 
   ~ShuffleDatasetBase() override { input_->Unref(); }
@@ -161,11 +170,25 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
 
   std::unique_ptr<IteratorBase> MakeIteratorInternal(
       const string& prefix) const override {
+    if (UseParallelFill()) {
+      return std::make_unique<ParallelFillIterator>(
+          ParallelFillIterator::Params{
+              this, name_utils::IteratorPrefix(op_type(), prefix)},
+          seed_generator_.get());
+    }
     return std::make_unique<Iterator>(
         Iterator::Params{this, name_utils::IteratorPrefix(op_type(), prefix)},
         seed_generator_.get());
   }
 
+  // Whether iterators should fill the shuffle buffer from background threads.
+  // Only single-epoch shuffles with a bounded buffer are supported; fused
+  // shuffle-and-repeat and `buffer_size=-1` use the sequential iterator.
+  bool UseParallelFill() const {
+    return num_fill_threads_ > 0 && count_ == 1 &&
+           buffer_size_ != kUnknownCardinality;
+  }
+
   void InitializeRandomAccessIndices() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
     const int64 cardinality = Cardinality();
     shuffled_indices_ = std::vector<std::int64_t>(cardinality);
@@ -583,6 +606,344 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
     bool data_produced_ TF_GUARDED_BY(mu_) = false;
   };
 
+  // Iterator that fills the shuffle buffer from background threads, so that
+  // producing input elements overlaps with sampling instead of stalling
+  // `GetNext()`. The buffer is a ring of `buffer_size_` slots that is sampled
+  // exactly like `Iterator` samples a single epoch.
+  //
+  // If the pipeline is deterministic, a single fill thread pulls from the input
+  // so that elements enter the buffer in input order, and the output is
+  // identical to that of `Iterator` for the same seeds. Otherwise,
+  // `num_fill_threads_` threads pull from the input concurrently.
+  //
+  // Checkpoints use the layout of `Iterator` for a single epoch, so that they
+  // can be restored by either iterator regardless of
+  // `TF_DATA_SHUFFLE_NUM_FILL_THREADS`.
+  class ParallelFillIterator : public DatasetIterator<ShuffleDatasetBase> {
+   public:
+    explicit ParallelFillIterator(const Params& params,
+                                  SeedGenerator* seed_generator)
+        : DatasetIterator<ShuffleDatasetBase>(params),
+          seed_generator_(seed_generator),
+          parent_generator_(seed_generator->seed(), seed_generator->seed2()),
+          generator_(&parent_generator_),
+          buffer_(params.dataset->buffer_size_) {}
+
+    ~ParallelFillIterator() override {
+      CancelThreads(/*wait=*/true);
+      input_impl_.reset();
+      if (deregister_fn_) deregister_fn_();
+    }
+
+    absl::Status Initialize(IteratorContext* ctx) override {
+      mutex_lock l(mu_);
+      seed_generator_->GenerateSeeds(&seed_, &seed2_);
+      ResetRngs();
+      const Options* options = ctx->options();
+      deterministic_ =
+          options == nullptr ||
+          options->optional_deterministic_case() != Options::kDeterministic ||
+          options->deterministic();
+      cancellation_manager_ = std::make_unique<CancellationManager>();
+      TF_RETURN_IF_ERROR(RegisterCancellationCallback(
+          ctx->cancellation_manager(),
+          [this]() { CancelThreads(/*wait=*/false); }, &deregister_fn_));
+      IteratorContext::Params params(ctx);
+      params.cancellation_manager = cancellation_manager_.get();
+      IteratorContext iter_ctx(std::move(params));
+      TF_RETURN_IF_ERROR(dataset()->input_->MakeIterator(
+          &iter_ctx, this, prefix(), &input_impl_));
+      ctx->MergeCheckpoint(iter_ctx.checkpoint());
+      return absl::OkStatus();
+    }
+
+    absl::Status GetNextInternal(IteratorContext* ctx,
+                                 std::vector<Tensor>* out_tensors,
+                                 bool* end_of_sequence) override {
+      mutex_lock l(mu_);
+      EnsureThreadsStarted(ctx);
+      while (!cancelled_ && status_.ok() && !IsBufferReady()) {
+        RecordStop(ctx);
+        cond_var_.wait(l);
+        RecordStart(ctx);
+      }
+      if (cancelled_) {
+        return errors::Cancelled("Iterator was cancelled");
+      }
+      TF_RETURN_IF_ERROR(status_);
+      if (start_ == end_) {
+        *end_of_sequence = true;
+        return absl::OkStatus();
+      }
+
+      *end_of_sequence = false;
+      // Choose an element to produce uniformly at random, and then move the
+      // oldest element into its slot.
+      int64_t offset = Random() % (end_ - start_);
+      int64_t index = (start_ + offset) % buffer_.size();
+      *out_tensors = std::move(buffer_[index]);
+      RecordBufferDequeue(ctx, *out_tensors);
+      std::swap(buffer_[index], buffer_[start_ % buffer_.size()]);
+      start_++;
+      cond_var_.notify_all();
+      return absl::OkStatus();
+    }
+
+   protected:
+    std::shared_ptr<model::Node> CreateNode(
+        IteratorContext* ctx, model::Node::Args args) const override {
+      return model::MakeKnownRatioNode(std::move(args),
+                                       /*ratio=*/1);
+    }
+
+    absl::Status SaveInternal(SerializationContext* ctx,
+                              IteratorStateWriter* writer) override {
+      mutex_lock l(mu_);
+      // Stop fill threads from starting new input elements, and wait for the
+      // in-flight ones to land in the buffer.
+      save_pending_ = true;
+      auto cleanup = gtl::MakeCleanup([this]() TF_EXCLUSIVE_LOCKS_REQUIRED(
+                                          mu_) {
+        save_pending_ = false;
+        cond_var_.notify_all();
+      });
+      while (num_in_flight_ > 0) {
+        cond_var_.wait(l);
+      }
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(prefix(), kEpochNumRandomSamples,
+                              seed_generator_->num_random_samples()));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kNumRandomSamples,
+                                             num_random_samples_));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kSeed, seed_));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kSeed2, seed2_));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(
+          prefix(), kEndOfInputSequence, static_cast<int64_t>(end_of_input_)));
+      if (!end_of_input_) {
+        TF_RETURN_IF_ERROR(SaveInput(ctx, writer, input_impl_));
+      }
+      // The input iterator is created in `Initialize()`, so the buffer always
+      // holds the single slice `[start_, end_)` of the first epoch.
+      TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kEpoch, 1));
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(prefix(), kNumElements, end_ - start_));
+      TF_RETURN_IF_ERROR(WriteElementsToCheckpoint(
+          writer, absl::StrCat(prefix(), kColon, "buffer"), buffer_));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kSlicesSize, 1));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(
+          prefix(), absl::StrJoin(std::make_tuple(kSlicesStart, 0), "_"),
+          start_));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(
+          prefix(), absl::StrJoin(std::make_tuple(kSlicesEnd, 0), "_"), end_));
+      TF_RETURN_IF_ERROR(writer->WriteScalar(
+          prefix(),
+          absl::StrJoin(std::make_tuple(kSlicesReachedEndOfSequence, 0), "_"),
+          static_cast<int64_t>(end_of_input_)));
+      if (end_ > 0) {
+        TF_RETURN_IF_ERROR(writer->WriteScalar(prefix(), kDataProduced, ""));
+      }
+      return absl::OkStatus();
+    }
+
+    absl::Status RestoreInternal(IteratorContext* ctx,
+                                 IteratorStateReader* reader) override {
+      mutex_lock l(mu_);
+      DCHECK(fill_threads_.empty());
+      int64_t num_random_samples;
+      TF_RETURN_IF_ERROR(reader->ReadScalar(prefix(), kEpochNumRandomSamples,
+                                            &num_random_samples));
+      seed_generator_->set_num_random_samples(num_random_samples);
+      seed_generator_->Reset();
+      TF_RETURN_IF_ERROR(reader->ReadScalar(prefix(), kNumRandomSamples,
+                                            &num_random_samples_));
+      TF_RETURN_IF_ERROR(reader->ReadScalar(prefix(), kSeed, &seed_));
+      TF_RETURN_IF_ERROR(reader->ReadScalar(prefix(), kSeed2, &seed2_));
+      ResetRngs();
+
+      // The checkpoint may have been written by `Iterator`, in which case the
+      // input iterator only exists once the first epoch has started.
+      int64_t epoch;
+      TF_RETURN_IF_ERROR(reader->ReadScalar(prefix(), kEpoch, &epoch));
+      int64_t slices_size;
+      TF_RETURN_IF_ERROR(
+          reader->ReadScalar(prefix(), kSlicesSize, &slices_size));
+      if (epoch > 1 || slices_size > 1) {
+        return errors::FailedPrecondition(
+            "Cannot restore a shuffle buffer spanning ", slices_size,
+            " epochs into an iterator that fills it in the background.");
+      }
+      int64_t input_empty;
+      TF_RETURN_IF_ERROR(
+          reader->ReadScalar(prefix(), kEndOfInputSequence, &input_empty));
+      // At epoch 0, the input iterator has not been created yet, and the one
+      // created by `Initialize()` starts from the beginning of the input.
+      end_of_input_ = epoch == 1 && static_cast<bool>(input_empty);
+      if (!input_empty) {
+        TF_RETURN_IF_ERROR(RestoreInput(ctx, reader, input_impl_));
+      }
+
+      std::vector<std::vector<Tensor>> elements;
+      TF_RETURN_IF_ERROR(ReadElementsFromCheckpoint(
+          ctx, reader, absl::StrCat(prefix(), kColon, "buffer"), &elements));
+      if (elements.size() > buffer_.size()) {
+        return errors::DataLoss("Checkpointed shuffle buffer holds ",
+                                elements.size(),
+                                " elements, but the buffer size is ",
+                                buffer_.size(), ".");
+      }
+      start_ = 0;
+      end_ = 0;
+      if (slices_size == 1) {
+        TF_RETURN_IF_ERROR(reader->ReadScalar(
+            prefix(), absl::StrJoin(std::make_tuple(kSlicesStart, 0), "_"),
+            &start_));
+        TF_RETURN_IF_ERROR(reader->ReadScalar(
+            prefix(), absl::StrJoin(std::make_tuple(kSlicesEnd, 0), "_"),
+            &end_));
+      }
+      if (end_ - start_ > static_cast<int64_t>(buffer_.size())) {
+        return errors::DataLoss("Checkpointed shuffle buffer holds ",
+                                end_ - start_,
+                                " elements, but the buffer size is ",
+                                buffer_.size(), ".");
+      }
+      for (size_t i = 0; i < elements.size(); ++i) {
+        buffer_[i] = std::move(elements[i]);
+      }
+      for (int64_t i = start_; i < end_; ++i) {
+        RecordBufferEnqueue(ctx, buffer_[i % buffer_.size()]);
+      }
+      return absl::OkStatus();
+    }
+
+    TraceMeMetadata GetTraceMeMetadata() const override {
+      return dataset()->traceme_metadata_;
+    }
+
+   private:
+    // Returns whether `GetNext()` can sample from the buffer, i.e. the buffer
+    // is full or will not receive any more elements.
+    bool IsBufferReady() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return end_ - start_ == dataset()->buffer_size_ ||
+             (end_of_input_ && num_in_flight_ == 0);
+    }
+
+    void ResetRngs() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      parent_generator_ = random::PhiloxRandom(seed_, seed2_);
+      generator_ =
+          random::SingleSampleAdapter<random::PhiloxRandom>(&parent_generator_);
+      generator_.Skip(num_random_samples_);
+    }
+
+    random::SingleSampleAdapter<random::PhiloxRandom>::ResultType Random()
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      num_random_samples_++;
+      return generator_();
+    }
+
+    void AddToShuffleBuffer(IteratorContext* ctx, std::vector<Tensor>&& element)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      RecordBufferEnqueue(ctx, element);
+      buffer_[end_ % buffer_.size()] = std::move(element);
+      end_++;
+    }
+
+    void CancelThreads(bool wait) TF_LOCKS_EXCLUDED(mu_) {
+      if (cancellation_manager_) {
+        cancellation_manager_->StartCancel();
+      }
+      mutex_lock l(mu_);
+      cancelled_ = true;
+      cond_var_.notify_all();
+      while (wait && num_in_flight_ > 0) {
+        cond_var_.wait(l);
+      }
+    }
+
+    void EnsureThreadsStarted(IteratorContext* ctx)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!fill_threads_.empty()) {
+        return;
+      }
+      IteratorContext::Params params(ctx);
+      params.cancellation_manager = cancellation_manager_.get();
+      auto ctx_copy = std::make_shared<IteratorContext>(std::move(params));
+      const int64_t num_threads =
+          deterministic_ ? 1 : dataset()->num_fill_threads_;
+      for (int64_t i = 0; i < num_threads; ++i) {
+        fill_threads_.push_back(ctx->StartThread(
+            absl::StrCat("tf_data_shuffle_fill_", i),
+            [this, ctx_copy]() { FillThread(ctx_copy); }));
+      }
+    }
+
+    void FillThread(const std::shared_ptr<IteratorContext>& ctx) {
+      RecordStart(ctx.get());
+      while (true) {
+        {
+          mutex_lock l(mu_);
+          while (!cancelled_ && status_.ok() && !end_of_input_ &&
+                 (save_pending_ || end_ - start_ + num_in_flight_ >=
+                                       dataset()->buffer_size_)) {
+            RecordStop(ctx.get());
+            cond_var_.wait(l);
+            RecordStart(ctx.get());
+          }
+          if (cancelled_ || !status_.ok() || end_of_input_) {
+            break;
+          }
+          num_in_flight_++;
+        }
+        std::vector<Tensor> element;
+        bool end_of_input = false;
+        absl::Status s =
+            input_impl_->GetNext(ctx.get(), &element, &end_of_input);
+        mutex_lock l(mu_);
+        num_in_flight_--;
+        if (!s.ok()) {
+          status_.Update(s);
+        } else if (end_of_input) {
+          end_of_input_ = true;
+        } else {
+          AddToShuffleBuffer(ctx.get(), std::move(element));
+        }
+        cond_var_.notify_all();
+      }
+      RecordStop(ctx.get());
+    }
+
+    mutex mu_;
+    condition_variable cond_var_;
+    SeedGenerator* const seed_generator_ TF_GUARDED_BY(mu_);  // Not owned.
+    random::PhiloxRandom parent_generator_ TF_GUARDED_BY(mu_);
+    random::SingleSampleAdapter<random::PhiloxRandom> generator_
+        TF_GUARDED_BY(mu_);
+    int64_t num_random_samples_ TF_GUARDED_BY(mu_) = 0;
+    int64_t seed_ TF_GUARDED_BY(mu_) = 0;
+    int64_t seed2_ TF_GUARDED_BY(mu_) = 0;
+    bool deterministic_ = true;
+    // Ring buffer of shuffle candidates. The live elements occupy the
+    // positions `[start_, end_)` taken modulo the size of `buffer_`.
+    std::vector<std::vector<Tensor>> buffer_ TF_GUARDED_BY(mu_);
+    int64_t start_ TF_GUARDED_BY(mu_) = 0;
+    int64_t end_ TF_GUARDED_BY(mu_) = 0;
+    // Number of input elements being produced by fill threads.
+    int64_t num_in_flight_ TF_GUARDED_BY(mu_) = 0;
+    bool end_of_input_ TF_GUARDED_BY(mu_) = false;
+    bool cancelled_ TF_GUARDED_BY(mu_) = false;
+    // Set while `SaveInternal()` waits for in-flight elements, so that fill
+    // threads cannot keep it waiting by starting new ones.
+    bool save_pending_ TF_GUARDED_BY(mu_) = false;
+    absl::Status status_ TF_GUARDED_BY(mu_);
+    // Fill threads call `GetNext()` on `input_impl_` without holding `mu_`.
+    std::unique_ptr<IteratorBase> input_impl_;
+    std::unique_ptr<CancellationManager> cancellation_manager_;
+    std::function<void()> deregister_fn_;
+    // Declared last so that the threads are joined before the state they use
+    // is destroyed.
+    std::vector<std::unique_ptr<Thread>> fill_threads_ TF_GUARDED_BY(mu_);
+  };
+
   const DatasetBase* const input_;
   const int64_t buffer_size_;
   const std::shared_ptr<SeedGenerator> seed_generator_;
@@ -591,6 +952,11 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
   // responsible for repeating as well.
   const int64_t count_;
   const TraceMeMetadata traceme_metadata_;
+  // Number of threads used to fill the shuffle buffer in the background. Read
+  // from `TF_DATA_SHUFFLE_NUM_FILL_THREADS`; non-positive values disable
+  // background filling. Deterministic pipelines use a single thread, which
+  // still overlaps producing input elements with the consumer.
+  int64_t num_fill_threads_ = 0;
   mutable mutex mu_;
   mutable std::vector<std::int64_t> shuffled_indices_ TF_GUARDED_BY(mu_);
 };  // ShuffleDatasetBase
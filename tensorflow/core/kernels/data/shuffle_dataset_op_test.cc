@@ -11,12 +11,21 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/shuffle_dataset_op.h"
 
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "absl/strings/str_cat.h"
 #include "tensorflow/core/data/dataset_test_base.h"
 #include "tensorflow/core/data/dataset_utils.h"
 #include "tensorflow/core/data/serialization_utils.h"
+#include "tensorflow/core/framework/dataset_options.pb.h"
+#include "tensorflow/core/framework/function_testlib.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test_benchmark.h"
 
 namespace tensorflow {
 namespace data {
@@ -24,6 +33,7 @@ namespace {
 
 constexpr char kShuffleNodeName[] = "shuffle_dataset";
 constexpr char kShuffleAndRepeatNodeName[] = "shuffle_and_repeat_dataset";
+constexpr char kNumFillThreadsEnvVar[] = "TF_DATA_SHUFFLE_NUM_FILL_THREADS";
 
 class ShuffleDatasetParams : public DatasetParams {
  public:
@@ -594,6 +604,219 @@ TEST_F(ShuffleDatasetOpTest, InvalidArguments) {
   }
 }
 
+class ParallelFillShuffleDatasetOpTest : public ShuffleDatasetOpTest {
+ protected:
+  void SetUp() override {
+    setenv(kNumFillThreadsEnvVar, "4", /*overwrite=*/1);
+  }
+
+  void TearDown() override { unsetenv(kNumFillThreadsEnvVar); }
+};
+
+// Without a `deterministic=false` option, a single fill thread adds elements to
+// the buffer in input order, so the outputs match those of the sequential
+// iterator.
+std::vector<IteratorSaveAndRestoreTestCase<ShuffleDatasetParams>>
+ParallelFillTestCases() {
+  std::vector<IteratorSaveAndRestoreTestCase<ShuffleDatasetParams>> test_cases;
+  for (auto& test_case : IteratorSaveAndRestoreTestCases()) {
+    if (test_case.dataset_params.count() == 1) {
+      test_cases.push_back(std::move(test_case));
+    }
+  }
+  return test_cases;
+}
+
+class ParameterizedParallelFillTest
+    : public ParallelFillShuffleDatasetOpTest,
+      public ::testing::WithParamInterface<
+          IteratorSaveAndRestoreTestCase<ShuffleDatasetParams>> {};
+
+TEST_P(ParameterizedParallelFillTest, GetNext) {
+  auto test_case = GetParam();
+  TF_ASSERT_OK(Initialize(test_case.dataset_params));
+  TF_ASSERT_OK(CheckIteratorGetNext(test_case.expected_shuffle_outputs,
+                                    /*compare_order=*/true));
+}
+
+TEST_P(ParameterizedParallelFillTest, IteratorSaveAndRestore) {
+  auto test_case = GetParam();
+  TF_ASSERT_OK(Initialize(test_case.dataset_params));
+  TF_ASSERT_OK(CheckIteratorSaveAndRestore(
+      test_case.dataset_params.iterator_prefix(),
+      test_case.expected_shuffle_outputs, test_case.breakpoints,
+      /*compare_order=*/true));
+}
+
+// Checkpoints are written in the same layout with and without background
+// filling, so they can be restored whichever way the buffer is filled.
+TEST_P(ParameterizedParallelFillTest, RestoreAcrossFillModes) {
+  auto test_case = GetParam();
+  TF_ASSERT_OK(Initialize(test_case.dataset_params));
+  unsetenv(kNumFillThreadsEnvVar);
+  std::unique_ptr<TestDataset> sequential_dataset;
+  TF_ASSERT_OK(MakeDataset(test_case.dataset_params, &sequential_dataset));
+  // Alternates between the two datasets at each breakpoint, so that the
+  // checkpoints of each iterator are restored by the other one.
+  const std::vector<const DatasetBase*> datasets = {
+      sequential_dataset->dataset(), dataset_};
+  std::unique_ptr<SerializationContext> serialization_ctx;
+  TF_ASSERT_OK(CreateSerializationContext(&serialization_ctx));
+  std::unique_ptr<IteratorBase> iterator = std::move(iterator_);
+  bool end_of_sequence = false;
+  int cur_iteration = 0;
+  std::vector<Tensor> out_tensors;
+  for (int i = 0; i < test_case.breakpoints.size(); ++i) {
+    VariantTensorDataWriter writer;
+    TF_ASSERT_OK(iterator->Save(serialization_ctx.get(), &writer));
+    std::vector<const VariantTensorData*> data;
+    writer.GetData(&data);
+    VariantTensorDataReader reader(data);
+    TF_ASSERT_OK(RestoreIterator(
+        iterator_ctx_.get(), &reader,
+        test_case.dataset_params.iterator_prefix(), *datasets[i % 2],
+        &iterator));
+    while (cur_iteration <= test_case.breakpoints[i]) {
+      std::vector<Tensor> next;
+      TF_ASSERT_OK(
+          iterator->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+      out_tensors.insert(out_tensors.end(), next.begin(), next.end());
+      cur_iteration++;
+    }
+  }
+  TF_EXPECT_OK(ExpectEqual(out_tensors, test_case.expected_shuffle_outputs,
+                           /*compare_order=*/true));
+}
+
+INSTANTIATE_TEST_SUITE_P(ShuffleDatasetOpTest, ParameterizedParallelFillTest,
+                         ::testing::ValuesIn(ParallelFillTestCases()));
+
+TEST_F(ParallelFillShuffleDatasetOpTest, Nondeterministic) {
+  auto dataset_params = ShuffleDatasetParams(
+      RangeDatasetParams(0, 1000, 1),
+      /*buffer_size=*/100,
+      /*seed=*/1,
+      /*seed2=*/2,
+      /*count=*/1,
+      /*reshuffle_each_iteration=*/false,
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({})},
+      /*node_name=*/kShuffleNodeName);
+  TF_ASSERT_OK(Initialize(dataset_params));
+  Options options;
+  options.set_deterministic(false);
+  IteratorContext::Params params(iterator_ctx_.get());
+  params.options = &options;
+  IteratorContext ctx(std::move(params));
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(dataset_->MakeIterator(&ctx, /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator));
+  std::vector<Tensor> expected_outputs;
+  for (int64_t i = 0; i < 1000; ++i) {
+    expected_outputs.push_back(CreateTensor<int64_t>(TensorShape({}), {i}));
+  }
+  TF_EXPECT_OK(CheckIteratorGetNext(iterator.get(), &ctx, expected_outputs,
+                                    /*compare_order=*/false));
+}
+
+// A shuffle of a map, whose function must be registered with the runtime.
+class ShuffleMapDatasetParams : public ShuffleDatasetParams {
+ public:
+  using ShuffleDatasetParams::ShuffleDatasetParams;
+
+  std::vector<FunctionDef> func_lib() const override {
+    return {test::function::XTimesTwo()};
+  }
+};
+
+// Drains a shuffle of `2 * buffer_size` elements, where `buffer_size` is
+// `state.range(0)`, the number of fill threads is `state.range(1)` and the
+// pipeline is deterministic if `state.range(2)` is non-zero. Producing an
+// input element runs a map function, and consuming one takes about as long,
+// which is where filling the buffer in the background pays off. Benchmarks
+// only run when selected with --benchmark_filter, so the multi-million element
+// rows do not slow down the test itself.
+class ShuffleDatasetBenchmark : public ShuffleDatasetOpTest {
+ public:
+  void TestBody() override {}
+
+  void Run(::testing::benchmark::State& state) {
+    constexpr int64_t kElementSize = 64;
+    constexpr int64_t kConsumeMicros = 20;
+    const int64_t buffer_size = state.range(0);
+    const bool deterministic = state.range(2) != 0;
+    setenv(kNumFillThreadsEnvVar, absl::StrCat(state.range(1)).c_str(),
+           /*overwrite=*/1);
+    Tensor slices(DT_FLOAT, TensorShape({2 * buffer_size, kElementSize}));
+    slices.flat<float>().setConstant(1.0f);
+    auto map_dataset_params = MapDatasetParams(
+        TensorSliceDatasetParams({slices}, "tensor_slice_dataset"),
+        /*other_arguments=*/{},
+        /*func=*/
+        FunctionDefHelper::FunctionRef("XTimesTwo", {{"T", DT_FLOAT}}),
+        /*func_lib=*/{test::function::XTimesTwo()},
+        /*type_arguments=*/{},
+        /*output_dtypes=*/{DT_FLOAT},
+        /*output_shapes=*/{PartialTensorShape({kElementSize})},
+        /*use_inter_op_parallelism=*/false,
+        /*preserve_cardinality=*/true,
+        /*node_name=*/"map_dataset");
+    auto dataset_params = ShuffleMapDatasetParams(
+        std::move(map_dataset_params), buffer_size,
+        /*seed=*/1,
+        /*seed2=*/2,
+        /*count=*/1,
+        /*reshuffle_each_iteration=*/true,
+        /*output_dtypes=*/{DT_FLOAT},
+        /*output_shapes=*/{PartialTensorShape({kElementSize})},
+        /*node_name=*/kShuffleNodeName);
+    TF_CHECK_OK(Initialize(dataset_params));
+    unsetenv(kNumFillThreadsEnvVar);
+    Options options;
+    options.set_deterministic(deterministic);
+    IteratorContext::Params params(iterator_ctx_.get());
+    params.options = &options;
+    IteratorContext ctx(std::move(params));
+    for (auto s : state) {
+      std::unique_ptr<IteratorBase> iterator;
+      TF_CHECK_OK(dataset_->MakeIterator(&ctx, /*parent=*/nullptr,
+                                         dataset_params.iterator_prefix(),
+                                         &iterator));
+      bool end_of_sequence = false;
+      while (!end_of_sequence) {
+        std::vector<Tensor> next;
+        TF_CHECK_OK(iterator->GetNext(&ctx, &next, &end_of_sequence));
+        // Stands in for the work of the consumer of the element.
+        const uint64 start_micros = Env::Default()->NowMicros();
+        while (Env::Default()->NowMicros() - start_micros < kConsumeMicros) {
+        }
+      }
+    }
+    state.SetItemsProcessed(state.iterations() * 2 * buffer_size);
+  }
+};
+
+void BM_ShuffleDataset(::testing::benchmark::State& state) {
+  ShuffleDatasetBenchmark benchmark;
+  benchmark.Run(state);
+}
+
+BENCHMARK(BM_ShuffleDataset)
+    ->UseRealTime()
+    ->Args({1 << 10, 0, 1})
+    ->Args({1 << 10, 1, 1})
+    ->Args({1 << 10, 4, 0})
+    ->Args({1 << 14, 0, 1})
+    ->Args({1 << 14, 1, 1})
+    ->Args({1 << 14, 4, 0})
+    ->Args({1 << 20, 0, 1})
+    ->Args({1 << 20, 1, 1})
+    ->Args({1 << 20, 4, 0})
+    ->Args({1 << 22, 0, 1})
+    ->Args({1 << 22, 1, 1})
+    ->Args({1 << 22, 4, 0});
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
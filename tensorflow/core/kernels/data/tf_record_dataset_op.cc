@@ -16,7 +16,11 @@ limitations under the License.
 
 #include <cstdint>
 
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "tensorflow/core/data/global_shuffle_utils.h"
 #include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/data/tfrecord_index.h"
 #include "tensorflow/core/data/utils.h"
 #include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
@@ -28,6 +32,7 @@ limitations under the License.
 #include "tensorflow/core/lib/io/zlib_compression_options.h"
 #include "tensorflow/core/lib/io/zlib_inputstream.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tsl/profiler/lib/traceme.h"
 
 namespace tensorflow {
@@ -51,6 +56,16 @@ constexpr int64_t kUnspecifiedBufferSize = -1;
 constexpr int64_t kDefaultBufferSize = 256LL << 10;  // 256KB
 constexpr int64_t kCloudTpuBlockSize = 127LL << 20;  // 127MB.
 constexpr int64_t kS3BlockSize = kCloudTpuBlockSize;
+// If set to a positive value, each file is read ahead of the iterator with up
+// to this many reads of `buffer_size` bytes in flight.
+constexpr char kReadaheadNumBlocksEnvVar[] =
+    "TF_DATA_TFRECORD_READAHEAD_NUM_BLOCKS";
+// If true, uncompressed files are read at random positions using the indices
+// written by `build_tfrecord_index`, which makes the dataset support global
+// shuffling. Opt-in, so that datasets without indices do not look for them.
+constexpr char kUseIndexEnvVar[] = "TF_DATA_TFRECORD_USE_INDEX";
+// Number of index files opened in parallel when creating the dataset.
+constexpr int kIndexOpenParallelism = 16;
 
 bool is_cloud_tpu_gcs_fs() {
 #if (defined(PLATFORM_CLOUD_TPU) && defined(TPU_GCS_FS)) || \
@@ -75,6 +90,37 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     if (buffer_size > 0) {
       options_.buffer_size = buffer_size;
     }
+    absl::Status s =
+        ReadInt64FromEnvVar(kReadaheadNumBlocksEnvVar, /*default_val=*/0,
+                            &options_.readahead_num_blocks);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to read " << kReadaheadNumBlocksEnvVar << ": "
+                   << s;
+    }
+    random_indexing_compatible_ = absl::FailedPreconditionError(absl::StrCat(
+        "Global shuffling of ", kDatasetType, " requires ", kUseIndexEnvVar,
+        "=true and uncompressed files indexed with `build_tfrecord_index`."));
+    bool use_index = false;
+    s = ReadBoolFromEnvVar(kUseIndexEnvVar, /*default_val=*/false, &use_index);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to read " << kUseIndexEnvVar << ": " << s;
+    }
+    if (use_index && compression_type_.empty() && byte_offsets_.empty()) {
+      std::vector<std::string> translated_filenames;
+      translated_filenames.reserve(filenames_.size());
+      for (const std::string& filename : filenames_) {
+        translated_filenames.push_back(TranslateFileName(filename));
+      }
+      auto indexed_reader = IndexedTFRecordReader::Create(
+          ctx->env(), translated_filenames, kIndexOpenParallelism);
+      random_indexing_compatible_ = indexed_reader.status();
+      if (indexed_reader.ok()) {
+        indexed_reader_ = std::move(*indexed_reader);
+      } else {
+        LOG(WARNING) << "Failed to open TFRecord indices: "
+                     << indexed_reader.status();
+      }
+    }
   }
 
   std::unique_ptr<IteratorBase> MakeIteratorInternal(
@@ -108,6 +154,35 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
 
   Status CheckExternalState() const override { return absl::OkStatus(); }
 
+  int64_t CardinalityInternal(CardinalityOptions options) const override {
+    if (indexed_reader_ == nullptr) {
+      return kUnknownCardinality;
+    }
+    return indexed_reader_->num_records();
+  }
+
+  Status Get(OpKernelContext* ctx, int64 index,
+             std::vector<Tensor>* out_tensors) const override {
+    return Get(AnyContext(ctx), index, out_tensors);
+  }
+
+  Status Get(AnyContext ctx, int64 index,
+             std::vector<Tensor>* out_tensors) const override {
+    TF_RETURN_IF_ERROR(CheckRandomAccessCompatible(index));
+    out_tensors->clear();
+    out_tensors->emplace_back(ctx.allocator, DT_STRING, TensorShape({}));
+    tstring& record = out_tensors->back().scalar<tstring>()();
+    TF_RETURN_IF_ERROR(indexed_reader_->Read(index, record));
+    static monitoring::CounterCell* bytes_counter =
+        metrics::GetTFDataBytesReadCounter(kDatasetType);
+    bytes_counter->IncrementBy(record.size());
+    return absl::OkStatus();
+  }
+
+  absl::Status RandomIndexingCompatible() const override {
+    return random_indexing_compatible_;
+  }
+
  protected:
   Status AsGraphDefInternal(SerializationContext* ctx,
                             DatasetGraphDefBuilder* b,
@@ -129,13 +204,18 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
   class Iterator : public DatasetIterator<Dataset> {
    public:
     explicit Iterator(const Params& params)
-        : DatasetIterator<Dataset>(params) {}
+        : DatasetIterator<Dataset>(params),
+          global_shuffle_iterator_(dataset()) {}
 
     bool SymbolicCheckpointCompatible() const override { return true; }
 
     Status GetNextInternal(IteratorContext* ctx,
                            std::vector<Tensor>* out_tensors,
                            bool* end_of_sequence) override {
+      if (ctx->index_mapper() != nullptr) {
+        return global_shuffle_iterator_.GetNext(ctx, out_tensors,
+                                                end_of_sequence);
+      }
       out_tensors->reserve(1);
       mutex_lock l(mu_);
       do {
@@ -236,11 +316,15 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
         TF_RETURN_IF_ERROR(
             writer->WriteScalar(prefix(), kOffset, reader_->TellOffset()));
       }
+      TF_RETURN_IF_ERROR(global_shuffle_iterator_.Save(prefix(), ctx, writer));
       return absl::OkStatus();
     }
 
     Status RestoreInternal(IteratorContext* ctx,
                            IteratorStateReader* reader) override {
+      if (ctx->restored_element_count().has_value()) {
+        return global_shuffle_iterator_.Restore(prefix(), ctx, reader);
+      }
       mutex_lock l(mu_);
       ResetStreamsLocked();
       int64_t current_file_index;
@@ -299,6 +383,8 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     // we must destroy `reader_` before `file_`.
     std::unique_ptr<RandomAccessFile> file_ TF_GUARDED_BY(mu_);
     std::unique_ptr<io::SequentialRecordReader> reader_ TF_GUARDED_BY(mu_);
+
+    GlobalShuffleIterator global_shuffle_iterator_;
   };
 
   const std::vector<string> filenames_;
@@ -306,6 +392,9 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
   io::RecordReaderOptions options_;
   const std::vector<int64_t> byte_offsets_;
   const int op_version_;
+  // Set if the files are read at random positions using their indices.
+  std::unique_ptr<IndexedTFRecordReader> indexed_reader_;
+  absl::Status random_indexing_compatible_;
 };
 
 TFRecordDatasetOp::TFRecordDatasetOp(OpKernelConstruction* ctx)
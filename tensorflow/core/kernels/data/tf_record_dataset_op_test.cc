@@ -12,7 +12,9 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/tf_record_dataset_op.h"
 
 #include <memory>
+#include <cstdlib>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 #include "absl/log/log.h"
@@ -23,6 +25,7 @@ limitations under the License.
 #include "xla/tsl/lib/core/status_test_util.h"
 #include "tensorflow/core/data/dataset_test_base.h"
 #include "tensorflow/core/data/name_utils.h"
+#include "tensorflow/core/data/tfrecord_index.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/tensor_shape.h"
@@ -106,6 +109,8 @@ class TFRecordDatasetParams : public DatasetParams {
     return TFRecordDatasetOp::kDatasetType;
   }
 
+  const std::vector<tstring>& filenames() const { return filenames_; }
+
  private:
   std::vector<tstring> filenames_;
   CompressionType compression_type_;
@@ -352,6 +357,40 @@ TEST_F(TFRecordDatasetOpTest, InvalidByteOffsetsToSeek) {
       absl::StatusCode::kDataLoss);
 }
 
+TEST_F(TFRecordDatasetOpTest, RandomAccessWithIndex) {
+  auto dataset_params = TFRecordDatasetParams3();
+  std::vector<std::string> filenames(dataset_params.filenames().begin(),
+                                     dataset_params.filenames().end());
+  TF_ASSERT_OK(BuildTFRecordIndices(Env::Default(), filenames,
+                                    /*num_threads=*/2));
+  setenv("TF_DATA_TFRECORD_USE_INDEX", "true", /*overwrite=*/1);
+  absl::Status status = Initialize(dataset_params);
+  unsetenv("TF_DATA_TFRECORD_USE_INDEX");
+  TF_ASSERT_OK(status);
+  TF_ASSERT_OK(dataset_->RandomIndexingCompatible());
+  TF_ASSERT_OK(CheckDatasetCardinality(6));
+
+  std::vector<tstring> expected = {"1", "22", "333", "a", "bb", "ccc"};
+  for (int64_t i = expected.size() - 1; i >= 0; --i) {
+    std::vector<Tensor> out_tensors;
+    TF_ASSERT_OK(
+        dataset_->Get(AnyContext(iterator_ctx_.get()), i, &out_tensors));
+    ASSERT_EQ(out_tensors.size(), 1);
+    EXPECT_EQ(out_tensors[0].scalar<tstring>()(), expected[i]);
+  }
+  std::vector<Tensor> out_tensors;
+  EXPECT_EQ(dataset_->Get(AnyContext(iterator_ctx_.get()), 6, &out_tensors)
+                .code(),
+            absl::StatusCode::kOutOfRange);
+}
+
+TEST_F(TFRecordDatasetOpTest, NoRandomAccessWithoutIndex) {
+  auto dataset_params = TFRecordDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  EXPECT_EQ(dataset_->RandomIndexingCompatible().code(),
+            absl::StatusCode::kFailedPrecondition);
+}
+
 std::vector<IteratorSaveAndRestoreTestCase<TFRecordDatasetParams>>
 IteratorSaveAndRestoreTestCases() {
   return {
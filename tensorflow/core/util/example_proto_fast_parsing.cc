@@ -15,6 +15,7 @@ limitations under the License.
 #include "tensorflow/core/util/example_proto_fast_parsing.h"
 
 #include <algorithm>
+#include <cstring>
 #include <functional>
 #include <optional>
 #include <utility>
@@ -119,6 +120,39 @@ constexpr uint8 kVarintTag(uint32 tag) { return (tag << 3) | 0; }
 constexpr uint8 kDelimitedTag(uint32 tag) { return (tag << 3) | 2; }
 constexpr uint8 kFixed32Tag(uint32 tag) { return (tag << 3) | 5; }
 
+// Decodes the packed varints in [p, end) and appends them to `int64_list`.
+// Ids, counts and other small values are encoded as single-byte varints, so
+// eight bytes at a time are checked for continuation bits and, when none are
+// set, appended without going through the general varint decoder.
+template <typename Result>
+bool DecodePackedVarints(const uint8* p, const uint8* end,
+                         Result* int64_list) {
+  constexpr uint64 kContinuationBits = 0x8080808080808080ULL;
+  while (p < end) {
+    if (end - p >= 8) {
+      uint64 word;
+      std::memcpy(&word, p, sizeof(word));
+      if ((word & kContinuationBits) == 0) {
+        for (int i = 0; i < 8; ++i) {
+          int64_list->push_back(static_cast<int64_t>(p[i]));
+        }
+        p += 8;
+        continue;
+      }
+    }
+    uint64 n = 0;
+    for (int shift = 0;; shift += 7) {
+      // A varint is at most 10 bytes long.
+      if (p == end || shift >= 70) return false;
+      const uint8 byte = *p++;
+      n |= static_cast<uint64>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) break;
+    }
+    int64_list->push_back(static_cast<int64_t>(n));
+  }
+  return true;
+}
+
 namespace parsed {
 
 // ParseDataType has to be called first, then appropriate ParseZzzzList.
@@ -305,15 +339,22 @@ class Feature {
         if (!stream.ExpectTag(kDelimitedTag(1))) return false;  // packed tag
         uint32 packed_length;
         if (!stream.ReadVarint32(&packed_length)) return false;
-        auto packed_limit = stream.PushLimit(packed_length);
-
-        while (!stream.ExpectAtEnd()) {
-          protobuf_uint64 n;  // There is no API for int64
-          if (!stream.ReadVarint64(&n)) return false;
-          int64_list->push_back(static_cast<int64_t>(n));
+        if (packed_length > 0) {
+          // The stream aliases `serialized_`, so the packed values can be
+          // decoded in place.
+          const void* packed_data;
+          int packed_size;
+          if (!stream.GetDirectBufferPointer(&packed_data, &packed_size) ||
+              static_cast<uint32>(packed_size) < packed_length) {
+            return false;
+          }
+          const uint8* packed_begin = static_cast<const uint8*>(packed_data);
+          if (!DecodePackedVarints(packed_begin, packed_begin + packed_length,
+                                   int64_list)) {
+            return false;
+          }
+          if (!stream.Skip(packed_length)) return false;
         }
-
-        stream.PopLimit(packed_limit);
       } else {  // non-packed
         while (!stream.ExpectAtEnd()) {
           if (!stream.ExpectTag(kVarintTag(1))) return false;
@@ -567,6 +608,43 @@ struct SeededHasher {
   uint64 seed{0xDECAFCAFFE};
 };
 
+// Remembers which config entry the feature at each position of the last parsed
+// Example resolved to. Examples of one dataset are almost always serialized by
+// the same writer and so list their features in the same order; for those, a
+// name comparison against the cached entry replaces hashing the name and
+// probing the config index.
+//
+// The cached names alias the serialized input, which must outlive the layout.
+class FeatureLayout {
+ public:
+  // Returns true if the feature at `position` was called `feature_name` in
+  // the last Example. In that case `*in_config` tells whether the config
+  // contains the feature, and if so `*d_and_type` identifies the entry.
+  bool Lookup(size_t position, StringPiece feature_name, bool* in_config,
+              std::pair<size_t, Type>* d_and_type) const {
+    if (position >= entries_.size()) return false;
+    const Entry& entry = entries_[position];
+    if (entry.feature_name != feature_name) return false;
+    *in_config = entry.in_config;
+    *d_and_type = entry.d_and_type;
+    return true;
+  }
+
+  void Update(size_t position, StringPiece feature_name, bool in_config,
+              const std::pair<size_t, Type>& d_and_type) {
+    if (position >= entries_.size()) entries_.resize(position + 1);
+    entries_[position] = {feature_name, in_config, d_and_type};
+  }
+
+ private:
+  struct Entry {
+    StringPiece feature_name;
+    bool in_config = false;
+    std::pair<size_t, Type> d_and_type;
+  };
+  std::vector<Entry> entries_;
+};
+
 void LogDenseFeatureDataLoss(StringPiece feature_name) {
   LOG(WARNING) << "Data loss! Feature '" << feature_name
                << "' is present in multiple concatenated "
@@ -593,7 +671,8 @@ absl::Status FastParseSerializedExample(
     const tstring& serialized_example, const tstring& example_name,
     const size_t example_index, const Config& config,
     const PresizedCuckooMap<std::pair<size_t, Type>>& config_index,
-    SeededHasher hasher, std::vector<Tensor>* output_dense,
+    SeededHasher hasher, FeatureLayout* layout,
+    std::vector<Tensor>* output_dense,
     std::vector<SparseBuffer>* output_varlen_dense,
     std::vector<SparseBuffer>* output_sparse,
     std::vector<SparseBuffer>* output_ragged,
@@ -623,30 +702,37 @@ absl::Status FastParseSerializedExample(
   for (size_t i = 0; i < parsed_example_size; ++i) {
     // This is a logic that standard protobuf parsing is implementing.
     // I.e. last entry in the map overwrites all the previous ones.
-    parsed::FeatureMapEntry& name_and_feature =
-        parsed_example[parsed_example_size - i - 1];
+    const size_t position = parsed_example_size - i - 1;
+    parsed::FeatureMapEntry& name_and_feature = parsed_example[position];
 
     const StringPiece feature_name = name_and_feature.first;
     parsed::Feature& feature = name_and_feature.second;
 
     std::pair<size_t, Type> d_and_type;
-    uint64 h = hasher(feature_name);
-    if (!config_index.Find(h, &d_and_type)) continue;
+    bool in_config = false;
+    if (!layout->Lookup(position, feature_name, &in_config, &d_and_type)) {
+      uint64 h = hasher(feature_name);
+      in_config = config_index.Find(h, &d_and_type);
+      if (in_config) {
+        // Testing for PresizedCuckooMap collision.
+        // TODO(lew): Use dense_hash_map and avoid this and hasher creation.
+        const size_t d = d_and_type.first;
+        const tstring& config_feature_name =
+            d_and_type.second == Type::Dense
+                ? config.dense[d].feature_name
+                : (d_and_type.second == Type::Ragged
+                       ? config.ragged[d].feature_name
+                       : config.sparse[d].feature_name);
+        in_config = feature_name == config_feature_name;
+      }
+      layout->Update(position, feature_name, in_config, d_and_type);
+    }
+    if (!in_config) continue;
 
     size_t d = d_and_type.first;
     bool is_dense = d_and_type.second == Type::Dense;
     bool is_ragged = d_and_type.second == Type::Ragged;
 
-    {
-      // Testing for PresizedCuckooMap collision.
-      // TODO(lew): Use dense_hash_map and avoid this and hasher creation.
-      const tstring& config_feature_name =
-          is_dense ? config.dense[d].feature_name
-                   : (is_ragged ? config.ragged[d].feature_name
-                                : config.sparse[d].feature_name);
-      if (feature_name != config_feature_name) continue;
-    }
-
     auto example_error = [&](StringPiece suffix) {
       return errors::InvalidArgument("Name: ", example_name,
                                      ", Key: ", feature_name,
@@ -1237,6 +1323,7 @@ absl::Status FastParseExample(const Config& config,
     ragged_buffers[minibatch].resize(config.ragged.size());
     size_t start = first_example_of_minibatch(minibatch);
     size_t end = first_example_of_minibatch(minibatch + 1);
+    FeatureLayout layout;
     for (size_t e = start; e < end; ++e) {
       PerExampleFeatureStats* stats = nullptr;
       if (config.collect_feature_stats) {
@@ -1245,7 +1332,7 @@ absl::Status FastParseExample(const Config& config,
       status_of_minibatch[minibatch] = FastParseSerializedExample(
           serialized[e],
           (!example_names.empty() ? example_names[e] : "<unknown>"), e, config,
-          config_index, hasher, &fixed_dense_values,
+          config_index, hasher, &layout, &fixed_dense_values,
           &varlen_dense_buffers[minibatch], &sparse_buffers[minibatch],
           &ragged_buffers[minibatch], stats);
       if (!status_of_minibatch[minibatch].ok()) break;
@@ -21,6 +21,7 @@ limitations under the License.
 
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature.pb.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/platform/protobuf.h"
@@ -172,6 +173,21 @@ TEST(FastParse, Packed) {
       "\x0a\x0d\x0a\x0b\x0a\x03\x61\x67\x65\x12\x04\x1a\x02\x08\x0d");
 }
 
+TEST(FastParse, PackedInt64RunsOfSmallValues) {
+  Example example;
+  Int64List* int64_list =
+      (*example.mutable_features()->mutable_feature())["ids"]
+          .mutable_int64_list();
+  // Runs of single-byte varints interleaved with multi-byte and negative
+  // values, with run lengths around the 8-byte decoding width.
+  for (int run = 0; run < 20; ++run) {
+    for (int i = 0; i < run; ++i) int64_list->add_value(i);
+    int64_list->add_value(int64_t{1} << (3 * run));
+    int64_list->add_value(-run);
+  }
+  TestCorrectness(Serialize(example));
+}
+
 TEST(FastParse, ValueBeforeKeyInMap) {
   TestCorrectness("\x0a\x12\x0a\x10\x12\x09\x0a\x07\x0a\x05value\x0a\x03key");
 }
@@ -327,6 +343,55 @@ TEST(FastParse, StatsCollection) {
   }
 }
 
+TEST(FastParse, FeatureOrderChangesBetweenExamples) {
+  FastParseExampleConfig config;
+  AddDenseFeature("a", DT_INT64, {1}, false, 1, &config);
+  AddDenseFeature("b", DT_FLOAT, {1}, false, 1, &config);
+  AddSparseFeature("c", DT_INT64, &config);
+
+  // Each example lists its features in a different order, with features that
+  // are not in the config at positions that held config features before.
+  const std::vector<std::vector<string>> feature_orders = {
+      {"a", "b", "c"}, {"a", "b", "c"}, {"c", "a", "b"}, {"x", "b", "a"},
+      {"b", "x", "a", "c"}, {"a", "b", "c"}};
+  std::vector<tstring> serialized;
+  for (int e = 0; e < feature_orders.size(); ++e) {
+    // Proto maps do not guarantee a serialization order, so concatenate
+    // single-feature Examples, which parse as one Example with the features in
+    // the order given.
+    string serialized_example;
+    for (const string& name : feature_orders[e]) {
+      Example example;
+      Feature& feature = (*example.mutable_features()->mutable_feature())[name];
+      if (name == "b") {
+        feature.mutable_float_list()->add_value(e + 0.5f);
+      } else {
+        feature.mutable_int64_list()->add_value(name == "c" ? 100 + e : e);
+      }
+      serialized_example += Serialize(example);
+    }
+    serialized.push_back(serialized_example);
+  }
+
+  Result result;
+  TF_ASSERT_OK(FastParseExample(config, serialized, {}, nullptr, &result));
+  ASSERT_EQ(2, result.dense_values.size());
+  const auto a = result.dense_values[0].flat<int64_t>();
+  const auto b = result.dense_values[1].flat<float>();
+  for (int e = 0; e < feature_orders.size(); ++e) {
+    EXPECT_EQ(e, a(e));
+    EXPECT_EQ(e + 0.5f, b(e));
+  }
+  const auto c_indices = result.sparse_indices[0].matrix<int64_t>();
+  const auto c_values = result.sparse_values[0].flat<int64_t>();
+  ASSERT_EQ(5, c_values.size());
+  const std::vector<int64_t> examples_with_c = {0, 1, 2, 4, 5};
+  for (int i = 0; i < examples_with_c.size(); ++i) {
+    EXPECT_EQ(examples_with_c[i], c_indices(i, 0));
+    EXPECT_EQ(100 + examples_with_c[i], c_values(i));
+  }
+}
+
 string RandStr(random::SimplePhilox* rng) {
   static const char key_char_lookup[] =
       "0123456789{}~`!@#$%^&*()"
@@ -429,6 +494,92 @@ TEST(TestFastParseExample, Empty) {
   EXPECT_TRUE(status.ok()) << status;
 }
 
+// Parses batches of `state.range(0)` Examples shaped like a ranking model's
+// input: `state.range(1)` features split between single-valued int64 ids,
+// fixed-size float embeddings, and variable-length int64 and bytes features,
+// all listed in the same order in every Example.
+void BM_FastParseExample(::testing::benchmark::State& state) {
+  const int batch_size = state.range(0);
+  const int num_features = state.range(1);
+  random::PhiloxRandom philox(42);
+  random::SimplePhilox rng(&philox);
+
+  FastParseExampleConfig config;
+  std::vector<string> names;
+  for (int f = 0; f < num_features; ++f) {
+    names.push_back(strings::StrCat("feature_", f));
+  }
+  auto make_example = [&] {
+    string serialized;
+    for (int f = 0; f < num_features; ++f) {
+      Example example;
+      Feature& feature =
+          (*example.mutable_features()->mutable_feature())[names[f]];
+      switch (f % 8) {
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+          feature.mutable_int64_list()->add_value(rng.Uniform64(1 << 20));
+          break;
+        case 4:
+        case 5:
+          for (int i = 0; i < 16; ++i) {
+            feature.mutable_float_list()->add_value(rng.RandFloat());
+          }
+          break;
+        case 6:
+          for (int i = 0, n = rng.Uniform(32); i < n; ++i) {
+            feature.mutable_int64_list()->add_value(rng.Uniform(100));
+          }
+          break;
+        case 7:
+          feature.mutable_bytes_list()->add_value(RandStr(&rng));
+          break;
+      }
+      serialized += Serialize(example);
+    }
+    return serialized;
+  };
+  for (int f = 0; f < num_features; ++f) {
+    const char* name = names[f].c_str();
+    switch (f % 8) {
+      case 0:
+      case 1:
+      case 2:
+      case 3:
+        AddDenseFeature(name, DT_INT64, {1}, false, 1, &config);
+        break;
+      case 4:
+      case 5:
+        AddDenseFeature(name, DT_FLOAT, {16}, false, 16, &config);
+        break;
+      case 6:
+        AddSparseFeature(name, DT_INT64, &config);
+        break;
+      case 7:
+        AddSparseFeature(name, DT_STRING, &config);
+        break;
+    }
+  }
+  std::vector<tstring> serialized;
+  for (int i = 0; i < batch_size; ++i) {
+    serialized.push_back(make_example());
+  }
+
+  for (auto s : state) {
+    Result result;
+    TF_CHECK_OK(FastParseExample(config, serialized, {}, nullptr, &result));
+  }
+  state.SetItemsProcessed(state.iterations() * batch_size);
+}
+
+BENCHMARK(BM_FastParseExample)
+    ->ArgPair(1, 256)
+    ->ArgPair(128, 256)
+    ->ArgPair(128, 512)
+    ->ArgPair(1024, 256);
+
 }  // namespace
 }  // namespace example
 }  // namespace tensorflow
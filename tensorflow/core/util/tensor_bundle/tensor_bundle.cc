@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
 
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
@@ -24,6 +25,7 @@ limitations under the License.
 #include "absl/synchronization/mutex.h"
 #include "xla/tsl/lib/io/buffered_file.h"
 #include "xla/tsl/util/byte_swap_array.h"
+#include "tensorflow/core/framework/allocation_description.pb.h"
 #include "tensorflow/core/framework/register_types.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/framework/tensor_shape.pb.h"
@@ -769,6 +771,45 @@ Status MergeBundles(Env* env, absl::Span<const tstring> prefixes,
 
 // Interface for reading a tensor bundle.
 
+// A memory-mapped data file. Tensors that alias the file hold a reference.
+class BundleReader::MappedFile : public core::RefCounted {
+ public:
+  explicit MappedFile(std::unique_ptr<ReadOnlyMemoryRegion> region)
+      : region_(std::move(region)) {}
+
+  const char* data() const { return static_cast<const char*>(region_->data()); }
+  uint64 length() const { return region_->length(); }
+
+ private:
+  const std::unique_ptr<ReadOnlyMemoryRegion> region_;
+};
+
+namespace {
+
+// A TensorBuffer aliasing a range of a memory-mapped data file.
+class MappedTensorBuffer : public TensorBuffer {
+ public:
+  MappedTensorBuffer(core::RefCounted* file, const char* data, size_t size)
+      : TensorBuffer(const_cast<char*>(data)), file_(file), size_(size) {
+    file_->Ref();
+  }
+  ~MappedTensorBuffer() override { file_->Unref(); }
+
+  size_t size() const override { return size_; }
+  TensorBuffer* root_buffer() override { return this; }
+  void FillAllocationDescription(AllocationDescription* proto) const override {
+    proto->set_requested_bytes(size_);
+    proto->set_allocator_name("mmap");
+  }
+  bool OwnsMemory() const override { return false; }
+
+ private:
+  core::RefCounted* const file_;
+  const size_t size_;
+};
+
+}  // namespace
+
 BundleReader::BundleReader(
     Env* env, StringPiece prefix,
     bool enable_multi_threading_for_testing /* = false */)
@@ -785,7 +826,8 @@ BundleReader::BundleReader(Env* env, StringPiece prefix, Options options)
       iter_(nullptr),
       need_to_swap_bytes_(false),
       enable_multi_threading_for_testing_(
-          options.enable_multi_threading_for_testing) {
+          options.enable_multi_threading_for_testing),
+      use_mmap_(options.use_mmap) {
   if (cache_ == nullptr) {
     // Make a cache for use just by this BundleReader.
     owned_cache_ = std::make_unique<BundleCache>(env);
@@ -849,6 +891,10 @@ BundleReader::~BundleReader() {
   for (auto& temp : data_) {
     delete temp.second;
   }
+  for (auto& temp : mapped_data_) {
+    temp.second->Unref();
+  }
+  mapped_data_.clear();
   for (auto& temp : tensor_slices_) {
     delete temp.second;
   }
@@ -877,7 +923,70 @@ Status BundleReader::GetBundleEntryProto(StringPiece key,
   return absl::OkStatus();
 }
 
+Status BundleReader::GetMappedValue(const BundleEntryProto& entry, Tensor* val,
+                                    bool* aliased) {
+  *aliased = false;
+  if (!DataTypeCanUseMemcpy(entry.dtype()) || need_to_swap_bytes_ ||
+      entry.size() == 0 || entry.offset() % EIGEN_MAX_ALIGN_BYTES != 0) {
+    return absl::OkStatus();
+  }
+  const TensorShape stored_shape(entry.shape());
+  const uint64 expected_size =
+      stored_shape.num_elements() * DataTypeSize(entry.dtype());
+  if (entry.size() != expected_size) {
+    return errors::DataLoss("Invalid size in bundle entry: key ", key(),
+                            "; stored size ", entry.size(), "; expected size ",
+                            expected_size);
+  }
+
+  MappedFile* mapped_file = mapped_data_[entry.shard_id()];
+  if (mapped_file == nullptr) {
+    const string filename =
+        DataFilename(prefix_, entry.shard_id(), num_shards_);
+    std::unique_ptr<ReadOnlyMemoryRegion> region;
+    Status s = env_->NewReadOnlyMemoryRegionFromFile(filename, &region);
+    if (!s.ok()) {
+      // Not every file system supports memory-mapping. Fall back to reading.
+      VLOG(1) << "Failed to memory-map " << filename << ": " << s
+              << ". Falling back to copying reads.";
+      mapped_data_.erase(entry.shard_id());
+      use_mmap_ = false;
+      return absl::OkStatus();
+    }
+    mapped_file = new MappedFile(std::move(region));
+    mapped_data_[entry.shard_id()] = mapped_file;
+  }
+  if (entry.offset() + entry.size() > mapped_file->length()) {
+    return errors::DataLoss("TensorBundle at ", prefix_, " shard ",
+                            entry.shard_id(), ": entry for key ", key(),
+                            " exceeds the data file size ",
+                            mapped_file->length());
+  }
+  const char* data = mapped_file->data() + entry.offset();
+  if (reinterpret_cast<uintptr_t>(data) % EIGEN_MAX_ALIGN_BYTES != 0) {
+    return absl::OkStatus();
+  }
+  const uint32 actual_crc32c = crc32c::Value(data, entry.size());
+  if (crc32c::Unmask(entry.crc32c()) != actual_crc32c) {
+    return errors::DataLoss(
+        "TensorBundle at ", prefix_, " shard ", entry.shard_id(), " (",
+        entry.size(), " bytes): Checksum does not match: stored ",
+        strings::Printf("%08u", crc32c::Unmask(entry.crc32c())),
+        " vs. calculated on the restored bytes ", actual_crc32c);
+  }
+  auto* buffer = new MappedTensorBuffer(mapped_file, data, entry.size());
+  *val = Tensor(entry.dtype(), stored_shape, buffer);
+  buffer->Unref();
+  *aliased = true;
+  return absl::OkStatus();
+}
+
 Status BundleReader::GetValue(const BundleEntryProto& entry, Tensor* val) {
+  if (use_mmap_ && val->NumElements() == 0) {
+    bool aliased = false;
+    TF_RETURN_IF_ERROR(GetMappedValue(entry, val, &aliased));
+    if (aliased) return absl::OkStatus();
+  }
   Tensor* ret = val;
   const TensorShape stored_shape(TensorShape(entry.shape()));
   if (val->NumElements() == 0) {
@@ -212,6 +212,14 @@ class BundleReader {
 
     // For tests only.
     bool enable_multi_threading_for_testing = false;
+
+    // If true, data files are memory-mapped and tensors whose data is stored
+    // at an offset aligned to EIGEN_MAX_ALIGN_BYTES are returned as views of
+    // the mapped pages instead of being copied. Such tensors keep the mapping
+    // alive. Other tensors, and tensors read into a caller-allocated "val",
+    // are copied as usual. Write the bundle with a matching
+    // `BundleWriter::Options::data_alignment` to make all tensors eligible.
+    bool use_mmap = false;
   };
   BundleReader(Env* env, absl::string_view prefix, Options options);
 
@@ -322,6 +330,12 @@ class BundleReader {
   Status GetValue(const BundleEntryProto& entry,
                   Tensor* val) TF_MUST_USE_RESULT;
 
+  // Attempts to return the tensor described by "entry" as a view of the
+  // memory-mapped data file. Sets "*aliased" to false, leaving "val" untouched,
+  // if the entry cannot be aliased.
+  Status GetMappedValue(const BundleEntryProto& entry, Tensor* val,
+                        bool* aliased) TF_MUST_USE_RESULT;
+
   // Reads the slice described by "slice_spec".  The corresponding full tensor
   // has key "ful_tensor_key" and metadata proto "full_tensor_entry".
   // REQUIRES: full_tensor_entry.slices_size() > 0
@@ -344,6 +358,11 @@ class BundleReader {
   // Owned InputBuffer objects. cache_ owns the underlying RandomAccessFiles.
   std::unordered_map<int32_t, io::InputBuffer*> data_;
 
+  // Memory-mapped data files, populated on-demand when "use_mmap_" is true.
+  // Each file is ref-counted and shared with the tensors that alias it.
+  class MappedFile;
+  std::unordered_map<int32_t, MappedFile*> mapped_data_;
+
   // Maps each partitioned tensor's key to its stored slices (represented in a
   // TensorSliceSet).  Populated on-demand.
   std::unordered_map<std::string, checkpoint::TensorSliceSet*> tensor_slices_;
@@ -360,6 +379,8 @@ class BundleReader {
 
   bool enable_multi_threading_for_testing_ = false;
 
+  bool use_mmap_ = false;
+
   BundleReader(const BundleReader&) = delete;
   void operator=(const BundleReader&) = delete;
 };
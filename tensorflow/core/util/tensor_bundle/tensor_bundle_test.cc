@@ -1270,6 +1270,80 @@ TEST_F(TensorBundleAlignmentTest, AlignmentTest) {
   }
 }
 
+TEST(TensorBundleTest, MmapAliasesAlignedTensors) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = EIGEN_MAX_ALIGN_BYTES;
+    BundleWriter writer(Env::Default(), Prefix("mmap"), opts);
+    TF_EXPECT_OK(writer.Add("foo_000", Constant_2x3<float>(0)));
+    TF_EXPECT_OK(writer.Add("foo_001", Constant_2x3<int64_t>(1)));
+    TF_EXPECT_OK(writer.Add("foo_002", Constant_2x3<tstring>("two")));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader::Options options;
+  options.use_mmap = true;
+  BundleReader reader(Env::Default(), Prefix("mmap"), options);
+  TF_ASSERT_OK(reader.status());
+
+  Tensor first, second;
+  TF_ASSERT_OK(reader.Lookup("foo_000", &first));
+  TF_ASSERT_OK(reader.Lookup("foo_000", &second));
+  test::ExpectTensorEqual<float>(first, Constant_2x3<float>(0));
+  // Both lookups alias the same mapped pages.
+  EXPECT_EQ(first.tensor_data().data(), second.tensor_data().data());
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(first.tensor_data().data()) %
+                   EIGEN_MAX_ALIGN_BYTES);
+
+  Tensor int_tensor;
+  TF_ASSERT_OK(reader.Lookup("foo_001", &int_tensor));
+  test::ExpectTensorEqual<int64_t>(int_tensor, Constant_2x3<int64_t>(1));
+
+  // String tensors cannot alias the file and are copied.
+  Tensor string_tensor;
+  TF_ASSERT_OK(reader.Lookup("foo_002", &string_tensor));
+  test::ExpectTensorEqual<tstring>(string_tensor, Constant_2x3<tstring>("two"));
+
+  // Caller-allocated tensors are filled in place.
+  Expect<float>(&reader, "foo_000", Constant_2x3<float>(0));
+}
+
+TEST(TensorBundleTest, MmapOutlivesReader) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = EIGEN_MAX_ALIGN_BYTES;
+    BundleWriter writer(Env::Default(), Prefix("mmap_outlives"), opts);
+    TF_EXPECT_OK(writer.Add("foo", Constant_100x100<double>(4.5)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  Tensor val;
+  {
+    BundleReader::Options options;
+    options.use_mmap = true;
+    BundleReader reader(Env::Default(), Prefix("mmap_outlives"), options);
+    TF_ASSERT_OK(reader.status());
+    TF_ASSERT_OK(reader.Lookup("foo", &val));
+  }
+  test::ExpectTensorEqual<double>(val, Constant_100x100<double>(4.5));
+}
+
+TEST(TensorBundleTest, MmapUnalignedTensorsAreCopied) {
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = 1;
+    BundleWriter writer(Env::Default(), Prefix("mmap_unaligned"), opts);
+    TF_EXPECT_OK(writer.Add("foo_000", Constant(true, TensorShape({3}))));
+    TF_EXPECT_OK(writer.Add("foo_001", Constant_2x3<float>(1)));
+    TF_ASSERT_OK(writer.Finish());
+  }
+  BundleReader::Options options;
+  options.use_mmap = true;
+  BundleReader reader(Env::Default(), Prefix("mmap_unaligned"), options);
+  TF_ASSERT_OK(reader.status());
+  Tensor val;
+  TF_ASSERT_OK(reader.Lookup("foo_001", &val));
+  test::ExpectTensorEqual<float>(val, Constant_2x3<float>(1));
+}
+
 static void BM_BundleAlignment(::testing::benchmark::State& state) {
   {
     const int alignment = state.range(0);
@@ -1296,6 +1370,42 @@ BENCHMARK(BM_BundleAlignment)->ArgPair(4096, 512);
 BENCHMARK(BM_BundleAlignment)->ArgPair(4096, 4096);
 BENCHMARK(BM_BundleAlignment)->ArgPair(4096, 1048576);
 
+// Compares copying reads with memory-mapped reads on a warm page cache.
+static void BM_BundleReaderMmap(::testing::benchmark::State& state) {
+  const bool use_mmap = state.range(0);
+  const int tensor_size = state.range(1);
+  {
+    BundleWriter::Options opts;
+    opts.data_alignment = EIGEN_MAX_ALIGN_BYTES;
+    BundleWriter writer(Env::Default(), Prefix("mmap_bm"), opts);
+    for (int i = 0; i < 16; ++i) {
+      TF_CHECK_OK(writer.Add(strings::StrCat("t", i),
+                             Constant(1.0f, TensorShape({tensor_size}))));
+    }
+    TF_CHECK_OK(writer.Finish());
+  }
+  BundleReader::Options options;
+  options.use_mmap = use_mmap;
+  BundleReader reader(Env::Default(), Prefix("mmap_bm"), options);
+  TF_CHECK_OK(reader.status());
+  // Warm up the page cache.
+  for (int i = 0; i < 16; ++i) {
+    Tensor t;
+    TF_CHECK_OK(reader.Lookup(strings::StrCat("t", i), &t));
+  }
+  int i = 0;
+  for (auto s : state) {
+    Tensor t;
+    TF_CHECK_OK(reader.Lookup(strings::StrCat("t", i++ % 16), &t));
+  }
+  state.SetBytesProcessed(state.iterations() * tensor_size * sizeof(float));
+}
+
+BENCHMARK(BM_BundleReaderMmap)->ArgPair(0, 4096);
+BENCHMARK(BM_BundleReaderMmap)->ArgPair(1, 4096);
+BENCHMARK(BM_BundleReaderMmap)->ArgPair(0, 1048576);
+BENCHMARK(BM_BundleReaderMmap)->ArgPair(1, 1048576);
+
 static void BM_BundleWriterSmallTensor(::testing::benchmark::State& state) {
   const int64_t bytes = state.range(0);
   Tensor t = Constant(static_cast<int8>('a'), TensorShape{bytes});
@@ -38,6 +38,10 @@ from tensorflow.python.saved_model import nested_structure_coder
 # snapshot is not ready yet.
 _RETRY_INTERVAL_SEC = 5
 
+# When loading a distributed snapshot without a `reader_func`, the maximum
+# number of decoded elements buffered for each chunk read in parallel.
+_CHUNK_BUFFER_SIZE = 8
+
 
 def _load(  # pylint: disable=unused-private-name
     path: str,
@@ -51,19 +55,25 @@ def _load(  # pylint: disable=unused-private-name
   if wait:
     return _load_with_retry(path, element_spec, compression, reader_func)
 
-  if reader_func is None:
-    reader_func = lambda datasets: datasets.interleave(  # pylint:disable=g-long-lambda
-        lambda x: x,
-        cycle_length=multiprocessing.cpu_count(),
-        num_parallel_calls=dataset_ops.AUTOTUNE)
-
   distributed_snapshot_metadata = _load_distributed_snapshot_metadata(path)
   if distributed_snapshot_metadata:
     _validate_snapshot(
         path, distributed_snapshot_metadata, element_spec, compression)
+    if reader_func is None:
+      return _ParallelSnapshotChunksDataset(
+          path,
+          element_spec=_parse_element_spec(
+              distributed_snapshot_metadata.element_spec),
+          compression=distributed_snapshot_metadata.compression)
     return _load_distributed_snapshot(
         path, distributed_snapshot_metadata, reader_func)
 
+  if reader_func is None:
+    reader_func = lambda datasets: datasets.interleave(  # pylint:disable=g-long-lambda
+        lambda x: x,
+        cycle_length=multiprocessing.cpu_count(),
+        num_parallel_calls=dataset_ops.AUTOTUNE)
+
   if element_spec is None:
     element_spec = _load_element_spec(path)
   return _LoadDataset(path, element_spec, compression, reader_func)
@@ -223,6 +233,34 @@ class _SnapshotChunkDataset(dataset_ops.DatasetSource):
     return self._element_spec
 
 
+class _ParallelSnapshotChunksDataset(dataset_ops.DatasetSource):
+  """A dataset that reads the chunks of a distributed snapshot in parallel.
+
+  Decodes `cpu_count()` chunks concurrently, and buffers up to
+  `_CHUNK_BUFFER_SIZE` decoded elements per chunk. The elements are produced in
+  the same order as the default `reader_func`, which interleaves
+  `cpu_count()` chunks. If `tf.data.Options.deterministic` is False, they are
+  produced in the order they are decoded.
+  """
+
+  def __init__(self, snapshot_path: str, element_spec: Any, compression: str):
+    self._snapshot_path = snapshot_path
+    self._element_spec = element_spec
+    variant_tensor = ged_ops.parallel_snapshot_chunks_dataset(
+        snapshot_path,
+        num_parallel_chunks=multiprocessing.cpu_count(),
+        buffer_size=_CHUNK_BUFFER_SIZE,
+        compression=compression,
+        # Rewritten to "false" if `tf.data.Options.deterministic` is False.
+        deterministic="default",
+        **self._flat_structure)
+    super().__init__(variant_tensor)
+
+  @property
+  def element_spec(self) -> Any:
+    return self._element_spec
+
+
 class _ListSnapshotChunksDataset(dataset_ops.DatasetSource):
   """A dataset for listing snapshot chunk files.
 
@@ -81,8 +81,10 @@ void* AllocatorRetry::AllocateRaw(
       if (now < deadline_micros) {
         tracker.Enable();
         absl::MutexLock l(&mu_);
+        num_waiters_.fetch_add(1, std::memory_order_release);
         memory_returned_.WaitWithTimeout(
             &mu_, absl::Milliseconds((deadline_micros - now) / 1000));
+        num_waiters_.fetch_sub(1, std::memory_order_relaxed);
       } else {
         return alloc_func(alignment, num_bytes, true);
       }
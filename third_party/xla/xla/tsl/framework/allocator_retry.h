@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef XLA_TSL_FRAMEWORK_ALLOCATOR_RETRY_H_
 #define XLA_TSL_FRAMEWORK_ALLOCATOR_RETRY_H_
 
+#include <atomic>
 #include <cstddef>
 #include <functional>
 
@@ -51,10 +52,16 @@ class AllocatorRetry {
   Env* env_;
   absl::Mutex mu_;
   absl::CondVar memory_returned_ ABSL_GUARDED_BY(mu_);
+  // Number of allocations waiting for memory to be returned.
+  std::atomic<int> num_waiters_ = 0;
 };
 
 // Implementation details below
 inline void AllocatorRetry::NotifyDealloc() {
+  // Skips the lock in the common case where no allocation is waiting.
+  if (num_waiters_.load(std::memory_order_acquire) == 0) {
+    return;
+  }
   absl::MutexLock l(&mu_);
   memory_returned_.SignalAll();
 }
@@ -29,11 +29,13 @@ limitations under the License.
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 #include "absl/synchronization/mutex.h"
 #include "xla/tsl/framework/allocator.h"
 #include "xla/tsl/framework/allocator_retry.h"
+#include "xla/tsl/lib/core/bits.h"
 #include "xla/tsl/protobuf/bfc_memory_map.pb.h"
 #include "tsl/platform/env.h"
 #include "tsl/platform/file_system.h"
@@ -49,11 +51,28 @@ namespace tsl {
 
 constexpr BFCAllocator::ChunkHandle BFCAllocator::kInvalidChunkHandle;
 
+namespace {
+
+std::atomic<int64_t> next_allocator_id{0};
+
+// Sets 'max' to 'value' if 'value' is larger.
+void UpdateMax(std::atomic<int64_t>& max, int64_t value) {
+  int64_t current = max.load(std::memory_order_relaxed);
+  while (value > current &&
+         !max.compare_exchange_weak(current, value,
+                                    std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
 BFCAllocator::BFCAllocator(std::unique_ptr<SubAllocator> sub_allocator,
                            size_t total_memory, const string& name,
                            const Options& opts)
     : opts_(opts),
       coalesce_regions_(sub_allocator->SupportsCoalescing()),
+      use_thread_caches_(opts.thread_cache_bytes > 0 && !coalesce_regions_),
+      id_(next_allocator_id.fetch_add(1, std::memory_order_relaxed)),
       sub_allocator_(std::move(sub_allocator)),
       name_(name),
       free_chunks_list_(kInvalidChunkHandle),
@@ -115,15 +134,19 @@ BFCAllocator::~BFCAllocator() {
 }
 
 BFCAllocator::Chunk* BFCAllocator::ChunkFromHandle(ChunkHandle h) {
-  DCHECK_GE(h, 0);
-  DCHECK_LT(h, static_cast<int>(chunks_.size()));
-  return &(chunks_[h]);
+  DCHECK_LT(h, num_chunks_);
+  return OwnedChunkFromHandle(h);
 }
 
 const BFCAllocator::Chunk* BFCAllocator::ChunkFromHandle(ChunkHandle h) const {
-  DCHECK_GE(h, 0);
-  DCHECK_LT(h, static_cast<int>(chunks_.size()));
-  return &(chunks_[h]);
+  DCHECK_LT(h, num_chunks_);
+  return OwnedChunkFromHandle(h);
+}
+
+BFCAllocator::Chunk* BFCAllocator::OwnedChunkFromHandle(ChunkHandle h) const {
+  const int block = tsl::Log2Floor64(h / kChunkBlockSize + 1);
+  const size_t offset = h - kChunkBlockSize * ((size_t{1} << block) - 1);
+  return &chunk_blocks_[block][offset];
 }
 
 bool BFCAllocator::Extend(size_t alignment, size_t rounded_bytes) {
@@ -188,6 +211,7 @@ bool BFCAllocator::Extend(size_t alignment, size_t rounded_bytes) {
   } else {
     region_manager_.AddAllocationRegion(mem_addr, bytes_received);
   }
+  UpdateRegionIndex();
 
   // Create one large chunk for the whole memory space that will
   // be chunked later.
@@ -230,8 +254,13 @@ BFCAllocator::ChunkHandle BFCAllocator::AllocateChunk() {
     free_chunks_list_ = c->next;
     return h;
   } else {
-    ChunkHandle h = chunks_.size();
-    chunks_.resize(h + 1);
+    ChunkHandle h = num_chunks_++;
+    const int block = tsl::Log2Floor64(h / kChunkBlockSize + 1);
+    CHECK_LT(block, kMaxChunkBlocks);
+    if (chunk_blocks_[block] == nullptr) {
+      chunk_blocks_[block] =
+          std::make_unique<Chunk[]>(kChunkBlockSize << block);
+    }
     return h;
   }
 }
@@ -335,6 +364,185 @@ size_t BFCAllocator::RoundedBytes(size_t bytes) {
   return rounded_bytes;
 }
 
+void BFCAllocator::UpdateRegionIndex() {
+  if (!use_thread_caches_) {
+    return;
+  }
+  auto index = std::make_unique<RegionIndex>();
+  for (const AllocationRegion& region : region_manager_.regions()) {
+    index->regions.push_back(
+        {region.ptr(), region.end_ptr(), region.handles()});
+  }
+  region_index_.store(index.get(), std::memory_order_release);
+  region_indices_.push_back(std::move(index));
+}
+
+BFCAllocator::Chunk* BFCAllocator::InUseChunkFromPtr(const void* ptr) const {
+  const RegionIndex* index = region_index_.load(std::memory_order_acquire);
+  CHECK(index != nullptr) << "Could not find Region for " << ptr;
+  auto region = std::upper_bound(
+      index->regions.begin(), index->regions.end(), ptr,
+      [](const void* p, const RegionIndex::Region& r) {
+        return p < r.end_ptr;
+      });
+  CHECK(region != index->regions.end() && ptr >= region->ptr)
+      << "Could not find Region for " << ptr;
+  const size_t handle_index = (reinterpret_cast<std::uintptr_t>(ptr) -
+                               reinterpret_cast<std::uintptr_t>(region->ptr)) >>
+                              kMinAllocationBits;
+  const ChunkHandle h = region->handles[handle_index];
+  CHECK(h != kInvalidChunkHandle)
+      << "Asked to deallocate pointer we never allocated: " << ptr;
+  return OwnedChunkFromHandle(h);
+}
+
+BFCAllocator::ThreadCache* BFCAllocator::GetThreadCache() {
+  // The caches of the allocators used by this thread, by allocator id. Most
+  // threads use a single allocator, so the last lookup is remembered.
+  thread_local absl::flat_hash_map<int64_t, std::shared_ptr<ThreadCache>>
+      caches;
+  thread_local int64_t last_id = -1;
+  thread_local ThreadCache* last_cache = nullptr;
+  if (last_id == id_) {
+    return last_cache;
+  }
+  std::shared_ptr<ThreadCache>& cache = caches[id_];
+  if (cache == nullptr) {
+    cache = std::make_shared<ThreadCache>();
+    absl::MutexLock l(&thread_caches_mu_);
+    thread_caches_.push_back(cache);
+  }
+  last_id = id_;
+  last_cache = cache.get();
+  return last_cache;
+}
+
+bool BFCAllocator::UseThreadCache() const {
+  // Allocations with free timestamps, and allocations traced by the profiler,
+  // go through the bins.
+  return use_thread_caches_ && timing_counter_ == nullptr &&
+         !tsl::profiler::TraceMe::Active(tsl::profiler::TraceMeLevel::kInfo);
+}
+
+void* BFCAllocator::AllocateFromThreadCache(size_t rounded_bytes,
+                                            size_t num_bytes) {
+  if (rounded_bytes > kThreadCacheMaxChunkSize) {
+    return nullptr;
+  }
+  ThreadCache* cache = GetThreadCache();
+  Chunk* chunk = nullptr;
+  {
+    absl::MutexLock l(&cache->mu);
+    std::vector<Chunk*>& chunks =
+        cache->chunks[ThreadCacheSizeClass(rounded_bytes)];
+    if (chunks.empty()) {
+      return nullptr;
+    }
+    chunk = chunks.back();
+    chunks.pop_back();
+    cache->bytes -= chunk->size;
+  }
+  chunk->requested_size.store(num_bytes, std::memory_order_relaxed);
+  chunk->allocation_id.store(next_allocation_id_++, std::memory_order_relaxed);
+
+  num_cached_allocs_.fetch_add(1, std::memory_order_relaxed);
+  RecordAllocation(chunk->size);
+  UpdateMax(largest_cached_alloc_size_, chunk->size);
+  VLOG(4) << "Returning cached: " << chunk->ptr;
+  return chunk->ptr;
+}
+
+bool BFCAllocator::DeallocateToThreadCache(void* ptr) {
+  Chunk* chunk = InUseChunkFromPtr(ptr);
+  const size_t size = chunk->size;
+  if (size > kThreadCacheMaxChunkSize || size > opts_.thread_cache_bytes) {
+    return false;
+  }
+  CHECK_GT(chunk->allocation_id.load(std::memory_order_relaxed), 0)
+      << "Deallocating pointer that is not in use: " << ptr;
+
+  ThreadCache* cache = GetThreadCache();
+  std::vector<Chunk*> to_release;
+  {
+    absl::MutexLock l(&cache->mu);
+    // If the cache is full, returns the older half of each size class to the
+    // bins, or all of them if that is not enough.
+    for (bool release_all : {false, true}) {
+      if (cache->bytes + size <= opts_.thread_cache_bytes) {
+        break;
+      }
+      for (std::vector<Chunk*>& chunks : cache->chunks) {
+        const size_t num_to_release =
+            release_all ? chunks.size() : (chunks.size() + 1) / 2;
+        for (size_t i = 0; i < num_to_release; ++i) {
+          cache->bytes -= chunks[i]->size;
+          to_release.push_back(chunks[i]);
+        }
+        chunks.erase(chunks.begin(), chunks.begin() + num_to_release);
+      }
+    }
+    chunk->allocation_id.store(kCachedAllocationId, std::memory_order_relaxed);
+    cache->chunks[ThreadCacheSizeClass(size)].push_back(chunk);
+    cache->bytes += size;
+  }
+  RecordDeallocation(size);
+
+  if (!to_release.empty()) {
+    absl::MutexLock l(&mutex_);
+    ReleaseCachedChunks(to_release);
+  }
+  return true;
+}
+
+void BFCAllocator::ReleaseCachedChunks(const std::vector<Chunk*>& chunks) {
+  for (Chunk* chunk : chunks) {
+    DCHECK_EQ(chunk->allocation_id.load(), kCachedAllocationId);
+    ReturnChunk(region_manager_.get_handle(chunk->ptr));
+  }
+}
+
+bool BFCAllocator::ReleaseThreadCaches() {
+  if (!use_thread_caches_) {
+    return false;
+  }
+  std::vector<Chunk*> chunks;
+  {
+    absl::MutexLock l(&thread_caches_mu_);
+    for (const std::shared_ptr<ThreadCache>& cache : thread_caches_) {
+      absl::MutexLock cache_lock(&cache->mu);
+      for (std::vector<Chunk*>& class_chunks : cache->chunks) {
+        chunks.insert(chunks.end(), class_chunks.begin(), class_chunks.end());
+        class_chunks.clear();
+      }
+      cache->bytes = 0;
+    }
+    // The caches that are not shared with a thread-local storage belong to
+    // threads that have exited.
+    thread_caches_.erase(
+        std::remove_if(thread_caches_.begin(), thread_caches_.end(),
+                       [](const std::shared_ptr<ThreadCache>& cache) {
+                         return cache.use_count() == 1;
+                       }),
+        thread_caches_.end());
+  }
+  if (chunks.empty()) {
+    return false;
+  }
+  VLOG(1) << "Returning " << chunks.size() << " chunks from the thread caches"
+          << " of " << Name();
+  ReleaseCachedChunks(chunks);
+  return true;
+}
+
+void BFCAllocator::RecordAllocation(int64_t bytes) {
+  UpdateMax(peak_bytes_in_use_,
+            bytes_in_use_.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+}
+
+void BFCAllocator::RecordDeallocation(int64_t bytes) {
+  bytes_in_use_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
 bool BFCAllocator::DeallocateFreeRegions(size_t rounded_bytes)
     ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
   // Do nothing if garbage collection is off.
@@ -424,6 +632,7 @@ void BFCAllocator::DeallocateRegions(
     *stats_.pool_bytes -= it->memory_size();
     it = region_manager_.RemoveAllocationRegion(it);
   }
+  UpdateRegionIndex();
 }
 
 void* BFCAllocator::AllocateRawInternal(size_t unused_alignment,
@@ -439,6 +648,13 @@ void* BFCAllocator::AllocateRawInternal(size_t unused_alignment,
   // so all memory addresses are nicely byte aligned.
   size_t rounded_bytes = RoundedBytes(num_bytes);
 
+  if (freed_before == 0 && UseThreadCache()) {
+    void* ptr = AllocateFromThreadCache(rounded_bytes, num_bytes);
+    if (ptr != nullptr) {
+      return ptr;
+    }
+  }
+
   // The BFC allocator tries to find the best fit first.
   BinNum bin_num = BinNumForSize(rounded_bytes);
 
@@ -462,6 +678,16 @@ void* BFCAllocator::AllocateRawInternal(size_t unused_alignment,
     }
   }
 
+  // Return the chunks held by the thread caches to the bins, where they can
+  // be merged with their neighbors.
+  if (ReleaseThreadCaches()) {
+    ptr = FindChunkPtr(bin_num, rounded_bytes, num_bytes, freed_before);
+    if (ptr != nullptr) {
+      AddTraceMe("MemoryAllocation", ptr);
+      return ptr;
+    }
+  }
+
   if ((freed_before == 0) && (!timestamped_chunks_.empty())) {
     // We're unable to satisfy an allocation request without a specific
     // timestamp requirement.  Rather than fail, try merging any held-out
@@ -520,7 +746,8 @@ int64_t BFCAllocator::LargestFreeChunk() {
 }
 
 double BFCAllocator::GetFragmentation() {
-  int64_t bytes_available = *stats_.pool_bytes - stats_.bytes_in_use;
+  int64_t bytes_available =
+      *stats_.pool_bytes - GetStatsInternal().bytes_in_use;
   DCHECK_GE(bytes_available, 0);
   return static_cast<double>(bytes_available - LargestFreeChunk()) /
          bytes_available;
@@ -537,8 +764,9 @@ void BFCAllocator::AddTraceMe(absl::string_view traceme_name,
   tsl::profiler::TraceMe::InstantActivity(
       [this, traceme_name, chunk_ptr, req_bytes, alloc_bytes]()
           ABSL_NO_THREAD_SAFETY_ANALYSIS {
+            const AllocatorStats stats = GetStatsInternal();
             int64_t bytes_available =
-                memory_limit_ - stats_.bytes_reserved - stats_.bytes_in_use;
+                memory_limit_ - stats.bytes_reserved - stats.bytes_in_use;
             const auto& annotation =
                 tsl::profiler::ScopedMemoryDebugAnnotation::CurrentAnnotation();
             const auto op_name = annotation.pending_op_name
@@ -549,11 +777,11 @@ void BFCAllocator::AddTraceMe(absl::string_view traceme_name,
                                          : "(null)";
             return tsl::profiler::TraceMeEncode(
                 traceme_name, {{"allocator_name", name_},
-                               {"bytes_reserved", stats_.bytes_reserved},
-                               {"bytes_allocated", stats_.bytes_in_use},
+                               {"bytes_reserved", stats.bytes_reserved},
+                               {"bytes_allocated", stats.bytes_in_use},
                                {"bytes_available", bytes_available},
                                {"fragmentation", GetFragmentation()},
-                               {"peak_bytes_in_use", stats_.peak_bytes_in_use},
+                               {"peak_bytes_in_use", stats.peak_bytes_in_use},
                                {"requested_bytes", req_bytes},
                                {"allocation_bytes", alloc_bytes},
                                {"addr", reinterpret_cast<uint64>(chunk_ptr)},
@@ -620,6 +848,9 @@ void* BFCAllocator::FindChunkPtr(BinNum bin_num, size_t rounded_bytes,
             std::max(stats_.peak_bytes_in_use, stats_.bytes_in_use);
         stats_.largest_alloc_size =
             std::max<std::size_t>(stats_.largest_alloc_size, chunk->size);
+        if (use_thread_caches_) {
+          RecordAllocation(chunk->size);
+        }
 
 #ifdef TENSORFLOW_MEM_DEBUG
         if (ShouldRecordOpName()) {
@@ -707,6 +938,9 @@ void BFCAllocator::DeallocateRawInternal(void* ptr) {
     VLOG(2) << "tried to deallocate nullptr";
     return;
   }
+  if (UseThreadCache() && DeallocateToThreadCache(ptr)) {
+    return;
+  }
   absl::MutexLock l(&mutex_);
 
   // Find the chunk from the ptr.
@@ -718,14 +952,9 @@ void BFCAllocator::DeallocateRawInternal(void* ptr) {
   int64_t req_bytes = chunk->requested_size;
   int64_t alloc_bytes = chunk->size;
 
-  MarkFree(h);
-
-  // Consider coalescing it.
-  if (timing_counter_) {
-    InsertFreeChunkIntoBin(h);
-    timestamped_chunks_.push_back(h);
-  } else {
-    InsertFreeChunkIntoBin(TryToCoalesce(h, false));
+  ReturnChunk(h);
+  if (use_thread_caches_) {
+    RecordDeallocation(alloc_bytes);
   }
 
   // TraceMe needs to be added after MarkFree and InsertFreeChunkIntoBin for
@@ -779,6 +1008,18 @@ void BFCAllocator::DeleteChunk(ChunkHandle h) {
   DeallocateChunk(h);
 }
 
+void BFCAllocator::ReturnChunk(ChunkHandle h) {
+  MarkFree(h);
+
+  // Consider coalescing it.
+  if (timing_counter_) {
+    InsertFreeChunkIntoBin(h);
+    timestamped_chunks_.push_back(h);
+  } else {
+    InsertFreeChunkIntoBin(TryToCoalesce(h, false));
+  }
+}
+
 void BFCAllocator::InsertFreeChunkIntoBin(BFCAllocator::ChunkHandle h) {
   Chunk* c = ChunkFromHandle(h);
   CHECK(!c->in_use() && (c->bin_num == kInvalidBinNum));
@@ -1125,7 +1366,7 @@ void BFCAllocator::DumpMemoryLog(size_t num_bytes) {
             << " available bytes: " << (memory_limit_ - *stats_.pool_bytes)
             << " curr_region_allocation_bytes_: "
             << curr_region_allocation_bytes_;
-  LOG(INFO) << "Stats: \n" << stats_.DebugString();
+  LOG(INFO) << "Stats: \n" << GetStatsInternal().DebugString();
 }
 
 void BFCAllocator::MaybeWriteMemoryMap() {
@@ -1160,10 +1401,11 @@ MemoryDump BFCAllocator::RecordMemoryMapInternal() {
 
   // Record the general stats
   tensorflow::MemAllocatorStats* mas = md.mutable_stats();
-  mas->set_num_allocs(stats_.num_allocs);
-  mas->set_bytes_in_use(stats_.bytes_in_use);
-  mas->set_peak_bytes_in_use(stats_.peak_bytes_in_use);
-  mas->set_largest_alloc_size(stats_.largest_alloc_size);
+  const AllocatorStats stats = GetStatsInternal();
+  mas->set_num_allocs(stats.num_allocs);
+  mas->set_bytes_in_use(stats.bytes_in_use);
+  mas->set_peak_bytes_in_use(stats.peak_bytes_in_use);
+  mas->set_largest_alloc_size(stats.largest_alloc_size);
 
   // Record summary data for every bin.
   const std::array<BinDebugInfo, kNumBins> bin_infos = get_bin_debug_info();
@@ -1222,7 +1464,21 @@ MemoryDump BFCAllocator::RecordMemoryMapInternal() {
 
 std::optional<AllocatorStats> BFCAllocator::GetStats() {
   absl::MutexLock l(&mutex_);
-  return stats_;
+  return GetStatsInternal();
+}
+
+AllocatorStats BFCAllocator::GetStatsInternal() {
+  AllocatorStats stats = stats_;
+  if (use_thread_caches_) {
+    stats.num_allocs += num_cached_allocs_.load(std::memory_order_relaxed);
+    stats.bytes_in_use = bytes_in_use_.load(std::memory_order_relaxed);
+    stats.peak_bytes_in_use =
+        peak_bytes_in_use_.load(std::memory_order_relaxed);
+    stats.largest_alloc_size =
+        std::max(stats.largest_alloc_size,
+                 largest_cached_alloc_size_.load(std::memory_order_relaxed));
+  }
+  return stats;
 }
 
 bool BFCAllocator::ClearStats() {
@@ -1230,6 +1486,10 @@ bool BFCAllocator::ClearStats() {
   stats_.num_allocs = 0;
   stats_.peak_bytes_in_use = stats_.bytes_in_use;
   stats_.largest_alloc_size = 0;
+  num_cached_allocs_.store(0, std::memory_order_relaxed);
+  peak_bytes_in_use_.store(bytes_in_use_.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+  largest_cached_alloc_size_.store(0, std::memory_order_relaxed);
   return true;
 }
 
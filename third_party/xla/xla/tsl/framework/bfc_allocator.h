@@ -73,6 +73,13 @@ class BFCAllocator : public Allocator {
     // Controls when a chunk should be split, if its size exceeds the requested
     // allocation size.
     double fragmentation_fraction = 0;
+
+    // Maximum number of bytes of freed chunks that each thread keeps to serve
+    // its own small allocations without taking the allocator lock. The cached
+    // chunks are returned to the bins in batches when a thread cache is full,
+    // and all at once when an allocation would fail otherwise. Zero disables
+    // the thread caches. Ignored if the sub-allocator supports coalescing.
+    size_t thread_cache_bytes = 0;
   };
   BFCAllocator(std::unique_ptr<SubAllocator> sub_allocator, size_t total_memory,
                const string& name, const Options& opts);
@@ -125,6 +132,19 @@ class BFCAllocator : public Allocator {
 
   void DeallocateRawInternal(void* ptr);
 
+  // Allocates a chunk of exactly 'rounded_bytes' bytes from the calling
+  // thread's cache. Returns nullptr if the cache has no such chunk.
+  void* AllocateFromThreadCache(size_t rounded_bytes, size_t num_bytes)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Puts the chunk of 'ptr' into the calling thread's cache, and returns the
+  // oldest cached chunks to the bins if the cache is full. Returns false if
+  // the chunk is too large to be cached.
+  bool DeallocateToThreadCache(void* ptr) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns true if the thread caches can be used for the current call.
+  bool UseThreadCache() const;
+
   // Chunks whose freed_at_count is later than the safe frontier value are kept
   // on a special list and not subject to merging immediately upon being freed.
   //
@@ -157,7 +177,7 @@ class BFCAllocator : public Allocator {
                   int64_t req_bytes, int64_t alloc_bytes)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  // A ChunkHandle is an index into the chunks_ vector in BFCAllocator
+  // A ChunkHandle is an index into the chunk_blocks_ in BFCAllocator
   // kInvalidChunkHandle means an invalid chunk
   typedef size_t ChunkHandle;
   static constexpr ChunkHandle kInvalidChunkHandle = SIZE_MAX;
@@ -188,13 +208,17 @@ class BFCAllocator : public Allocator {
     // fragmentation.  requested_size keeps track of what the client
     // actually wanted so we can understand whether our splitting
     // strategy is efficient.
-    size_t requested_size = 0;
+    //
+    // requested_size and allocation_id are atomic because the thread caches
+    // update them without holding the allocator lock.
+    std::atomic<size_t> requested_size = 0;
 
     // allocation_id is set to -1 when the chunk is not in use. It is assigned a
     // value greater than zero before the chunk is returned from
     // AllocateRaw, and this value is unique among values assigned by
-    // the parent allocator.
-    int64_t allocation_id = -1;
+    // the parent allocator. It is set to kCachedAllocationId while the chunk is
+    // held by a thread cache, which keeps the chunk from being coalesced.
+    std::atomic<int64_t> allocation_id = -1;
     void* ptr = nullptr;  // pointer to granted subbuffer.
 
     // If not kInvalidChunkHandle, the memory referred to by 'prev' is directly
@@ -282,6 +306,29 @@ class BFCAllocator : public Allocator {
   static constexpr size_t kMinAllocationBits = 8;
   static constexpr size_t kMinAllocationSize = 1 << kMinAllocationBits;
 
+  static constexpr int64_t kCachedAllocationId = -2;
+
+  // The thread caches hold chunks of up to kThreadCacheMaxChunkSize bytes, in
+  // one size class per multiple of kMinAllocationSize.
+  static constexpr size_t kThreadCacheMaxChunkSize = 32 << 10;
+  static constexpr size_t kNumThreadCacheSizeClasses =
+      kThreadCacheMaxChunkSize / kMinAllocationSize;
+
+  // A cache of freed chunks owned by one thread. The lock is only contended
+  // when the allocator returns all cached chunks to the bins.
+  struct ThreadCache {
+    absl::Mutex mu;
+    // Chunks of size class i have (i + 1) * kMinAllocationSize bytes, in the
+    // order they were freed.
+    std::array<std::vector<Chunk*>, kNumThreadCacheSizeClasses> chunks
+        ABSL_GUARDED_BY(mu);
+    size_t bytes ABSL_GUARDED_BY(mu) = 0;
+  };
+
+  static size_t ThreadCacheSizeClass(size_t chunk_size) {
+    return chunk_size / kMinAllocationSize - 1;
+  }
+
   // BFCAllocator allocates memory into a collection of disjoint
   // AllocationRegions.  Each AllocationRegion corresponds to one call to
   // SubAllocator::Alloc().  (Actually, if a subsequent call to
@@ -330,6 +377,8 @@ class BFCAllocator : public Allocator {
     }
     void set_handle(const void* p, ChunkHandle h) { handles_[IndexFor(p)] = h; }
     void erase(const void* p) { set_handle(p, kInvalidChunkHandle); }
+    // The handle array is only reallocated by extend().
+    const ChunkHandle* handles() const { return handles_.data(); }
 
    private:
     void Swap(AllocationRegion* other) {
@@ -450,9 +499,45 @@ class BFCAllocator : public Allocator {
     std::vector<AllocationRegion> regions_;
   };
 
+  // An immutable copy of the region bounds and handle arrays, which lets the
+  // thread caches map pointers to chunks without holding mutex_. A new index
+  // is published whenever regions are added or removed.
+  struct RegionIndex {
+    struct Region {
+      const void* ptr;
+      const void* end_ptr;
+      const ChunkHandle* handles;
+    };
+    // Sorted by end_ptr.
+    std::vector<Region> regions;
+  };
+
   // Returns 'bytes' rounded up to the next highest kMinAllocationSize.
   static size_t RoundedBytes(size_t bytes);
 
+  // Publishes a RegionIndex of the current regions.
+  void UpdateRegionIndex() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the chunk of 'ptr', which must be in use, using the published
+  // RegionIndex.
+  Chunk* InUseChunkFromPtr(const void* ptr) const;
+
+  // Returns the calling thread's cache, creating it on first use.
+  ThreadCache* GetThreadCache() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns chunks held by the thread caches to the bins.
+  void ReleaseCachedChunks(const std::vector<Chunk*>& chunks)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the chunks of all thread caches to the bins. Returns true if any
+  // chunk was returned.
+  bool ReleaseThreadCaches() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Records an allocation or a deallocation of 'bytes' in the stats that are
+  // updated without holding mutex_ when the thread caches are enabled.
+  void RecordAllocation(int64_t bytes);
+  void RecordDeallocation(int64_t bytes);
+
   // Try to add a new memory region that can satisfy an allocation of
   // 'rounded_bytes' bytes.  Returns true on success and false on
   // failure.
@@ -504,6 +589,10 @@ class BFCAllocator : public Allocator {
   // Removes the chunk metadata represented by 'h'.
   void DeleteChunk(ChunkHandle h) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Marks the in-use chunk 'h' as free and inserts it into its bin, merging it
+  // with its free neighbors if possible.
+  void ReturnChunk(ChunkHandle h) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   string RenderOccupancy() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void DumpMemoryLog(size_t num_bytes) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   tensorflow::MemoryDump RecordMemoryMapInternal()
@@ -516,6 +605,8 @@ class BFCAllocator : public Allocator {
   Chunk* ChunkFromHandle(ChunkHandle h) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   const Chunk* ChunkFromHandle(ChunkHandle h) const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Same as ChunkFromHandle, for a chunk owned by the caller.
+  Chunk* OwnedChunkFromHandle(ChunkHandle h) const;
 
   void MarkFree(ChunkHandle h) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -523,9 +614,14 @@ class BFCAllocator : public Allocator {
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Fragmentation is calculated as the reverse ratio of the largest free chunk
-  // size over total free memory, and returns a value within [0, 1].
+  // size over total free memory, and returns a value within [0, 1]. Chunks
+  // held by the thread caches count as free memory outside the largest chunk.
   double GetFragmentation() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns stats_, with the exact bytes in use if the thread caches are
+  // enabled. stats_ counts the chunks held by the thread caches as in use.
+  AllocatorStats GetStatsInternal() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Information about a Bin that is useful for debugging.
   struct BinDebugInfo {
     size_t total_bytes_in_use = 0;
@@ -572,6 +668,14 @@ class BFCAllocator : public Allocator {
   // device's address space).
   const bool coalesce_regions_;
 
+  // Whether the allocator uses thread caches. Requires the handle arrays of
+  // the regions to never move, so it is false if coalesce_regions_ is true.
+  const bool use_thread_caches_;
+
+  // Unique among all BFCAllocators of the process; identifies the thread
+  // caches of this allocator.
+  const int64_t id_;
+
   std::unique_ptr<SubAllocator> sub_allocator_;
   string name_;
   SharedCounter* timing_counter_ = nullptr;
@@ -583,18 +687,44 @@ class BFCAllocator : public Allocator {
   mutable absl::Mutex mutex_;
   RegionManager region_manager_ ABSL_GUARDED_BY(mutex_);
 
-  std::vector<Chunk> chunks_ ABSL_GUARDED_BY(mutex_);
+  // Chunks are stored in blocks that do not move until the allocator is
+  // destroyed, so that the thread caches can update the chunks they own
+  // without holding mutex_. Block b holds kChunkBlockSize << b chunks.
+  static constexpr size_t kChunkBlockSize = 1024;
+  static constexpr int kMaxChunkBlocks = 40;
+  std::array<std::unique_ptr<Chunk[]>, kMaxChunkBlocks> chunk_blocks_;
+  size_t num_chunks_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  std::atomic<const RegionIndex*> region_index_ = nullptr;
+  // All published indices. Threads may still read old indices, so they are
+  // only deleted with the allocator.
+  std::vector<std::unique_ptr<RegionIndex>> region_indices_
+      ABSL_GUARDED_BY(mutex_);
+
+  // Acquired after mutex_ and before the locks of the thread caches.
+  absl::Mutex thread_caches_mu_ ABSL_ACQUIRED_AFTER(mutex_);
+  // The caches of all threads that used this allocator. They are shared with
+  // the thread-local storage of their threads.
+  std::vector<std::shared_ptr<ThreadCache>> thread_caches_
+      ABSL_GUARDED_BY(thread_caches_mu_);
 
   // Pointer to head of linked list of free Chunks
   ChunkHandle free_chunks_list_ ABSL_GUARDED_BY(mutex_);
 
   // Counter containing the next unique identifier to assign to a
   // newly-created chunk.
-  int64_t next_allocation_id_ ABSL_GUARDED_BY(mutex_);
+  std::atomic<int64_t> next_allocation_id_;
 
   // Stats.
   AllocatorStats stats_ ABSL_GUARDED_BY(mutex_);
 
+  // Stats that are updated without holding mutex_ when the thread caches are
+  // enabled, and override the corresponding fields of stats_.
+  std::atomic<int64_t> bytes_in_use_ = 0;
+  std::atomic<int64_t> peak_bytes_in_use_ = 0;
+  std::atomic<int64_t> num_cached_allocs_ = 0;
+  std::atomic<int64_t> largest_cached_alloc_size_ = 0;
+
 #ifdef TENSORFLOW_MEM_DEBUG
   int64 action_counter_ ABSL_GUARDED_BY(mutex_);
 #define MEM_DEBUG_SIZE_HISTORY_SIZE 4096
@@ -0,0 +1,275 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/tsl/framework/bfc_allocator.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "xla/tsl/framework/allocator.h"
+#include "xla/tsl/protobuf/bfc_memory_map.pb.h"
+#include "tsl/platform/blocking_counter.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/mem.h"
+#include "tsl/platform/test.h"
+#include "tsl/platform/test_benchmark.h"
+#include "tsl/platform/threadpool.h"
+
+namespace tsl {
+namespace {
+
+constexpr size_t kThreadCacheBytes = 1 << 20;
+
+class HostSubAllocator : public SubAllocator {
+ public:
+  HostSubAllocator() : SubAllocator({}, {}) {}
+
+  void* Alloc(size_t alignment, size_t num_bytes,
+              size_t* bytes_received) override {
+    *bytes_received = num_bytes;
+    return port::AlignedMalloc(num_bytes, Allocator::kAllocatorAlignment);
+  }
+
+  void Free(void* ptr, size_t num_bytes) override { port::AlignedFree(ptr); }
+
+  bool SupportsCoalescing() const override { return false; }
+
+  AllocatorMemoryType GetMemoryType() const override {
+    return AllocatorMemoryType::kHostPageable;
+  }
+};
+
+std::unique_ptr<BFCAllocator> CreateAllocator(size_t memory_limit,
+                                              size_t thread_cache_bytes) {
+  BFCAllocator::Options options;
+  options.allow_growth = false;
+  options.thread_cache_bytes = thread_cache_bytes;
+  return std::make_unique<BFCAllocator>(std::make_unique<HostSubAllocator>(),
+                                        memory_limit, "host_bfc", options);
+}
+
+void CheckStats(Allocator& a, int64_t num_allocs, int64_t bytes_in_use,
+                int64_t peak_bytes_in_use, int64_t largest_alloc_size) {
+  std::optional<AllocatorStats> stats = a.GetStats();
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(stats->num_allocs, num_allocs);
+  EXPECT_EQ(stats->bytes_in_use, bytes_in_use);
+  EXPECT_EQ(stats->peak_bytes_in_use, peak_bytes_in_use);
+  EXPECT_EQ(stats->largest_alloc_size, largest_alloc_size);
+}
+
+class BFCAllocatorTest : public ::testing::TestWithParam<size_t> {};
+
+TEST_P(BFCAllocatorTest, Stats) {
+  std::unique_ptr<BFCAllocator> a = CreateAllocator(1 << 20, GetParam());
+  void* p1 = a->AllocateRaw(1, 1000);
+  void* p2 = a->AllocateRaw(1, 2048);
+  CheckStats(*a, 2, 3072, 3072, 2048);
+  EXPECT_EQ(a->RequestedSize(p1), 1000);
+  EXPECT_EQ(a->AllocatedSize(p1), 1024);
+
+  a->DeallocateRaw(p1);
+  CheckStats(*a, 2, 2048, 3072, 2048);
+  void* p3 = a->AllocateRaw(1, 900);
+  CheckStats(*a, 3, 3072, 3072, 2048);
+  EXPECT_EQ(a->RequestedSize(p3), 900);
+  EXPECT_EQ(a->AllocatedSize(p3), 1024);
+  EXPECT_GT(a->AllocationId(p3), a->AllocationId(p2));
+
+  a->DeallocateRaw(p2);
+  a->DeallocateRaw(p3);
+  CheckStats(*a, 3, 0, 3072, 2048);
+  EXPECT_TRUE(a->ClearStats());
+  CheckStats(*a, 0, 0, 0, 0);
+}
+
+TEST_P(BFCAllocatorTest, ConcurrentAllocations) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumAllocations = 1000;
+  std::unique_ptr<BFCAllocator> a = CreateAllocator(64 << 20, GetParam());
+  {
+    thread::ThreadPool pool(Env::Default(), "test", kNumThreads);
+    for (int t = 0; t < kNumThreads; ++t) {
+      pool.Schedule([&a, t]() {
+        std::vector<void*> live;
+        for (int i = 0; i < kNumAllocations; ++i) {
+          // Mixes cached and uncached sizes, and keeps a few allocations live
+          // so that chunks are split and merged.
+          size_t num_bytes = ((i * 7 + t) % 48 + 1) * 1000;
+          void* p = a->AllocateRaw(1, num_bytes);
+          ASSERT_NE(p, nullptr);
+          EXPECT_EQ(a->RequestedSize(p), num_bytes);
+          live.push_back(p);
+          if (live.size() > 4) {
+            a->DeallocateRaw(live.front());
+            live.erase(live.begin());
+          }
+        }
+        for (void* p : live) {
+          a->DeallocateRaw(p);
+        }
+      });
+    }
+  }
+  std::optional<AllocatorStats> stats = a->GetStats();
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(stats->num_allocs, kNumThreads * kNumAllocations);
+  EXPECT_EQ(stats->bytes_in_use, 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(ThreadCache, BFCAllocatorTest,
+                         ::testing::Values(0, kThreadCacheBytes));
+
+TEST(BFCAllocatorThreadCacheTest, ReusesFreedChunks) {
+  std::unique_ptr<BFCAllocator> a = CreateAllocator(1 << 20, kThreadCacheBytes);
+  void* p1 = a->AllocateRaw(1, 4096);
+  int64_t id1 = a->AllocationId(p1);
+  a->DeallocateRaw(p1);
+  void* p2 = a->AllocateRaw(1, 4000);
+  EXPECT_EQ(p2, p1);
+  EXPECT_GT(a->AllocationId(p2), id1);
+  EXPECT_EQ(a->RequestedSize(p2), 4000);
+  a->DeallocateRaw(p2);
+}
+
+TEST(BFCAllocatorThreadCacheTest, FragmentationCountsCachedChunks) {
+  constexpr int kNumChunks = 512;
+  std::unique_ptr<BFCAllocator> a = CreateAllocator(1 << 20, kThreadCacheBytes);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < kNumChunks; ++i) {
+    ptrs.push_back(a->AllocateRaw(1, 1024));
+  }
+  for (void* p : ptrs) {
+    a->DeallocateRaw(p);
+  }
+  // The cached chunks are free memory that is not part of the largest free
+  // chunk, which is the second half of the region.
+  tensorflow::MemoryDump dump = a->RecordMemoryMap();
+  EXPECT_EQ(dump.stats().bytes_in_use(), 0);
+  EXPECT_DOUBLE_EQ(dump.stats().fragmentation_metric(), 0.5);
+}
+
+TEST(BFCAllocatorThreadCacheTest, ReleasesCachedChunksUnderMemoryPressure) {
+  constexpr int kNumChunks = 512;
+  std::unique_ptr<BFCAllocator> a = CreateAllocator(1 << 20, kThreadCacheBytes);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < kNumChunks; ++i) {
+    ptrs.push_back(a->AllocateRaw(1, 1024));
+  }
+  for (void* p : ptrs) {
+    a->DeallocateRaw(p);
+  }
+  // Only fits if the cached chunks are merged back into the region.
+  void* p = a->AllocateRaw(1, 768 << 10);
+  ASSERT_NE(p, nullptr);
+  a->DeallocateRaw(p);
+  tensorflow::MemoryDump dump = a->RecordMemoryMap();
+  EXPECT_EQ(dump.stats().bytes_in_use(), 0);
+  EXPECT_DOUBLE_EQ(dump.stats().fragmentation_metric(), 0.0);
+}
+
+TEST(BFCAllocatorThreadCacheTest, ReleasesOldestChunksWhenFull) {
+  constexpr size_t kChunkSize = 16 << 10;
+  std::unique_ptr<BFCAllocator> a =
+      CreateAllocator(1 << 20, /*thread_cache_bytes=*/4 * kChunkSize);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 8; ++i) {
+    ptrs.push_back(a->AllocateRaw(1, kChunkSize));
+  }
+  for (void* p : ptrs) {
+    a->DeallocateRaw(p);
+  }
+  // The most recently freed chunk is still cached.
+  void* p = a->AllocateRaw(1, kChunkSize);
+  EXPECT_EQ(p, ptrs.back());
+  a->DeallocateRaw(p);
+  std::optional<AllocatorStats> stats = a->GetStats();
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(stats->bytes_in_use, 0);
+}
+
+TEST(BFCAllocatorThreadCacheTest, CrossThreadDeallocation) {
+  std::unique_ptr<BFCAllocator> a = CreateAllocator(1 << 20, kThreadCacheBytes);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 16; ++i) {
+    ptrs.push_back(a->AllocateRaw(1, 512));
+  }
+  {
+    std::unique_ptr<Thread> thread(Env::Default()->StartThread(
+        ThreadOptions(), "deallocate", [&a, &ptrs]() {
+          for (void* p : ptrs) {
+            a->DeallocateRaw(p);
+          }
+        }));
+  }
+  // The chunks are cached by the exited thread, and released when needed.
+  void* p = a->AllocateRaw(1, 1 << 20);
+  ASSERT_NE(p, nullptr);
+  a->DeallocateRaw(p);
+  std::optional<AllocatorStats> stats = a->GetStats();
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_EQ(stats->bytes_in_use, 0);
+}
+
+// Each thread allocates and frees small buffers, keeping a few of them live.
+// The second argument is the size of the thread caches.
+static void BM_AllocationThreaded(::testing::benchmark::State& state) {
+  const int num_threads = state.range(0);
+  const size_t thread_cache_bytes = state.range(1);
+  constexpr int kNumAllocationsPerThread = 10000;
+  std::unique_ptr<BFCAllocator> a =
+      CreateAllocator(size_t{1} << 30, thread_cache_bytes);
+  thread::ThreadPool pool(Env::Default(), "test", num_threads);
+  for (auto s : state) {
+    BlockingCounter counter(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+      pool.Schedule([&a, &counter]() {
+        constexpr size_t kSizes[] = {64, 256, 1024, 4096, 512, 16384, 128};
+        constexpr int kNumLive = 8;
+        void* live[kNumLive] = {};
+        for (int i = 0; i < kNumAllocationsPerThread; ++i) {
+          void*& p = live[i % kNumLive];
+          if (p != nullptr) {
+            a->DeallocateRaw(p);
+          }
+          p = a->AllocateRaw(Allocator::kAllocatorAlignment,
+                             kSizes[i % std::size(kSizes)]);
+        }
+        for (void* p : live) {
+          a->DeallocateRaw(p);
+        }
+        counter.DecrementCount();
+      });
+    }
+    counter.Wait();
+  }
+  state.SetItemsProcessed(state.iterations() * num_threads *
+                          kNumAllocationsPerThread);
+}
+
+BENCHMARK(BM_AllocationThreaded)
+    ->ArgPair(1, 0)
+    ->ArgPair(1, kThreadCacheBytes)
+    ->ArgPair(8, 0)
+    ->ArgPair(8, kThreadCacheBytes)
+    ->ArgPair(64, 0)
+    ->ArgPair(64, kThreadCacheBytes);
+
+}  // namespace
+}  // namespace tsl
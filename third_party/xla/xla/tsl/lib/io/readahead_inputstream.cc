@@ -0,0 +1,196 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/tsl/lib/io/readahead_inputstream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/notification.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/errors.h"
+
+namespace tsl {
+namespace io {
+namespace {
+
+// Number of threads shared by all readahead streams in the process. The
+// threads spend their time blocked on I/O, so this is not tied to the number
+// of cores.
+constexpr int kNumReadaheadThreads = 32;
+
+thread::ThreadPool* ReadaheadThreadPool() {
+  static thread::ThreadPool* thread_pool = new thread::ThreadPool(
+      Env::Default(), "tsl_io_readahead", kNumReadaheadThreads);
+  return thread_pool;
+}
+
+}  // namespace
+
+struct ReadaheadInputStream::Block {
+  Block(int64_t offset, size_t capacity)
+      : offset(offset), data(new char[capacity]) {}
+
+  const int64_t offset;
+  std::unique_ptr<char[]> data;
+  // Number of bytes read into `data`. Only valid once `done` is notified.
+  size_t size = 0;
+  absl::Status status;
+  absl::Notification done;
+};
+
+ReadaheadInputStream::ReadaheadInputStream(RandomAccessFile* file,
+                                           size_t block_size,
+                                           int64_t num_blocks)
+    : file_(file),
+      block_size_(block_size),
+      num_blocks_(std::max<int64_t>(num_blocks, 1)),
+      thread_pool_(ReadaheadThreadPool()) {}
+
+ReadaheadInputStream::~ReadaheadInputStream() {
+  for (const auto& block : blocks_) {
+    block->done.WaitForNotification();
+  }
+}
+
+void ReadaheadInputStream::IssueReads() {
+  while (!end_of_file_ && static_cast<int64_t>(blocks_.size()) < num_blocks_) {
+    auto block = std::make_shared<Block>(next_offset_, block_size_);
+    next_offset_ += block_size_;
+    blocks_.push_back(block);
+    thread_pool_->Schedule([file = file_, block_size = block_size_, block]() {
+      absl::string_view data;
+      absl::Status s =
+          file->Read(block->offset, block_size, &data, block->data.get());
+      if (data.data() != block->data.get()) {
+        memmove(block->data.get(), data.data(), data.size());
+      }
+      block->size = data.size();
+      // A short read at the end of the file is reported by the block size.
+      if (!s.ok() && !errors::IsOutOfRange(s)) {
+        block->status = s;
+      }
+      block->done.Notify();
+    });
+  }
+}
+
+void ReadaheadInputStream::Restart(int64_t position) {
+  for (const auto& block : blocks_) {
+    block->done.WaitForNotification();
+  }
+  blocks_.clear();
+  end_of_file_ = false;
+  next_offset_ = position - position % block_size_;
+  pos_ = position;
+}
+
+absl::Status ReadaheadInputStream::Consume(int64_t n, char* dst,
+                                           int64_t* consumed) {
+  *consumed = 0;
+  while (*consumed < n) {
+    IssueReads();
+    if (blocks_.empty()) {
+      break;
+    }
+    Block& block = *blocks_.front();
+    block.done.WaitForNotification();
+    TF_RETURN_IF_ERROR(block.status);
+    const int64_t block_end = block.offset + block.size;
+    if (pos_ < block_end) {
+      const int64_t bytes = std::min(n - *consumed, block_end - pos_);
+      if (dst != nullptr) {
+        memcpy(dst + *consumed, block.data.get() + (pos_ - block.offset),
+               bytes);
+      }
+      pos_ += bytes;
+      *consumed += bytes;
+      continue;
+    }
+    if (block.size < block_size_) {
+      // Blocks issued past this one are empty; keep them until they complete.
+      end_of_file_ = true;
+      break;
+    }
+    blocks_.pop_front();
+  }
+  if (*consumed < n) {
+    return errors::OutOfRange("reached end of file");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ReadaheadInputStream::ReadNBytes(int64_t bytes_to_read,
+                                              tstring* result) {
+  if (bytes_to_read < 0) {
+    return errors::InvalidArgument("Can't read a negative number of bytes: ",
+                                   bytes_to_read);
+  }
+  result->clear();
+  result->resize_uninitialized(bytes_to_read);
+  int64_t bytes_read = 0;
+  absl::Status s = Consume(bytes_to_read, &(*result)[0], &bytes_read);
+  result->resize(bytes_read);
+  return s;
+}
+
+absl::Status ReadaheadInputStream::SkipNBytes(int64_t bytes_to_skip) {
+  if (bytes_to_skip < 0) {
+    return errors::InvalidArgument("Can't skip a negative number of bytes: ",
+                                   bytes_to_skip);
+  }
+  const int64_t position = pos_;
+  const int64_t target = pos_ + bytes_to_skip;
+  // Skips within the blocks already buffered or in flight consume them. Longer
+  // skips seek to the target instead of reading the bytes in between, which
+  // matters for callers that position the stream with `Reset()` followed by
+  // `SkipNBytes()`.
+  if (blocks_.empty() ||
+      target >= blocks_.back()->offset + static_cast<int64_t>(block_size_)) {
+    Restart(target);
+    IssueReads();
+    Block& block = *blocks_.front();
+    block.done.WaitForNotification();
+    TF_RETURN_IF_ERROR(block.status);
+    const int64_t block_end = block.offset + block.size;
+    if (block_end >= target) {
+      return absl::OkStatus();
+    }
+    if (block.size > 0) {
+      // The file ends within the block, before the target.
+      end_of_file_ = true;
+      pos_ = block_end;
+      return errors::OutOfRange("reached end of file");
+    }
+    // The file ends before the block, at an unknown offset. Skip to it by
+    // reading from the original position, like a short skip would.
+    Restart(position);
+  }
+  int64_t bytes_skipped = 0;
+  return Consume(bytes_to_skip, /*dst=*/nullptr, &bytes_skipped);
+}
+
+int64_t ReadaheadInputStream::Tell() const { return pos_; }
+
+absl::Status ReadaheadInputStream::Reset() {
+  Restart(/*position=*/0);
+  return absl::OkStatus();
+}
+
+}  // namespace io
+}  // namespace tsl
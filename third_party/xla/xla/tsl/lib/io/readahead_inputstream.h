@@ -0,0 +1,92 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_TSL_LIB_IO_READAHEAD_INPUTSTREAM_H_
+#define XLA_TSL_LIB_IO_READAHEAD_INPUTSTREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+#include "absl/status/status.h"
+#include "xla/tsl/lib/io/inputstream_interface.h"
+#include "tsl/platform/file_system.h"
+#include "tsl/platform/threadpool.h"
+
+namespace tsl {
+namespace io {
+
+// An InputStreamInterface that reads a RandomAccessFile sequentially while
+// keeping up to `num_blocks` reads of `block_size` bytes in flight on a
+// process-wide I/O thread pool. Reads are issued at offsets that are multiples
+// of `block_size`, so a single file can keep several large, aligned requests
+// outstanding instead of one.
+//
+// A single instance of ReadaheadInputStream is NOT safe for concurrent use by
+// multiple threads.
+class ReadaheadInputStream : public InputStreamInterface {
+ public:
+  // Does not take ownership of `file`, which must outlive *this. `block_size`
+  // must be positive.
+  ReadaheadInputStream(RandomAccessFile* file, size_t block_size,
+                       int64_t num_blocks);
+
+  // Blocks until all in-flight reads have completed.
+  ~ReadaheadInputStream() override;
+
+  absl::Status ReadNBytes(int64_t bytes_to_read, tstring* result) override;
+
+  absl::Status SkipNBytes(int64_t bytes_to_skip) override;
+
+  int64_t Tell() const override;
+
+  absl::Status Reset() override;
+
+ private:
+  struct Block;
+
+  // Issues reads until `num_blocks_` blocks are buffered or in flight, unless
+  // the end of the file has been reached.
+  void IssueReads();
+
+  // Waits for and discards all buffered blocks, then restarts reading at the
+  // block containing `position`.
+  void Restart(int64_t position);
+
+  // Advances the stream by up to `n` bytes, copying them to `dst` if it is not
+  // null. Stores the number of bytes consumed in `*consumed`.
+  absl::Status Consume(int64_t n, char* dst, int64_t* consumed);
+
+  RandomAccessFile* const file_;  // Not owned.
+  const size_t block_size_;
+  const int64_t num_blocks_;
+  thread::ThreadPool* const thread_pool_;  // Not owned.
+
+  // Buffered and in-flight blocks, in file order.
+  std::deque<std::shared_ptr<Block>> blocks_;
+  // Offset of the next block to read.
+  int64_t next_offset_ = 0;
+  // Set once a completed read has come back short, which marks the end of the
+  // file.
+  bool end_of_file_ = false;
+  // Current position in the stream.
+  int64_t pos_ = 0;
+};
+
+}  // namespace io
+}  // namespace tsl
+
+#endif  // XLA_TSL_LIB_IO_READAHEAD_INPUTSTREAM_H_
@@ -0,0 +1,238 @@
+/* Copyright 2024 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/tsl/lib/io/readahead_inputstream.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "xla/tsl/lib/core/status_test_util.h"
+#include "xla/tsl/lib/io/buffered_inputstream.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/mutex.h"
+#include "tsl/platform/test.h"
+#include "tsl/platform/test_benchmark.h"
+
+namespace tsl {
+namespace io {
+namespace {
+
+static std::vector<int> BlockSizes() { return {1, 2, 3, 4, 7, 10, 11, 65536}; }
+
+static std::vector<int> NumBlocks() { return {1, 2, 4}; }
+
+TEST(ReadaheadInputStream, ReadNBytes) {
+  Env* env = Env::Default();
+  string fname;
+  ASSERT_TRUE(env->LocalTempFilename(&fname));
+  TF_ASSERT_OK(WriteStringToFile(env, fname, "0123456789"));
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+
+  for (auto block_size : BlockSizes()) {
+    for (auto num_blocks : NumBlocks()) {
+      ReadaheadInputStream in(file.get(), block_size, num_blocks);
+      tstring read;
+      TF_ASSERT_OK(in.ReadNBytes(3, &read));
+      EXPECT_EQ(read, "012");
+      EXPECT_EQ(3, in.Tell());
+      TF_ASSERT_OK(in.ReadNBytes(0, &read));
+      EXPECT_EQ(read, "");
+      EXPECT_EQ(3, in.Tell());
+      TF_ASSERT_OK(in.ReadNBytes(4, &read));
+      EXPECT_EQ(read, "3456");
+      EXPECT_EQ(7, in.Tell());
+      EXPECT_TRUE(errors::IsOutOfRange(in.ReadNBytes(5, &read)));
+      EXPECT_EQ(read, "789");
+      EXPECT_EQ(10, in.Tell());
+      EXPECT_TRUE(errors::IsOutOfRange(in.ReadNBytes(1, &read)));
+      EXPECT_EQ(read, "");
+      EXPECT_EQ(10, in.Tell());
+    }
+  }
+}
+
+TEST(ReadaheadInputStream, EmptyFile) {
+  Env* env = Env::Default();
+  string fname;
+  ASSERT_TRUE(env->LocalTempFilename(&fname));
+  TF_ASSERT_OK(WriteStringToFile(env, fname, ""));
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+
+  for (auto block_size : BlockSizes()) {
+    for (auto num_blocks : NumBlocks()) {
+      ReadaheadInputStream in(file.get(), block_size, num_blocks);
+      tstring read;
+      EXPECT_TRUE(errors::IsOutOfRange(in.ReadNBytes(1, &read)));
+      EXPECT_EQ(read, "");
+      EXPECT_EQ(0, in.Tell());
+    }
+  }
+}
+
+TEST(ReadaheadInputStream, SkipNBytes) {
+  Env* env = Env::Default();
+  string fname;
+  ASSERT_TRUE(env->LocalTempFilename(&fname));
+  TF_ASSERT_OK(WriteStringToFile(env, fname, "0123456789"));
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+
+  for (auto block_size : BlockSizes()) {
+    for (auto num_blocks : NumBlocks()) {
+      ReadaheadInputStream in(file.get(), block_size, num_blocks);
+      tstring read;
+      TF_ASSERT_OK(in.SkipNBytes(3));
+      EXPECT_EQ(3, in.Tell());
+      TF_ASSERT_OK(in.ReadNBytes(2, &read));
+      EXPECT_EQ(read, "34");
+      TF_ASSERT_OK(in.SkipNBytes(4));
+      EXPECT_EQ(9, in.Tell());
+      EXPECT_TRUE(errors::IsOutOfRange(in.SkipNBytes(2)));
+      EXPECT_EQ(10, in.Tell());
+      EXPECT_TRUE(errors::IsInvalidArgument(in.SkipNBytes(-1)));
+    }
+  }
+}
+
+// Records the offsets of the reads issued to the wrapped file.
+class RecordingRandomAccessFile : public RandomAccessFile {
+ public:
+  explicit RecordingRandomAccessFile(std::unique_ptr<RandomAccessFile> file)
+      : file_(std::move(file)) {}
+
+  absl::Status Read(uint64 offset, size_t n, absl::string_view* result,
+                    char* scratch) const override {
+    {
+      mutex_lock l(mu_);
+      read_offsets_.push_back(offset);
+    }
+    return file_->Read(offset, n, result, scratch);
+  }
+
+  std::vector<uint64> read_offsets() const {
+    mutex_lock l(mu_);
+    return read_offsets_;
+  }
+
+ private:
+  const std::unique_ptr<RandomAccessFile> file_;
+  mutable mutex mu_;
+  mutable std::vector<uint64> read_offsets_ TF_GUARDED_BY(mu_);
+};
+
+TEST(ReadaheadInputStream, SkipNBytesSeeks) {
+  Env* env = Env::Default();
+  string fname;
+  ASSERT_TRUE(env->LocalTempFilename(&fname));
+  TF_ASSERT_OK(WriteStringToFile(env, fname, "0123456789"));
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+  RecordingRandomAccessFile recording_file(std::move(file));
+
+  ReadaheadInputStream in(&recording_file, /*block_size=*/2,
+                          /*num_blocks=*/1);
+  TF_ASSERT_OK(in.Reset());
+  TF_ASSERT_OK(in.SkipNBytes(7));
+  EXPECT_EQ(7, in.Tell());
+  tstring read;
+  TF_ASSERT_OK(in.ReadNBytes(2, &read));
+  EXPECT_EQ(read, "78");
+  // The skipped bytes are not read.
+  for (uint64 offset : recording_file.read_offsets()) {
+    EXPECT_GE(offset, 6);
+  }
+  // Seeking past the end of the file stops at the end of the file.
+  EXPECT_TRUE(errors::IsOutOfRange(in.SkipNBytes(5)));
+  EXPECT_EQ(10, in.Tell());
+  TF_ASSERT_OK(in.Reset());
+  EXPECT_TRUE(errors::IsOutOfRange(in.SkipNBytes(20)));
+  EXPECT_EQ(10, in.Tell());
+  EXPECT_TRUE(errors::IsOutOfRange(in.ReadNBytes(1, &read)));
+}
+
+TEST(ReadaheadInputStream, Reset) {
+  Env* env = Env::Default();
+  string fname;
+  ASSERT_TRUE(env->LocalTempFilename(&fname));
+  TF_ASSERT_OK(WriteStringToFile(env, fname, "0123456789"));
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+
+  for (auto block_size : BlockSizes()) {
+    for (auto num_blocks : NumBlocks()) {
+      ReadaheadInputStream in(file.get(), block_size, num_blocks);
+      tstring read;
+      EXPECT_TRUE(errors::IsOutOfRange(in.ReadNBytes(20, &read)));
+      EXPECT_EQ(read, "0123456789");
+      TF_ASSERT_OK(in.Reset());
+      EXPECT_EQ(0, in.Tell());
+      TF_ASSERT_OK(in.ReadNBytes(5, &read));
+      EXPECT_EQ(read, "01234");
+    }
+  }
+}
+
+// Reads a file of `state.range(1)` bytes in 1 KiB reads through a stream with
+// a block size of `state.range(0)` bytes. The readahead stream keeps 8 blocks
+// in flight.
+void RunReadBenchmark(::testing::benchmark::State& state, bool readahead) {
+  const int block_size = state.range(0);
+  const int file_size = state.range(1);
+  Env* env = Env::Default();
+  string fname;
+  ASSERT_TRUE(env->LocalTempFilename(&fname));
+  TF_ASSERT_OK(WriteStringToFile(env, fname, string(file_size, 'x')));
+  std::unique_ptr<RandomAccessFile> file;
+  TF_ASSERT_OK(env->NewRandomAccessFile(fname, &file));
+
+  tstring result;
+  for (auto s : state) {
+    std::unique_ptr<InputStreamInterface> in;
+    if (readahead) {
+      in = std::make_unique<ReadaheadInputStream>(file.get(), block_size,
+                                                  /*num_blocks=*/8);
+    } else {
+      in = std::make_unique<BufferedInputStream>(file.get(), block_size);
+    }
+    for (int64_t i = 0; i < file_size / 1024; ++i) {
+      TF_ASSERT_OK(in->ReadNBytes(1024, &result));
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * file_size);
+  TF_ASSERT_OK(env->DeleteFile(fname));
+}
+
+void BM_BufferedReader(::testing::benchmark::State& state) {
+  RunReadBenchmark(state, /*readahead=*/false);
+}
+
+void BM_ReadaheadReader(::testing::benchmark::State& state) {
+  RunReadBenchmark(state, /*readahead=*/true);
+}
+
+BENCHMARK(BM_BufferedReader)
+    ->ArgPair(256 * 1024, 64 * 1024 * 1024)
+    ->ArgPair(1024 * 1024, 64 * 1024 * 1024);
+BENCHMARK(BM_ReadaheadReader)
+    ->ArgPair(256 * 1024, 64 * 1024 * 1024)
+    ->ArgPair(1024 * 1024, 64 * 1024 * 1024);
+
+}  // anonymous namespace
+}  // namespace io
+}  // namespace tsl
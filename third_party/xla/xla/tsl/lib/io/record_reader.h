@@ -46,6 +46,13 @@ struct RecordReaderOptions {
   // compressed files.) Consider using SequentialRecordReader.
   int64_t buffer_size = 0;
 
+  // If positive and buffer_size is non-zero, the file is read ahead of the
+  // consumer with up to this many reads of buffer_size bytes in flight on a
+  // shared I/O thread pool, instead of one read at a time. This applies to
+  // compressed files too, whose compressed bytes are read ahead. The same
+  // sequential read restriction as for buffer_size applies.
+  int64_t readahead_num_blocks = 0;
+
   static RecordReaderOptions CreateRecordReaderOptions(
       const string& compression_type);
 
@@ -78,7 +78,8 @@ RecordWriter::RecordWriter(WritableFile* dest,
   } else if (IsSnappyCompressed(options)) {
     dest_ =
         new SnappyOutputBuffer(dest, options.snappy_options.input_buffer_size,
-                               options.snappy_options.output_buffer_size);
+                               options.snappy_options.output_buffer_size,
+                               options.snappy_options.num_compression_threads);
   } else if (options.compression_type == RecordWriterOptions::NONE) {
     // Nothing to do
   } else {
@@ -28,6 +28,10 @@ struct SnappyCompressionOptions {
   // Size of the sink buffer where the compressed/decompressed data produced by
   // snappy is cached.
   int64_t output_buffer_size = 256 << 10;
+
+  // Number of threads compressing input buffers concurrently when writing. If
+  // 1, input is compressed on the writing thread.
+  int32_t num_compression_threads = 1;
 };
 
 }  // namespace io
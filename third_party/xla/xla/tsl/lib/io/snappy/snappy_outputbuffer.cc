@@ -16,10 +16,21 @@ limitations under the License.
 #include "xla/tsl/lib/io/snappy/snappy_outputbuffer.h"
 
 #include <algorithm>
+#include <memory>
+#include <string>
+
+#include "absl/synchronization/notification.h"
 
 namespace tsl {
 namespace io {
 
+struct SnappyOutputBuffer::PendingBlock {
+  std::string input;
+  std::string output;
+  bool ok = false;
+  absl::Notification done;
+};
+
 SnappyOutputBuffer::SnappyOutputBuffer(WritableFile* file,
                                        int32_t input_buffer_bytes,
                                        int32_t output_buffer_bytes)
@@ -32,9 +43,24 @@ SnappyOutputBuffer::SnappyOutputBuffer(WritableFile* file,
       next_out_(output_buffer_.get()),
       avail_out_(output_buffer_bytes) {}
 
+SnappyOutputBuffer::SnappyOutputBuffer(WritableFile* file,
+                                       int32_t input_buffer_bytes,
+                                       int32_t output_buffer_bytes,
+                                       int32_t num_compression_threads)
+    : SnappyOutputBuffer(file, input_buffer_bytes, output_buffer_bytes) {
+  if (num_compression_threads > 1) {
+    max_pending_blocks_ = 2 * num_compression_threads;
+    thread_pool_ = std::make_unique<thread::ThreadPool>(
+        Env::Default(), "snappy_compression", num_compression_threads);
+  }
+}
+
 SnappyOutputBuffer::~SnappyOutputBuffer() {
+  for (const auto& block : pending_blocks_) {
+    block->done.WaitForNotification();
+  }
   size_t bytes_to_write = output_buffer_capacity_ - avail_out_;
-  if (bytes_to_write > 0) {
+  if (!pending_blocks_.empty() || bytes_to_write > 0) {
     LOG(WARNING) << "There is still data in the output buffer. "
                  << "Possible data loss has occurred.";
   }
@@ -113,6 +139,7 @@ absl::Status SnappyOutputBuffer::Write(absl::string_view data) {
 
 absl::Status SnappyOutputBuffer::Flush() {
   TF_RETURN_IF_ERROR(DeflateBuffered());
+  TF_RETURN_IF_ERROR(WritePendingBlocks());
   TF_RETURN_IF_ERROR(FlushOutputBufferToFile());
   return absl::OkStatus();
 }
@@ -197,27 +224,73 @@ absl::Status SnappyOutputBuffer::Deflate() {
   if (avail_in_ == 0) {
     return absl::OkStatus();
   }
+  if (thread_pool_ != nullptr) {
+    return DeflateInParallel();
+  }
   string output;
   if (!port::Snappy_Compress(next_in_, avail_in_, &output)) {
     return errors::DataLoss("Snappy_Compress failed");
   }
+  TF_RETURN_IF_ERROR(AddCompressedBlock(output));
+  next_in_ += avail_in_;
+  avail_in_ = 0;
 
+  return absl::OkStatus();
+}
+
+absl::Status SnappyOutputBuffer::AddCompressedBlock(
+    absl::string_view compressed) {
   // Write length of compressed block to output buffer.
   char compressed_length_array[4];
   std::fill(compressed_length_array, compressed_length_array + 4, 0);
   for (int i = 0; i < 4; i++) {
     // Little endian.
-    compressed_length_array[i] = output.size() >> (8 * (3 - i));
+    compressed_length_array[i] = compressed.size() >> (8 * (3 - i));
   }
   TF_RETURN_IF_ERROR(AddToOutputBuffer(compressed_length_array, 4));
 
   // Write compressed output to buffer.
-  TF_RETURN_IF_ERROR(AddToOutputBuffer(output.data(), output.size()));
+  return AddToOutputBuffer(compressed.data(), compressed.size());
+}
+
+absl::Status SnappyOutputBuffer::DeflateInParallel() {
+  auto block = std::make_shared<PendingBlock>();
+  block->input.assign(next_in_, avail_in_);
   next_in_ += avail_in_;
   avail_in_ = 0;
+  thread_pool_->Schedule([block]() {
+    block->ok = port::Snappy_Compress(block->input.data(), block->input.size(),
+                                      &block->output);
+    block->input.clear();
+    block->input.shrink_to_fit();
+    block->done.Notify();
+  });
+  pending_blocks_.push_back(std::move(block));
+
+  while (!pending_blocks_.empty() &&
+         (pending_blocks_.size() > max_pending_blocks_ ||
+          pending_blocks_.front()->done.HasBeenNotified())) {
+    TF_RETURN_IF_ERROR(WriteFirstPendingBlock());
+  }
+  return absl::OkStatus();
+}
 
+absl::Status SnappyOutputBuffer::WritePendingBlocks() {
+  while (!pending_blocks_.empty()) {
+    TF_RETURN_IF_ERROR(WriteFirstPendingBlock());
+  }
   return absl::OkStatus();
 }
 
+absl::Status SnappyOutputBuffer::WriteFirstPendingBlock() {
+  std::shared_ptr<PendingBlock> block = std::move(pending_blocks_.front());
+  pending_blocks_.pop_front();
+  block->done.WaitForNotification();
+  if (!block->ok) {
+    return errors::DataLoss("Snappy_Compress failed");
+  }
+  return AddCompressedBlock(block->output);
+}
+
 }  // namespace io
 }  // namespace tsl
@@ -16,6 +16,8 @@ limitations under the License.
 #ifndef XLA_TSL_LIB_IO_SNAPPY_SNAPPY_OUTPUTBUFFER_H_
 #define XLA_TSL_LIB_IO_SNAPPY_SNAPPY_OUTPUTBUFFER_H_
 
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
 
@@ -24,6 +26,7 @@ limitations under the License.
 #include "tsl/platform/platform.h"
 #include "tsl/platform/snappy.h"
 #include "tsl/platform/status.h"
+#include "tsl/platform/threadpool.h"
 #include "tsl/platform/types.h"
 
 namespace tsl {
@@ -46,6 +49,13 @@ namespace io {
 // _compressed_ block _excluding_ this header. The compressed
 // block (excluding the 4 byte header) is a valid snappy block and can directly
 // be uncompressed using Snappy_Uncompress.
+//
+// Since blocks are compressed independently, they can also be compressed
+// concurrently: with `num_compression_threads` > 1, full input buffers are
+// handed to a thread pool and the compressed blocks are written in their
+// original order. At most 2 * `num_compression_threads` blocks are pending at
+// any time, which bounds the extra memory used. The output is identical to
+// that of sequential compression.
 class SnappyOutputBuffer : public WritableFile {
  public:
   // Create an SnappyOutputBuffer for `file` with two buffers that cache the
@@ -56,6 +66,11 @@ class SnappyOutputBuffer : public WritableFile {
   SnappyOutputBuffer(WritableFile* file, int32_t input_buffer_bytes,
                      int32_t output_buffer_bytes);
 
+  // Same as above, but compresses blocks on `num_compression_threads` threads.
+  SnappyOutputBuffer(WritableFile* file, int32_t input_buffer_bytes,
+                     int32_t output_buffer_bytes,
+                     int32_t num_compression_threads);
+
   // Per convention, the dtor does not call Flush() or Close(). We expect the
   // caller to call those manually when done.
   ~SnappyOutputBuffer() override;
@@ -132,6 +147,21 @@ class SnappyOutputBuffer : public WritableFile {
   // Returns non-OK status if writing to file failed.
   absl::Status Deflate();
 
+  // Writes the length header and `compressed` to the output buffer.
+  absl::Status AddCompressedBlock(absl::string_view compressed);
+
+  // Schedules the compression of the `avail_in_` bytes at `next_in_` on
+  // `thread_pool_`, then writes out compressed blocks that are ready, blocking
+  // while too many blocks are pending.
+  absl::Status DeflateInParallel();
+
+  // Waits for all pending blocks and writes them to the output buffer.
+  absl::Status WritePendingBlocks();
+
+  // Writes the first pending block to the output buffer, waiting for its
+  // compression to finish.
+  absl::Status WriteFirstPendingBlock();
+
   WritableFile* file_;  // Not owned
 
   // Buffer for storing contents read from input `file_`.
@@ -148,6 +178,14 @@ class SnappyOutputBuffer : public WritableFile {
   char* next_out_;
   size_t avail_out_;
 
+  // A block of input that is being compressed on `thread_pool_`.
+  struct PendingBlock;
+  // Blocks whose compressed output has not been written yet, in input order.
+  std::deque<std::shared_ptr<PendingBlock>> pending_blocks_;
+  size_t max_pending_blocks_ = 0;
+  // Null unless compression is parallel.
+  std::unique_ptr<thread::ThreadPool> thread_pool_;
+
   SnappyOutputBuffer(const SnappyOutputBuffer&) = delete;
   void operator=(const SnappyOutputBuffer&) = delete;
 };
@@ -22,6 +22,7 @@ limitations under the License.
 #include "xla/tsl/lib/io/snappy/snappy_inputstream.h"
 #include "xla/tsl/lib/io/snappy/snappy_outputbuffer.h"
 #include "tsl/platform/env.h"
+#include "tsl/platform/path.h"
 #include "tsl/platform/test.h"
 
 namespace tsl {
@@ -404,4 +405,50 @@ TEST(SnappyBuffers, TellInputStream) {
   TestTellInputStream(10000, 10000, 2000, 10000, 2);
 }
 
+// Writes `num_writes` copies of the test string through a SnappyOutputBuffer
+// with the given number of compression threads and returns the file contents.
+static absl::Status WriteWithCompressionThreads(int num_compression_threads,
+                                                int num_writes, bool with_flush,
+                                                string* contents) {
+  Env* env = Env::Default();
+  const string fname = io::JoinPath(
+      testing::TmpDir(),
+      strings::StrCat("snappy_parallel_test_", num_compression_threads));
+  std::unique_ptr<WritableFile> file_writer;
+  TF_RETURN_IF_ERROR(env->NewWritableFile(fname, &file_writer));
+  io::SnappyOutputBuffer out(file_writer.get(), /*input_buffer_bytes=*/1000,
+                             /*output_buffer_bytes=*/1000,
+                             num_compression_threads);
+  const string data = GenTestString(3);
+  for (int i = 0; i < num_writes; ++i) {
+    // Alternate between writes that fit in the input buffer and writes that
+    // are compressed directly.
+    TF_RETURN_IF_ERROR(out.Write(
+        i % 2 == 0 ? absl::string_view(data).substr(0, 100) : data));
+    if (with_flush && i % 7 == 0) {
+      TF_RETURN_IF_ERROR(out.Flush());
+    }
+  }
+  TF_RETURN_IF_ERROR(out.Close());
+  TF_RETURN_IF_ERROR(file_writer->Close());
+  return ReadFileToString(env, fname, contents);
+}
+
+TEST(SnappyBuffers, ParallelCompressionMatchesSequential) {
+  if (!SnappyCompressionSupported()) {
+    fprintf(stderr, "skipping compression tests\n");
+    return;
+  }
+  for (bool with_flush : {false, true}) {
+    string sequential;
+    TF_ASSERT_OK(WriteWithCompressionThreads(1, 50, with_flush, &sequential));
+    for (int num_compression_threads : {2, 4}) {
+      string parallel;
+      TF_ASSERT_OK(WriteWithCompressionThreads(num_compression_threads, 50,
+                                               with_flush, &parallel));
+      EXPECT_EQ(parallel, sequential);
+    }
+  }
+}
+
 }  // namespace tsl